@@ -0,0 +1,434 @@
+#include "BenchmarkHarness.h"
+#include "BigTriangleTuning.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// the big triangles paths: the settings swept and tuned at runtime, the compact records,
+// the coarse tile classification and the coarse depth rejection
+namespace Benchmark
+{
+
+// zooming in and out while panning, so the same triangles go from small to big and back
+static std::vector<Float4x4> BuildCameraPath(unsigned int framesCount)
+{
+	std::vector<Float4x4> path(framesCount);
+	for (unsigned int frame = 0; frame < framesCount; frame++)
+	{
+		float phase = 6.2831853f * frame / framesCount;
+		float scale = 2.0f - cosf(phase);
+
+		// row vectors, the translation is in the last row
+		Float4x4& VP = path[frame];
+		VP = {};
+		VP.m[0][0] = scale;
+		VP.m[1][1] = scale;
+		VP.m[2][2] = 1.0f;
+		VP.m[3][3] = 1.0f;
+		VP.m[3][0] = 0.5f * (scale - 1.0f) * sinf(phase);
+		VP.m[3][1] = 0.5f * (scale - 1.0f) * cosf(phase);
+	}
+
+	return path;
+}
+
+// random triangles of about the same depth each, so they occlude each other like surfaces do,
+// frontToBack sorts them from the closest one, reversed Z
+static void AddLayeredTriangles(SyntheticScene& scene, const SizeBucket& bucket, bool frontToBack)
+{
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> size(bucket.minSize, bucket.maxSize);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> depth(0.1f, 0.9f);
+	std::uniform_real_distribution<float> slope(-0.001f, 0.001f);
+
+	struct Triangle
+	{
+		Float3 vertices[3];
+		float depth;
+	};
+	std::vector<Triangle> triangles(bucket.trianglesCount);
+	for (Triangle& triangle : triangles)
+	{
+		float s = size(generator);
+		float originX = unit(generator) * (Width - s);
+		float originY = unit(generator) * (Height - s);
+		triangle.depth = depth(generator);
+
+		for (auto& vertex : triangle.vertices)
+		{
+			vertex = { originX + unit(generator) * s, originY + unit(generator) * s, triangle.depth + slope(generator) };
+		}
+
+		// screen space area should be positive
+		Float3* vertices = triangle.vertices;
+		if ((vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) -
+			(vertices[2].x - vertices[0].x) * (vertices[1].y - vertices[0].y) < 0.0f)
+		{
+			std::swap(vertices[1], vertices[2]);
+		}
+	}
+
+	if (frontToBack)
+	{
+		std::sort(
+			triangles.begin(),
+			triangles.end(),
+			[](const Triangle& a, const Triangle& b)
+			{
+				return a.depth > b.depth;
+			});
+	}
+
+	for (const Triangle& triangle : triangles)
+	{
+		AddTriangle(scene, triangle.vertices);
+	}
+}
+
+// threshold x tile size x triangles per job over the camera path, then the runtime tuner over the same path
+void CompareBigTriangleSettings()
+{
+	const unsigned int FramesCount = 32;
+	const unsigned int TunerLoops = 3;
+
+	SyntheticScene scene;
+	AddTriangles(scene, { 4.0f, 16.0f, 1 << 15 });
+	AddTriangles(scene, { 32.0f, 256.0f, 1 << 11 });
+	BuildScene(scene);
+
+	std::vector<Float4x4> cameraPath = BuildCameraPath(FramesCount);
+
+	Rasterizer rasterizer;
+	RasterizationSettings base;
+	base.scanlineRasterization = false;
+
+	DepthTarget depth;
+	depth.Resize(Width, Height);
+
+	std::vector<SweepResult> results = SweepBigTriangles(
+		rasterizer,
+		base,
+		scene.buffers,
+		scene.commands.data(),
+		scene.commands.size(),
+		cameraPath,
+		{ 256.0f, 1024.0f, 4096.0f, 16384.0f },
+		{ 64.0f, 128.0f, 256.0f },
+		{ 64, 128, 256 },
+		depth);
+	const SweepResult* best = FindBestConfiguration(results);
+
+	printf("\n%u threads, %u frames\n", rasterizer.GetThreadsCount(), FramesCount);
+	Table table({
+		{ "threshold", -10 },
+		{ "tile", -8 },
+		{ "job", -8 },
+		{ "mean ms", 10 },
+		{ "p50 ms", 10 },
+		{ "p95 ms", 10 },
+		{ "p99 ms", 10 },
+		{ "tiles/frame", 12 } });
+	for (const SweepResult& result : results)
+	{
+		table.Row(
+			{
+				Format("%g", result.configuration.bigTriangleThreshold),
+				Format("%g", result.configuration.bigTriangleTileSize),
+				Format("%u", result.configuration.trianglesPerJob),
+				Format("%.2f", result.mean),
+				Format("%.2f", result.p50),
+				Format("%.2f", result.p95),
+				Format("%.2f", result.p99),
+				Format("%.0f", result.bigTriangleTiles)
+			},
+			&result == best ? " best" : "");
+	}
+
+	// the last loop is reported, the first ones are for the tuner to settle
+	BigTriangleTuner tuner(base.bigTriangleThreshold);
+	RasterizationSettings settings = base;
+	std::vector<double> frameTimes;
+	for (unsigned int loop = 0; loop < TunerLoops; loop++)
+	{
+		frameTimes.clear();
+		for (const Float4x4& VP : cameraPath)
+		{
+			settings.bigTriangleThreshold = tuner.GetThreshold();
+			rasterizer.SetSettings(settings);
+
+			depth.Clear();
+			auto start = std::chrono::high_resolution_clock::now();
+			Statistics statistics = DrawDepth(rasterizer, scene, VP, depth);
+			auto end = std::chrono::high_resolution_clock::now();
+			frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+			tuner.Update(statistics.smallTrianglesSeconds, statistics.bigTrianglesSeconds);
+		}
+	}
+
+	double mean = 0.0;
+	for (double time : frameTimes)
+	{
+		mean += time;
+	}
+	mean /= frameTimes.size();
+
+	table.Row(
+		{
+			"tuner",
+			Format("%g", base.bigTriangleTileSize),
+			Format("%u", base.trianglesPerJob),
+			Format("%.2f", mean),
+			Format("%.2f", Percentile(frameTimes, 50.0)),
+			Format("%.2f", Percentile(frameTimes, 95.0)),
+			Format("%.2f", Percentile(frameTimes, 99.0)),
+			"-"
+		},
+		Format(" threshold %g at the end", tuner.GetThreshold()));
+}
+
+// best of the repeats of the big triangles passes, depth then opaque, in seconds
+static void MeasureBigTriangles(
+	Rasterizer& rasterizer,
+	const SyntheticScene& scene,
+	DepthTarget& depth,
+	ColorTarget& color,
+	double& depthSeconds,
+	double& opaqueSeconds,
+	Statistics& depthStatistics,
+	Statistics& opaqueStatistics)
+{
+	depthSeconds = 1e30;
+	opaqueSeconds = 1e30;
+	for (int repeat = 0; repeat < Repeats; repeat++)
+	{
+		depth.Clear();
+		depthStatistics = DrawDepth(rasterizer, scene, Identity(), depth);
+		color.Clear(ClearColor);
+		opaqueStatistics = DrawOpaque(rasterizer, scene, depth, color);
+
+		depthSeconds = std::min(depthSeconds, depthStatistics.bigTrianglesSeconds);
+		opaqueSeconds = std::min(opaqueSeconds, opaqueStatistics.bigTrianglesSeconds);
+	}
+}
+
+// whole triangle per tile against a record per triangle plus tile entries, multithreaded,
+// big triangles pass time and the memory the triangles pass writes, the very same pixels are expected
+void CompareBigTriangleRecords()
+{
+	const SizeBucket scenes[] =
+	{
+		{ 100.0f, 200.0f, 1 << 14 },
+		{ 200.0f, 800.0f, 1 << 12 },
+		{ 400.0f, 1000.0f, 1 << 10 },
+	};
+
+	Rasterizer rasterizer;
+	RasterizationSettings settings;
+	settings.scanlineRasterization = false;
+
+	printf("\n%u threads\n", rasterizer.GetThreadsCount());
+	Table table({
+		{ "size, px", -12 },
+		{ "records", -10 },
+		{ "tiles", 10 },
+		{ "depth ms", 12 },
+		{ "depth, MB", 12 },
+		{ "opaque ms", 12 },
+		{ "opaque, MB", 12 },
+		{ "mismatches", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget referenceDepth;
+	DepthTarget depth;
+	ColorTarget reference;
+	ColorTarget color;
+	referenceDepth.Resize(Width, Height);
+	depth.Resize(Width, Height);
+	reference.Resize(Width, Height);
+	color.Resize(Width, Height);
+
+	for (const SizeBucket& bucket : scenes)
+	{
+		BuildScene(scene, bucket);
+
+		for (bool compact : { false, true })
+		{
+			settings.compactBigTriangles = compact;
+			rasterizer.SetSettings(settings);
+
+			double depthSeconds;
+			double opaqueSeconds;
+			Statistics depthStatistics;
+			Statistics opaqueStatistics;
+			MeasureBigTriangles(
+				rasterizer,
+				scene,
+				compact ? depth : referenceDepth,
+				compact ? color : reference,
+				depthSeconds,
+				opaqueSeconds,
+				depthStatistics,
+				opaqueStatistics);
+
+			table.Row({
+				BucketName(bucket),
+				compact ? "compact" : "per tile",
+				Format("%zu", depthStatistics.bigTriangleTiles),
+				Format("%.2f", depthSeconds * 1000.0),
+				Format("%.2f", depthStatistics.bigTriangleBytes / (1024.0 * 1024.0)),
+				Format("%.2f", opaqueSeconds * 1000.0),
+				Format("%.2f", opaqueStatistics.bigTriangleBytes / (1024.0 * 1024.0)),
+				compact ? Format("%zu", CountMismatches(referenceDepth, depth) + CountMismatches(reference, color)) : "-" });
+		}
+	}
+}
+
+// big triangle tiles with the edge tests everywhere against the coarse classification, multithreaded,
+// tiles per class and the big triangles passes times, the very same pixels are expected
+void CompareTileClassification()
+{
+	const SizeBucket scenes[] =
+	{
+		{ 100.0f, 200.0f, 1 << 14 },
+		{ 200.0f, 800.0f, 1 << 12 },
+		{ 400.0f, 1000.0f, 1 << 10 },
+	};
+
+	Rasterizer rasterizer;
+
+	printf("\n%u threads\n", rasterizer.GetThreadsCount());
+	Table table({
+		{ "size, px", -12 },
+		{ "tiles", -18 },
+		{ "outside", 10 },
+		{ "partial", 10 },
+		{ "covered", 10 },
+		{ "depth ms", 12 },
+		{ "opaque ms", 12 },
+		{ "mismatches", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget referenceDepth;
+	DepthTarget depth;
+	ColorTarget reference;
+	ColorTarget color;
+	referenceDepth.Resize(Width, Height);
+	depth.Resize(Width, Height);
+	reference.Resize(Width, Height);
+	color.Resize(Width, Height);
+
+	for (const SizeBucket& bucket : scenes)
+	{
+		BuildScene(scene, bucket);
+
+		for (bool fixedPoint : { false, true })
+		{
+			for (bool classification : { false, true })
+			{
+				RasterizationSettings settings;
+				settings.scanlineRasterization = false;
+				settings.fixedPointEdges = fixedPoint;
+				settings.coarseTileClassification = classification;
+				rasterizer.SetSettings(settings);
+
+				double depthSeconds;
+				double opaqueSeconds;
+				Statistics statistics;
+				Statistics opaqueStatistics;
+				MeasureBigTriangles(
+					rasterizer,
+					scene,
+					classification ? depth : referenceDepth,
+					classification ? color : reference,
+					depthSeconds,
+					opaqueSeconds,
+					statistics,
+					opaqueStatistics);
+
+				table.Row({
+					BucketName(bucket),
+					Format("%s%s", classification ? "classified" : "edge tests", fixedPoint ? ", fixed" : ""),
+					Format("%zu", statistics.bigTriangleOutsideTiles),
+					Format("%zu", statistics.bigTriangleTiles - statistics.bigTriangleCoveredTiles),
+					Format("%zu", statistics.bigTriangleCoveredTiles),
+					Format("%.2f", depthSeconds * 1000.0),
+					Format("%.2f", opaqueSeconds * 1000.0),
+					classification ? Format("%zu", CountMismatches(referenceDepth, depth) + CountMismatches(reference, color)) : "-" });
+			}
+		}
+	}
+}
+
+// depth pass with and without the coarse depth, multithreaded, front to back and unsorted submission,
+// rejected triangles and big triangle tiles, the very same depth is expected
+void CompareCoarseDepth()
+{
+	const SizeBucket scenes[] =
+	{
+		{ 8.0f, 32.0f, 1 << 18 },
+		{ 32.0f, 128.0f, 1 << 14 },
+		{ 200.0f, 800.0f, 1 << 10 },
+	};
+
+	Rasterizer rasterizer;
+
+	printf("\n%u threads\n", rasterizer.GetThreadsCount());
+	Table table({
+		{ "size, px", -12 },
+		{ "path", -18 },
+		{ "ms", 10 },
+		{ "speedup", 10 },
+		{ "triangles, %", 12 },
+		{ "tiles, %", 12 },
+		{ "Mpix", 10 },
+		{ "mismatches", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget reference;
+	DepthTarget depth;
+	reference.Resize(Width, Height);
+	depth.Resize(Width, Height);
+
+	for (const SizeBucket& bucket : scenes)
+	{
+		for (bool frontToBack : { false, true })
+		{
+			scene.positions.clear();
+			AddLayeredTriangles(scene, bucket, frontToBack);
+			BuildScene(scene);
+
+			RasterizationSettings settings;
+			settings.scanlineRasterization = false;
+
+			const char* order = frontToBack ? "front to back" : "unsorted";
+			Statistics statistics;
+			double referenceSeconds = Run(rasterizer, settings, scene, reference, &statistics);
+			table.Row({
+				BucketName(bucket),
+				order,
+				Format("%.2f", referenceSeconds * 1000.0),
+				"-",
+				"-",
+				"-",
+				Format("%.2f", statistics.coveredPixels * 1e-6),
+				"-" });
+
+			settings.coarseDepth = true;
+			double seconds = Run(rasterizer, settings, scene, depth, &statistics);
+			table.Row({
+				BucketName(bucket),
+				Format("%s, coarse", order),
+				Format("%.2f", seconds * 1000.0),
+				Format("%.2f", referenceSeconds / seconds),
+				Format("%.1f", 100.0 * statistics.coarseDepthRejectedTriangles / std::max<size_t>(statistics.renderedTriangles, 1)),
+				Format("%.1f", 100.0 * statistics.coarseDepthRejectedTiles / std::max<size_t>(statistics.bigTriangleTiles, 1)),
+				Format("%.2f", statistics.coveredPixels * 1e-6),
+				Format("%zu", CountMismatches(reference, depth)) });
+		}
+	}
+}
+
+}
@@ -0,0 +1,859 @@
+#include "BenchmarkHarness.h"
+#include "ClusterRouting.h"
+#include "CullingEngine.h"
+#include "MaskedOcclusion.h"
+#include "OcclusionCulling.h"
+#include "StreamCompaction.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// what decides what gets drawn: the masked occlusion buffer, the occlusion culling schemes,
+// the routes of the meshlets between the rasterizers, the culling kernels and the compaction of their results
+namespace Benchmark
+{
+
+// occluders into the masked occlusion buffer, then random boxes against it, a per-pixel
+// depth buffer of the same resolution is the reference, the masked test must never occlude more
+void CompareOcclusion()
+{
+	const int OcclusionRes = 256;
+	const unsigned int BoxesCount = 1 << 16;
+
+	Rasterizer rasterizer(1);
+	RasterizationSettings settings;
+	settings.scanlineRasterization = false;
+
+	const Float4x4 identity = Identity();
+
+	// clip space boxes, as the transforms are identities
+	std::vector<Float3> centers(BoxesCount);
+	std::vector<Float3> extents(BoxesCount);
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> size(0.005f, 0.1f);
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+	for (unsigned int box = 0; box < BoxesCount; box++)
+	{
+		centers[box] = { position(generator), position(generator), depth(generator) };
+		extents[box] = { size(generator), size(generator), 0.02f };
+	}
+
+	printf("\n");
+	Table table({
+		{ "occluders", -12 },
+		{ "render, ms", 12 },
+		{ "Mtri/s", 10 },
+		{ "test, ms", 12 },
+		{ "Mbox/s", 10 },
+		{ "occluded", 10 },
+		{ "reference", 10 } });
+
+	SyntheticScene scene;
+	OcclusionBuffer occlusion;
+	occlusion.Resize(OcclusionRes, OcclusionRes);
+	DepthTarget reference;
+	reference.Resize(OcclusionRes, OcclusionRes);
+
+	for (int sceneIndex = 0; sceneIndex < 2; sceneIndex++)
+	{
+		if (sceneIndex == 0)
+		{
+			scene.positions.clear();
+			AddJitteredGrid(scene, 64.0f);
+			BuildScene(scene);
+		}
+		else
+		{
+			BuildScene(scene, { 100.0f, 400.0f, 1 << 10 });
+		}
+
+		double renderSeconds = BestOf(Repeats, [&]()
+		{
+			occlusion.Clear();
+			for (const IndirectCommand& command : scene.commands)
+			{
+				occlusion.RenderOccluder(scene.buffers, command, identity, identity);
+			}
+		});
+
+		size_t occluded = 0;
+		double testSeconds = BestOf(1, [&]()
+		{
+			for (unsigned int box = 0; box < BoxesCount; box++)
+			{
+				occluded += occlusion.IsOccluded(centers[box], extents[box], identity) ? 1 : 0;
+			}
+		});
+
+		Run(rasterizer, settings, scene, reference);
+
+		// every pixel the box bounds touch, same as the masked test does with tiles
+		size_t referenceOccluded = 0;
+		size_t falselyOccluded = 0;
+		for (unsigned int box = 0; box < BoxesCount; box++)
+		{
+			const Float3& c = centers[box];
+			const Float3& e = extents[box];
+			int minX = std::max(static_cast<int>(((c.x - e.x) * 0.5f + 0.5f) * OcclusionRes), 0);
+			int maxX = std::min(static_cast<int>(((c.x + e.x) * 0.5f + 0.5f) * OcclusionRes), OcclusionRes - 1);
+			int minY = std::max(static_cast<int>((-(c.y + e.y) * 0.5f + 0.5f) * OcclusionRes), 0);
+			int maxY = std::min(static_cast<int>((-(c.y - e.y) * 0.5f + 0.5f) * OcclusionRes), OcclusionRes - 1);
+
+			bool hidden = true;
+			for (int y = minY; y <= maxY && hidden; y++)
+			{
+				for (int x = minX; x <= maxX && hidden; x++)
+				{
+					hidden = c.z + e.z < reference.GetDepth(x, y);
+				}
+			}
+
+			referenceOccluded += hidden ? 1 : 0;
+			falselyOccluded += (!hidden && occlusion.IsOccluded(c, e, identity)) ? 1 : 0;
+		}
+
+		if (falselyOccluded > 0)
+		{
+			printf("%zu boxes occluded by the masked buffer only\n", falselyOccluded);
+		}
+
+		table.Row({
+			sceneIndex == 0 ? "grid" : "random",
+			Format("%.3f", renderSeconds * 1000.0),
+			Format("%.2f", scene.buffers.totalTriangles / renderSeconds * 1e-6),
+			Format("%.3f", testSeconds * 1000.0),
+			Format("%.2f", BoxesCount / testSeconds * 1e-6),
+			Format("%.1f%%", 100.0 * occluded / BoxesCount),
+			Format("%.1f%%", 100.0 * referenceOccluded / BoxesCount) });
+	}
+}
+
+// an 8x4 cells grid of 64 triangles, i.e. a command, flat at depth z, in pixels
+static void AddQuad(SyntheticScene& scene, float x0, float y0, float x1, float y1, float z)
+{
+	const int CellsX = 8;
+	const int CellsY = 4;
+	static_assert(CellsX * CellsY * 2 == TrianglesPerCommand, "a quad per command");
+
+	for (int y = 0; y < CellsY; y++)
+	{
+		for (int x = 0; x < CellsX; x++)
+		{
+			float cellX0 = x0 + (x1 - x0) * x / CellsX;
+			float cellX1 = x0 + (x1 - x0) * (x + 1) / CellsX;
+			float cellY0 = y0 + (y1 - y0) * y / CellsY;
+			float cellY1 = y0 + (y1 - y0) * (y + 1) / CellsY;
+
+			Float3 triangle0[3] = { { cellX0, cellY0, z }, { cellX1, cellY0, z }, { cellX1, cellY1, z } };
+			Float3 triangle1[3] = { { cellX0, cellY0, z }, { cellX1, cellY1, z }, { cellX0, cellY1, z } };
+			AddTriangle(scene, triangle0);
+			AddTriangle(scene, triangle1);
+		}
+	}
+}
+
+// strafing with an oblique projection, so the closer layers slide over the farther ones
+static std::vector<Float4x4> BuildStrafingPath(unsigned int framesCount)
+{
+	std::vector<Float4x4> path(framesCount);
+	for (unsigned int frame = 0; frame < framesCount; frame++)
+	{
+		float shear = 0.25f * sinf(6.2831853f * frame / framesCount);
+
+		// row vectors, x += shear * (z - 0.5)
+		Float4x4& VP = path[frame];
+		VP = Identity();
+		VP.m[2][0] = shear;
+		VP.m[3][0] = -0.5f * shear;
+	}
+
+	return path;
+}
+
+// current frame culling against the previous frame depth and against the two phases, over a strafing camera:
+// walls in front of many small objects, instances are (walls or objects) commands,
+// the reference is the visibility buffer of every instance
+void CompareOcclusionCulling()
+{
+	const unsigned int FramesCount = 32;
+	const unsigned int ObjectsCount = 4096;
+
+	SyntheticScene scene;
+	for (float x = 0.0f; x < Width; x += 128.0f)
+	{
+		AddQuad(scene, x, 0.0f, x + 88.0f, static_cast<float>(Height), 0.9f);
+	}
+	for (float y = 0.0f; y < Height; y += 160.0f)
+	{
+		AddQuad(scene, 0.0f, y, static_cast<float>(Width), y + 64.0f, 0.6f);
+	}
+
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> size(12.0f, 32.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> objectDepth(0.1f, 0.5f);
+	for (unsigned int object = 0; object < ObjectsCount; object++)
+	{
+		float s = size(generator);
+		float x = unit(generator) * (Width - s);
+		float y = unit(generator) * (Height - s);
+		AddQuad(scene, x, y, x + s, y + s, objectDepth(generator));
+	}
+	BuildScene(scene);
+
+	// identity transforms, so model space bounds are world space ones
+	std::vector<InstanceBounds> bounds(scene.commands.size());
+	for (size_t instance = 0; instance < scene.commands.size(); instance++)
+	{
+		Float3 minP = { 1e30f, 1e30f, 1e30f };
+		Float3 maxP = { -1e30f, -1e30f, -1e30f };
+		for (unsigned int triangle = 0; triangle < TrianglesPerCommand; triangle++)
+		{
+			Float3 positions[3];
+			GetTrianglePositions(scene.buffers, scene.commands[instance], triangle, positions);
+			for (const Float3& p : positions)
+			{
+				minP = { std::min(minP.x, p.x), std::min(minP.y, p.y), std::min(minP.z, p.z) };
+				maxP = { std::max(maxP.x, p.x), std::max(maxP.y, p.y), std::max(maxP.z, p.z) };
+			}
+		}
+		bounds[instance].center = { (minP.x + maxP.x) * 0.5f, (minP.y + maxP.y) * 0.5f, (minP.z + maxP.z) * 0.5f };
+		bounds[instance].extents = { (maxP.x - minP.x) * 0.5f, (maxP.y - minP.y) * 0.5f, (maxP.z - minP.z) * 0.5f };
+	}
+
+	std::vector<Float4x4> cameraPath = BuildStrafingPath(FramesCount);
+
+	Rasterizer rasterizer;
+	RasterizationSettings settings;
+	settings.scanlineRasterization = false;
+	rasterizer.SetSettings(settings);
+
+	// the reference of every frame, visible instances and depth
+	std::vector<std::vector<uint8_t>> visible(FramesCount);
+	std::vector<DepthTarget> referenceDepth(FramesCount);
+	VisibilityTarget visibility;
+	visibility.Resize(Width, Height);
+	for (unsigned int frame = 0; frame < FramesCount; frame++)
+	{
+		Statistics statistics = FindVisibleInstances(
+			rasterizer,
+			scene.buffers,
+			scene.commands.data(),
+			scene.commands.size(),
+			cameraPath[frame],
+			visibility,
+			visible[frame]);
+		if (statistics.droppedIDTriangles > 0)
+		{
+			printf("frame %u: %zu triangles past the visibility IDs, the reference is incomplete\n",
+				frame,
+				statistics.droppedIDTriangles);
+		}
+
+		referenceDepth[frame].Resize(Width, Height);
+		for (int y = 0; y < Height; y++)
+		{
+			for (int x = 0; x < Width; x++)
+			{
+				referenceDepth[frame].WriteMaxExclusive(x, y, visibility.GetDepth(x, y));
+			}
+		}
+	}
+
+	printf("\n%u threads, %zu instances, %u frames, per frame after the first one\n",
+		rasterizer.GetThreadsCount(),
+		scene.commands.size(),
+		FramesCount);
+	Table table({
+		{ "culling", -16 },
+		{ "drawn", 10 },
+		{ "visible", 10 },
+		{ "tests", 10 },
+		{ "false culled", 12 },
+		{ "false vis.", 12 },
+		{ "cull ms", 10 },
+		{ "draw ms", 10 },
+		{ "mismatches", 12 } });
+
+	const OcclusionCullingMode modes[] =
+	{
+		OcclusionCullingMode::None,
+		OcclusionCullingMode::PrevFrameDepth,
+		OcclusionCullingMode::TwoPhase,
+	};
+	const char* modeNames[] = { "frustum only", "prev frame Hi-Z", "two-phase" };
+
+	DepthTarget depth;
+	depth.Resize(Width, Height);
+	for (int mode = 0; mode < 3; mode++)
+	{
+		OcclusionCulling culling(modes[mode]);
+		OcclusionCullingStats total;
+		size_t mismatches = 0;
+		for (unsigned int frame = 0; frame < FramesCount; frame++)
+		{
+			OcclusionCullingStats stats = culling.DrawDepth(
+				rasterizer,
+				scene.buffers,
+				scene.commands.data(),
+				bounds.data(),
+				scene.commands.size(),
+				cameraPath[frame],
+				depth);
+			CompareWithVisible(culling.GetDrawn(), visible[frame], stats);
+
+			// the first frame has no history
+			if (frame == 0)
+			{
+				continue;
+			}
+
+			total.drawn += stats.drawn;
+			total.visible += stats.visible;
+			total.occlusionTests += stats.occlusionTests;
+			total.falseCulled += stats.falseCulled;
+			total.falseVisible += stats.falseVisible;
+			total.cullingSeconds += stats.cullingSeconds;
+			total.drawSeconds += stats.drawSeconds;
+			mismatches += CountMismatches(referenceDepth[frame], depth);
+		}
+
+		double frames = FramesCount - 1.0;
+		table.Row({
+			modeNames[mode],
+			Format("%.1f", total.drawn / frames),
+			Format("%.1f", total.visible / frames),
+			Format("%.1f", total.occlusionTests / frames),
+			Format("%.1f", total.falseCulled / frames),
+			Format("%.1f", total.falseVisible / frames),
+			Format("%.2f", total.cullingSeconds * 1000.0 / frames),
+			Format("%.2f", total.drawSeconds * 1000.0 / frames),
+			Format("%.1f", mismatches / frames) });
+	}
+}
+
+#ifdef MESHLET_INDICES
+
+// a perspective camera over a ground of meshlet grid tiles, from the ones under the camera to the horizon:
+// routes of the estimated average triangle area against the ones of the exact area, every visible triangle
+// projected, how many clusters the exact ones route each way, how many of the estimated ones agree with them,
+// and the share of the triangles the CPU rasterizer would take as big, per route
+void CompareClusterRouting()
+{
+	SyntheticScene scene;
+	AddMeshletGrid(scene, 0);
+	for (IndirectCommand& command : scene.commands)
+	{
+		command.args.instanceCount = 1;
+	}
+
+	scene.buffers.positions = scene.positions.data();
+	scene.buffers.indices = scene.indices.data();
+
+	// model space triangles of every meshlet
+	std::vector<Float3> meshletTriangles(scene.commands.size() * MeshletTriangles * 3);
+	for (size_t command = 0; command < scene.commands.size(); command++)
+	{
+		for (unsigned int triangle = 0; triangle < MeshletTriangles; triangle++)
+		{
+			GetTrianglePositions(
+				scene.buffers,
+				scene.commands[command],
+				triangle,
+				&meshletTriangles[(command * MeshletTriangles + triangle) * 3]);
+		}
+	}
+
+	// tiles of 32 x 32 units on the ground, the bumps of the grid are up, looking along z, 30 degrees down
+	const int TilesX = 5;
+	const int TilesZ = 4;
+	const float TileScale = 16.0f;
+	const float PitchSin = 0.5f;
+	const float PitchCos = 0.8660254f;
+	const float NearZ = 0.1f;
+	const float YScale = 1.0f / std::tan(0.5f * 1.0471976f);
+	const float BigTriangleThreshold = RasterizationSettings().bigTriangleThreshold;
+
+	ClusterRoutingView view = {};
+	view.nearZ = NearZ;
+	view.projectionScale = 0.5f * Height * YScale;
+	view.width = static_cast<float>(Width);
+	view.height = static_cast<float>(Height);
+	ClusterRoutingSettings settings;
+
+	printf("\n%d x %d tiles of %zu meshlets, %u triangles each, SW micro up to %g px, SW big from %g px\n",
+		TilesX,
+		TilesZ,
+		scene.commands.size(),
+		MeshletTriangles,
+		settings.microTriangleArea,
+		settings.bigTriangleArea);
+	Table table({
+		{ "height", -8 },
+		{ "route", -10 },
+		{ "clusters", 10 },
+		{ "triangles, M", 12 },
+		{ "exact", 10 },
+		{ "agree, %", 12 },
+		{ "exact area, px", 14 },
+		{ "big, %", 10 },
+		{ "Mclusters/s", 14 } });
+
+	for (float cameraHeight : { 1.5f, 8.0f })
+	{
+		std::vector<Float3> centers;
+		std::vector<Float3> extents;
+		std::vector<unsigned int> trianglesCounts;
+		std::vector<ClusterRoute> exactRoutes;
+		std::vector<double> exactAreas;
+		std::vector<size_t> bigTriangles;
+
+		for (int tileZ = 0; tileZ < TilesZ; tileZ++)
+		{
+			for (int tileX = 0; tileX < TilesX; tileX++)
+			{
+				float tileCenterX = (tileX - TilesX / 2) * 2.0f * TileScale;
+				float tileCenterZ = tileZ * 2.0f * TileScale;
+
+				for (size_t command = 0; command < scene.commands.size(); command++)
+				{
+					// camera space, the camera is at the origin
+					Float3 minP = { 1e30f, 1e30f, 1e30f };
+					Float3 maxP = { -1e30f, -1e30f, -1e30f };
+					bool crossesNear = false;
+					bool visible = false;
+					double area = 0.0;
+					size_t big = 0;
+
+					for (unsigned int triangle = 0; triangle < MeshletTriangles; triangle++)
+					{
+						const Float3* model = &meshletTriangles[(command * MeshletTriangles + triangle) * 3];
+						Float3 p[3];
+						Float2 screen[3];
+						bool inFront = true;
+						for (int vertex = 0; vertex < 3; vertex++)
+						{
+							float y = model[vertex].z - cameraHeight;
+							float z = model[vertex].y * TileScale + tileCenterZ;
+							p[vertex].x = model[vertex].x * TileScale + tileCenterX;
+							p[vertex].y = y * PitchCos + z * PitchSin;
+							p[vertex].z = z * PitchCos - y * PitchSin;
+
+							minP = { std::min(minP.x, p[vertex].x), std::min(minP.y, p[vertex].y), std::min(minP.z, p[vertex].z) };
+							maxP = { std::max(maxP.x, p[vertex].x), std::max(maxP.y, p[vertex].y), std::max(maxP.z, p[vertex].z) };
+
+							inFront = inFront && p[vertex].z > NearZ;
+							float invZ = 1.0f / p[vertex].z;
+							screen[vertex].x = (p[vertex].x * YScale * invZ * 0.5f + 0.5f) * Width;
+							screen[vertex].y = (-p[vertex].y * YScale * invZ * 0.5f + 0.5f) * Height;
+						}
+
+						if (!inFront)
+						{
+							crossesNear = true;
+							continue;
+						}
+
+						float minX = std::min({ screen[0].x, screen[1].x, screen[2].x });
+						float minY = std::min({ screen[0].y, screen[1].y, screen[2].y });
+						float maxX = std::max({ screen[0].x, screen[1].x, screen[2].x });
+						float maxY = std::max({ screen[0].y, screen[1].y, screen[2].y });
+						if (maxX < 0.0f || maxY < 0.0f || minX > Width || minY > Height)
+						{
+							continue;
+						}
+
+						visible = true;
+						area += 0.5 * std::fabs(
+							(screen[1].x - screen[0].x) * (screen[2].y - screen[0].y)
+							- (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y));
+						big += (maxX - minX) * (maxY - minY) >= BigTriangleThreshold ? 1 : 0;
+					}
+
+					// culled, as CullingCS would
+					if (!visible)
+					{
+						continue;
+					}
+
+					ClusterEstimate exact = {};
+					exact.crossesNear = crossesNear;
+					exact.triangleArea = static_cast<float>(area / MeshletTriangles);
+
+					centers.push_back({ 0.5f * (minP.x + maxP.x), 0.5f * (minP.y + maxP.y), 0.5f * (minP.z + maxP.z) });
+					extents.push_back({ 0.5f * (maxP.x - minP.x), 0.5f * (maxP.y - minP.y), 0.5f * (maxP.z - minP.z) });
+					trianglesCounts.push_back(MeshletTriangles);
+					exactRoutes.push_back(RouteCluster(exact, settings));
+					exactAreas.push_back(area);
+					bigTriangles.push_back(big);
+				}
+			}
+		}
+
+		std::vector<ClusterRoute> routes;
+		ClusterRoutingStats stats;
+		double seconds = BestOf(Repeats, [&]()
+		{
+			stats = RouteClusters(
+				centers.data(),
+				extents.data(),
+				trianglesCounts.data(),
+				centers.size(),
+				view,
+				settings,
+				routes);
+		});
+
+		for (int route = 0; route < ClusterRoutesCount; route++)
+		{
+			size_t exact = 0;
+			size_t agree = 0;
+			double area = 0.0;
+			size_t big = 0;
+			for (size_t cluster = 0; cluster < routes.size(); cluster++)
+			{
+				exact += static_cast<int>(exactRoutes[cluster]) == route ? 1 : 0;
+				if (static_cast<int>(routes[cluster]) == route)
+				{
+					agree += exactRoutes[cluster] == routes[cluster] ? 1 : 0;
+					area += exactAreas[cluster];
+					big += bigTriangles[cluster];
+				}
+			}
+
+			double clusters = static_cast<double>(std::max<size_t>(stats.clusters[route], 1));
+			double triangles = static_cast<double>(std::max<size_t>(stats.triangles[route], 1));
+			table.Row({
+				Format("%g", cameraHeight),
+				GetClusterRouteName(static_cast<ClusterRoute>(route)),
+				Format("%zu", stats.clusters[route]),
+				Format("%.3f", stats.triangles[route] * 1e-6),
+				Format("%zu", exact),
+				Format("%.1f", 100.0 * agree / clusters),
+				Format("%.1f", area / triangles),
+				Format("%.1f", 100.0 * big / triangles),
+				Format("%.2f", centers.size() / seconds * 1e-6) });
+		}
+	}
+}
+
+#endif
+
+// a command per mesh, its meshlets one after the other
+static std::vector<IndirectCommand> BuildMeshCommands(size_t meshesCount)
+{
+	std::vector<IndirectCommand> meshCommands(meshesCount);
+	for (size_t mesh = 0; mesh < meshesCount; mesh++)
+	{
+		meshCommands[mesh] = {};
+		meshCommands[mesh].args.indexCountPerInstance = MESHLET_SIZE * 3;
+		meshCommands[mesh].args.startIndexLocation = static_cast<unsigned int>(mesh * MESHLET_SIZE * 3);
+	}
+
+	return meshCommands;
+}
+
+// best of the repeats of both compactions, in seconds, interleaved, so both see the same machine load
+static void MeasureCompactions(
+	ThreadPool& pool,
+	const CompactionInputs& inputs,
+	CompactionOutputs& atomics,
+	CompactionOutputs& prefixSum,
+	double& atomicsSeconds,
+	double& prefixSumSeconds)
+{
+	StreamCompaction compaction;
+	atomicsSeconds = 1e30;
+	prefixSumSeconds = 1e30;
+	for (int round = 0; round < Repeats; round++)
+	{
+		atomicsSeconds = std::min(atomicsSeconds, BestOf(1, [&]() { compaction.CompactWithAtomics(pool, inputs, atomics); }));
+		prefixSumSeconds = std::min(prefixSumSeconds, BestOf(1, [&]() { compaction.CompactWithPrefixSum(pool, inputs, prefixSum); }));
+	}
+}
+
+// culling results compaction, from a frustums mask per (object, mesh) pair: the InterlockedAdd per visible instance
+// of CullingCS and GenerateCommandsCS against the prefix sum of the visibility flags, many meshes per object,
+// then a single mesh of many instances, which all contend for the same counter, up to more frustums than
+// MAX_CASCADES_COUNT, the prefix sum doesn't need a buffer per frustum
+void CompareStreamCompaction()
+{
+	struct Layout
+	{
+		size_t objectsCount;
+		size_t meshesCount;
+	};
+	const Layout layouts[] = { { 16384, 16 }, { 262144, 1 } };
+
+	ThreadPool pool;
+
+	printf("\n%u threads, the camera sees 30%% of the pairs, every cascade 60%%\n", pool.GetThreadsCount());
+	Table table({
+		{ "objects", -10 },
+		{ "meshes", -8 },
+		{ "frustums", -10 },
+		{ "path", -12 },
+		{ "ms", 10 },
+		{ "Mpairs/s", 12 },
+		{ "visible, M", 12 },
+		{ "instances, M", 14 },
+		{ "commands", 10 },
+		{ "mismatches", 12 } });
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+
+	for (const Layout& layout : layouts)
+	{
+		std::vector<IndirectCommand> meshCommands = BuildMeshCommands(layout.meshesCount);
+
+		for (unsigned int frustumsCount : { 1u, 5u, static_cast<unsigned int>(MAX_FRUSTUMS_COUNT), 16u })
+		{
+			std::vector<uint32_t> visibility(layout.objectsCount * layout.meshesCount);
+			for (uint32_t& mask : visibility)
+			{
+				mask = chance(random) < 0.3f ? 1u : 0u;
+				for (unsigned int frustum = 1; frustum < frustumsCount; frustum++)
+				{
+					mask |= chance(random) < 0.6f ? 1u << frustum : 0u;
+				}
+			}
+
+			CompactionInputs inputs;
+			inputs.visibility = visibility.data();
+			inputs.objectsCount = layout.objectsCount;
+			inputs.meshesCount = layout.meshesCount;
+			inputs.frustumsCount = frustumsCount;
+			inputs.meshCommands = meshCommands.data();
+
+			CompactionOutputs atomics;
+			CompactionOutputs prefixSum;
+			double atomicsSeconds;
+			double prefixSumSeconds;
+			MeasureCompactions(pool, inputs, atomics, prefixSum, atomicsSeconds, prefixSumSeconds);
+
+			size_t mismatches = CompareCompactions(inputs, atomics, prefixSum);
+			auto report = [&](const char* path, double seconds, const CompactionOutputs& outputs)
+			{
+				size_t visible = 0;
+				size_t commands = 0;
+				for (unsigned int frustum = 0; frustum < frustumsCount; frustum++)
+				{
+					commands += outputs.frustumCommandsCounts[frustum];
+					for (uint32_t command = 0; command < outputs.frustumCommandsCounts[frustum]; command++)
+					{
+						visible += outputs.commands[outputs.frustumCommandsOffsets[frustum] + command].args.instanceCount;
+					}
+				}
+
+				table.Row({
+					Format("%zu", layout.objectsCount),
+					Format("%zu", layout.meshesCount),
+					Format("%u", frustumsCount),
+					path,
+					Format("%.2f", seconds * 1000.0),
+					Format("%.2f", visibility.size() / seconds * 1e-6),
+					Format("%.2f", visible * 1e-6),
+					Format("%.2f", outputs.visibleInstances.size() * 1e-6),
+					Format("%zu", commands),
+					Format("%zu", mismatches) });
+			};
+			report("atomics", atomicsSeconds, atomics);
+			report("prefix sum", prefixSumSeconds, prefixSum);
+		}
+	}
+}
+
+// planes point inside, x + tan * z >= 0 and so on, looking along z from the origin
+static CullingFrustum PerspectiveFrustum(float tanHalfFov, float nearZ, float farZ)
+{
+	float invLength = 1.0f / std::sqrt(1.0f + tanHalfFov * tanHalfFov);
+	CullingFrustum frustum;
+	frustum.l = { invLength, 0.0f, tanHalfFov * invLength, 0.0f };
+	frustum.r = { -invLength, 0.0f, tanHalfFov * invLength, 0.0f };
+	frustum.b = { 0.0f, invLength, tanHalfFov * invLength, 0.0f };
+	frustum.t = { 0.0f, -invLength, tanHalfFov * invLength, 0.0f };
+	frustum.n = { 0.0f, 0.0f, 1.0f, -nearZ };
+	frustum.f = { 0.0f, 0.0f, -1.0f, farZ };
+	for (int corner = 0; corner < 8; corner++)
+	{
+		float z = (corner & 4) ? farZ : nearZ;
+		frustum.cornersWS[corner] =
+		{
+			((corner & 1) ? 1.0f : -1.0f) * tanHalfFov * z,
+			((corner & 2) ? 1.0f : -1.0f) * tanHalfFov * z,
+			z,
+			1.0f
+		};
+	}
+
+	return frustum;
+}
+
+// an orthographic cascade around the origin
+static CullingFrustum BoxFrustum(float halfSize, float halfHeight)
+{
+	CullingFrustum frustum;
+	frustum.l = { 1.0f, 0.0f, 0.0f, halfSize };
+	frustum.r = { -1.0f, 0.0f, 0.0f, halfSize };
+	frustum.b = { 0.0f, 1.0f, 0.0f, halfHeight };
+	frustum.t = { 0.0f, -1.0f, 0.0f, halfHeight };
+	frustum.n = { 0.0f, 0.0f, 1.0f, halfSize };
+	frustum.f = { 0.0f, 0.0f, -1.0f, halfSize };
+	for (int corner = 0; corner < 8; corner++)
+	{
+		frustum.cornersWS[corner] =
+		{
+			(corner & 1) ? halfSize : -halfSize,
+			(corner & 2) ? halfHeight : -halfHeight,
+			(corner & 4) ? halfSize : -halfSize,
+			1.0f
+		};
+	}
+
+	return frustum;
+}
+
+// culling only, a million objects of a 4 meshlet prefab spread around a camera and 4 cascades:
+// the scalar kernel is the reference, the SIMD ones must match its masks bit for bit,
+// then the masks compacted into the visible instances and commands, with atomics, as the GPU lays them out,
+// and with the prefix sum
+void CompareCullingEngine()
+{
+	const size_t ObjectsCount = 1 << 20;
+	const size_t MeshesCount = 4;
+	const unsigned int CascadesCount = 4;
+
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<Instance> instances(ObjectsCount);
+	for (Instance& instance : instances)
+	{
+		float angle = 6.2831853f * unit(random);
+		float scale = 1.0f + 2.0f * unit(random);
+		instance = {};
+		instance.worldTransform.m[0][0] = scale * std::cos(angle);
+		instance.worldTransform.m[0][2] = -scale * std::sin(angle);
+		instance.worldTransform.m[1][1] = scale;
+		instance.worldTransform.m[2][0] = scale * std::sin(angle);
+		instance.worldTransform.m[2][2] = scale * std::cos(angle);
+		instance.worldTransform.m[3][0] = 2000.0f * unit(random) - 1000.0f;
+		instance.worldTransform.m[3][1] = 40.0f * unit(random) - 20.0f;
+		instance.worldTransform.m[3][2] = 2000.0f * unit(random) - 1000.0f;
+		instance.worldTransform.m[3][3] = 1.0f;
+	}
+
+	// quarters of a unit box, the cones of random meshlets
+	std::vector<CullingMesh> meshes(MeshesCount);
+	for (size_t mesh = 0; mesh < MeshesCount; mesh++)
+	{
+		float x = (mesh & 1) ? 0.5f : -0.5f;
+		float z = (mesh & 2) ? 0.5f : -0.5f;
+		float axis[3] = { unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f };
+		float invLength = 1.0f / std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+		meshes[mesh].center = { x, 0.0f, z };
+		meshes[mesh].extents = { 0.5f, 1.0f, 0.5f };
+		meshes[mesh].coneApex = { x, 0.0f, z };
+		meshes[mesh].coneAxis = { axis[0] * invLength, axis[1] * invLength, axis[2] * invLength };
+		meshes[mesh].coneCutoff = 0.2f + 0.6f * unit(random);
+	}
+
+	CullingView view;
+	view.frustumsCount = 1 + CascadesCount;
+	view.frustums[0] = PerspectiveFrustum(0.57735f, 0.1f, 1000.0f);
+	for (unsigned int cascade = 0; cascade < CascadesCount; cascade++)
+	{
+		view.frustums[1 + cascade] = BoxFrustum(25.0f * std::pow(3.0f, static_cast<float>(cascade)), 100.0f);
+	}
+	view.cameraPosition = { 0.0f, 0.0f, 0.0f };
+	view.lightDirection = { 0.0f, -1.0f, 0.0f };
+
+	CullingPrefab prefab;
+	prefab.instances = instances.data();
+	prefab.objectsCount = ObjectsCount;
+	prefab.meshes = meshes.data();
+	prefab.meshesCount = MeshesCount;
+
+	ThreadPool pool;
+	CullingEngine engine;
+
+	printf("\n%u threads, %zu objects, %zu meshes, %u frustums\n",
+		pool.GetThreadsCount(),
+		ObjectsCount,
+		MeshesCount,
+		view.frustumsCount);
+	Table table({
+		{ "path", -18 },
+		{ "lanes", 8 },
+		{ "ms", 10 },
+		{ "Mobjects/s", 12 },
+		{ "Mpairs/s", 12 },
+		{ "camera, M", 14 },
+		{ "mismatches", 12 } });
+
+	std::vector<uint32_t> reference(ObjectsCount * MeshesCount);
+	std::vector<uint32_t> visibility(ObjectsCount * MeshesCount);
+
+	for (int isa = static_cast<int>(BlockKernelISA::Scalar);
+		isa <= static_cast<int>(GetBestBlockKernelISA());
+		isa++)
+	{
+		if (static_cast<BlockKernelISA>(isa) == BlockKernelISA::SSE41)
+		{
+			continue;
+		}
+
+		engine.SetISA(static_cast<BlockKernelISA>(isa));
+		std::vector<uint32_t>& masks = isa == static_cast<int>(BlockKernelISA::Scalar) ? reference : visibility;
+
+		double seconds = BestOf(Repeats, [&]()
+		{
+			engine.Cull(pool, view, prefab, masks.data());
+		});
+
+		size_t cameraVisible = 0;
+		size_t mismatches = 0;
+		for (size_t pair = 0; pair < masks.size(); pair++)
+		{
+			cameraVisible += masks[pair] & 1;
+			mismatches += masks[pair] != reference[pair] ? 1 : 0;
+		}
+
+		table.Row({
+			GetBlockKernelISAName(engine.GetISA()),
+			Format("%u", engine.GetLanesCount()),
+			Format("%.2f", seconds * 1000.0),
+			Format("%.2f", ObjectsCount / seconds * 1e-6),
+			Format("%.2f", masks.size() / seconds * 1e-6),
+			Format("%.3f", cameraVisible * 1e-6),
+			Format("%zu", mismatches) });
+	}
+
+	// the outputs of the GPU culler
+	std::vector<IndirectCommand> meshCommands = BuildMeshCommands(MeshesCount);
+
+	CompactionInputs inputs;
+	inputs.visibility = reference.data();
+	inputs.objectsCount = ObjectsCount;
+	inputs.meshesCount = MeshesCount;
+	inputs.frustumsCount = view.frustumsCount;
+	inputs.meshCommands = meshCommands.data();
+
+	CompactionOutputs atomics;
+	CompactionOutputs prefixSum;
+	double atomicsSeconds;
+	double prefixSumSeconds;
+	MeasureCompactions(pool, inputs, atomics, prefixSum, atomicsSeconds, prefixSumSeconds);
+
+	printf("compaction, atomics: %.2f ms, prefix sum: %.2f ms, %zu visible instances, %zu mismatches\n",
+		atomicsSeconds * 1000.0,
+		prefixSumSeconds * 1000.0,
+		prefixSum.visibleInstances.size(),
+		CompareCompactions(inputs, atomics, prefixSum));
+}
+
+}
@@ -0,0 +1,399 @@
+#include "BenchmarkHarness.h"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace Benchmark
+{
+
+void AddPosition(SyntheticScene& scene, float x, float y, float z)
+{
+#ifdef QUANTIZED_POSITIONS
+	// origin (-1, -1, 0), scale (2, 2, 1), see QuantizePosition() in Common.h
+	unsigned int qx = static_cast<unsigned int>((x + 1.0f) * 0.5f * 65535.0f + 0.5f);
+	unsigned int qy = static_cast<unsigned int>((y + 1.0f) * 0.5f * 65535.0f + 0.5f);
+	unsigned int qz = static_cast<unsigned int>(z * 65535.0f + 0.5f);
+	scene.positions.push_back(qx | (qy << 16));
+	scene.positions.push_back(qz);
+#else
+	float position[3] = { x, y, z };
+	for (float value : position)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		scene.positions.push_back(bits);
+	}
+#endif
+}
+
+void AddTriangle(SyntheticScene& scene, const Float3 vertices[3])
+{
+	for (int vertex = 0; vertex < 3; vertex++)
+	{
+		AddPosition(
+			scene,
+			vertices[vertex].x / Width * 2.0f - 1.0f,
+			1.0f - vertices[vertex].y / Height * 2.0f,
+			vertices[vertex].z);
+	}
+}
+
+void AddTriangles(SyntheticScene& scene, const SizeBucket& bucket)
+{
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> size(bucket.minSize, bucket.maxSize);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> depth(0.1f, 0.9f);
+
+	for (unsigned int triangle = 0; triangle < bucket.trianglesCount; triangle++)
+	{
+		float s = size(generator);
+		float originX = unit(generator) * (Width - s);
+		float originY = unit(generator) * (Height - s);
+
+		Float3 vertices[3];
+		for (auto& vertex : vertices)
+		{
+			vertex = { originX + unit(generator) * s, originY + unit(generator) * s, depth(generator) };
+		}
+
+		// screen space area should be positive
+		if ((vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) -
+			(vertices[2].x - vertices[0].x) * (vertices[1].y - vertices[0].y) < 0.0f)
+		{
+			std::swap(vertices[1], vertices[2]);
+		}
+
+		AddTriangle(scene, vertices);
+	}
+}
+
+void AddJitteredGrid(SyntheticScene& scene, float cellSize)
+{
+	std::mt19937 generator(1337);
+	std::uniform_real_distribution<float> jitter(-0.45f * cellSize, 0.45f * cellSize);
+	std::uniform_real_distribution<float> depth(0.1f, 0.9f);
+
+	int cellsX = static_cast<int>(Width / cellSize);
+	int cellsY = static_cast<int>(Height / cellSize);
+
+	std::vector<Float3> grid((cellsX + 1) * (cellsY + 1));
+	for (int y = 0; y <= cellsY; y++)
+	{
+		for (int x = 0; x <= cellsX; x++)
+		{
+			bool borderX = x == 0 || x == cellsX;
+			bool borderY = y == 0 || y == cellsY;
+			grid[y * (cellsX + 1) + x] =
+			{
+				x * static_cast<float>(Width) / cellsX + (borderX ? 0.0f : jitter(generator)),
+				y * static_cast<float>(Height) / cellsY + (borderY ? 0.0f : jitter(generator)),
+				depth(generator)
+			};
+		}
+	}
+
+	for (int y = 0; y < cellsY; y++)
+	{
+		for (int x = 0; x < cellsX; x++)
+		{
+			const Float3& v00 = grid[y * (cellsX + 1) + x];
+			const Float3& v10 = grid[y * (cellsX + 1) + x + 1];
+			const Float3& v01 = grid[(y + 1) * (cellsX + 1) + x];
+			const Float3& v11 = grid[(y + 1) * (cellsX + 1) + x + 1];
+
+			// y goes down on the screen, so these are clockwise there, i.e. positive
+			Float3 triangle0[3] = { v00, v10, v11 };
+			Float3 triangle1[3] = { v00, v11, v01 };
+			AddTriangle(scene, triangle0);
+			AddTriangle(scene, triangle1);
+		}
+	}
+}
+
+void BuildScene(SyntheticScene& scene)
+{
+	const unsigned int trianglesCount = static_cast<unsigned int>(scene.positions.size() / PositionUints / 3);
+	scene.indices.clear();
+	scene.commands.clear();
+
+	for (unsigned int first = 0; first < trianglesCount; first += TrianglesPerCommand)
+	{
+		unsigned int count = std::min(TrianglesPerCommand, trianglesCount - first);
+
+		IndirectCommand command = {};
+		command.startInstanceLocation = 0;
+#ifdef QUANTIZED_POSITIONS
+		command.positionsOrigin = { -1.0f, -1.0f, 0.0f };
+		command.positionsScale = { 2.0f, 2.0f, 1.0f };
+#endif
+		command.args.indexCountPerInstance = count * 3;
+		command.args.instanceCount = 1;
+		command.args.baseVertexLocation = static_cast<int>(first * 3);
+#ifdef MESHLET_INDICES
+		// meshlet vertices, followed by the packed local triangles
+		command.startMeshletVertexLocation = static_cast<unsigned int>(scene.indices.size());
+		for (unsigned int vertex = 0; vertex < count * 3; vertex++)
+		{
+			scene.indices.push_back(vertex);
+		}
+		command.startMeshletTriangleLocation = static_cast<unsigned int>(scene.indices.size());
+		for (unsigned int triangle = 0; triangle < count; triangle++)
+		{
+			unsigned int i = triangle * 3;
+			scene.indices.push_back(i | ((i + 1) << 8) | ((i + 2) << 16));
+		}
+#else
+		command.args.startIndexLocation = first * 3;
+#endif
+		scene.commands.push_back(command);
+	}
+
+#ifndef MESHLET_INDICES
+	scene.indices.resize(static_cast<size_t>(trianglesCount) * 3);
+	for (unsigned int triangle = 0; triangle < trianglesCount; triangle++)
+	{
+		// relative to baseVertexLocation
+		unsigned int i = (triangle % TrianglesPerCommand) * 3;
+		for (unsigned int vertex = 0; vertex < 3; vertex++)
+		{
+#ifdef GPU_SOA_BUFFERS
+			scene.indices[vertex * trianglesCount + triangle] = i + vertex;
+#else
+			scene.indices[triangle * 3 + vertex] = i + vertex;
+#endif
+		}
+	}
+#endif
+
+	scene.instance = {};
+	scene.instance.worldTransform = Identity();
+
+	// facing the default sun, a color per triangle, half floats
+	const unsigned int halfs[] = { 0x3400, 0x3800, 0x3C00 };
+	scene.normals.assign(static_cast<size_t>(trianglesCount) * 3, (512 << 20) | (1023 << 10) | 512);
+	scene.colors.resize(static_cast<size_t>(trianglesCount) * 3 * 2);
+	for (unsigned int triangle = 0; triangle < trianglesCount; triangle++)
+	{
+		unsigned int packed[2] =
+		{
+			(halfs[triangle % 3] << 16) | halfs[(triangle / 3) % 3],
+			halfs[(triangle / 9) % 3] << 16
+		};
+		for (unsigned int vertex = 0; vertex < 3; vertex++)
+		{
+			scene.colors[(triangle * 3 + vertex) * 2 + 0] = packed[0];
+			scene.colors[(triangle * 3 + vertex) * 2 + 1] = packed[1];
+		}
+	}
+
+	scene.buffers.positions = scene.positions.data();
+	scene.buffers.normals = scene.normals.data();
+	scene.buffers.colors = scene.colors.data();
+	scene.buffers.indices = scene.indices.data();
+	scene.buffers.totalTriangles = trianglesCount;
+	scene.buffers.instances = &scene.instance;
+}
+
+void BuildScene(SyntheticScene& scene, const SizeBucket& bucket)
+{
+	scene.positions.clear();
+	AddTriangles(scene, bucket);
+	BuildScene(scene);
+}
+
+#ifdef MESHLET_INDICES
+
+void AddMeshletGrid(SyntheticScene& scene, unsigned int startInstanceLocation)
+{
+	for (unsigned int meshletY = 0; meshletY < MeshletsPerSide; meshletY++)
+	{
+		for (unsigned int meshletX = 0; meshletX < MeshletsPerSide; meshletX++)
+		{
+			unsigned int firstVertex = static_cast<unsigned int>(scene.positions.size() / PositionUints);
+			for (unsigned int y = 0; y <= MeshletCells; y++)
+			{
+				for (unsigned int x = 0; x <= MeshletCells; x++)
+				{
+					float u = static_cast<float>(meshletX * MeshletCells + x) / (MeshletsPerSide * MeshletCells);
+					float v = static_cast<float>(meshletY * MeshletCells + y) / (MeshletsPerSide * MeshletCells);
+					AddPosition(scene, u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.5f + 0.25f * std::sin(u * 17.0f) * std::cos(v * 13.0f));
+				}
+			}
+
+			IndirectCommand command = {};
+			command.startInstanceLocation = startInstanceLocation;
+#ifdef QUANTIZED_POSITIONS
+			command.positionsOrigin = { -1.0f, -1.0f, 0.0f };
+			command.positionsScale = { 2.0f, 2.0f, 1.0f };
+#endif
+			command.args.indexCountPerInstance = MeshletTriangles * 3;
+			command.args.baseVertexLocation = static_cast<int>(firstVertex);
+			command.startMeshletVertexLocation = static_cast<unsigned int>(scene.indices.size());
+			for (unsigned int vertex = 0; vertex < MeshletVertices; vertex++)
+			{
+				scene.indices.push_back(vertex);
+			}
+			command.startMeshletTriangleLocation = static_cast<unsigned int>(scene.indices.size());
+			for (unsigned int y = 0; y < MeshletCells; y++)
+			{
+				for (unsigned int x = 0; x < MeshletCells; x++)
+				{
+					// y is up, so clockwise here is a positive screen space area
+					unsigned int a = y * (MeshletCells + 1) + x;
+					unsigned int b = a + 1;
+					unsigned int c = a + MeshletCells + 1;
+					unsigned int d = c + 1;
+					scene.indices.push_back(a | (c << 8) | (b << 16));
+					scene.indices.push_back(b | (c << 8) | (d << 16));
+				}
+			}
+			scene.commands.push_back(command);
+		}
+	}
+}
+
+std::vector<Instance> GridInstances(unsigned int instancesPerSide)
+{
+	std::vector<Instance> instances(instancesPerSide * instancesPerSide);
+	float scale = 1.0f / instancesPerSide;
+	for (unsigned int instance = 0; instance < instances.size(); instance++)
+	{
+		instances[instance] = {};
+		instances[instance].worldTransform.m[0][0] = scale;
+		instances[instance].worldTransform.m[1][1] = scale;
+		instances[instance].worldTransform.m[2][2] = 1.0f;
+		instances[instance].worldTransform.m[3][0] = -1.0f + (instance % instancesPerSide * 2 + 1) * scale;
+		instances[instance].worldTransform.m[3][1] = -1.0f + (instance / instancesPerSide * 2 + 1) * scale;
+		instances[instance].worldTransform.m[3][3] = 1.0f;
+	}
+
+	return instances;
+}
+
+#endif
+
+Float4x4 Identity()
+{
+	Float4x4 identity = {};
+	for (int i = 0; i < 4; i++)
+	{
+		identity.m[i][i] = 1.0f;
+	}
+
+	return identity;
+}
+
+Statistics DrawDepth(Rasterizer& rasterizer, const SyntheticScene& scene, const Float4x4& VP, DepthTarget& depth)
+{
+	return rasterizer.DrawDepth(scene.buffers, scene.commands.data(), scene.commands.size(), VP, depth);
+}
+
+Statistics DrawOpaque(Rasterizer& rasterizer, const SyntheticScene& scene, const DepthTarget& depth, ColorTarget& color)
+{
+	return rasterizer.DrawOpaque(
+		scene.buffers,
+		scene.commands.data(),
+		scene.commands.size(),
+		Identity(),
+		ShadingSettings(),
+		depth,
+		nullptr,
+		color);
+}
+
+double Run(
+	Rasterizer& rasterizer,
+	const RasterizationSettings& settings,
+	const SyntheticScene& scene,
+	DepthTarget& depth,
+	Statistics* statistics)
+{
+	Float4x4 identity = Identity();
+	rasterizer.SetSettings(settings);
+
+	double best = 1e30;
+	for (int repeat = 0; repeat < Repeats; repeat++)
+	{
+		depth.Clear();
+		auto start = std::chrono::high_resolution_clock::now();
+		Statistics result = DrawDepth(rasterizer, scene, identity, depth);
+		auto end = std::chrono::high_resolution_clock::now();
+		if (statistics)
+		{
+			*statistics = result;
+		}
+		best = std::min(best, std::chrono::duration<double>(end - start).count());
+	}
+
+	return best;
+}
+
+size_t CountMismatches(const DepthTarget& a, const DepthTarget& b)
+{
+	size_t mismatches = 0;
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			float depthA = a.GetDepth(x, y);
+			float depthB = b.GetDepth(x, y);
+			mismatches += memcmp(&depthA, &depthB, sizeof(float)) != 0 ? 1 : 0;
+		}
+	}
+
+	return mismatches;
+}
+
+size_t CountMismatches(const ColorTarget& a, const ColorTarget& b)
+{
+	size_t mismatches = 0;
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			mismatches += a.GetPixel(x, y) != b.GetPixel(x, y) ? 1 : 0;
+		}
+	}
+
+	return mismatches;
+}
+
+std::string Format(const char* format, ...)
+{
+	char buffer[256];
+	va_list arguments;
+	va_start(arguments, format);
+	vsnprintf(buffer, sizeof(buffer), format, arguments);
+	va_end(arguments);
+	return buffer;
+}
+
+std::string BucketName(const SizeBucket& bucket)
+{
+	return Format("%g-%g", bucket.minSize, bucket.maxSize);
+}
+
+Table::Table(std::vector<Column> columns)
+	: _columns(std::move(columns))
+{
+	for (size_t column = 0; column < _columns.size(); column++)
+	{
+		printf("%s%*s", column == 0 ? "" : " ", _columns[column].width, _columns[column].name);
+	}
+	printf("\n");
+}
+
+void Table::Row(const std::vector<std::string>& cells, const std::string& suffix) const
+{
+	for (size_t column = 0; column < _columns.size(); column++)
+	{
+		printf("%s%*s", column == 0 ? "" : " ", _columns[column].width, column < cells.size() ? cells[column].c_str() : "-");
+	}
+	printf("%s\n", suffix.c_str());
+}
+
+}
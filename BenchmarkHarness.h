@@ -0,0 +1,174 @@
+#pragma once
+
+#include "CPURasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// what the comparisons of CPURasterizerBenchmark share: the synthetic scenes, the timing and the tables,
+// a comparison runs its paths over a scene and prints a row per path, mismatches are against its reference path
+namespace Benchmark
+{
+
+using namespace CPURasterizer;
+
+const int Width = 1024;
+const int Height = 1024;
+// 3 unique vertices per triangle, so meshlet local indices stay 8-bit
+const unsigned int TrianglesPerCommand = 64;
+const int Repeats = 5;
+
+#ifdef QUANTIZED_POSITIONS
+const size_t PositionUints = 2;
+#else
+const size_t PositionUints = 3;
+#endif
+
+const float ClearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+struct SizeBucket
+{
+	float minSize;
+	float maxSize;
+	unsigned int trianglesCount;
+};
+
+struct SyntheticScene
+{
+	std::vector<unsigned int> positions;
+	std::vector<unsigned int> normals;
+	std::vector<unsigned int> colors;
+	std::vector<unsigned int> indices;
+	std::vector<IndirectCommand> commands;
+	Instance instance;
+	SceneBuffers buffers;
+};
+
+void AddPosition(SyntheticScene& scene, float x, float y, float z);
+
+// vertices are in pixels and NDC z, 3 per triangle, with positive screen space area
+void AddTriangle(SyntheticScene& scene, const Float3 vertices[3]);
+
+// random triangles
+void AddTriangles(SyntheticScene& scene, const SizeBucket& bucket);
+
+// a mesh covering the whole screen, inner vertices are jittered and shared by the adjacent cells,
+// so every pixel center should be covered exactly once
+void AddJitteredGrid(SyntheticScene& scene, float cellSize);
+
+// identity transforms, so the positions are in clip space
+void BuildScene(SyntheticScene& scene);
+
+// the random triangles of the bucket only
+void BuildScene(SyntheticScene& scene, const SizeBucket& bucket);
+
+#ifdef MESHLET_INDICES
+
+const unsigned int MeshletCells = 10;
+const unsigned int MeshletsPerSide = 8;
+const unsigned int MeshletVertices = (MeshletCells + 1) * (MeshletCells + 1);
+const unsigned int MeshletTriangles = MeshletCells * MeshletCells * 2;
+
+// meshlets of MeshletCells x MeshletCells quads, their vertices shared, as Scene::_loadObj builds them,
+// a mesh of MeshletsPerSide x MeshletsPerSide meshlets over the [-1, 1] square, appended as a command each,
+// instance counts are left to the caller
+void AddMeshletGrid(SyntheticScene& scene, unsigned int startInstanceLocation);
+
+// instancesPerSide x instancesPerSide copies of the [-1, 1] square over the screen
+std::vector<Instance> GridInstances(unsigned int instancesPerSide);
+
+#endif
+
+Float4x4 Identity();
+
+// the depth pass of the whole scene
+Statistics DrawDepth(Rasterizer& rasterizer, const SyntheticScene& scene, const Float4x4& VP, DepthTarget& depth);
+
+// the opaque pass of the whole scene over its depth, identity transforms, the default shading
+Statistics DrawOpaque(Rasterizer& rasterizer, const SyntheticScene& scene, const DepthTarget& depth, ColorTarget& color);
+
+// best of the repeats of the depth pass, in seconds, identity transforms, the target is cleared untimed
+double Run(
+	Rasterizer& rasterizer,
+	const RasterizationSettings& settings,
+	const SyntheticScene& scene,
+	DepthTarget& depth,
+	Statistics* statistics = nullptr);
+
+// best of the repeats, in seconds
+template<typename Function>
+double BestOf(int repeats, Function&& function)
+{
+	double best = 1e30;
+	for (int repeat = 0; repeat < repeats; repeat++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		function();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	return best;
+}
+
+size_t CountMismatches(const DepthTarget& a, const DepthTarget& b);
+size_t CountMismatches(const ColorTarget& a, const ColorTarget& b);
+
+// printf into a string, for the cells of a table
+std::string Format(const char* format, ...);
+
+// "min-max", the sizes of the bucket
+std::string BucketName(const SizeBucket& bucket);
+
+// a column of a table, printf widths, negative ones are left aligned
+struct Column
+{
+	const char* name;
+	int width;
+};
+
+// prints the header when constructed, then a row per call, the cells are formatted by the caller, "-" if none
+class Table
+{
+public:
+
+	explicit Table(std::vector<Column> columns);
+
+	void Row(const std::vector<std::string>& cells, const std::string& suffix = "") const;
+
+private:
+
+	std::vector<Column> _columns;
+};
+
+// BenchmarkRasterization.cpp
+void CompareKernels();
+void CompareWatertightness();
+void CompareBinning();
+void CompareSpecializedKernels();
+#ifdef MESHLET_INDICES
+void CompareMeshletVertexCache();
+void CompareInstanceSlices();
+#endif
+
+// BenchmarkBigTriangles.cpp
+void CompareBigTriangleSettings();
+void CompareBigTriangleRecords();
+void CompareTileClassification();
+void CompareCoarseDepth();
+
+// BenchmarkPasses.cpp
+void CompareVisibility();
+void CompareMultiViewShadows();
+
+// BenchmarkCulling.cpp
+void CompareOcclusion();
+void CompareOcclusionCulling();
+#ifdef MESHLET_INDICES
+void CompareClusterRouting();
+#endif
+void CompareStreamCompaction();
+void CompareCullingEngine();
+
+}
@@ -0,0 +1,315 @@
+#include "BenchmarkHarness.h"
+
+#include <cmath>
+#include <cstdio>
+
+// the passes built over the rasterizer: the visibility buffer and the multi-view shadow cascades
+namespace Benchmark
+{
+
+// depth and opaque passes against the visibility buffer and its resolve, multithreaded,
+// traffic is estimated from the counters, as if nothing was cached
+void CompareVisibility()
+{
+	const SizeBucket scenes[] =
+	{
+		{ 2.0f, 4.0f, 1 << 20 },
+		{ 16.0f, 32.0f, 1 << 16 },
+		{ 200.0f, 800.0f, 1 << 12 },
+	};
+
+	// indices and positions, plus normals and colors for the shading
+	const double vertexBytes = 3.0 * (4.0 + PositionUints * 4.0);
+	const double attributeBytes = 3.0 * (4.0 + 8.0);
+
+	const Float4x4 identity = Identity();
+
+	Rasterizer rasterizer;
+	RasterizationSettings settings;
+	settings.scanlineRasterization = false;
+	rasterizer.SetSettings(settings);
+
+	ShadingSettings shading;
+
+	printf("\n%u threads\n", rasterizer.GetThreadsCount());
+	Table table({
+		{ "size, px", -12 },
+		{ "path", -18 },
+		{ "depth ms", 10 },
+		{ "shade ms", 10 },
+		{ "total ms", 10 },
+		{ "traffic, MB", 12 },
+		{ "mismatches", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget depth;
+	VisibilityTarget visibility;
+	ColorTarget reference;
+	ColorTarget color;
+	depth.Resize(Width, Height);
+	visibility.Resize(Width, Height);
+	reference.Resize(Width, Height);
+	color.Resize(Width, Height);
+
+	for (const SizeBucket& bucket : scenes)
+	{
+		BuildScene(scene, bucket);
+
+		// best of the repeats, per pass
+		double bestDepth = 1e30;
+		double bestShade = 1e30;
+		Statistics depthStatistics;
+		Statistics shadeStatistics;
+		auto measure = [&](auto&& depthPass, auto&& shadePass)
+		{
+			bestDepth = 1e30;
+			bestShade = 1e30;
+			for (int repeat = 0; repeat < Repeats; repeat++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				depthStatistics = depthPass();
+				auto middle = std::chrono::high_resolution_clock::now();
+				shadeStatistics = shadePass();
+				auto end = std::chrono::high_resolution_clock::now();
+				bestDepth = std::min(bestDepth, std::chrono::duration<double>(middle - start).count());
+				bestShade = std::min(bestShade, std::chrono::duration<double>(end - middle).count());
+			}
+		};
+		auto report = [&](const char* path, double bytes, const std::string& mismatches)
+		{
+			table.Row({
+				BucketName(bucket),
+				path,
+				Format("%.2f", bestDepth * 1000.0),
+				Format("%.2f", bestShade * 1000.0),
+				Format("%.2f", (bestDepth + bestShade) * 1000.0),
+				Format("%.1f", bytes / (1024.0 * 1024.0)),
+				mismatches });
+		};
+
+		measure(
+			[&]()
+			{
+				depth.Clear();
+				return DrawDepth(rasterizer, scene, identity, depth);
+			},
+			[&]()
+			{
+				reference.Clear(ClearColor);
+				return DrawOpaque(rasterizer, scene, depth, reference);
+			});
+
+		// depth read-modify-write, then the vertices fetched again, depth read and color write
+		report(
+			"depth + opaque",
+			depthStatistics.pipelineTriangles * vertexBytes +
+			depthStatistics.coveredPixels * 8.0 +
+			shadeStatistics.pipelineTriangles * (vertexBytes + attributeBytes) +
+			shadeStatistics.coveredPixels * 4.0 +
+			shadeStatistics.shadedPixels * 4.0,
+			"-");
+
+		measure(
+			[&]()
+			{
+				visibility.Clear();
+				return rasterizer.DrawVisibility(
+					scene.buffers,
+					scene.commands.data(),
+					scene.commands.size(),
+					identity,
+					visibility);
+			},
+			[&]()
+			{
+				color.Clear(ClearColor);
+				return rasterizer.ResolveVisibility(
+					scene.buffers,
+					scene.commands.data(),
+					scene.commands.size(),
+					identity,
+					shading,
+					visibility,
+					nullptr,
+					color);
+			});
+
+		// 64-bit read-modify-write, then every texel read, a triangle fetch per setup and color write
+		report(
+			"visibility",
+			depthStatistics.pipelineTriangles * vertexBytes +
+			depthStatistics.coveredPixels * 16.0 +
+			shadeStatistics.coveredPixels * 8.0 +
+			shadeStatistics.renderedTriangles * (vertexBytes + attributeBytes) +
+			shadeStatistics.shadedPixels * 4.0,
+			Format("%zu", CountMismatches(reference, color)));
+		if (depthStatistics.droppedIDTriangles > 0)
+		{
+			printf("%zu triangles past the visibility IDs weren't rasterized\n", depthStatistics.droppedIDTriangles);
+		}
+	}
+}
+
+// cascade c is the screen scaled by 3 / 1.5^c around its center, so the next ones cover more of the scene
+static Float4x4 CascadeVP(int cascade)
+{
+	float scale = 3.0f / std::pow(1.5f, static_cast<float>(cascade));
+	Float4x4 VP = {};
+	VP.m[0][0] = scale;
+	VP.m[1][1] = scale;
+	VP.m[2][2] = 1.0f;
+	VP.m[3][3] = 1.0f;
+	return VP;
+}
+
+// the shadow cascades rendered a pass per cascade against a single multi-view pass
+void CompareMultiViewShadows()
+{
+	// vertex bound, then pixel bound
+	const SizeBucket scenes[] =
+	{
+		{ 0.5f, 2.0f, 1 << 20 },
+		{ 4.0f, 16.0f, 1 << 18 },
+	};
+
+	Rasterizer rasterizer;
+	RasterizationSettings settings;
+	settings.scanlineRasterization = false;
+	rasterizer.SetSettings(settings);
+
+	printf("\n%u threads\n", rasterizer.GetThreadsCount());
+	Table table({
+		{ "size, px", -10 },
+		{ "cascades", -10 },
+		{ "path", -12 },
+		{ "ms", 10 },
+		{ "speedup", 10 },
+		{ "fetched, M", 14 },
+		{ "transformed, M", 16 },
+		{ "triangles, M", 14 },
+		{ "mismatches", 12 } });
+
+	SyntheticScene scene;
+	for (const SizeBucket& bucket : scenes)
+	{
+		BuildScene(scene, bucket);
+
+		// clip space bounds of the commands, identity transforms
+		std::vector<Float2> minP(scene.commands.size(), { 1e30f, 1e30f });
+		std::vector<Float2> maxP(scene.commands.size(), { -1e30f, -1e30f });
+		for (size_t command = 0; command < scene.commands.size(); command++)
+		{
+			for (unsigned int triangle = 0; triangle * 3 < scene.commands[command].args.indexCountPerInstance; triangle++)
+			{
+				Float3 positions[3];
+				GetTrianglePositions(scene.buffers, scene.commands[command], triangle, positions);
+				for (const Float3& p : positions)
+				{
+					minP[command] = { std::min(minP[command].x, p.x), std::min(minP[command].y, p.y) };
+					maxP[command] = { std::max(maxP[command].x, p.x), std::max(maxP[command].y, p.y) };
+				}
+			}
+		}
+
+		for (int cascadesCount : { 4, 8 })
+		{
+			// the per-cascade lists CullingCS would output, and their union with a cascade mask per command
+			std::vector<Float4x4> VPs(cascadesCount);
+			std::vector<std::vector<IndirectCommand>> cascadeCommands(cascadesCount);
+			std::vector<IndirectCommand> commands;
+			std::vector<unsigned int> masks;
+			for (int cascade = 0; cascade < cascadesCount; cascade++)
+			{
+				VPs[cascade] = CascadeVP(cascade);
+			}
+			for (size_t command = 0; command < scene.commands.size(); command++)
+			{
+				unsigned int mask = 0;
+				for (int cascade = 0; cascade < cascadesCount; cascade++)
+				{
+					float scale = VPs[cascade].m[0][0];
+					if (maxP[command].x * scale >= -1.0f && minP[command].x * scale <= 1.0f &&
+						maxP[command].y * scale >= -1.0f && minP[command].y * scale <= 1.0f)
+					{
+						mask |= 1u << cascade;
+						cascadeCommands[cascade].push_back(scene.commands[command]);
+					}
+				}
+				if (mask != 0)
+				{
+					commands.push_back(scene.commands[command]);
+					masks.push_back(mask);
+				}
+			}
+
+			std::vector<DepthTarget> reference(cascadesCount);
+			std::vector<DepthTarget> depths(cascadesCount);
+			for (int cascade = 0; cascade < cascadesCount; cascade++)
+			{
+				reference[cascade].Resize(Width, Height);
+				depths[cascade].Resize(Width, Height);
+			}
+
+			// a pass per cascade, as _drawShadows does
+			Statistics referenceStatistics;
+			double referenceSeconds = BestOf(Repeats, [&]()
+			{
+				referenceStatistics = {};
+				for (int cascade = 0; cascade < cascadesCount; cascade++)
+				{
+					reference[cascade].Clear();
+					Statistics statistics = rasterizer.DrawDepth(
+						scene.buffers,
+						cascadeCommands[cascade].data(),
+						cascadeCommands[cascade].size(),
+						VPs[cascade],
+						reference[cascade]);
+					referenceStatistics.fetchedVertices += statistics.fetchedVertices;
+					referenceStatistics.transformedVertices += statistics.transformedVertices;
+					referenceStatistics.pipelineTriangles += statistics.pipelineTriangles;
+				}
+			});
+
+			Statistics statistics;
+			double seconds = BestOf(Repeats, [&]()
+			{
+				for (DepthTarget& depth : depths)
+				{
+					depth.Clear();
+				}
+				statistics = rasterizer.DrawDepthMultiView(
+					scene.buffers,
+					commands.data(),
+					masks.data(),
+					commands.size(),
+					VPs.data(),
+					depths.data(),
+					cascadesCount);
+			});
+
+			size_t mismatches = 0;
+			for (int cascade = 0; cascade < cascadesCount; cascade++)
+			{
+				mismatches += CountMismatches(reference[cascade], depths[cascade]);
+			}
+
+			auto report = [&](const char* path, double pathSeconds, const Statistics& pathStatistics, bool isReference)
+			{
+				table.Row({
+					BucketName(bucket),
+					Format("%d", cascadesCount),
+					path,
+					Format("%.2f", pathSeconds * 1000.0),
+					isReference ? "-" : Format("%.2f", referenceSeconds / pathSeconds),
+					Format("%.2f", pathStatistics.fetchedVertices * 1e-6),
+					Format("%.2f", pathStatistics.transformedVertices * 1e-6),
+					Format("%.2f", pathStatistics.pipelineTriangles * 1e-6),
+					isReference ? "-" : Format("%zu", mismatches) });
+			};
+			report("per cascade", referenceSeconds, referenceStatistics, true);
+			report("multi-view", seconds, statistics, false);
+		}
+	}
+}
+
+}
@@ -0,0 +1,421 @@
+#include "BenchmarkHarness.h"
+
+#include <cstdio>
+
+// the rasterization paths of the depth pass: kernels, watertightness, binning, specialization,
+// the meshlet vertex cache and the instance slices
+namespace Benchmark
+{
+
+static size_t CountHoles(const DepthTarget& depth)
+{
+	size_t holes = 0;
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			holes += depth.GetDepth(x, y) == 0.0f ? 1 : 0;
+		}
+	}
+
+	return holes;
+}
+
+// per-pixel stepping against the block kernels of every supported ISA, single threaded, so the numbers are per core
+void CompareKernels()
+{
+	const SizeBucket buckets[] =
+	{
+		{ 2.0f, 4.0f, 1 << 20 },
+		{ 4.0f, 8.0f, 1 << 19 },
+		{ 8.0f, 16.0f, 1 << 18 },
+		{ 16.0f, 32.0f, 1 << 16 },
+		{ 32.0f, 64.0f, 1 << 14 },
+		{ 64.0f, 128.0f, 1 << 12 },
+	};
+
+	Rasterizer rasterizer(1);
+
+	RasterizationSettings base;
+	// no big triangles, every triangle goes through the small triangles path
+	base.bigTriangleThreshold = 3.402823466e+38f;
+	base.useTopLeftRule = true;
+
+	printf("best ISA: %s\n", GetBlockKernelISAName(GetBestBlockKernelISA()));
+	Table table({ { "size, px", -12 }, { "path", -18 }, { "ms", 10 }, { "Mtri/s", 10 }, { "mismatches", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget reference;
+	DepthTarget depth;
+	reference.Resize(Width, Height);
+	depth.Resize(Width, Height);
+
+	for (const SizeBucket& bucket : buckets)
+	{
+		BuildScene(scene, bucket);
+
+		auto report = [&](const std::string& path, double seconds, size_t mismatches)
+		{
+			table.Row({
+				BucketName(bucket),
+				path,
+				Format("%.2f", seconds * 1000.0),
+				Format("%.2f", bucket.trianglesCount / seconds * 1e-6),
+				Format("%zu", mismatches) });
+		};
+
+		// the scalar block kernel is the reference, SIMD kernels must match it bit for bit
+		RasterizationSettings settings = base;
+		settings.scanlineRasterization = false;
+		settings.blockRasterization = true;
+		settings.blockKernelISA = BlockKernelISA::Scalar;
+		report("block Scalar", Run(rasterizer, settings, scene, reference), 0);
+
+		for (int isa = static_cast<int>(BlockKernelISA::Scalar) + 1;
+			isa <= static_cast<int>(GetBestBlockKernelISA());
+			isa++)
+		{
+			settings.blockKernelISA = static_cast<BlockKernelISA>(isa);
+			double seconds = Run(rasterizer, settings, scene, depth);
+			report(Format("block %s", GetBlockKernelISAName(settings.blockKernelISA)), seconds, CountMismatches(reference, depth));
+		}
+
+		// the shaders' paths, their incremental stepping may differ in the last bits
+		settings.blockRasterization = false;
+		double seconds = Run(rasterizer, settings, scene, depth);
+		report("per-pixel edges", seconds, CountMismatches(reference, depth));
+
+		settings.scanlineRasterization = true;
+		seconds = Run(rasterizer, settings, scene, depth);
+		report("per-pixel scanline", seconds, CountMismatches(reference, depth));
+
+		// vertices are snapped, so it differs from the float paths
+		settings.fixedPointEdges = true;
+		seconds = Run(rasterizer, settings, scene, depth);
+		report("fixed point", seconds, CountMismatches(reference, depth));
+	}
+}
+
+// uncovered pixels of the meshes, which cover the whole screen
+void CompareWatertightness()
+{
+	const float cellSizes[] = { 4.0f, 32.0f, 256.0f };
+
+	Rasterizer rasterizer(1);
+
+	RasterizationSettings base;
+	base.bigTriangleThreshold = 3.402823466e+38f;
+
+	printf("\n");
+	Table table({ { "cell, px", -12 }, { "path", -18 }, { "ms", 10 }, { "Mtri/s", 10 }, { "holes", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget depth;
+	depth.Resize(Width, Height);
+
+	for (float cellSize : cellSizes)
+	{
+		scene.positions.clear();
+		AddJitteredGrid(scene, cellSize);
+		BuildScene(scene);
+
+		auto report = [&](const char* path, const RasterizationSettings& settings)
+		{
+			double seconds = Run(rasterizer, settings, scene, depth);
+			table.Row({
+				Format("%g", cellSize),
+				path,
+				Format("%.2f", seconds * 1000.0),
+				Format("%.2f", scene.buffers.totalTriangles / seconds * 1e-6),
+				Format("%zu", CountHoles(depth)) });
+		};
+
+		RasterizationSettings settings = base;
+		settings.scanlineRasterization = true;
+		settings.blockRasterization = false;
+		report("per-pixel scanline", settings);
+		settings.scanlineRasterization = false;
+		report("per-pixel edges", settings);
+		settings.blockRasterization = true;
+		report("block", settings);
+		settings.fixedPointEdges = true;
+		report("fixed point", settings);
+	}
+}
+
+// atomics against binning, multithreaded, micro triangles like the Buddha scene, big ones like the Plant scene
+void CompareBinning()
+{
+	const SizeBucket scenes[] =
+	{
+		{ 1.0f, 3.0f, 1 << 21 },
+		{ 200.0f, 800.0f, 1 << 12 },
+	};
+	const unsigned int binSizes[] = { 32, 64, 128 };
+
+	Rasterizer rasterizer;
+
+	RasterizationSettings base;
+	base.scanlineRasterization = false;
+
+	printf("\n%u threads\n", rasterizer.GetThreadsCount());
+	Table table({ { "size, px", -12 }, { "path", -18 }, { "ms", 10 }, { "Mtri/s", 10 }, { "bin entries", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget depth;
+	depth.Resize(Width, Height);
+
+	for (const SizeBucket& bucket : scenes)
+	{
+		BuildScene(scene, bucket);
+
+		RasterizationSettings settings = base;
+		double seconds = Run(rasterizer, settings, scene, depth);
+		table.Row({
+			BucketName(bucket),
+			"atomics",
+			Format("%.2f", seconds * 1000.0),
+			Format("%.2f", bucket.trianglesCount / seconds * 1e-6),
+			"-" });
+
+		settings.binning = true;
+		for (unsigned int binSize : binSizes)
+		{
+			settings.binSize = binSize;
+			Statistics statistics;
+			seconds = Run(rasterizer, settings, scene, depth, &statistics);
+			table.Row({
+				BucketName(bucket),
+				Format("binning %u", binSize),
+				Format("%.2f", seconds * 1000.0),
+				Format("%.2f", bucket.trianglesCount / seconds * 1e-6),
+				Format("%zu", statistics.binnedTriangles) });
+		}
+	}
+}
+
+// the generic per-pixel kernel against the ones specialized per rasterization mode
+void CompareSpecializedKernels()
+{
+	const SizeBucket buckets[] =
+	{
+		{ 2.0f, 4.0f, 1 << 20 },
+		{ 8.0f, 16.0f, 1 << 18 },
+		{ 32.0f, 64.0f, 1 << 14 },
+	};
+
+	// single thread, per-pixel paths, the block kernels take the top-left rule as data anyway
+	Rasterizer rasterizer(1);
+	RasterizationSettings base;
+	base.bigTriangleThreshold = 3.402823466e+38f;
+	base.blockRasterization = false;
+
+	printf("\n");
+	Table table({
+		{ "size, px", -12 },
+		{ "mode", -22 },
+		{ "generic, ms", 12 },
+		{ "special., ms", 12 },
+		{ "speedup", 10 },
+		{ "mismatches", 12 } });
+
+	SyntheticScene scene;
+	DepthTarget reference;
+	DepthTarget depth;
+	reference.Resize(Width, Height);
+	depth.Resize(Width, Height);
+
+	for (const SizeBucket& bucket : buckets)
+	{
+		BuildScene(scene, bucket);
+
+		for (bool scanline : { false, true })
+		{
+			for (bool topLeft : { false, true })
+			{
+				RasterizationSettings settings = base;
+				settings.useTopLeftRule = topLeft;
+				settings.scanlineRasterization = scanline;
+
+				// interleaved, so both see the same machine load
+				double genericSeconds = 1e30;
+				double seconds = 1e30;
+				for (int round = 0; round < 3; round++)
+				{
+					settings.specializedKernels = false;
+					genericSeconds = std::min(genericSeconds, Run(rasterizer, settings, scene, reference));
+					settings.specializedKernels = true;
+					seconds = std::min(seconds, Run(rasterizer, settings, scene, depth));
+				}
+
+				table.Row({
+					BucketName(bucket),
+					Format("%s%s", scanline ? "scanline" : "edges", topLeft ? ", top-left" : ""),
+					Format("%.2f", genericSeconds * 1000.0),
+					Format("%.2f", seconds * 1000.0),
+					Format("%.2f", genericSeconds / seconds),
+					Format("%zu", CountMismatches(reference, depth)) });
+			}
+		}
+	}
+}
+
+#ifdef MESHLET_INDICES
+
+// the meshlet triangles with and without the per-meshlet vertex cache
+void CompareMeshletVertexCache()
+{
+	SyntheticScene scene;
+	AddMeshletGrid(scene, 0);
+
+	scene.buffers.positions = scene.positions.data();
+	scene.buffers.indices = scene.indices.data();
+	scene.buffers.totalTriangles = static_cast<unsigned int>(scene.commands.size()) * MeshletTriangles;
+
+	Rasterizer rasterizer;
+	RasterizationSettings settings;
+	settings.scanlineRasterization = false;
+
+	printf("\n%u threads, %u vertices, %u triangles per meshlet\n",
+		rasterizer.GetThreadsCount(),
+		MeshletVertices,
+		MeshletTriangles);
+	Table table({
+		{ "instances", -10 },
+		{ "cache", -8 },
+		{ "ms", 10 },
+		{ "speedup", 10 },
+		{ "fetched, M", 14 },
+		{ "transformed, M", 16 },
+		{ "Mtri/s", 10 },
+		{ "mismatches", 12 } });
+
+	DepthTarget reference;
+	DepthTarget depth;
+	reference.Resize(Width, Height);
+	depth.Resize(Width, Height);
+
+	// the instances of a command are a grid over the screen, from a full screen mesh to Buddha-like micro triangles
+	for (unsigned int instancesPerSide : { 1u, 4u, 10u })
+	{
+		std::vector<Instance> instances = GridInstances(instancesPerSide);
+		for (IndirectCommand& command : scene.commands)
+		{
+			command.args.instanceCount = static_cast<unsigned int>(instances.size());
+		}
+		scene.buffers.instances = instances.data();
+
+		Statistics referenceStatistics;
+		Statistics statistics;
+		double referenceSeconds = 1e30;
+		double seconds = 1e30;
+		// interleaved, so both see the same machine load
+		for (int round = 0; round < 3; round++)
+		{
+			settings.meshletVertexCache = false;
+			referenceSeconds = std::min(referenceSeconds, Run(rasterizer, settings, scene, reference, &referenceStatistics));
+			settings.meshletVertexCache = true;
+			seconds = std::min(seconds, Run(rasterizer, settings, scene, depth, &statistics));
+		}
+
+		size_t mismatches = CountMismatches(reference, depth);
+		auto report = [&](const char* cache, double pathSeconds, const Statistics& pathStatistics)
+		{
+			table.Row({
+				Format("%zu", instances.size()),
+				cache,
+				Format("%.2f", pathSeconds * 1000.0),
+				Format("%.2f", referenceSeconds / pathSeconds),
+				Format("%.2f", pathStatistics.fetchedVertices * 1e-6),
+				Format("%.2f", pathStatistics.transformedVertices * 1e-6),
+				Format("%.2f", pathStatistics.pipelineTriangles / pathSeconds * 1e-6),
+				Format("%zu", mismatches) });
+		};
+		report("off", referenceSeconds, referenceStatistics);
+		report("on", seconds, statistics);
+	}
+}
+
+// the instanced meshlet grid, 100 instances per command, among single instance commands of small triangles,
+// as a Buddha grid among the rest of a scene: a job per command loops over every instance of it,
+// instance slices split it, the longest job bounds the triangles pass, whatever the threads count is
+void CompareInstanceSlices()
+{
+	SyntheticScene scene;
+	AddTriangles(scene, { 1.0f, 4.0f, 1 << 16 });
+	BuildScene(scene);
+	size_t firstGridCommand = scene.commands.size();
+	AddMeshletGrid(scene, 1);
+
+	std::vector<Instance> instances = GridInstances(10);
+	instances.insert(instances.begin(), scene.instance);
+	for (size_t command = firstGridCommand; command < scene.commands.size(); command++)
+	{
+		scene.commands[command].args.instanceCount = static_cast<unsigned int>(instances.size() - 1);
+	}
+
+	scene.buffers.positions = scene.positions.data();
+	scene.buffers.indices = scene.indices.data();
+	scene.buffers.instances = instances.data();
+
+	Rasterizer rasterizer;
+	RasterizationSettings settings;
+	settings.scanlineRasterization = false;
+
+	printf("\n%u threads, %zu commands, %zu of them with %zu instances\n",
+		rasterizer.GetThreadsCount(),
+		scene.commands.size(),
+		scene.commands.size() - firstGridCommand,
+		instances.size() - 1);
+	Table table({
+		{ "instances/job", -16 },
+		{ "jobs", 10 },
+		{ "ms", 10 },
+		{ "max job, ms", 14 },
+		{ "32 thr. bound", 16 },
+		{ "256 thr. bound", 16 },
+		{ "mismatches", 12 } });
+
+	DepthTarget reference;
+	DepthTarget depth;
+	reference.Resize(Width, Height);
+	depth.Resize(Width, Height);
+
+	settings.instancesPerJob = 0;
+	Run(rasterizer, settings, scene, reference);
+
+	for (unsigned int instancesPerJob : { 0u, 64u, 16u, 4u, 1u })
+	{
+		settings.instancesPerJob = instancesPerJob;
+		// the best of a few, the longest job is the one most disturbed by the rest of the machine
+		double seconds = 1e30;
+		double triangleSeconds = 1e30;
+		double maxJobSeconds = 1e30;
+		Statistics statistics;
+		for (int round = 0; round < 5; round++)
+		{
+			seconds = std::min(seconds, Run(rasterizer, settings, scene, depth, &statistics));
+			triangleSeconds = std::min(triangleSeconds, statistics.smallTrianglesSeconds);
+			maxJobSeconds = std::min(maxJobSeconds, statistics.maxTriangleJobSeconds);
+		}
+
+		// the pass can't be shorter than its longest job, nor than its work spread evenly over the threads
+		auto bound = [&](double threads)
+		{
+			return Format("%.3f", std::max(triangleSeconds / threads, maxJobSeconds) * 1000.0);
+		};
+
+		table.Row({
+			instancesPerJob == 0 ? "all" : Format("%u", instancesPerJob),
+			Format("%zu", statistics.triangleJobs),
+			Format("%.2f", seconds * 1000.0),
+			Format("%.3f", maxJobSeconds * 1000.0),
+			bound(32.0),
+			bound(256.0),
+			Format("%zu", CountMismatches(reference, depth)) });
+	}
+}
+
+#endif
+
+}
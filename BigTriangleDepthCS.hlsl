@@ -9,6 +9,7 @@ cbuffer DepthSceneCB : register(b0)
 	float2 InvOutputRes;
 	float BigTriangleThreshold;
 	float BigTriangleTileSize;
+	// the work graphs only, see USE_TOP_LEFT_RULE and USE_SCANLINE_RASTERIZATION
 	int UseTopLeftRule;
 	int ScanlineRasterization;
 	uint TotalTriangles;
@@ -16,10 +17,15 @@ cbuffer DepthSceneCB : register(b0)
 
 StructuredBuffer<uint> BigTriangles : register(t0);
 StructuredBuffer<Instance> Instances : register(t1);
+StructuredBuffer<uint> BigTriangleRecords : register(t2);
 
 RWTexture2D<uint> Depth : register(u0);
 
+#ifdef COMPACT_BIG_TRIANGLES
+groupshared uint Triangle[BIG_TRIANGLE_DEPTH_RECORD_FIELDS];
+#else
 groupshared uint Triangle[BIG_TRIANGLE_DEPTH_FIELDS];
+#endif
 
 groupshared float2 MinP;
 groupshared float2 MaxP;
@@ -39,6 +45,13 @@ groupshared float Area2;
 groupshared float2 Dxdy0;
 groupshared float2 Dxdy1;
 groupshared float2 Dxdy2;
+#ifdef FIXED_POINT_EDGES
+groupshared FixedPointEdges FixedEdges;
+groupshared bool FixedPoint;
+#endif
+#ifdef COARSE_TILE_CLASSIFICATION
+groupshared bool Covered;
+#endif
 
 #include "Common.hlsli"
 #include "Rasterization.hlsli"
@@ -50,15 +63,41 @@ void main(
 	uint3 groupThreadID : SV_GroupThreadID,
 	uint groupIndex : SV_GroupIndex)
 {
+#ifdef COMPACT_BIG_TRIANGLES
+	// same for the whole group
+	uint record = BigTriangles[groupID.x * BIG_TRIANGLE_TILE_FIELDS + TILE_RECORD_UINT];
+	if (groupIndex < BIG_TRIANGLE_DEPTH_RECORD_FIELDS)
+	{
+		Triangle[groupIndex] = BigTriangleRecords[record * BIG_TRIANGLE_DEPTH_RECORD_FIELDS + groupIndex];
+	}
+#else
 	if (groupIndex < BIG_TRIANGLE_DEPTH_FIELDS)
 	{
 		Triangle[groupIndex] = BigTriangles[groupID.x * BIG_TRIANGLE_DEPTH_FIELDS + groupIndex];
 	}
+#endif
 
-	GroupMemoryBarrier();
+	GroupMemoryBarrierWithGroupSync();
 
 	if (groupIndex == 0)
 	{
+#ifdef COMPACT_BIG_TRIANGLES
+		// the triangle pass has done the projection and the bounds already
+		float2 p0SS = asfloat(uint2(Triangle[RECORD_P0_SS_FLOAT2 + 0], Triangle[RECORD_P0_SS_FLOAT2 + 1]));
+		float2 p1SS = asfloat(uint2(Triangle[RECORD_P1_SS_FLOAT2 + 0], Triangle[RECORD_P1_SS_FLOAT2 + 1]));
+		float2 p2SS = asfloat(uint2(Triangle[RECORD_P2_SS_FLOAT2 + 0], Triangle[RECORD_P2_SS_FLOAT2 + 1]));
+
+		float z0NDC = asfloat(Triangle[RECORD_Z_NDC_FLOAT3 + 0]);
+		float z1NDC = asfloat(Triangle[RECORD_Z_NDC_FLOAT3 + 1]);
+		float z2NDC = asfloat(Triangle[RECORD_Z_NDC_FLOAT3 + 2]);
+
+		float area = asfloat(Triangle[RECORD_AREA_FLOAT]);
+
+		float2 minP = asfloat(uint2(Triangle[RECORD_MIN_P_FLOAT2 + 0], Triangle[RECORD_MIN_P_FLOAT2 + 1]));
+		float2 maxP = asfloat(uint2(Triangle[RECORD_MAX_P_FLOAT2 + 0], Triangle[RECORD_MAX_P_FLOAT2 + 1]));
+		float tilesCountX = asfloat(Triangle[RECORD_TILES_X_FLOAT]);
+		float tileOffset = asfloat(BigTriangles[groupID.x * BIG_TRIANGLE_TILE_FIELDS + TILE_OFFSET_FLOAT]);
+#else
 		// no tests for this triangle, since it had passed them already
 
 		// WS -> VS -> CS
@@ -74,6 +113,9 @@ void main(
 		GetSSPositions(p0CS.xy, p1CS.xy, p2CS.xy, invW0, invW1, invW2, p0SS, p1SS, p2SS);
 
 		float area = Area(p0SS.xy, p1SS.xy, p2SS.xy);
+#ifdef FIXED_POINT_EDGES
+		SnapVertices(p0SS, p1SS, p2SS, area);
+#endif
 
 		float z0NDC = p0CS.z * invW0;
 		float z1NDC = p1CS.z * invW1;
@@ -85,11 +127,23 @@ void main(
 		ClampToScreenBounds(minP.xy, maxP.xy);
 		minP.xy = SnapMinBoundToPixelCenter(minP.xy);
 		float2 dimensions = maxP.xy - minP.xy;
-		float2 tileCount = ceil(dimensions / BigTriangleTileSize);
-		float yTileOffset = floor(asfloat(Triangle[TILE_OFFSET_FLOAT]) / tileCount.x);
-		float xTileOffset = asfloat(Triangle[TILE_OFFSET_FLOAT]) - yTileOffset * tileCount.x;
-		MinP = minP.xy + float2(xTileOffset, yTileOffset) * BigTriangleTileSize;
-		MaxP = min(maxP.xy, MinP + BigTriangleTileSize.xx);
+		float tilesCountX = ceil(dimensions.x / BigTriangleTileSize);
+		float tileOffset = asfloat(Triangle[TILE_OFFSET_FLOAT]);
+
+		InvW0 = invW0;
+		InvW1 = invW1;
+		InvW2 = invW2;
+#endif
+
+#ifdef COARSE_TILE_CLASSIFICATION
+		bool covered;
+		tileOffset = DecodeTileOffset(tileOffset, covered);
+		Covered = covered;
+#endif
+		float2 tileMinP, tileMaxP;
+		GetBigTriangleTile(minP.xy, maxP.xy, tilesCountX, tileOffset, tileMinP, tileMaxP);
+		MinP = tileMinP;
+		MaxP = tileMaxP;
 
 		P0SS = p0SS;
 		P1SS = p1SS;
@@ -97,15 +151,21 @@ void main(
 		Z0NDC = z0NDC;
 		Z1NDC = z1NDC;
 		Z2NDC = z2NDC;
-		InvW0 = invW0;
-		InvW1 = invW1;
-		InvW2 = invW2;
 		InvArea = 1.0 / area;
 
 		// https://www.cs.drexel.edu/~david/Classes/Papers/comp175-06-pineda.pdf
 		EdgeFunction(p1SS.xy, p2SS.xy, MinP, Area0, Dxdy0);
 		EdgeFunction(p2SS.xy, p0SS.xy, MinP, Area1, Dxdy1);
 		EdgeFunction(p0SS.xy, p1SS.xy, MinP, Area2, Dxdy2);
+#ifdef FIXED_POINT_EDGES
+		FixedPointEdges fixedEdges;
+		FixedPoint = SetupFixedPointEdges(p0SS.xy, p1SS.xy, p2SS.xy, MinP, USE_TOP_LEFT_RULE, fixedEdges);
+		FixedEdges = fixedEdges;
+		if (FixedPoint)
+		{
+			InvArea = fixedEdges.invArea;
+		}
+#endif
 	}
 
 	GroupMemoryBarrierWithGroupSync();
@@ -133,7 +193,15 @@ void main(
 
 			// edge tests, "frustum culling" for 3 lines in 2D
 			bool insideTriangle = true;
-			if (UseTopLeftRule)
+#ifdef COARSE_TILE_CLASSIFICATION
+			// every pixel center of a covered tile is inside
+			if (Covered)
+			{
+				insideTriangle = true;
+			}
+			else
+#endif
+			if (USE_TOP_LEFT_RULE)
 			{
 				insideTriangle = insideTriangle && (EdgeIsTopLeft(P1SS.xy, P2SS.xy) ? (area0 >= 0.0) : (area0 > 0.0));
 				insideTriangle = insideTriangle && (EdgeIsTopLeft(P2SS.xy, P0SS.xy) ? (area1 >= 0.0) : (area1 > 0.0));
@@ -143,6 +211,17 @@ void main(
 			{
 				insideTriangle = area0 >= 0.0 && area1 >= 0.0 && area2 >= 0.0;
 			}
+#ifdef FIXED_POINT_EDGES
+			if (FixedPoint)
+			{
+				// E(x + a, y + b) = E(x, y) + a * stepX + b * stepY, exact
+				FixedPoint3 fixedArea = FixedEdges.area + FixedPoint(float(xOffset)) * FixedEdges.stepX + FixedPoint(float(yOffset)) * FixedEdges.stepY;
+				insideTriangle = all(fixedArea >= 0);
+				// unbiased, for the barycentric weights
+				area0 = float(fixedArea.x - FixedEdges.bias.x);
+				area1 = float(fixedArea.y - FixedEdges.bias.y);
+			}
+#endif
 
 			[branch]
 			if (insideTriangle)
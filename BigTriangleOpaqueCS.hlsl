@@ -15,6 +15,7 @@ cbuffer SceneCB : register(b0)
 	float BigTriangleTileSize;
 	int ShowCascades;
 	int ShowMeshlets;
+	// the work graphs only, see USE_TOP_LEFT_RULE and USE_SCANLINE_RASTERIZATION
 	int UseTopLeftRule;
 	int CascadesCount;
 	int ScanlineRasterization;
@@ -28,10 +29,15 @@ StructuredBuffer<uint> BigTriangles : register(t0);
 StructuredBuffer<Instance> Instances : register(t1);
 Texture2D Depth : register(t2);
 Texture2DArray ShadowMap : register(t3);
+StructuredBuffer<uint> BigTriangleRecords : register(t4);
 
 RWTexture2D<float4> RenderTarget : register(u0);
 
+#ifdef COMPACT_BIG_TRIANGLES
+groupshared uint Triangle[BIG_TRIANGLE_OPAQUE_RECORD_FIELDS];
+#else
 groupshared uint Triangle[BIG_TRIANGLE_OPAQUE_FIELDS];
+#endif
 
 groupshared float2 MinP;
 groupshared float2 MaxP;
@@ -63,6 +69,13 @@ groupshared float Area2;
 groupshared float2 Dxdy0;
 groupshared float2 Dxdy1;
 groupshared float2 Dxdy2;
+#ifdef FIXED_POINT_EDGES
+groupshared FixedPointEdges FixedEdges;
+groupshared bool FixedPoint;
+#endif
+#ifdef COARSE_TILE_CLASSIFICATION
+groupshared bool Covered;
+#endif
 
 #include "Common.hlsli"
 #include "Rasterization.hlsli"
@@ -74,15 +87,61 @@ void main(
 	uint3 groupThreadID : SV_GroupThreadID,
 	uint groupIndex : SV_GroupIndex)
 {
+#ifdef COMPACT_BIG_TRIANGLES
+	// same for the whole group
+	uint record = BigTriangles[groupID.x * BIG_TRIANGLE_TILE_FIELDS + TILE_RECORD_UINT];
+	if (groupIndex < BIG_TRIANGLE_OPAQUE_RECORD_FIELDS)
+	{
+		Triangle[groupIndex] = BigTriangleRecords[record * BIG_TRIANGLE_OPAQUE_RECORD_FIELDS + groupIndex];
+	}
+#else
 	if (groupIndex < BIG_TRIANGLE_OPAQUE_FIELDS)
 	{
 		Triangle[groupIndex] = BigTriangles[groupID.x * BIG_TRIANGLE_OPAQUE_FIELDS + groupIndex];
 	}
+#endif
 
-	GroupMemoryBarrier();
+	GroupMemoryBarrierWithGroupSync();
 
 	if (groupIndex == 0)
 	{
+#ifdef COMPACT_BIG_TRIANGLES
+		// the triangle pass has done the projection and the bounds already
+		float2 p0SS = asfloat(uint2(Triangle[RECORD_P0_SS_FLOAT2 + 0], Triangle[RECORD_P0_SS_FLOAT2 + 1]));
+		float2 p1SS = asfloat(uint2(Triangle[RECORD_P1_SS_FLOAT2 + 0], Triangle[RECORD_P1_SS_FLOAT2 + 1]));
+		float2 p2SS = asfloat(uint2(Triangle[RECORD_P2_SS_FLOAT2 + 0], Triangle[RECORD_P2_SS_FLOAT2 + 1]));
+
+		float z0NDC = asfloat(Triangle[RECORD_Z_NDC_FLOAT3 + 0]);
+		float z1NDC = asfloat(Triangle[RECORD_Z_NDC_FLOAT3 + 1]);
+		float z2NDC = asfloat(Triangle[RECORD_Z_NDC_FLOAT3 + 2]);
+
+		float invW0 = asfloat(Triangle[RECORD_INV_W_FLOAT3 + 0]);
+		float invW1 = asfloat(Triangle[RECORD_INV_W_FLOAT3 + 1]);
+		float invW2 = asfloat(Triangle[RECORD_INV_W_FLOAT3 + 2]);
+
+		float area = asfloat(Triangle[RECORD_AREA_FLOAT]);
+
+		float2 minP = asfloat(uint2(Triangle[RECORD_MIN_P_FLOAT2 + 0], Triangle[RECORD_MIN_P_FLOAT2 + 1]));
+		float2 maxP = asfloat(uint2(Triangle[RECORD_MAX_P_FLOAT2 + 0], Triangle[RECORD_MAX_P_FLOAT2 + 1]));
+		float tilesCountX = asfloat(Triangle[RECORD_TILES_X_FLOAT]);
+		float tileOffset = asfloat(BigTriangles[groupID.x * BIG_TRIANGLE_TILE_FIELDS + TILE_OFFSET_FLOAT]);
+
+		P0WS = asfloat(uint3(Triangle[RECORD_P0_WS_FLOAT3 + 0], Triangle[RECORD_P0_WS_FLOAT3 + 1], Triangle[RECORD_P0_WS_FLOAT3 + 2]));
+		P1WS = asfloat(uint3(Triangle[RECORD_P1_WS_FLOAT3 + 0], Triangle[RECORD_P1_WS_FLOAT3 + 1], Triangle[RECORD_P1_WS_FLOAT3 + 2]));
+		P2WS = asfloat(uint3(Triangle[RECORD_P2_WS_FLOAT3 + 0], Triangle[RECORD_P2_WS_FLOAT3 + 1], Triangle[RECORD_P2_WS_FLOAT3 + 2]));
+
+		N0 = UnpackNormal(Triangle[RECORD_N0_PACKED_UINT]);
+		N1 = UnpackNormal(Triangle[RECORD_N1_PACKED_UINT]);
+		N2 = UnpackNormal(Triangle[RECORD_N2_PACKED_UINT]);
+
+		C0 = UnpackColor(uint2(Triangle[RECORD_C0_PACKED_UINT2 + 0], Triangle[RECORD_C0_PACKED_UINT2 + 1]));
+		C1 = UnpackColor(uint2(Triangle[RECORD_C1_PACKED_UINT2 + 0], Triangle[RECORD_C1_PACKED_UINT2 + 1]));
+		C2 = UnpackColor(uint2(Triangle[RECORD_C2_PACKED_UINT2 + 0], Triangle[RECORD_C2_PACKED_UINT2 + 1]));
+
+		UV0 = UnpackTexcoords(Triangle[RECORD_UV0_PACKED_UINT]);
+		UV1 = UnpackTexcoords(Triangle[RECORD_UV1_PACKED_UINT]);
+		UV2 = UnpackTexcoords(Triangle[RECORD_UV2_PACKED_UINT]);
+#else
 		// no tests for this triangle, since it had passed them already
 
 		P0WS = asfloat(uint3(Triangle[P0_WS_FLOAT3 + 0], Triangle[P0_WS_FLOAT3 + 1], Triangle[P0_WS_FLOAT3 + 2]));
@@ -102,6 +161,9 @@ void main(
 		GetSSPositions(p0CS.xy, p1CS.xy, p2CS.xy, invW0, invW1, invW2, p0SS, p1SS, p2SS);
 
 		float area = Area(p0SS.xy, p1SS.xy, p2SS.xy);
+#ifdef FIXED_POINT_EDGES
+		SnapVertices(p0SS, p1SS, p2SS, area);
+#endif
 
 		float z0NDC = p0CS.z * invW0;
 		float z1NDC = p1CS.z * invW1;
@@ -113,11 +175,8 @@ void main(
 		ClampToScreenBounds(minP.xy, maxP.xy);
 		minP.xy = SnapMinBoundToPixelCenter(minP.xy);
 		float2 dimensions = maxP.xy - minP.xy;
-		float2 tileCount = ceil(dimensions / BigTriangleTileSize);
-		float yTileOffset = floor(asfloat(Triangle[TILE_OFFSET_FLOAT]) / tileCount.x);
-		float xTileOffset = asfloat(Triangle[TILE_OFFSET_FLOAT]) - yTileOffset * tileCount.x;
-		MinP = minP.xy + float2(xTileOffset, yTileOffset) * BigTriangleTileSize;
-		MaxP = min(maxP.xy, MinP + BigTriangleTileSize.xx);
+		float tilesCountX = ceil(dimensions.x / BigTriangleTileSize);
+		float tileOffset = asfloat(Triangle[TILE_OFFSET_FLOAT]);
 
 		N0 = UnpackNormal(Triangle[N0_PACKED_UINT]);
 		N1 = UnpackNormal(Triangle[N1_PACKED_UINT]);
@@ -126,6 +185,11 @@ void main(
 		C0 = UnpackColor(uint2(Triangle[C0_PACKED_UINT2 + 0], Triangle[C0_PACKED_UINT2 + 1]));
 		C1 = UnpackColor(uint2(Triangle[C1_PACKED_UINT2 + 0], Triangle[C1_PACKED_UINT2 + 1]));
 		C2 = UnpackColor(uint2(Triangle[C2_PACKED_UINT2 + 0], Triangle[C2_PACKED_UINT2 + 1]));
+
+		UV0 = UnpackTexcoords(Triangle[UV0_PACKED_UINT]);
+		UV1 = UnpackTexcoords(Triangle[UV1_PACKED_UINT]);
+		UV2 = UnpackTexcoords(Triangle[UV2_PACKED_UINT]);
+#endif
 		//if (ShowMeshlets)
 		//{
 		//	C0 = float4(instance.color, 1.0);
@@ -133,9 +197,15 @@ void main(
 		//	C2 = float4(instance.color, 1.0);
 		//}
 
-		UV0 = UnpackTexcoords(Triangle[UV0_PACKED_UINT]);
-		UV1 = UnpackTexcoords(Triangle[UV1_PACKED_UINT]);
-		UV2 = UnpackTexcoords(Triangle[UV2_PACKED_UINT]);
+#ifdef COARSE_TILE_CLASSIFICATION
+		bool covered;
+		tileOffset = DecodeTileOffset(tileOffset, covered);
+		Covered = covered;
+#endif
+		float2 tileMinP, tileMaxP;
+		GetBigTriangleTile(minP.xy, maxP.xy, tilesCountX, tileOffset, tileMinP, tileMaxP);
+		MinP = tileMinP;
+		MaxP = tileMaxP;
 
 		P0SS = p0SS;
 		P1SS = p1SS;
@@ -152,6 +222,15 @@ void main(
 		EdgeFunction(p1SS.xy, p2SS.xy, MinP, Area0, Dxdy0);
 		EdgeFunction(p2SS.xy, p0SS.xy, MinP, Area1, Dxdy1);
 		EdgeFunction(p0SS.xy, p1SS.xy, MinP, Area2, Dxdy2);
+#ifdef FIXED_POINT_EDGES
+		FixedPointEdges fixedEdges;
+		FixedPoint = SetupFixedPointEdges(p0SS.xy, p1SS.xy, p2SS.xy, MinP, USE_TOP_LEFT_RULE, fixedEdges);
+		FixedEdges = fixedEdges;
+		if (FixedPoint)
+		{
+			InvArea = fixedEdges.invArea;
+		}
+#endif
 	}
 
 	GroupMemoryBarrierWithGroupSync();
@@ -179,7 +258,15 @@ void main(
 
 			// edge tests, "frustum culling" for 3 lines in 2D
 			bool insideTriangle = true;
-			if (UseTopLeftRule)
+#ifdef COARSE_TILE_CLASSIFICATION
+			// every pixel center of a covered tile is inside
+			if (Covered)
+			{
+				insideTriangle = true;
+			}
+			else
+#endif
+			if (USE_TOP_LEFT_RULE)
 			{
 				insideTriangle = insideTriangle && (EdgeIsTopLeft(P1SS.xy, P2SS.xy) ? (area0 >= 0.0) : (area0 > 0.0));
 				insideTriangle = insideTriangle && (EdgeIsTopLeft(P2SS.xy, P0SS.xy) ? (area1 >= 0.0) : (area1 > 0.0));
@@ -189,6 +276,17 @@ void main(
 			{
 				insideTriangle = area0 >= 0.0 && area1 >= 0.0 && area2 >= 0.0;
 			}
+#ifdef FIXED_POINT_EDGES
+			if (FixedPoint)
+			{
+				// E(x + a, y + b) = E(x, y) + a * stepX + b * stepY, exact
+				FixedPoint3 fixedArea = FixedEdges.area + FixedPoint(float(xOffset)) * FixedEdges.stepX + FixedPoint(float(yOffset)) * FixedEdges.stepY;
+				insideTriangle = all(fixedArea >= 0);
+				// unbiased, for the barycentric weights
+				area0 = float(fixedArea.x - FixedEdges.bias.x);
+				area1 = float(fixedArea.y - FixedEdges.bias.y);
+			}
+#endif
 
 			[branch]
 			if (insideTriangle)
@@ -0,0 +1,152 @@
+#include "BigTriangleTuning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace CPURasterizer
+{
+
+double Percentile(std::vector<double> values, double percentile)
+{
+	if (values.empty())
+	{
+		return 0.0;
+	}
+
+	std::sort(values.begin(), values.end());
+	size_t rank = static_cast<size_t>(ceil(percentile / 100.0 * values.size()));
+	return values[std::min(std::max(rank, size_t(1)), values.size()) - 1];
+}
+
+std::vector<SweepResult> SweepBigTriangles(
+	Rasterizer& rasterizer,
+	const RasterizationSettings& base,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const std::vector<Float4x4>& cameraPath,
+	const std::vector<float>& thresholds,
+	const std::vector<float>& tileSizes,
+	const std::vector<unsigned int>& trianglesPerJob,
+	DepthTarget& depth)
+{
+	std::vector<SweepResult> results;
+	std::vector<double> frameTimes(cameraPath.size());
+
+	for (float threshold : thresholds)
+	{
+		for (float tileSize : tileSizes)
+		{
+			for (unsigned int jobSize : trianglesPerJob)
+			{
+				RasterizationSettings settings = base;
+				settings.bigTriangleThreshold = threshold;
+				settings.bigTriangleTileSize = tileSize;
+				settings.trianglesPerJob = jobSize;
+				rasterizer.SetSettings(settings);
+
+				SweepResult result = {};
+				result.configuration = { threshold, tileSize, jobSize };
+
+				for (size_t frame = 0; frame < cameraPath.size(); frame++)
+				{
+					depth.Clear();
+					auto start = std::chrono::steady_clock::now();
+					Statistics statistics = rasterizer.DrawDepth(
+						scene,
+						commands,
+						commandsCount,
+						cameraPath[frame],
+						depth);
+					std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+
+					frameTimes[frame] = time.count();
+					result.mean += time.count();
+					result.bigTriangleTiles += static_cast<double>(statistics.bigTriangleTiles);
+				}
+
+				double framesCount = static_cast<double>(std::max(cameraPath.size(), size_t(1)));
+				result.mean /= framesCount;
+				result.bigTriangleTiles /= framesCount;
+				result.p50 = Percentile(frameTimes, 50.0);
+				result.p95 = Percentile(frameTimes, 95.0);
+				result.p99 = Percentile(frameTimes, 99.0);
+				results.push_back(result);
+			}
+		}
+	}
+
+	rasterizer.SetSettings(base);
+
+	return results;
+}
+
+const SweepResult* FindBestConfiguration(const std::vector<SweepResult>& results)
+{
+	const SweepResult* best = nullptr;
+	for (const SweepResult& result : results)
+	{
+		if (!best ||
+			result.p95 < best->p95 ||
+			(result.p95 == best->p95 && result.mean < best->mean))
+		{
+			best = &result;
+		}
+	}
+
+	return best;
+}
+
+void BigTriangleTuner::Reset(float threshold)
+{
+	_threshold = std::min(std::max(threshold, MinThreshold), MaxThreshold);
+	_direction = 0;
+	_framesMeasured = 0;
+	_smallTrianglesSeconds = 0.0;
+	_bigTrianglesSeconds = 0.0;
+	_previousCost = 0.0;
+}
+
+float BigTriangleTuner::Update(double smallTrianglesSeconds, double bigTrianglesSeconds)
+{
+	_smallTrianglesSeconds += smallTrianglesSeconds;
+	_bigTrianglesSeconds += bigTrianglesSeconds;
+	_framesMeasured++;
+	if (_framesMeasured < FramesPerStep)
+	{
+		return _threshold;
+	}
+
+	double cost = (_smallTrianglesSeconds + _bigTrianglesSeconds) / _framesMeasured;
+	bool hold = false;
+	if (_direction == 0)
+	{
+		// the big triangles pass dominating means too many triangles are sent there
+		_direction = _bigTrianglesSeconds > _smallTrianglesSeconds ? 1 : -1;
+	}
+	else if (cost > _previousCost * (1.0 + Tolerance))
+	{
+		// the last step made it worse, go back and try the other side
+		_direction = -_direction;
+	}
+	else if (cost >= _previousCost * (1.0 - Tolerance))
+	{
+		hold = true;
+	}
+
+	if (!hold)
+	{
+		float step = _direction > 0 ? Step : 1.0f / Step;
+		_threshold = std::min(std::max(_threshold * step, MinThreshold), MaxThreshold);
+	}
+
+	_previousCost = cost;
+	_framesMeasured = 0;
+	_smallTrianglesSeconds = 0.0;
+	_bigTrianglesSeconds = 0.0;
+
+	return _threshold;
+}
+
+}
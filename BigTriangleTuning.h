@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CPURasterizer.h"
+
+#include <vector>
+
+// big triangles threshold and tile size tuning with the CPU rasterizer, so it runs on hosts without a GPU:
+// a sweep over a camera path, which reports depth pass frame time percentiles per configuration,
+// and a runtime tuner, which moves the threshold every few frames towards the cheaper frame
+namespace CPURasterizer
+{
+
+struct BigTrianglesConfiguration
+{
+	float bigTriangleThreshold;
+	float bigTriangleTileSize;
+	unsigned int trianglesPerJob;
+};
+
+struct SweepResult
+{
+	BigTrianglesConfiguration configuration;
+	// frame times over the path, ms
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+	// per frame average
+	double bigTriangleTiles;
+};
+
+// nearest rank, percentile in [0, 100]
+double Percentile(std::vector<double> values, double percentile);
+
+// every combination of the lists, one depth pass per camera path frame, base provides the rest of the settings
+std::vector<SweepResult> SweepBigTriangles(
+	Rasterizer& rasterizer,
+	const RasterizationSettings& base,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const std::vector<Float4x4>& cameraPath,
+	const std::vector<float>& thresholds,
+	const std::vector<float>& tileSizes,
+	const std::vector<unsigned int>& trianglesPerJob,
+	DepthTarget& depth);
+
+// the lowest p95, so the unstable configurations lose, then the lowest mean, nullptr if empty
+const SweepResult* FindBestConfiguration(const std::vector<SweepResult>& results);
+
+// hill climbing on the small plus big triangles passes time, averaged over FramesPerStep frames,
+// the first step is towards the cheaper path, a worse total turns it back, a change within the noise holds it
+class BigTriangleTuner
+{
+public:
+
+	static const unsigned int FramesPerStep = 4;
+	// multiplicative, a third of an octave
+	static constexpr float Step = 1.26f;
+	// relative, changes below it are noise
+	static constexpr double Tolerance = 0.03;
+	static constexpr float MinThreshold = 64.0f;
+	static constexpr float MaxThreshold = 262144.0f;
+
+	explicit BigTriangleTuner(float threshold = 4096.0f) { Reset(threshold); }
+
+	void Reset(float threshold);
+
+	// passes times of the frame rendered with GetThreshold(), returns the threshold for the next one
+	float Update(double smallTrianglesSeconds, double bigTrianglesSeconds);
+
+	float GetThreshold() const { return _threshold; }
+
+private:
+
+	float _threshold = 0.0f;
+	// 0 before the first step
+	int _direction = 0;
+	unsigned int _framesMeasured = 0;
+	double _smallTrianglesSeconds = 0.0;
+	double _bigTrianglesSeconds = 0.0;
+	double _previousCost = 0.0;
+};
+
+}
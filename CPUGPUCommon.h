@@ -4,6 +4,12 @@
 #define CULLING_THREADS_X 64
 #define CULLING_THREADS_Y 1
 #define CULLING_THREADS_Z 1
+// bigger culling dispatches spill into the Y dimension
+#define CULLING_MAX_GROUPS_X 65535
+
+// culling results compaction, no atomics, a block of (object, mesh) pairs or meshes per thread group,
+// visible ones are counted per frustum and block, the counts scanned, then scattered, see CompactionCS.hlsl
+#define COMPACTION_THREADS_X 256
 
 #define HIZ_THREADS_X 8
 #define HIZ_THREADS_Y 8
@@ -20,6 +26,7 @@
 #define SWR_BIG_TRIANGLE_THREADS_Z 1
 
 #define MESHLET_SIZE 256
+#define MESHLET_MAX_VERTICES 128
 
 #define TRIANGLES_PER_THREAD ((MESHLET_SIZE) / (SWR_TRIANGLE_THREADS_X))
 #define SWR_THREAD_GROUPS_Y ((MESHLET_SIZE) / (SWR_TRIANGLE_THREADS_X))
@@ -29,11 +36,60 @@
 #define MAX_FRUSTUMS_COUNT ((CAMERAS_COUNT) + (MAX_CASCADES_COUNT))
 #define BIG_TRIANGLES_BUFFERS (2 + MAX_CASCADES_COUNT)
 
+// CullingCS routes every camera visible meshlet by its average triangle area, the screen area of its bounding sphere
+// over its triangles, see ClusterRouting.h, micro triangle ones stay in the camera list of culled commands,
+// the others get lists of their own, after the frustums ones, see Settings::ClusterRoutingEnabled
+#define CLUSTER_ROUTE_SOFTWARE_MICRO 0
+#define CLUSTER_ROUTE_SOFTWARE_BIG 1
+#define CLUSTER_ROUTE_HARDWARE 2
+#define CLUSTER_ROUTES_COUNT 3
+// pixels, at most for the SW triangles pass, at least for the SW big triangles one, the rest goes to the HW,
+// triangles fill about half of their AABB, so the big one is about half of the big triangle threshold
+#define CLUSTER_ROUTING_MICRO_TRIANGLE_AREA 32.0
+#define CLUSTER_ROUTING_BIG_TRIANGLE_AREA 2048.0
+// culled instances and commands lists, a frustum each, then the routed camera ones
+#define SOFTWARE_BIG_CULLING_LIST (MAX_FRUSTUMS_COUNT)
+#define HARDWARE_CULLING_LIST ((MAX_FRUSTUMS_COUNT) + 1)
+#define CULLING_LISTS_COUNT ((MAX_FRUSTUMS_COUNT) + 2)
+
+// SW rasterizer fetches triangles as 8-bit meshlet-local indices,
+// resolved through per-meshlet vertex lists
+// 32-bit indices are kept only for the HW index buffer
+#define MESHLET_INDICES
+
+// SW triangle shaders transform a meshlet's vertices once per instance into groupshared memory,
+// the whole group syncs on every instance, instead of transforming 3 vertices per triangle, needs MESHLET_INDICES
+//#define MESHLET_VERTEX_CACHE
+
+// GenerateCommandsCS splits commands with more instances than INSTANCES_PER_SLICE into slices of them,
+// a SW thread group each, instead of a group looping over every instance of its meshlet
+//#define INSTANCE_SLICES
+#define INSTANCES_PER_SLICE 16
+
+#ifndef MESHLET_INDICES
 #define GPU_SOA_BUFFERS
+#endif
 #ifdef GPU_SOA_BUFFERS
 #define INDICES_STRIDE 3
 #endif
 
+// 16-bit unorm positions relative to the bounds of their vertex range (an OBJ group)
+//#define QUANTIZED_POSITIONS
+#ifdef QUANTIZED_POSITIONS
+// startInstanceLocation + positions origin + positions scale + meshID
+#define DRAW_CALL_CONSTANTS 8
+#else
+// startInstanceLocation + meshID
+#define DRAW_CALL_CONSTANTS 2
+#endif
+
+// SW rasterizer edge functions in 64-bit integers, vertices snapped to sub-pixels,
+// instead of 32-bit floats, triangles outside of the guard band (in pixels) stay on floats
+//#define FIXED_POINT_EDGES
+#define FIXED_POINT_SUBPIXEL_BITS 8
+#define FIXED_POINT_SUBPIXEL_STEPS (1 << (FIXED_POINT_SUBPIXEL_BITS))
+#define FIXED_POINT_GUARD_BAND 16384.0
+
 #define TILE_OFFSET_FLOAT 0
 #define P0_WS_FLOAT3 1
 #define P1_WS_FLOAT3 4
@@ -53,6 +109,64 @@
 
 #define BIG_TRIANGLE_OPAQUE_FIELDS (UV2_PACKED_UINT + 1)
 
+// a record per big triangle, with the setup the triangle pass has already done,
+// plus a small entry per tile, which points at it, instead of the whole triangle per tile
+//#define COMPACT_BIG_TRIANGLES
+
+// tile entry, TILE_OFFSET_FLOAT is shared with the layout above
+#define TILE_RECORD_UINT 1
+#define BIG_TRIANGLE_TILE_FIELDS 2
+
+// record, min is snapped to a pixel center, both bounds are clamped to the screen
+#define RECORD_P0_SS_FLOAT2 0
+#define RECORD_P1_SS_FLOAT2 2
+#define RECORD_P2_SS_FLOAT2 4
+#define RECORD_Z_NDC_FLOAT3 6
+#define RECORD_AREA_FLOAT 9
+#define RECORD_MIN_P_FLOAT2 10
+#define RECORD_MAX_P_FLOAT2 12
+#define RECORD_TILES_X_FLOAT 14
+#define RECORD_INV_W_FLOAT3 16
+#define RECORD_P0_WS_FLOAT3 19
+#define RECORD_P1_WS_FLOAT3 22
+#define RECORD_P2_WS_FLOAT3 25
+#define RECORD_N0_PACKED_UINT 28
+#define RECORD_N1_PACKED_UINT 29
+#define RECORD_N2_PACKED_UINT 30
+#define RECORD_C0_PACKED_UINT2 31
+#define RECORD_C1_PACKED_UINT2 33
+#define RECORD_C2_PACKED_UINT2 35
+#define RECORD_UV0_PACKED_UINT 37
+#define RECORD_UV1_PACKED_UINT 38
+#define RECORD_UV2_PACKED_UINT 39
+
+// the records are in their own buffers, a record per tile entry of the per tile layout,
+// the depth one is padded to 16 uints
+#define BIG_TRIANGLE_DEPTH_RECORD_FIELDS (RECORD_INV_W_FLOAT3)
+#define BIG_TRIANGLE_OPAQUE_RECORD_FIELDS (RECORD_UV2_PACKED_UINT + 1)
+
+// big triangle tiles are tested against the edges at their corners, while they are appended,
+// tiles outside of the triangle are dropped, fully covered ones skip the edge tests,
+// they are flagged with the sign bit of their tile offset
+//#define COARSE_TILE_CLASSIFICATION
+#define TILE_OUTSIDE 0
+#define TILE_PARTIAL 1
+#define TILE_COVERED 2
+
+// SW rasterizer statistics buffer, records and tiles are counted per big triangles buffer,
+// i.e. per frustum, then the opaque one
+#define PIPELINE_TRIANGLES_STAT 0
+#define RENDERED_TRIANGLES_STAT 1
+#define BIG_TRIANGLE_RECORDS_STAT 2
+#define BIG_TRIANGLE_TILES_STAT ((BIG_TRIANGLE_RECORDS_STAT) + (BIG_TRIANGLES_BUFFERS))
+// COARSE_TILE_CLASSIFICATION, dropped tiles aren't in the tiles above, covered ones are
+#define BIG_TRIANGLE_OUTSIDE_TILES_STAT ((BIG_TRIANGLE_TILES_STAT) + (BIG_TRIANGLES_BUFFERS))
+#define BIG_TRIANGLE_COVERED_TILES_STAT ((BIG_TRIANGLE_OUTSIDE_TILES_STAT) + (BIG_TRIANGLES_BUFFERS))
+// COMPACT_BIG_TRIANGLES, big triangles which didn't get a record, so weren't rasterized
+#define BIG_TRIANGLE_DROPPED_STAT ((BIG_TRIANGLE_COVERED_TILES_STAT) + (BIG_TRIANGLES_BUFFERS))
+#define SWR_STATS_COUNT ((BIG_TRIANGLE_DROPPED_STAT) + (BIG_TRIANGLES_BUFFERS))
+#define OPAQUE_BIG_TRIANGLES_BUFFER (MAX_FRUSTUMS_COUNT)
+
 // work graphs specific macros
 
 #define USE_WORK_GRAPHS
@@ -0,0 +1,1164 @@
+#include "CPURasterizerInternal.h"
+
+namespace CPURasterizer
+{
+
+void GetTrianglePositions(
+	const SceneBuffers& scene,
+	const IndirectCommand& command,
+	unsigned int triangleIndex,
+	Float3 positions[3])
+{
+	unsigned int i0, i1, i2;
+	GetTriangleIndices(scene, command, triangleIndex, i0, i1, i2);
+
+	positions[0] = GetVertexPosition(scene, command, i0);
+	positions[1] = GetVertexPosition(scene, command, i1);
+	positions[2] = GetVertexPosition(scene, command, i2);
+}
+
+void DepthTarget::Resize(int width, int height)
+{
+	_width = width;
+	_height = height;
+	_depth.reset(new std::atomic<unsigned int>[static_cast<size_t>(width) * height]);
+	Clear();
+}
+
+void DepthTarget::Clear()
+{
+	// reversed Z
+	size_t texelsCount = static_cast<size_t>(_width) * _height;
+	for (size_t texel = 0; texel < texelsCount; texel++)
+	{
+		_depth[texel].store(0, std::memory_order_relaxed);
+	}
+}
+
+void DepthTarget::WriteMax(int x, int y, float depth)
+{
+	// InterlockedMax(Depth[uint2(x, y)], asuint(depth))
+	unsigned int value = AsUint(depth);
+	std::atomic<unsigned int>& texel = _depth[static_cast<size_t>(y) * _width + x];
+	unsigned int current = texel.load(std::memory_order_relaxed);
+	while (current < value && !texel.compare_exchange_weak(current, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+void DepthTarget::WriteMaxExclusive(int x, int y, float depth)
+{
+	// plain load and store, no read-modify-write
+	unsigned int value = AsUint(depth);
+	std::atomic<unsigned int>& texel = _depth[static_cast<size_t>(y) * _width + x];
+	if (texel.load(std::memory_order_relaxed) < value)
+	{
+		texel.store(value, std::memory_order_relaxed);
+	}
+}
+
+float DepthTarget::GetDepth(int x, int y) const
+{
+	return AsFloat(_depth[static_cast<size_t>(y) * _width + x].load(std::memory_order_relaxed));
+}
+
+float DepthTarget::Sample(float u, float v) const
+{
+	int x = static_cast<int>(floorf(u * _width));
+	int y = static_cast<int>(floorf(v * _height));
+	return GetDepth(
+		std::min(std::max(x, 0), _width - 1),
+		std::min(std::max(y, 0), _height - 1));
+}
+
+void ColorTarget::Resize(int width, int height)
+{
+	_width = width;
+	_height = height;
+	_pixels.assign(static_cast<size_t>(width) * height, 0);
+}
+
+void ColorTarget::Clear(const float color[4])
+{
+	std::fill(_pixels.begin(), _pixels.end(), PackUnorm({ color[0], color[1], color[2], color[3] }));
+}
+
+void ColorTarget::SetPixel(int x, int y, const Float4& color)
+{
+	_pixels[static_cast<size_t>(y) * _width + x] = PackUnorm(color);
+}
+
+Rasterizer::Rasterizer(unsigned int threadsCount) :
+	_threadPool(threadsCount)
+{
+}
+
+Rasterizer::~Rasterizer() = default;
+
+void Rasterizer::_resetBins(const Float2& outputRes)
+{
+	_binsCountX = (static_cast<unsigned int>(outputRes.x) + _settings.binSize - 1) / _settings.binSize;
+	_binsCountY = (static_cast<unsigned int>(outputRes.y) + _settings.binSize - 1) / _settings.binSize;
+
+	// memory is kept between passes
+	_binningArenas.resize(_threadPool.GetThreadsCount());
+	for (auto& arena : _binningArenas)
+	{
+		if (!arena)
+		{
+			arena = std::make_unique<BinningArena>();
+		}
+
+		arena->triangles.clear();
+		arena->opaqueTriangles.clear();
+		arena->triangleIDs.clear();
+		arena->bins.resize(static_cast<size_t>(_binsCountX) * _binsCountY);
+		for (auto& bin : arena->bins)
+		{
+			bin.clear();
+		}
+	}
+}
+
+template<typename Mode, typename WriteFunction, typename WriteExclusiveFunction, typename ReadFunction>
+Statistics Rasterizer::_drawDepth(
+	const Mode& mode,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const Float4x4& VP,
+	const Float2& outputRes,
+	bool visibility,
+	WriteFunction&& write,
+	WriteExclusiveFunction&& writeExclusive,
+	ReadFunction&& read)
+{
+	std::atomic<size_t> pipelineTriangles = 0;
+	std::atomic<size_t> renderedTriangles = 0;
+	std::atomic<size_t> binnedTriangles = 0;
+	std::atomic<size_t> coveredPixels = 0;
+	std::atomic<size_t> outsideTiles = 0;
+	std::atomic<size_t> coveredTiles = 0;
+	std::atomic<size_t> occludedTriangles = 0;
+	std::atomic<size_t> occludedTiles = 0;
+	std::atomic<size_t> fetchedVertices = 0;
+	std::atomic<size_t> transformedVertices = 0;
+	std::atomic<size_t> droppedIDTriangles = 0;
+	BlockKernel blockKernel = SelectBlockKernel(_settings);
+	_bigTrianglesDepth.clear();
+	_compactBigTrianglesDepth.clear();
+	_bigTriangleTiles.clear();
+	_bigTrianglesIDs.clear();
+	if (_settings.binning)
+	{
+		_resetBins(outputRes);
+	}
+
+	CoarseDepth* coarseDepth = nullptr;
+	if (_settings.coarseDepth && !_settings.binning)
+	{
+		if (!_coarseDepth)
+		{
+			_coarseDepth = std::make_unique<CoarseDepth>();
+		}
+		_coarseDepth->Reset(outputRes, _settings.coarseDepthTileSize);
+		coarseDepth = _coarseDepth.get();
+	}
+
+	if (_settings.meshletVertexCache)
+	{
+		_meshletVertexCaches.resize(_threadPool.GetThreadsCount());
+	}
+
+	unsigned int trianglesPerJob = std::max(_settings.trianglesPerJob, 1u);
+	_setupTriangleJobs(commands, commandsCount);
+	std::vector<double> maxJobSeconds(_threadPool.GetThreadsCount(), 0.0);
+	auto start = std::chrono::steady_clock::now();
+
+	// TriangleDepthCS, a job per thread group
+	_threadPool.ParallelFor(
+		_triangleJobs.size(),
+		[&](size_t group)
+		{
+			auto jobStart = std::chrono::steady_clock::now();
+			const TriangleJob& job = _triangleJobs[group];
+			size_t commandIndex = job.command;
+			const IndirectCommand& command = commands[commandIndex];
+			unsigned int firstTriangle = job.firstTriangle;
+			unsigned int lastInstance = job.firstInstance + job.instancesCount;
+			unsigned int trianglesCount = (command.args.indexCountPerInstance + 2) / 3;
+
+			size_t groupPipelineTriangles = 0;
+			size_t groupRenderedTriangles = 0;
+			size_t groupBinnedTriangles = 0;
+			size_t groupCoveredPixels = 0;
+			size_t groupOutsideTiles = 0;
+			size_t groupCoveredTiles = 0;
+			size_t groupOccludedTriangles = 0;
+			size_t groupFetchedVertices = 0;
+			size_t groupTransformedVertices = 0;
+			size_t groupDroppedIDTriangles = 0;
+			std::vector<BigTriangleDepth> bigTriangles;
+			std::vector<CompactBigTriangleDepth> compactBigTriangles;
+			std::vector<BigTriangleTile> bigTriangleTiles;
+			std::vector<unsigned int> bigTriangleIDs;
+			BinningArena* arena = _settings.binning ? _binningArenas[ThreadPool::GetThreadIndex()].get() : nullptr;
+
+			// a triangle of an instance, positions are transformed already, by the cache or per triangle
+			auto drawTriangle = [&](
+				unsigned int triangleIndex,
+				unsigned int instanceID,
+				const Float3& p0WS,
+				const Float3& p1WS,
+				const Float3& p2WS,
+				const Float4& p0CS,
+				const Float4& p1CS,
+				const Float4& p2CS)
+			{
+				// one more triangle attempted to be rendered
+				groupPipelineTriangles++;
+
+				unsigned int ID = 0;
+				if (visibility)
+				{
+					// instance major, so ResolveVisibility decodes it with a division
+					uint64_t globalID =
+						_visibilityIDs[commandIndex] +
+						static_cast<uint64_t>(instanceID) * trianglesCount +
+						triangleIndex;
+					if (globalID > UINT32_MAX)
+					{
+						groupDroppedIDTriangles++;
+						return;
+					}
+					ID = static_cast<unsigned int>(globalID);
+				}
+
+				TriangleSetup t;
+				TriangleClass triangleClass = ClassifyTriangle(
+					p0CS,
+					p1CS,
+					p2CS,
+					outputRes,
+					_settings,
+					t);
+				if (triangleClass == TriangleClass::Rejected)
+				{
+					return;
+				}
+
+				// one more triangle was rendered
+				// not precise, though, since it still could miss any pixel centers
+				groupRenderedTriangles++;
+
+				if (arena)
+				{
+					groupBinnedTriangles += AddToBins(
+						t,
+						static_cast<unsigned int>(arena->triangles.size()),
+						_settings.binSize,
+						_binsCountX,
+						arena->bins);
+					arena->triangles.push_back(GetBinnedTriangle(t));
+					if (visibility)
+					{
+						arena->triangleIDs.push_back(ID);
+					}
+
+					return;
+				}
+
+				if (triangleClass == TriangleClass::Big)
+				{
+					// records are local to the job until they are merged
+					size_t entries = AppendBigTriangle(
+						t,
+						p0WS,
+						p1WS,
+						p2WS,
+						_settings,
+						bigTriangles,
+						compactBigTriangles,
+						bigTriangleTiles,
+						groupOutsideTiles,
+						groupCoveredTiles);
+					if (visibility)
+					{
+						bigTriangleIDs.insert(bigTriangleIDs.end(), entries, ID);
+					}
+
+					return;
+				}
+
+				if (coarseDepth && coarseDepth->Occluded(t, read))
+				{
+					groupOccludedTriangles++;
+					return;
+				}
+
+				RasterizeTriangle(
+					t,
+					mode,
+					outputRes,
+					blockKernel,
+					[&](float x, float y, float, float, float pixelDepth)
+					{
+						write(static_cast<int>(x), static_cast<int>(y), pixelDepth, ID);
+						groupCoveredPixels++;
+					});
+
+				if (coarseDepth)
+				{
+					coarseDepth->Update(t);
+				}
+			};
+
+			MeshletVertexCache* cache =
+				_settings.meshletVertexCache ? &_meshletVertexCaches[ThreadPool::GetThreadIndex()] : nullptr;
+			if (cache && cache->Fetch(scene, command))
+			{
+				groupFetchedVertices += cache->verticesCount;
+
+				// instance major, as the thread group syncs on every instance to fill its groupshared cache
+				for (unsigned int instanceID = job.firstInstance; instanceID < lastInstance; instanceID++)
+				{
+					const Instance& instance = scene.instances[command.startInstanceLocation + instanceID];
+					cache->TransformVertices(instance.worldTransform, VP);
+					groupTransformedVertices += cache->verticesCount;
+
+					for (unsigned int triangleIndex = firstTriangle;
+						triangleIndex < firstTriangle + trianglesPerJob &&
+						triangleIndex * 3 < command.args.indexCountPerInstance;
+						triangleIndex++)
+					{
+						unsigned int l0, l1, l2;
+						GetMeshletTriangle(scene, command, triangleIndex, l0, l1, l2);
+						drawTriangle(
+							triangleIndex,
+							instanceID,
+							cache->GetWS(l0),
+							cache->GetWS(l1),
+							cache->GetWS(l2),
+							cache->GetCS(l0),
+							cache->GetCS(l1),
+							cache->GetCS(l2));
+					}
+				}
+			}
+			else
+			{
+				for (unsigned int triangleIndex = firstTriangle;
+					triangleIndex < firstTriangle + trianglesPerJob &&
+					triangleIndex * 3 < command.args.indexCountPerInstance;
+					triangleIndex++)
+				{
+					unsigned int i0, i1, i2;
+					GetTriangleIndices(scene, command, triangleIndex, i0, i1, i2);
+
+					Float3 p0 = GetVertexPosition(scene, command, i0);
+					Float3 p1 = GetVertexPosition(scene, command, i1);
+					Float3 p2 = GetVertexPosition(scene, command, i2);
+					groupFetchedVertices += 3;
+
+					for (unsigned int instanceID = job.firstInstance; instanceID < lastInstance; instanceID++)
+					{
+						const Instance& instance = scene.instances[command.startInstanceLocation + instanceID];
+
+						// MS -> WS
+						Float3 p0WS = TransformPoint(p0, instance.worldTransform);
+						Float3 p1WS = TransformPoint(p1, instance.worldTransform);
+						Float3 p2WS = TransformPoint(p2, instance.worldTransform);
+						groupTransformedVertices += 3;
+
+						drawTriangle(
+							triangleIndex,
+							instanceID,
+							p0WS,
+							p1WS,
+							p2WS,
+							Transform(p0WS, VP),
+							Transform(p1WS, VP),
+							Transform(p2WS, VP));
+					}
+				}
+			}
+
+			pipelineTriangles += groupPipelineTriangles;
+			renderedTriangles += groupRenderedTriangles;
+			binnedTriangles += groupBinnedTriangles;
+			coveredPixels += groupCoveredPixels;
+			outsideTiles += groupOutsideTiles;
+			coveredTiles += groupCoveredTiles;
+			occludedTriangles += groupOccludedTriangles;
+			fetchedVertices += groupFetchedVertices;
+			transformedVertices += groupTransformedVertices;
+			droppedIDTriangles += groupDroppedIDTriangles;
+
+			if (!bigTriangles.empty())
+			{
+				std::lock_guard<std::mutex> lock(_bigTrianglesMutex);
+				_bigTrianglesDepth.insert(_bigTrianglesDepth.end(), bigTriangles.begin(), bigTriangles.end());
+				_bigTrianglesIDs.insert(_bigTrianglesIDs.end(), bigTriangleIDs.begin(), bigTriangleIDs.end());
+			}
+
+			if (!compactBigTriangles.empty())
+			{
+				std::lock_guard<std::mutex> lock(_bigTrianglesMutex);
+				unsigned int firstRecord = static_cast<unsigned int>(_compactBigTrianglesDepth.size());
+				for (BigTriangleTile& tile : bigTriangleTiles)
+				{
+					tile.record += firstRecord;
+				}
+				_compactBigTrianglesDepth.insert(
+					_compactBigTrianglesDepth.end(), compactBigTriangles.begin(), compactBigTriangles.end());
+				_bigTriangleTiles.insert(_bigTriangleTiles.end(), bigTriangleTiles.begin(), bigTriangleTiles.end());
+				_bigTrianglesIDs.insert(_bigTrianglesIDs.end(), bigTriangleIDs.begin(), bigTriangleIDs.end());
+			}
+
+			double& threadMaxJobSeconds = maxJobSeconds[ThreadPool::GetThreadIndex()];
+			threadMaxJobSeconds = std::max(
+				threadMaxJobSeconds,
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count());
+		});
+
+	// binning back end, a job per bin, every bin is owned by a single thread, so no atomics
+	_threadPool.ParallelFor(
+		_settings.binning ? static_cast<size_t>(_binsCountX) * _binsCountY : 0,
+		[&](size_t bin)
+		{
+			unsigned int binX = static_cast<unsigned int>(bin % _binsCountX);
+			unsigned int binY = static_cast<unsigned int>(bin / _binsCountX);
+			size_t binCoveredPixels = 0;
+			for (const auto& arena : _binningArenas)
+			{
+				for (unsigned int triangle : arena->bins[bin])
+				{
+					TriangleSetup t = {};
+					SetupBinnedTriangle(arena->triangles[triangle], outputRes, _settings, t);
+					unsigned int ID = visibility ? arena->triangleIDs[triangle] : 0;
+
+					RasterizeBin(
+						t,
+						mode.useTopLeftRule,
+						blockKernel,
+						binX,
+						binY,
+						_settings.binSize,
+						[&](float x, float y, float, float, float pixelDepth)
+						{
+							writeExclusive(static_cast<int>(x), static_cast<int>(y), pixelDepth, ID);
+							binCoveredPixels++;
+						});
+				}
+			}
+
+			coveredPixels += binCoveredPixels;
+		});
+
+	auto bigTrianglesStart = std::chrono::steady_clock::now();
+
+	// BigTriangleDepthCS
+	size_t bigTriangleTiles = _drawBigTriangles(
+		mode,
+		_bigTrianglesDepth,
+		_compactBigTrianglesDepth,
+		_bigTriangleTiles,
+		VP,
+		outputRes,
+		visibility,
+		blockKernel,
+		coarseDepth,
+		write,
+		read,
+		coveredPixels,
+		occludedTiles);
+
+	Statistics statistics;
+	statistics.pipelineTriangles = pipelineTriangles;
+	statistics.renderedTriangles = renderedTriangles;
+	statistics.bigTriangleTiles = bigTriangleTiles;
+	statistics.bigTriangleOutsideTiles = outsideTiles;
+	statistics.bigTriangleCoveredTiles = coveredTiles;
+	statistics.coarseDepthRejectedTriangles = occludedTriangles;
+	statistics.coarseDepthRejectedTiles = occludedTiles;
+	statistics.fetchedVertices = fetchedVertices;
+	statistics.transformedVertices = transformedVertices;
+	statistics.droppedIDTriangles = droppedIDTriangles;
+	statistics.triangleJobs = _triangleJobs.size();
+	statistics.maxTriangleJobSeconds = *std::max_element(maxJobSeconds.begin(), maxJobSeconds.end());
+	statistics.bigTriangleRecords = _compactBigTrianglesDepth.size();
+	statistics.bigTriangleBytes =
+		_bigTrianglesDepth.size() * sizeof(BigTriangleDepth) +
+		_compactBigTrianglesDepth.size() * sizeof(CompactBigTriangleDepth) +
+		_bigTriangleTiles.size() * sizeof(BigTriangleTile);
+	statistics.smallTrianglesSeconds = std::chrono::duration<double>(bigTrianglesStart - start).count();
+	statistics.bigTrianglesSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - bigTrianglesStart).count();
+	statistics.binnedTriangles = binnedTriangles;
+	statistics.coveredPixels = coveredPixels;
+	return statistics;
+}
+
+Statistics Rasterizer::DrawDepth(
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const Float4x4& VP,
+	DepthTarget& depth)
+{
+	const Float2 outputRes =
+	{
+		static_cast<float>(depth.GetWidth()),
+		static_cast<float>(depth.GetHeight())
+	};
+
+	return DispatchMode(
+		_settings,
+		[&](const auto& mode)
+		{
+			return _drawDepth(
+				mode,
+				scene,
+				commands,
+				commandsCount,
+				VP,
+				outputRes,
+				false,
+				[&](int x, int y, float pixelDepth, unsigned int)
+				{
+					// TODO: account for non-reversed Z
+					depth.WriteMax(x, y, pixelDepth);
+				},
+				[&](int x, int y, float pixelDepth, unsigned int)
+				{
+					depth.WriteMaxExclusive(x, y, pixelDepth);
+				},
+				[&](int x, int y)
+				{
+					return depth.GetDepth(x, y);
+				});
+		});
+}
+
+void Rasterizer::_setupTriangleJobs(const IndirectCommand* commands, size_t commandsCount)
+{
+	unsigned int trianglesPerJob = std::max(_settings.trianglesPerJob, 1u);
+	_triangleJobs.clear();
+	for (size_t command = 0; command < commandsCount; command++)
+	{
+		// command major, then instances, then triangles, as GenerateCommandsCS appends the slices
+		unsigned int instanceCount = commands[command].args.instanceCount;
+		unsigned int instancesPerJob = _settings.instancesPerJob > 0 ? _settings.instancesPerJob : instanceCount;
+		for (unsigned int firstInstance = 0; firstInstance < instanceCount; firstInstance += instancesPerJob)
+		{
+			for (unsigned int firstTriangle = 0; firstTriangle < MESHLET_SIZE; firstTriangle += trianglesPerJob)
+			{
+				_triangleJobs.push_back(
+				{
+					static_cast<unsigned int>(command),
+					firstTriangle,
+					firstInstance,
+					std::min(instancesPerJob, instanceCount - firstInstance)
+				});
+			}
+		}
+	}
+}
+
+Statistics Rasterizer::DrawVisibility(
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const Float4x4& VP,
+	VisibilityTarget& visibility)
+{
+	const Float2 outputRes =
+	{
+		static_cast<float>(visibility.GetWidth()),
+		static_cast<float>(visibility.GetHeight())
+	};
+
+	_setupVisibilityIDs(commands, commandsCount);
+
+	return DispatchMode(
+		_settings,
+		[&](const auto& mode)
+		{
+			return _drawDepth(
+				mode,
+				scene,
+				commands,
+				commandsCount,
+				VP,
+				outputRes,
+				true,
+				[&](int x, int y, float pixelDepth, unsigned int ID)
+				{
+					visibility.WriteMax(x, y, pixelDepth, ID);
+				},
+				[&](int x, int y, float pixelDepth, unsigned int ID)
+				{
+					visibility.WriteMaxExclusive(x, y, pixelDepth, ID);
+				},
+				[&](int x, int y)
+				{
+					return visibility.GetDepth(x, y);
+				});
+		});
+}
+
+template<typename Mode>
+Statistics Rasterizer::_drawOpaque(
+	const Mode& mode,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const Float4x4& VP,
+	const ShadingSettings& shading,
+	const DepthTarget& depth,
+	const DepthTarget* shadowMaps,
+	ColorTarget& renderTarget)
+{
+	const Float2 outputRes =
+	{
+		static_cast<float>(depth.GetWidth()),
+		static_cast<float>(depth.GetHeight())
+	};
+
+	std::atomic<size_t> pipelineTriangles = 0;
+	std::atomic<size_t> renderedTriangles = 0;
+	std::atomic<size_t> binnedTriangles = 0;
+	std::atomic<size_t> coveredPixels = 0;
+	std::atomic<size_t> outsideTiles = 0;
+	std::atomic<size_t> coveredTiles = 0;
+	std::atomic<size_t> shadedPixels = 0;
+	BlockKernel blockKernel = SelectBlockKernel(_settings);
+	_bigTrianglesOpaque.clear();
+	_compactBigTrianglesOpaque.clear();
+	_bigTriangleTiles.clear();
+	if (_settings.binning)
+	{
+		_resetBins(outputRes);
+	}
+
+	if (_settings.meshletVertexCache)
+	{
+		_meshletVertexCaches.resize(_threadPool.GetThreadsCount());
+	}
+
+	unsigned int trianglesPerJob = std::max(_settings.trianglesPerJob, 1u);
+	_setupTriangleJobs(commands, commandsCount);
+	std::vector<double> maxJobSeconds(_threadPool.GetThreadsCount(), 0.0);
+	auto start = std::chrono::steady_clock::now();
+
+	// TriangleOpaqueCS, a job per thread group
+	_threadPool.ParallelFor(
+		_triangleJobs.size(),
+		[&](size_t group)
+		{
+			auto jobStart = std::chrono::steady_clock::now();
+			const TriangleJob& job = _triangleJobs[group];
+			const IndirectCommand& command = commands[job.command];
+			unsigned int firstTriangle = job.firstTriangle;
+			unsigned int lastInstance = job.firstInstance + job.instancesCount;
+
+			size_t groupPipelineTriangles = 0;
+			size_t groupRenderedTriangles = 0;
+			size_t groupBinnedTriangles = 0;
+			size_t groupCoveredPixels = 0;
+			size_t groupOutsideTiles = 0;
+			size_t groupCoveredTiles = 0;
+			size_t groupShadedPixels = 0;
+			std::vector<BigTriangleOpaque> bigTriangles;
+			std::vector<CompactBigTriangleOpaque> compactBigTriangles;
+			std::vector<BigTriangleTile> bigTriangleTiles;
+			BinningArena* arena = _settings.binning ? _binningArenas[ThreadPool::GetThreadIndex()].get() : nullptr;
+
+			// a triangle of an instance, positions are transformed already, by the cache or per triangle
+			auto drawTriangle = [&](
+				unsigned int i0,
+				unsigned int i1,
+				unsigned int i2,
+				const Float3& p0WS,
+				const Float3& p1WS,
+				const Float3& p2WS,
+				const Float4& p0CS,
+				const Float4& p1CS,
+				const Float4& p2CS)
+			{
+				// one more triangle attempted to be rendered
+				groupPipelineTriangles++;
+
+				ShadingAttributes attributes;
+				attributes.p0WS = p0WS;
+				attributes.p1WS = p1WS;
+				attributes.p2WS = p2WS;
+
+				TriangleSetup t;
+				TriangleClass triangleClass = ClassifyTriangle(
+					p0CS,
+					p1CS,
+					p2CS,
+					outputRes,
+					_settings,
+					t);
+				if (triangleClass == TriangleClass::Rejected)
+				{
+					return;
+				}
+
+				// one more triangle was rendered
+				// not precise, though, since it still could miss any pixel centers
+				groupRenderedTriangles++;
+
+				size_t baseVertexLocation = static_cast<size_t>(command.args.baseVertexLocation);
+				unsigned int n0P = scene.normals[baseVertexLocation + i0];
+				unsigned int n1P = scene.normals[baseVertexLocation + i1];
+				unsigned int n2P = scene.normals[baseVertexLocation + i2];
+				const unsigned int* c0P = scene.colors + (baseVertexLocation + i0) * 2;
+				const unsigned int* c1P = scene.colors + (baseVertexLocation + i1) * 2;
+				const unsigned int* c2P = scene.colors + (baseVertexLocation + i2) * 2;
+
+				if (arena)
+				{
+					BinnedTriangleOpaque binned =
+					{
+						GetBinnedTriangle(t),
+						t.invW0,
+						t.invW1,
+						t.invW2,
+						attributes.p0WS,
+						attributes.p1WS,
+						attributes.p2WS,
+						{ n0P, n1P, n2P },
+						{ { c0P[0], c0P[1] }, { c1P[0], c1P[1] }, { c2P[0], c2P[1] } },
+						shading.showMeshlets && triangleClass == TriangleClass::Small,
+						MeshColor(command.meshID)
+					};
+
+					groupBinnedTriangles += AddToBins(
+						t,
+						static_cast<unsigned int>(arena->opaqueTriangles.size()),
+						_settings.binSize,
+						_binsCountX,
+						arena->bins);
+					arena->opaqueTriangles.push_back(binned);
+
+					return;
+				}
+
+				if (triangleClass == TriangleClass::Big && _settings.compactBigTriangles)
+				{
+					float tilesCountX;
+					float totalTiles = TilesCount(t, _settings.bigTriangleTileSize, tilesCountX);
+					unsigned int record = static_cast<unsigned int>(compactBigTriangles.size());
+					compactBigTriangles.push_back(
+					{
+						GetCompactBigTriangle(t, tilesCountX),
+						t.invW0,
+						t.invW1,
+						t.invW2,
+						attributes.p0WS,
+						attributes.p1WS,
+						attributes.p2WS,
+						{ n0P, n1P, n2P },
+						{ { c0P[0], c0P[1] }, { c1P[0], c1P[1] }, { c2P[0], c2P[1] } }
+					});
+					for (float offset = 0.0f; offset < totalTiles; offset += 1.0f)
+					{
+						float tileOffset = offset;
+						if (_settings.coarseTileClassification && !ClassifyBigTriangleTile(
+							t,
+							offset,
+							tilesCountX,
+							_settings.bigTriangleTileSize,
+							groupOutsideTiles,
+							groupCoveredTiles,
+							tileOffset))
+						{
+							continue;
+						}
+
+						bigTriangleTiles.push_back({ tileOffset, record });
+					}
+
+					return;
+				}
+
+				if (triangleClass == TriangleClass::Big)
+				{
+					BigTriangleOpaque result =
+					{
+						0.0f,
+						attributes.p0WS,
+						attributes.p1WS,
+						attributes.p2WS,
+						{ n0P, n1P, n2P },
+						{ { c0P[0], c0P[1] }, { c1P[0], c1P[1] }, { c2P[0], c2P[1] } }
+					};
+
+					float tilesCountX;
+					float totalTiles = TilesCount(t, _settings.bigTriangleTileSize, tilesCountX);
+					for (float offset = 0.0f; offset < totalTiles; offset += 1.0f)
+					{
+						float tileOffset = offset;
+						if (_settings.coarseTileClassification && !ClassifyBigTriangleTile(
+							t,
+							offset,
+							tilesCountX,
+							_settings.bigTriangleTileSize,
+							groupOutsideTiles,
+							groupCoveredTiles,
+							tileOffset))
+						{
+							continue;
+						}
+
+						result.tileOffset = tileOffset;
+						bigTriangles.push_back(result);
+					}
+
+					return;
+				}
+
+				attributes.n0 = UnpackNormal(n0P);
+				attributes.n1 = UnpackNormal(n1P);
+				attributes.n2 = UnpackNormal(n2P);
+				attributes.c0 = UnpackColor(c0P);
+				attributes.c1 = UnpackColor(c1P);
+				attributes.c2 = UnpackColor(c2P);
+
+				Float3 commandMeshColor = MeshColor(command.meshID);
+				const Float3* meshColor = shading.showMeshlets ? &commandMeshColor : nullptr;
+
+				RasterizeTriangle(
+					t,
+					mode,
+					outputRes,
+					blockKernel,
+					[&](float x, float y, float area0, float area1, float pixelDepth)
+					{
+						groupCoveredPixels++;
+						if (ShadePixel(
+							t,
+							attributes,
+							meshColor,
+							shading,
+							depth,
+							shadowMaps,
+							renderTarget,
+							x,
+							y,
+							area0,
+							area1,
+							pixelDepth))
+						{
+							groupShadedPixels++;
+						}
+					});
+			};
+
+			MeshletVertexCache* cache =
+				_settings.meshletVertexCache ? &_meshletVertexCaches[ThreadPool::GetThreadIndex()] : nullptr;
+			if (cache && cache->Fetch(scene, command))
+			{
+				for (unsigned int instanceID = job.firstInstance; instanceID < lastInstance; instanceID++)
+				{
+					const Instance& instance = scene.instances[command.startInstanceLocation + instanceID];
+					cache->TransformVertices(instance.worldTransform, VP);
+
+					for (unsigned int triangleIndex = firstTriangle;
+						triangleIndex < firstTriangle + trianglesPerJob &&
+						triangleIndex * 3 < command.args.indexCountPerInstance;
+						triangleIndex++)
+					{
+						unsigned int l0, l1, l2;
+						GetMeshletTriangle(scene, command, triangleIndex, l0, l1, l2);
+						drawTriangle(
+							scene.indices[command.startMeshletVertexLocation + l0],
+							scene.indices[command.startMeshletVertexLocation + l1],
+							scene.indices[command.startMeshletVertexLocation + l2],
+							cache->GetWS(l0),
+							cache->GetWS(l1),
+							cache->GetWS(l2),
+							cache->GetCS(l0),
+							cache->GetCS(l1),
+							cache->GetCS(l2));
+					}
+				}
+			}
+			else
+			{
+				for (unsigned int triangleIndex = firstTriangle;
+					triangleIndex < firstTriangle + trianglesPerJob &&
+					triangleIndex * 3 < command.args.indexCountPerInstance;
+					triangleIndex++)
+				{
+					unsigned int i0, i1, i2;
+					GetTriangleIndices(scene, command, triangleIndex, i0, i1, i2);
+
+					Float3 p0 = GetVertexPosition(scene, command, i0);
+					Float3 p1 = GetVertexPosition(scene, command, i1);
+					Float3 p2 = GetVertexPosition(scene, command, i2);
+
+					for (unsigned int instanceID = job.firstInstance; instanceID < lastInstance; instanceID++)
+					{
+						const Instance& instance = scene.instances[command.startInstanceLocation + instanceID];
+
+						Float3 p0WS = TransformPoint(p0, instance.worldTransform);
+						Float3 p1WS = TransformPoint(p1, instance.worldTransform);
+						Float3 p2WS = TransformPoint(p2, instance.worldTransform);
+
+						drawTriangle(
+							i0,
+							i1,
+							i2,
+							p0WS,
+							p1WS,
+							p2WS,
+							Transform(p0WS, VP),
+							Transform(p1WS, VP),
+							Transform(p2WS, VP));
+					}
+				}
+			}
+
+			pipelineTriangles += groupPipelineTriangles;
+			renderedTriangles += groupRenderedTriangles;
+			binnedTriangles += groupBinnedTriangles;
+			coveredPixels += groupCoveredPixels;
+			outsideTiles += groupOutsideTiles;
+			coveredTiles += groupCoveredTiles;
+			shadedPixels += groupShadedPixels;
+
+			if (!bigTriangles.empty())
+			{
+				std::lock_guard<std::mutex> lock(_bigTrianglesMutex);
+				_bigTrianglesOpaque.insert(_bigTrianglesOpaque.end(), bigTriangles.begin(), bigTriangles.end());
+			}
+
+			if (!compactBigTriangles.empty())
+			{
+				std::lock_guard<std::mutex> lock(_bigTrianglesMutex);
+				unsigned int firstRecord = static_cast<unsigned int>(_compactBigTrianglesOpaque.size());
+				for (BigTriangleTile& tile : bigTriangleTiles)
+				{
+					tile.record += firstRecord;
+				}
+				_compactBigTrianglesOpaque.insert(
+					_compactBigTrianglesOpaque.end(), compactBigTriangles.begin(), compactBigTriangles.end());
+				_bigTriangleTiles.insert(_bigTriangleTiles.end(), bigTriangleTiles.begin(), bigTriangleTiles.end());
+			}
+
+			double& threadMaxJobSeconds = maxJobSeconds[ThreadPool::GetThreadIndex()];
+			threadMaxJobSeconds = std::max(
+				threadMaxJobSeconds,
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count());
+		});
+
+	// binning back end, a job per bin
+	_threadPool.ParallelFor(
+		_settings.binning ? static_cast<size_t>(_binsCountX) * _binsCountY : 0,
+		[&](size_t bin)
+		{
+			unsigned int binX = static_cast<unsigned int>(bin % _binsCountX);
+			unsigned int binY = static_cast<unsigned int>(bin / _binsCountX);
+			size_t binCoveredPixels = 0;
+			size_t binShadedPixels = 0;
+			for (const auto& arena : _binningArenas)
+			{
+				for (unsigned int triangle : arena->bins[bin])
+				{
+					const BinnedTriangleOpaque& binned = arena->opaqueTriangles[triangle];
+
+					TriangleSetup t = {};
+					SetupBinnedTriangle(binned.triangle, outputRes, _settings, t);
+					t.invW0 = binned.invW0;
+					t.invW1 = binned.invW1;
+					t.invW2 = binned.invW2;
+
+					ShadingAttributes attributes;
+					attributes.p0WS = binned.p0WS;
+					attributes.p1WS = binned.p1WS;
+					attributes.p2WS = binned.p2WS;
+					attributes.n0 = UnpackNormal(binned.packedNormal[0]);
+					attributes.n1 = UnpackNormal(binned.packedNormal[1]);
+					attributes.n2 = UnpackNormal(binned.packedNormal[2]);
+					attributes.c0 = UnpackColor(binned.packedColor[0]);
+					attributes.c1 = UnpackColor(binned.packedColor[1]);
+					attributes.c2 = UnpackColor(binned.packedColor[2]);
+
+					RasterizeBin(
+						t,
+						mode.useTopLeftRule,
+						blockKernel,
+						binX,
+						binY,
+						_settings.binSize,
+						[&](float x, float y, float area0, float area1, float pixelDepth)
+						{
+							binCoveredPixels++;
+							if (ShadePixel(
+								t,
+								attributes,
+								binned.useMeshColor ? &binned.meshColor : nullptr,
+								shading,
+								depth,
+								shadowMaps,
+								renderTarget,
+								x,
+								y,
+								area0,
+								area1,
+								pixelDepth))
+							{
+								binShadedPixels++;
+							}
+						});
+				}
+			}
+
+			coveredPixels += binCoveredPixels;
+			shadedPixels += binShadedPixels;
+		});
+
+	auto bigTrianglesStart = std::chrono::steady_clock::now();
+
+	// BigTriangleOpaqueCS, a job per tile
+	size_t bigTriangleTiles = _settings.compactBigTriangles ? _bigTriangleTiles.size() : _bigTrianglesOpaque.size();
+	_threadPool.ParallelFor(
+		bigTriangleTiles,
+		[&](size_t tile)
+		{
+			TriangleSetup t;
+			ShadingAttributes attributes;
+			bool covered = false;
+			if (_settings.compactBigTriangles)
+			{
+				const BigTriangleTile& bigTriangleTile = _bigTriangleTiles[tile];
+				const CompactBigTriangleOpaque& bigTriangle = _compactBigTrianglesOpaque[bigTriangleTile.record];
+				SetupCompactBigTriangleTile(
+					bigTriangle.triangle,
+					DecodeTileOffset(bigTriangleTile.tileOffset, covered),
+					_settings,
+					t);
+				t.invW0 = bigTriangle.invW0;
+				t.invW1 = bigTriangle.invW1;
+				t.invW2 = bigTriangle.invW2;
+
+				attributes.p0WS = bigTriangle.p0WS;
+				attributes.p1WS = bigTriangle.p1WS;
+				attributes.p2WS = bigTriangle.p2WS;
+				attributes.n0 = UnpackNormal(bigTriangle.packedNormal[0]);
+				attributes.n1 = UnpackNormal(bigTriangle.packedNormal[1]);
+				attributes.n2 = UnpackNormal(bigTriangle.packedNormal[2]);
+				attributes.c0 = UnpackColor(bigTriangle.packedColor[0]);
+				attributes.c1 = UnpackColor(bigTriangle.packedColor[1]);
+				attributes.c2 = UnpackColor(bigTriangle.packedColor[2]);
+			}
+			else
+			{
+				const BigTriangleOpaque& bigTriangle = _bigTrianglesOpaque[tile];
+				SetupBigTriangleTile(
+					bigTriangle.p0WS,
+					bigTriangle.p1WS,
+					bigTriangle.p2WS,
+					DecodeTileOffset(bigTriangle.tileOffset, covered),
+					VP,
+					outputRes,
+					_settings,
+					t);
+
+				attributes.p0WS = bigTriangle.p0WS;
+				attributes.p1WS = bigTriangle.p1WS;
+				attributes.p2WS = bigTriangle.p2WS;
+				attributes.n0 = UnpackNormal(bigTriangle.packedNormal[0]);
+				attributes.n1 = UnpackNormal(bigTriangle.packedNormal[1]);
+				attributes.n2 = UnpackNormal(bigTriangle.packedNormal[2]);
+				attributes.c0 = UnpackColor(bigTriangle.packedColor[0]);
+				attributes.c1 = UnpackColor(bigTriangle.packedColor[1]);
+				attributes.c2 = UnpackColor(bigTriangle.packedColor[2]);
+			}
+
+			size_t tileCoveredPixels = 0;
+			size_t tileShadedPixels = 0;
+
+			// big triangles don't carry the mesh color, same as on the GPU
+			RasterizeTile(
+				t,
+				mode,
+				blockKernel,
+				covered,
+				[&](float x, float y, float area0, float area1, float pixelDepth)
+				{
+					tileCoveredPixels++;
+					if (ShadePixel(
+						t,
+						attributes,
+						nullptr,
+						shading,
+						depth,
+						shadowMaps,
+						renderTarget,
+						x,
+						y,
+						area0,
+						area1,
+						pixelDepth))
+					{
+						tileShadedPixels++;
+					}
+				});
+
+			coveredPixels += tileCoveredPixels;
+			shadedPixels += tileShadedPixels;
+		});
+
+	Statistics statistics;
+	statistics.pipelineTriangles = pipelineTriangles;
+	statistics.renderedTriangles = renderedTriangles;
+	statistics.bigTriangleTiles = bigTriangleTiles;
+	statistics.bigTriangleOutsideTiles = outsideTiles;
+	statistics.bigTriangleCoveredTiles = coveredTiles;
+	statistics.triangleJobs = _triangleJobs.size();
+	statistics.maxTriangleJobSeconds = *std::max_element(maxJobSeconds.begin(), maxJobSeconds.end());
+	statistics.bigTriangleRecords = _compactBigTrianglesOpaque.size();
+	statistics.bigTriangleBytes =
+		_bigTrianglesOpaque.size() * sizeof(BigTriangleOpaque) +
+		_compactBigTrianglesOpaque.size() * sizeof(CompactBigTriangleOpaque) +
+		_bigTriangleTiles.size() * sizeof(BigTriangleTile);
+	statistics.smallTrianglesSeconds = std::chrono::duration<double>(bigTrianglesStart - start).count();
+	statistics.bigTrianglesSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - bigTrianglesStart).count();
+	statistics.binnedTriangles = binnedTriangles;
+	statistics.coveredPixels = coveredPixels;
+	statistics.shadedPixels = shadedPixels;
+	return statistics;
+}
+
+Statistics Rasterizer::DrawOpaque(
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const Float4x4& VP,
+	const ShadingSettings& shading,
+	const DepthTarget& depth,
+	const DepthTarget* shadowMaps,
+	ColorTarget& renderTarget)
+{
+	return DispatchMode(
+		_settings,
+		[&](const auto& mode)
+		{
+			return _drawOpaque(
+				mode,
+				scene,
+				commands,
+				commandsCount,
+				VP,
+				shading,
+				depth,
+				shadowMaps,
+				renderTarget);
+		});
+}
+
+}
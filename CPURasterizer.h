@@ -0,0 +1,532 @@
+#pragma once
+
+#include "CPUGPUCommon.h"
+#include "CPURasterizerKernels.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// headless CPU port of the SW rasterizer: TriangleDepthCS, BigTriangleDepthCS,
+// TriangleOpaqueCS and BigTriangleOpaqueCS, pixel rules and math follow the shaders
+// depends neither on D3D12 nor on Win32, so it builds and runs on hosts without a GPU
+namespace CPURasterizer
+{
+
+struct Float2
+{
+	float x;
+	float y;
+};
+
+struct Float3
+{
+	float x;
+	float y;
+	float z;
+};
+
+struct Float4
+{
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+// row vectors, same layout as DirectX::XMFLOAT4X4
+struct Float4x4
+{
+	float m[4][4];
+};
+
+// same layout as Instance in Common.h
+struct Instance
+{
+	Float4x4 worldTransform;
+	unsigned int ID;
+};
+
+// same layout as D3D12_DRAW_INDEXED_ARGUMENTS
+struct DrawIndexedArguments
+{
+	unsigned int indexCountPerInstance;
+	unsigned int instanceCount;
+	unsigned int startIndexLocation;
+	int baseVertexLocation;
+	unsigned int startInstanceLocation;
+};
+
+// same layout as IndirectCommand in Common.h, a thread group per command on the GPU
+struct IndirectCommand
+{
+	unsigned int startInstanceLocation;
+#ifdef QUANTIZED_POSITIONS
+	Float3 positionsOrigin;
+	Float3 positionsScale;
+#endif
+	unsigned int meshID;
+	DrawIndexedArguments args;
+#ifdef MESHLET_INDICES
+	unsigned int startMeshletVertexLocation;
+	unsigned int startMeshletTriangleLocation;
+#endif
+};
+
+// views of the scene buffers, as they are bound to the SW rasterizer shaders
+struct SceneBuffers
+{
+	// VertexPosition layout
+	const void* positions = nullptr;
+	// VertexNormal and VertexColor layouts, needed for the opaque pass only
+	const unsigned int* normals = nullptr;
+	const unsigned int* colors = nullptr;
+	// meshlet, SOA or plain 32-bit indices, see GetTriangleIndices
+	const unsigned int* indices = nullptr;
+	unsigned int totalTriangles = 0;
+	const Instance* instances = nullptr;
+};
+
+// model space positions of a triangle, triangleIndex is local to the command
+void GetTrianglePositions(
+	const SceneBuffers& scene,
+	const IndirectCommand& command,
+	unsigned int triangleIndex,
+	Float3 positions[3]);
+
+// the first group are options the shaders have too, as permutations or CPUGPUCommon.h defines,
+// so both rasterizers can be compared with the same options, the second one is the CPU rasterizer's own
+struct RasterizationSettings
+{
+	// how much screen space area should triangle's AABB occupy to be considered "big"
+	float bigTriangleThreshold = 4096.0f;
+	float bigTriangleTileSize = 128.0f;
+	bool useTopLeftRule = true;
+	bool scanlineRasterization = true;
+	// instances of a command split into jobs of instancesPerJob, instead of a job looping over all of them,
+	// as INSTANCE_SLICES does, 0 never splits
+	unsigned int instancesPerJob = 0;
+	// the vertices of a meshlet are fetched once per job, and transformed once per instance, needs MESHLET_INDICES
+	bool meshletVertexCache = false;
+	// vertices snapped to FIXED_POINT_SUBPIXEL_BITS sub-pixel bits and 64-bit integer edge functions,
+	// exact for any traversal, so no drift and watertight
+	bool fixedPointEdges = false;
+	// a record per big triangle, with the setup the triangles pass has done, plus a small entry per tile,
+	// instead of the whole triangle per tile, which every tile projects again
+	bool compactBigTriangles = false;
+	// big triangle tiles are tested against the edges at their corners, while they are appended,
+	// tiles outside of the triangle are dropped, covered ones skip the edge tests
+	bool coarseTileClassification = false;
+
+	// triangles of a command per job, as SWR_TRIANGLE_THREADS_X per thread group on the GPU,
+	// a divisor of MESHLET_SIZE
+	unsigned int trianglesPerJob = SWR_TRIANGLE_THREADS_X;
+	// the pixel loops are compiled per combination of the modes above and picked once per pass,
+	// instead of a generic kernel branching on them
+	bool specializedKernels = true;
+	// 8x8 blocks with the edge functions evaluated directly, as the big triangles shaders do,
+	// instead of the per-pixel stepping, scanline rasterization stays per-pixel
+	bool blockRasterization = true;
+	BlockKernelISA blockKernelISA = GetBestBlockKernelISA();
+	// sort-middle: triangles are binned into binSize x binSize screen tiles first,
+	// then every bin is rasterized by a single thread, so depth is written without atomics,
+	// big triangles aren't split into tiles, the bins already spread them over threads
+	bool binning = false;
+	unsigned int binSize = 64;
+	// the farthest depth of every coarseDepthTileSize x coarseDepthTileSize screen tile is kept
+	// while depth is written, triangles and big triangle tiles behind it are rejected before any per-pixel work,
+	// depth and visibility passes, except for binning mode
+	bool coarseDepth = false;
+	unsigned int coarseDepthTileSize = 8;
+};
+
+// opaque pass constants, besides the camera VP
+struct ShadingSettings
+{
+	Float4x4 cascadeVP[MAX_CASCADES_COUNT];
+	float cascadeBias[MAX_CASCADES_COUNT];
+	float cascadeSplits[MAX_CASCADES_COUNT];
+	int cascadesCount = 0;
+	// normalized
+	Float3 sunDirection = { 0.0f, 1.0f, 0.0f };
+	float shadowsDistance = 0.0f;
+	bool showCascades = false;
+	bool showMeshlets = false;
+};
+
+// reversed Z, holds asuint(depth) as the SW depth UAV does, so writes are an atomic max
+class DepthTarget
+{
+public:
+
+	void Resize(int width, int height);
+	void Clear();
+
+	void WriteMax(int x, int y, float depth);
+	// for the texels owned by the calling thread, e.g. binning mode bins
+	void WriteMaxExclusive(int x, int y, float depth);
+	float GetDepth(int x, int y) const;
+	// point clamp sampling, uv in [0, 1]
+	float Sample(float u, float v) const;
+
+	int GetWidth() const { return _width; }
+	int GetHeight() const { return _height; }
+
+private:
+
+	std::unique_ptr<std::atomic<unsigned int>[]> _depth;
+	int _width = 0;
+	int _height = 0;
+};
+
+// visibility buffer, asuint(depth) << 32 | ID of the closest triangle, so writes are a 64-bit atomic max,
+// depth is in the high bits, so IDs only break the ties, ID 0 means no triangle
+class VisibilityTarget
+{
+public:
+
+	void Resize(int width, int height);
+	void Clear();
+
+	void WriteMax(int x, int y, float depth, unsigned int ID);
+	void WriteMaxExclusive(int x, int y, float depth, unsigned int ID);
+	float GetDepth(int x, int y) const;
+	unsigned int GetID(int x, int y) const;
+
+	int GetWidth() const { return _width; }
+	int GetHeight() const { return _height; }
+
+private:
+
+	std::unique_ptr<std::atomic<uint64_t>[]> _texels;
+	int _width = 0;
+	int _height = 0;
+};
+
+// R8G8B8A8_UNORM, same as the back buffer
+class ColorTarget
+{
+public:
+
+	void Resize(int width, int height);
+	void Clear(const float color[4]);
+
+	void SetPixel(int x, int y, const Float4& color);
+	unsigned int GetPixel(int x, int y) const { return _pixels[y * _width + x]; }
+	const unsigned int* GetData() const { return _pixels.data(); }
+
+	int GetWidth() const { return _width; }
+	int GetHeight() const { return _height; }
+
+private:
+
+	std::vector<unsigned int> _pixels;
+	int _width = 0;
+	int _height = 0;
+};
+
+// same counters as the SW rasterizer statistics buffer, plus the big triangles tiles
+struct Statistics
+{
+	size_t pipelineTriangles = 0;
+	size_t renderedTriangles = 0;
+	size_t bigTriangleTiles = 0;
+	// coarse tile classification only, dropped tiles aren't in bigTriangleTiles, covered ones are
+	size_t bigTriangleOutsideTiles = 0;
+	size_t bigTriangleCoveredTiles = 0;
+	// coarse depth only, rendered triangles and big triangle tiles, which were behind it
+	size_t coarseDepthRejectedTriangles = 0;
+	size_t coarseDepthRejectedTiles = 0;
+	// depth passes only, vertex positions fetched along with their indices, and transformed to world space
+	size_t fetchedVertices = 0;
+	size_t transformedVertices = 0;
+	// visibility only, triangle instances past the 2^32 - 1 IDs, which weren't rasterized
+	size_t droppedIDTriangles = 0;
+	// compact big triangles mode only
+	size_t bigTriangleRecords = 0;
+	// big triangles buffer memory written by the triangles pass, records and tiles
+	size_t bigTriangleBytes = 0;
+	// triangle and bin pairs, binning mode only
+	size_t binnedTriangles = 0;
+	// pixel centers covered by the triangles, i.e. the depth or visibility buffer accesses,
+	// every pixel for the visibility resolve
+	size_t coveredPixels = 0;
+	// opaque pass and visibility resolve only
+	size_t shadedPixels = 0;
+	// DrawDepth, DrawVisibility and DrawOpaque, the triangles pass jobs and the longest of them,
+	// no thread count brings the triangles pass below it
+	size_t triangleJobs = 0;
+	double maxTriangleJobSeconds = 0.0;
+	// CPU time of the triangles pass, binning back end included, and of the big triangles pass
+	double smallTrianglesSeconds = 0.0;
+	double bigTrianglesSeconds = 0.0;
+};
+
+// records appended by the triangle passes, one per screen tile, see TypesAndConstants.hlsli,
+// the sign bit of the tile offset flags a covered tile with the coarse tile classification
+struct BigTriangleDepth
+{
+	float tileOffset;
+	Float3 p0WS;
+	Float3 p1WS;
+	Float3 p2WS;
+};
+
+struct BigTriangleOpaque
+{
+	float tileOffset;
+	Float3 p0WS;
+	Float3 p1WS;
+	Float3 p2WS;
+	unsigned int packedNormal[3];
+	unsigned int packedColor[3][2];
+};
+
+// compact big triangles mode, a record per big triangle, with the setup after the bounds are snapped,
+// see CPUGPUCommon.h
+struct CompactBigTriangleDepth
+{
+	Float2 p0SS;
+	Float2 p1SS;
+	Float2 p2SS;
+	float z0NDC;
+	float z1NDC;
+	float z2NDC;
+	float area;
+	Float2 minP;
+	Float2 maxP;
+	float tilesCountX;
+	float pad;
+};
+
+struct CompactBigTriangleOpaque
+{
+	CompactBigTriangleDepth triangle;
+	float invW0;
+	float invW1;
+	float invW2;
+	Float3 p0WS;
+	Float3 p1WS;
+	Float3 p2WS;
+	unsigned int packedNormal[3];
+	unsigned int packedColor[3][2];
+};
+
+// and a tile entry, which points at it
+struct BigTriangleTile
+{
+	float tileOffset;
+	unsigned int record;
+};
+
+class Rasterizer
+{
+public:
+
+	// 0 means one thread per hardware thread
+	explicit Rasterizer(unsigned int threadsCount = 0);
+	Rasterizer(const Rasterizer&) = delete;
+	Rasterizer& operator=(const Rasterizer&) = delete;
+	~Rasterizer();
+
+	void SetSettings(const RasterizationSettings& settings) { _settings = settings; }
+	const RasterizationSettings& GetSettings() const { return _settings; }
+
+	unsigned int GetThreadsCount() const { return _threadPool.GetThreadsCount(); }
+
+	// camera or cascade depth, TriangleDepthCS followed by BigTriangleDepthCS
+	Statistics DrawDepth(
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		size_t commandsCount,
+		const Float4x4& VP,
+		DepthTarget& depth);
+
+	// TriangleOpaqueCS followed by BigTriangleOpaqueCS,
+	// depth is the camera depth pass output, shadowMaps are cascadesCount cascades depths
+	Statistics DrawOpaque(
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		size_t commandsCount,
+		const Float4x4& VP,
+		const ShadingSettings& shading,
+		const DepthTarget& depth,
+		const DepthTarget* shadowMaps,
+		ColorTarget& renderTarget);
+
+	// multi-view depth, e.g. the shadow cascades: every triangle is fetched and transformed to world space once,
+	// then projected and rasterized into every view set in the viewMasks of its command, bit v for VPs[v] and depths[v],
+	// as the per-cascade instance lists of CullingCS would be merged, up to MAX_CASCADES_COUNT views,
+	// jobs are split as in DrawDepth, the coarse depth is per view, binning is ignored, depth is written with atomics,
+	// it pays off on vertex bound passes only, with 4-16 px triangles a DrawDepth per view is faster,
+	// the GPU shadows keep a pass per cascade, so CPURasterizerMultiView.cpp is built into the benchmark only
+	Statistics DrawDepthMultiView(
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		const unsigned int* viewMasks,
+		size_t commandsCount,
+		const Float4x4* VPs,
+		DepthTarget* depths,
+		int viewsCount);
+
+	// visibility buffer mode, the depth pass writes the ID of the closest triangle along with its depth,
+	// IDs are (command, instance, triangle) of the commands passed, up to 2^32 - 1 triangle instances,
+	// the rest isn't rasterized and is counted in droppedIDTriangles
+	Statistics DrawVisibility(
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		size_t commandsCount,
+		const Float4x4& VP,
+		VisibilityTarget& visibility);
+
+	// the command, instance and triangle of a non zero visibility ID,
+	// as assigned by the last DrawVisibility or ResolveVisibility, with the commands it was given
+	void DecodeVisibilityID(
+		const IndirectCommand* commands,
+		unsigned int ID,
+		size_t& commandIndex,
+		unsigned int& instanceID,
+		unsigned int& triangleIndex) const;
+
+	// replaces DrawOpaque: a single full screen pass, which fetches and interpolates the attributes
+	// of the visible triangle once per pixel, instead of rasterizing every triangle again,
+	// commands must be the same DrawVisibility was given
+	Statistics ResolveVisibility(
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		size_t commandsCount,
+		const Float4x4& VP,
+		const ShadingSettings& shading,
+		const VisibilityTarget& visibility,
+		const DepthTarget* shadowMaps,
+		ColorTarget& renderTarget);
+
+private:
+
+	struct BinningArena;
+	struct CoarseDepth;
+	struct MeshletVertexCache;
+
+	// world space vertices of a multi-view job, and their views, up to MultiViewMaxTriangles
+	struct MultiViewTriangles
+	{
+		std::vector<Float3> positionsWS;
+		std::vector<unsigned int> masks;
+	};
+
+	// a thread group of the triangles passes, a range of triangles of a range of instances of a command
+	struct TriangleJob
+	{
+		unsigned int command;
+		unsigned int firstTriangle;
+		unsigned int firstInstance;
+		unsigned int instancesCount;
+	};
+
+	// big triangles appended for a view, in multi-view mode
+	struct ViewBigTriangles
+	{
+		std::vector<BigTriangleDepth> depth;
+		std::vector<CompactBigTriangleDepth> compactDepth;
+		std::vector<BigTriangleTile> tiles;
+	};
+
+	void _resetBins(const Float2& outputRes);
+	// first ID of every command, plus the total, in _visibilityIDs
+	void _setupVisibilityIDs(const IndirectCommand* commands, size_t commandsCount);
+	// _triangleJobs of the commands, see trianglesPerJob and instancesPerJob
+	void _setupTriangleJobs(const IndirectCommand* commands, size_t commandsCount);
+
+	// the passes below take the rasterization mode, generic or specialized, see DispatchMode()
+
+	// DrawDepth and DrawVisibility, write(x, y, depth, ID) and writeExclusive for the binning back end,
+	// IDs are 0 without _visibilityIDs, read(x, y) returns the depth for the coarse depth
+	template<typename Mode, typename WriteFunction, typename WriteExclusiveFunction, typename ReadFunction>
+	Statistics _drawDepth(
+		const Mode& mode,
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		size_t commandsCount,
+		const Float4x4& VP,
+		const Float2& outputRes,
+		bool visibility,
+		WriteFunction&& write,
+		WriteExclusiveFunction&& writeExclusive,
+		ReadFunction&& read);
+
+	// BigTriangleDepthCS over the tiles the triangles pass appended, a job per tile, returns the tiles count,
+	// IDs are taken from _bigTrianglesIDs in visibility mode, coarseDepth may be null
+	template<typename Mode, typename WriteFunction, typename ReadFunction>
+	size_t _drawBigTriangles(
+		const Mode& mode,
+		const std::vector<BigTriangleDepth>& bigTriangles,
+		const std::vector<CompactBigTriangleDepth>& records,
+		const std::vector<BigTriangleTile>& tiles,
+		const Float4x4& VP,
+		const Float2& outputRes,
+		bool visibility,
+		BlockKernel blockKernel,
+		CoarseDepth* coarseDepth,
+		WriteFunction&& write,
+		ReadFunction&& read,
+		std::atomic<size_t>& coveredPixels,
+		std::atomic<size_t>& occludedTiles);
+
+	template<typename Mode>
+	Statistics _drawDepthMultiView(
+		const Mode& mode,
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		const unsigned int* viewMasks,
+		size_t commandsCount,
+		const Float4x4* VPs,
+		DepthTarget* depths,
+		int viewsCount);
+
+	template<typename Mode>
+	Statistics _drawOpaque(
+		const Mode& mode,
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		size_t commandsCount,
+		const Float4x4& VP,
+		const ShadingSettings& shading,
+		const DepthTarget& depth,
+		const DepthTarget* shadowMaps,
+		ColorTarget& renderTarget);
+
+	ThreadPool _threadPool;
+	RasterizationSettings _settings;
+
+	// kept between passes, so their memory is reused
+	std::vector<BigTriangleDepth> _bigTrianglesDepth;
+	std::vector<BigTriangleOpaque> _bigTrianglesOpaque;
+	// compact big triangles mode, records are in either of them, depending on the pass
+	std::vector<CompactBigTriangleDepth> _compactBigTrianglesDepth;
+	std::vector<CompactBigTriangleOpaque> _compactBigTrianglesOpaque;
+	std::vector<BigTriangleTile> _bigTriangleTiles;
+	// visibility buffer mode, an ID per _bigTrianglesDepth tile, or per record in compact mode
+	std::vector<unsigned int> _bigTrianglesIDs;
+	std::mutex _bigTrianglesMutex;
+
+	std::vector<uint64_t> _visibilityIDs;
+	std::vector<TriangleJob> _triangleJobs;
+
+	std::vector<ViewBigTriangles> _viewBigTriangles;
+	// per thread
+	std::vector<MultiViewTriangles> _multiViewTriangles;
+	std::vector<MeshletVertexCache> _meshletVertexCaches;
+
+	std::unique_ptr<CoarseDepth> _coarseDepth;
+	// multi-view mode, per view
+	std::vector<std::unique_ptr<CoarseDepth>> _viewCoarseDepths;
+
+	// binning mode, an arena per thread, so the front end appends without locks
+	std::vector<std::unique_ptr<BinningArena>> _binningArenas;
+	unsigned int _binsCountX = 0;
+	unsigned int _binsCountY = 0;
+};
+
+}
@@ -0,0 +1,82 @@
+#include "CPURasterizerKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+namespace CPURasterizer
+{
+
+// a row of the block per iteration, see RasterizeBlockScalar
+uint64_t RasterizeBlockAVX2(const BlockSetup& block, BlockOutput& output)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 invArea = _mm256_set1_ps(block.invArea);
+	const __m256 z0 = _mm256_set1_ps(block.z[0]);
+	const __m256 z1 = _mm256_set1_ps(block.z[1]);
+	const __m256 z2 = _mm256_set1_ps(block.z[2]);
+
+	const unsigned int columnsMask = (1u << block.columns) - 1;
+
+	__m256 xOffset = _mm256_add_ps(
+		_mm256_set1_ps(static_cast<float>(block.xOffset)),
+		_mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+
+	// E(x + a, y + b) = E(x, y) - a * dy + b * dx, x part doesn't change along the column
+	__m256 partial[3];
+	__m256 dx[3];
+	for (int edge = 0; edge < 3; edge++)
+	{
+		partial[edge] = _mm256_sub_ps(
+			_mm256_set1_ps(block.area[edge]),
+			_mm256_mul_ps(xOffset, _mm256_set1_ps(block.dy[edge])));
+		dx[edge] = _mm256_set1_ps(block.dx[edge]);
+	}
+
+	uint64_t mask = 0;
+	for (unsigned int row = 0; row < block.rows; row++)
+	{
+		__m256 yOffset = _mm256_set1_ps(static_cast<float>(block.yOffset + row));
+
+		__m256 area[3];
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int edge = 0; edge < 3; edge++)
+		{
+			area[edge] = _mm256_add_ps(partial[edge], _mm256_mul_ps(yOffset, dx[edge]));
+			inside = _mm256_and_ps(
+				inside,
+				block.inclusive[edge] ?
+					_mm256_cmp_ps(area[edge], zero, _CMP_GE_OQ) :
+					_mm256_cmp_ps(area[edge], zero, _CMP_GT_OQ));
+		}
+
+		unsigned int bits = static_cast<unsigned int>(_mm256_movemask_ps(inside)) & columnsMask;
+		if (bits == 0)
+		{
+			continue;
+		}
+
+		// convert to barycentric weights
+		__m256 weight0 = _mm256_mul_ps(area[0], invArea);
+		__m256 weight1 = _mm256_mul_ps(area[1], invArea);
+		__m256 weight2 = _mm256_sub_ps(_mm256_sub_ps(one, weight0), weight1);
+
+		__m256 depth = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(weight0, z0), _mm256_mul_ps(weight1, z1)),
+			_mm256_mul_ps(weight2, z2));
+
+		unsigned int pixel = row * BlockSize;
+		_mm256_store_ps(output.depth + pixel, depth);
+		_mm256_store_ps(output.area0 + pixel, area[0]);
+		_mm256_store_ps(output.area1 + pixel, area[1]);
+
+		mask |= static_cast<uint64_t>(bits) << pixel;
+	}
+
+	return mask;
+}
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include "CPURasterizerKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+namespace CPURasterizer
+{
+
+// two rows of the block per iteration, see RasterizeBlockScalar
+uint64_t RasterizeBlockAVX512(const BlockSetup& block, BlockOutput& output)
+{
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 one = _mm512_set1_ps(1.0f);
+	const __m512 invArea = _mm512_set1_ps(block.invArea);
+	const __m512 z0 = _mm512_set1_ps(block.z[0]);
+	const __m512 z1 = _mm512_set1_ps(block.z[1]);
+	const __m512 z2 = _mm512_set1_ps(block.z[2]);
+
+	const unsigned int columnsMask = (1u << block.columns) - 1;
+
+	__m512 xOffset = _mm512_add_ps(
+		_mm512_set1_ps(static_cast<float>(block.xOffset)),
+		_mm512_setr_ps(
+			0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f,
+			0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+	const __m512 rowOffsets = _mm512_setr_ps(
+		0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+		1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+
+	// E(x + a, y + b) = E(x, y) - a * dy + b * dx, x part doesn't change along the column
+	__m512 partial[3];
+	__m512 dx[3];
+	for (int edge = 0; edge < 3; edge++)
+	{
+		partial[edge] = _mm512_sub_ps(
+			_mm512_set1_ps(block.area[edge]),
+			_mm512_mul_ps(xOffset, _mm512_set1_ps(block.dy[edge])));
+		dx[edge] = _mm512_set1_ps(block.dx[edge]);
+	}
+
+	uint64_t mask = 0;
+	for (unsigned int row = 0; row < block.rows; row += 2)
+	{
+		__m512 yOffset = _mm512_add_ps(
+			_mm512_set1_ps(static_cast<float>(block.yOffset + row)),
+			rowOffsets);
+
+		__mmask16 lanesMask = static_cast<__mmask16>(
+			columnsMask | (row + 1 < block.rows ? columnsMask << BlockSize : 0));
+
+		__m512 area[3];
+		for (int edge = 0; edge < 3; edge++)
+		{
+			area[edge] = _mm512_add_ps(partial[edge], _mm512_mul_ps(yOffset, dx[edge]));
+			lanesMask = block.inclusive[edge] ?
+				_mm512_mask_cmp_ps_mask(lanesMask, area[edge], zero, _CMP_GE_OQ) :
+				_mm512_mask_cmp_ps_mask(lanesMask, area[edge], zero, _CMP_GT_OQ);
+		}
+
+		if (lanesMask == 0)
+		{
+			continue;
+		}
+
+		// convert to barycentric weights
+		__m512 weight0 = _mm512_mul_ps(area[0], invArea);
+		__m512 weight1 = _mm512_mul_ps(area[1], invArea);
+		__m512 weight2 = _mm512_sub_ps(_mm512_sub_ps(one, weight0), weight1);
+
+		__m512 depth = _mm512_add_ps(
+			_mm512_add_ps(_mm512_mul_ps(weight0, z0), _mm512_mul_ps(weight1, z1)),
+			_mm512_mul_ps(weight2, z2));
+
+		unsigned int pixel = row * BlockSize;
+		_mm512_store_ps(output.depth + pixel, depth);
+		_mm512_store_ps(output.area0 + pixel, area[0]);
+		_mm512_store_ps(output.area1 + pixel, area[1]);
+
+		mask |= static_cast<uint64_t>(lanesMask) << pixel;
+	}
+
+	return mask;
+}
+
+}
+
+#endif
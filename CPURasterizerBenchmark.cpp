@@ -0,0 +1,45 @@
+#include "BenchmarkHarness.h"
+
+// CPU rasterizer depth pass throughput: per-pixel stepping against the block kernels
+// of every supported ISA, single threaded, then atomics against binning, multithreaded,
+// the masked occlusion buffer against a per-pixel depth buffer of the same resolution,
+// the visibility buffer against the depth and opaque passes,
+// the big triangles settings over a camera path, swept and tuned at runtime,
+// the per tile big triangles records against the compact ones,
+// the big triangle tiles with and without the coarse classification,
+// the coarse depth rejection, for front to back and unsorted submission,
+// the previous frame depth occlusion culling against the two-phase one,
+// the shadow cascades rendered a pass per cascade against a single multi-view pass,
+// the generic per-pixel kernel against the ones specialized per rasterization mode,
+// the meshlet triangles with and without the per-meshlet vertex cache,
+// heavily instanced commands in a job each against jobs of instance slices,
+// the estimated routes of the meshlets between the rasterizers against the exact ones,
+// the culling results compaction with atomics against the one with a prefix sum,
+// and the culling engine kernels of every supported ISA, a million objects, then compacted,
+// the scenes and tables are in BenchmarkHarness.h, the comparisons in a Benchmark*.cpp per theme
+int main()
+{
+	using namespace Benchmark;
+
+	CompareKernels();
+	CompareWatertightness();
+	CompareBinning();
+	CompareOcclusion();
+	CompareVisibility();
+	CompareBigTriangleSettings();
+	CompareBigTriangleRecords();
+	CompareTileClassification();
+	CompareCoarseDepth();
+	CompareOcclusionCulling();
+	CompareMultiViewShadows();
+	CompareSpecializedKernels();
+#ifdef MESHLET_INDICES
+	CompareMeshletVertexCache();
+	CompareInstanceSlices();
+	CompareClusterRouting();
+#endif
+	CompareStreamCompaction();
+	CompareCullingEngine();
+
+	return 0;
+}
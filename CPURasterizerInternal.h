@@ -0,0 +1,1829 @@
+#pragma once
+
+#include "CPURasterizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// the helpers and pass internals the CPU rasterizer translation units share:
+// CPURasterizer.cpp has the depth and opaque passes, CPURasterizerVisibility.cpp the visibility buffer,
+// CPURasterizerMultiView.cpp the multi-view depth pass
+namespace CPURasterizer
+{
+
+static const Float3 SkyColor = { 136.0f / 255.0f, 198.0f / 255.0f, 252.0f / 255.0f };
+
+static const float FloatMax = 3.402823466e+38f;
+
+inline unsigned int AsUint(float value)
+{
+	unsigned int result;
+	memcpy(&result, &value, sizeof(result));
+	return result;
+}
+
+inline float AsFloat(unsigned int value)
+{
+	float result;
+	memcpy(&result, &value, sizeof(result));
+	return result;
+}
+
+inline float Lerp(float a, float b, float t)
+{
+	return a + t * (b - a);
+}
+
+inline float Frac(float value)
+{
+	return value - floorf(value);
+}
+
+inline float Saturate(float value)
+{
+	return std::min(std::max(value, 0.0f), 1.0f);
+}
+
+// R8G8B8A8_UNORM
+inline unsigned int PackUnorm(const Float4& color)
+{
+	auto unorm = [](float value)
+	{
+		return static_cast<unsigned int>(Saturate(value) * 255.0f + 0.5f);
+	};
+
+	return
+		(unorm(color.w) << 24) |
+		(unorm(color.z) << 16) |
+		(unorm(color.y) << 8) |
+		unorm(color.x);
+}
+
+// mul(M, float4(p, 1.0)) of the shaders
+inline Float4 Transform(const Float3& p, const Float4x4& M)
+{
+	return
+	{
+		p.x * M.m[0][0] + p.y * M.m[1][0] + p.z * M.m[2][0] + M.m[3][0],
+		p.x * M.m[0][1] + p.y * M.m[1][1] + p.z * M.m[2][1] + M.m[3][1],
+		p.x * M.m[0][2] + p.y * M.m[1][2] + p.z * M.m[2][2] + M.m[3][2],
+		p.x * M.m[0][3] + p.y * M.m[1][3] + p.z * M.m[2][3] + M.m[3][3]
+	};
+}
+
+inline Float3 TransformPoint(const Float3& p, const Float4x4& M)
+{
+	Float4 result = Transform(p, M);
+	return { result.x, result.y, result.z };
+}
+
+// f16tof32
+inline float HalfToFloat(unsigned int half)
+{
+	unsigned int sign = (half >> 15) & 0x1;
+	int exponent = static_cast<int>((half >> 10) & 0x1F);
+	unsigned int mantissa = half & 0x3FF;
+
+	float value;
+	if (exponent == 0)
+	{
+		value = ldexpf(static_cast<float>(mantissa), -24);
+	}
+	else if (exponent == 31)
+	{
+		value = mantissa == 0 ? INFINITY : NAN;
+	}
+	else
+	{
+		value = ldexpf(static_cast<float>(mantissa | 0x400), exponent - 25);
+	}
+
+	return sign ? -value : value;
+}
+
+inline Float3 UnpackNormal(unsigned int packed)
+{
+	// 1 / (2 ^ N - 1), N = 10, see Scene.cpp normal packing
+	const float denom = 1.0f / 1023.0f;
+
+	return
+	{
+		static_cast<float>((packed >> 20) & 0x3FF) * denom * 2.0f - 1.0f,
+		static_cast<float>((packed >> 10) & 0x3FF) * denom * 2.0f - 1.0f,
+		static_cast<float>(packed & 0x3FF) * denom * 2.0f - 1.0f
+	};
+}
+
+inline Float3 UnpackColor(const unsigned int packed[2])
+{
+	return
+	{
+		HalfToFloat(packed[0] >> 16),
+		HalfToFloat(packed[0] & 0xFFFF),
+		HalfToFloat(packed[1] >> 16)
+	};
+}
+
+// Show Meshlets color, same as MeshColor() in the shaders
+inline Float3 MeshColor(unsigned int meshID)
+{
+	return
+	{
+		static_cast<float>(meshID & 1),
+		static_cast<float>(meshID & 3) / 4.0f,
+		static_cast<float>(meshID & 7) / 8.0f
+	};
+}
+
+// indices into the command's meshlet vertices, see PackMeshletTriangle
+inline void GetMeshletTriangle(
+	const SceneBuffers& scene,
+	const IndirectCommand& command,
+	unsigned int triangleIndex,
+	unsigned int& l0,
+	unsigned int& l1,
+	unsigned int& l2)
+{
+	unsigned int packedTriangle = scene.indices[command.startMeshletTriangleLocation + triangleIndex];
+	l0 = packedTriangle & 0xFF;
+	l1 = (packedTriangle >> 8) & 0xFF;
+	l2 = (packedTriangle >> 16) & 0xFF;
+}
+
+inline void GetTriangleIndices(
+	const SceneBuffers& scene,
+	const IndirectCommand& command,
+	unsigned int triangleIndex,
+	unsigned int& i0,
+	unsigned int& i1,
+	unsigned int& i2)
+{
+	const unsigned int* indices = scene.indices;
+#if defined(MESHLET_INDICES)
+	unsigned int l0, l1, l2;
+	GetMeshletTriangle(scene, command, triangleIndex, l0, l1, l2);
+	i0 = indices[command.startMeshletVertexLocation + l0];
+	i1 = indices[command.startMeshletVertexLocation + l1];
+	i2 = indices[command.startMeshletVertexLocation + l2];
+#elif defined(GPU_SOA_BUFFERS)
+	unsigned int startIndexLocation = command.args.startIndexLocation / INDICES_STRIDE + triangleIndex;
+	i0 = indices[0 * scene.totalTriangles + startIndexLocation];
+	i1 = indices[1 * scene.totalTriangles + startIndexLocation];
+	i2 = indices[2 * scene.totalTriangles + startIndexLocation];
+#else
+	unsigned int startIndexLocation = command.args.startIndexLocation + triangleIndex * 3;
+	i0 = indices[startIndexLocation + 0];
+	i1 = indices[startIndexLocation + 1];
+	i2 = indices[startIndexLocation + 2];
+#endif
+}
+
+inline Float3 GetVertexPosition(
+	const SceneBuffers& scene,
+	const IndirectCommand& command,
+	unsigned int index)
+{
+	size_t vertex = static_cast<size_t>(command.args.baseVertexLocation + static_cast<int>(index));
+#ifdef QUANTIZED_POSITIONS
+	// see QuantizePosition() in Common.h
+	const unsigned int* packed = static_cast<const unsigned int*>(scene.positions) + vertex * 2;
+	const float denom = 1.0f / 65535.0f;
+	return
+	{
+		command.positionsOrigin.x + static_cast<float>(packed[0] & 0xFFFF) * denom * command.positionsScale.x,
+		command.positionsOrigin.y + static_cast<float>(packed[0] >> 16) * denom * command.positionsScale.y,
+		command.positionsOrigin.z + static_cast<float>(packed[1] & 0xFFFF) * denom * command.positionsScale.z
+	};
+#else
+	const float* position = static_cast<const float*>(scene.positions) + vertex * 3;
+	return { position[0], position[1], position[2] };
+#endif
+}
+
+inline float Area(const Float2& v0, const Float2& v1, const Float2& v2)
+{
+	Float2 e0 = { v1.x - v0.x, v1.y - v0.y };
+	Float2 e1 = { v2.x - v0.x, v2.y - v0.y };
+	return e0.x * e1.y - e1.x * e0.y;
+}
+
+inline void EdgeFunction(
+	const Float2& v0,
+	const Float2& v1,
+	const Float2& p,
+	float& area,
+	Float2& dxdy)
+{
+	Float2 e0 = { v1.x - v0.x, v1.y - v0.y };
+	Float2 e1 = { p.x - v0.x, p.y - v0.y };
+	area = e0.x * e1.y - e1.x * e0.y;
+	dxdy = e0;
+}
+
+// see the rules quoted in Rasterization.hlsli
+inline bool EdgeIsTopLeft(const Float2& v0, const Float2& v1)
+{
+	Float2 e = { v1.x - v0.x, v1.y - v0.y };
+	bool top = e.y == 0.0f && e.x > 0.0f;
+	bool left = e.y < 0.0f;
+	return top || left;
+}
+
+inline float EdgeScanlineIntersection(const Float2& v0, const Float2& v1, float y)
+{
+	float denom = v1.y - v0.y;
+	return denom == 0.0f ? FloatMax : (y - v0.y) * (1.0f / denom);
+}
+
+// everything the pixel loops need, computed once per triangle (or per big triangle tile)
+struct TriangleSetup
+{
+	Float2 p0SS;
+	Float2 p1SS;
+	Float2 p2SS;
+	float z0NDC;
+	float z1NDC;
+	float z2NDC;
+	float invW0;
+	float invW1;
+	float invW2;
+	float area;
+	float invArea;
+
+	// min is snapped to a pixel center, both are clamped to the screen
+	Float2 minP;
+	Float2 maxP;
+
+	// edge functions at minP
+	float area0;
+	float area1;
+	float area2;
+	Float2 dxdy0;
+	Float2 dxdy1;
+	Float2 dxdy2;
+	bool topLeft0;
+	bool topLeft1;
+	bool topLeft2;
+
+	// fixed point edge functions at minP, in 1 / FIXED_POINT_SUBPIXEL_STEPS^2 pixels,
+	// used instead of the float ones above, when set
+	bool fixedPoint;
+	int64_t fixedArea;
+	int64_t fixedArea0;
+	int64_t fixedArea1;
+	int64_t fixedArea2;
+	// E(x + a, y + b) = E(x, y) + a * stepX + b * stepY, exact
+	int64_t fixedStepX0;
+	int64_t fixedStepX1;
+	int64_t fixedStepX2;
+	int64_t fixedStepY0;
+	int64_t fixedStepY1;
+	int64_t fixedStepY2;
+};
+
+// area and bounds, from the screen space positions
+inline void SetupBounds(TriangleSetup& t)
+{
+	t.area = Area(t.p0SS, t.p1SS, t.p2SS);
+
+	t.minP = { std::min(std::min(t.p0SS.x, t.p1SS.x), t.p2SS.x), std::min(std::min(t.p0SS.y, t.p1SS.y), t.p2SS.y) };
+	t.maxP = { std::max(std::max(t.p0SS.x, t.p1SS.x), t.p2SS.x), std::max(std::max(t.p0SS.y, t.p1SS.y), t.p2SS.y) };
+}
+
+// CS -> NDC -> DX [0,1] -> SS, and the screen space bounds
+inline void ProjectTriangle(
+	const Float4& p0CS,
+	const Float4& p1CS,
+	const Float4& p2CS,
+	const Float2& outputRes,
+	TriangleSetup& t)
+{
+	// 1 / z for each vertex (z in VS)
+	t.invW0 = 1.0f / p0CS.w;
+	t.invW1 = 1.0f / p1CS.w;
+	t.invW2 = 1.0f / p2CS.w;
+
+	t.p0SS = { (p0CS.x * t.invW0 * 0.5f + 0.5f) * outputRes.x, (p0CS.y * t.invW0 * -0.5f + 0.5f) * outputRes.y };
+	t.p1SS = { (p1CS.x * t.invW1 * 0.5f + 0.5f) * outputRes.x, (p1CS.y * t.invW1 * -0.5f + 0.5f) * outputRes.y };
+	t.p2SS = { (p2CS.x * t.invW2 * 0.5f + 0.5f) * outputRes.x, (p2CS.y * t.invW2 * -0.5f + 0.5f) * outputRes.y };
+
+	t.z0NDC = p0CS.z * t.invW0;
+	t.z1NDC = p1CS.z * t.invW1;
+	t.z2NDC = p2CS.z * t.invW2;
+
+	SetupBounds(t);
+}
+
+inline void ClampToScreenBounds(const Float2& outputRes, TriangleSetup& t)
+{
+	t.minP.x = std::min(std::max(t.minP.x, 0.0f), outputRes.x);
+	t.minP.y = std::min(std::max(t.minP.y, 0.0f), outputRes.y);
+	t.maxP.x = std::min(std::max(t.maxP.x, 0.0f), outputRes.x);
+	t.maxP.y = std::min(std::max(t.maxP.y, 0.0f), outputRes.y);
+}
+
+inline void SnapMinBoundToPixelCenter(TriangleSetup& t)
+{
+	t.minP.x = ceilf(t.minP.x - 0.5f) + 0.5f;
+	t.minP.y = ceilf(t.minP.y - 0.5f) + 0.5f;
+}
+
+struct FixedPoint2
+{
+	int64_t x;
+	int64_t y;
+};
+
+// halfway cases round up, as SnapToSubpixels() in the shaders, spelled out on both sides,
+// so it doesn't depend on what round() does there, exact inside of the guard band
+inline FixedPoint2 SnapToSubpixels(const Float2& p)
+{
+	return
+	{
+		static_cast<int64_t>(floorf(p.x * FIXED_POINT_SUBPIXEL_STEPS + 0.5f)),
+		static_cast<int64_t>(floorf(p.y * FIXED_POINT_SUBPIXEL_STEPS + 0.5f))
+	};
+}
+
+inline void FixedPointEdgeFunction(
+	const FixedPoint2& v0,
+	const FixedPoint2& v1,
+	const FixedPoint2& p,
+	int64_t& area,
+	int64_t& stepX,
+	int64_t& stepY)
+{
+	FixedPoint2 e0 = { v1.x - v0.x, v1.y - v0.y };
+	FixedPoint2 e1 = { p.x - v0.x, p.y - v0.y };
+	area = e0.x * e1.y - e1.x * e0.y;
+	// a pixel is FIXED_POINT_SUBPIXEL_STEPS steps
+	stepX = -e0.y * FIXED_POINT_SUBPIXEL_STEPS;
+	stepY = e0.x * FIXED_POINT_SUBPIXEL_STEPS;
+}
+
+inline bool FixedPointEdgeIsTopLeft(const FixedPoint2& v0, const FixedPoint2& v1)
+{
+	FixedPoint2 e = { v1.x - v0.x, v1.y - v0.y };
+	bool top = e.y == 0 && e.x > 0;
+	bool left = e.y < 0;
+	return top || left;
+}
+
+inline bool InsideGuardBand(const TriangleSetup& t)
+{
+	const float guardBand = FIXED_POINT_GUARD_BAND;
+	return
+		fabsf(t.p0SS.x) < guardBand && fabsf(t.p0SS.y) < guardBand &&
+		fabsf(t.p1SS.x) < guardBand && fabsf(t.p1SS.y) < guardBand &&
+		fabsf(t.p2SS.x) < guardBand && fabsf(t.p2SS.y) < guardBand;
+}
+
+// fixed point mode, done right after the projection, so the culling tests and bounds
+// see the very same vertices as the edge functions, and the area sign is exact
+inline void SnapVertices(TriangleSetup& t)
+{
+	if (!InsideGuardBand(t))
+	{
+		return;
+	}
+
+	const float invSteps = 1.0f / FIXED_POINT_SUBPIXEL_STEPS;
+	FixedPoint2 p0 = SnapToSubpixels(t.p0SS);
+	FixedPoint2 p1 = SnapToSubpixels(t.p1SS);
+	FixedPoint2 p2 = SnapToSubpixels(t.p2SS);
+	// exact, up to FIXED_POINT_GUARD_BAND * FIXED_POINT_SUBPIXEL_STEPS fits into the mantissa
+	t.p0SS = { p0.x * invSteps, p0.y * invSteps };
+	t.p1SS = { p1.x * invSteps, p1.y * invSteps };
+	t.p2SS = { p2.x * invSteps, p2.y * invSteps };
+
+	SetupBounds(t);
+
+	int64_t area, unused;
+	FixedPointEdgeFunction(p0, p1, p2, area, unused, unused);
+	t.area = static_cast<float>(area) * invSteps * invSteps;
+}
+
+// 64-bit edge functions of the snapped vertices,
+// false for triangles outside of the guard band, which are left to the float path
+inline bool SetupFixedPointEdges(TriangleSetup& t)
+{
+	if (!InsideGuardBand(t))
+	{
+		return false;
+	}
+
+	FixedPoint2 p0 = SnapToSubpixels(t.p0SS);
+	FixedPoint2 p1 = SnapToSubpixels(t.p1SS);
+	FixedPoint2 p2 = SnapToSubpixels(t.p2SS);
+	// pixel centers are exact
+	FixedPoint2 minP = SnapToSubpixels(t.minP);
+
+	int64_t unused;
+	FixedPointEdgeFunction(p0, p1, p2, t.fixedArea, unused, unused);
+	t.invArea = 1.0f / static_cast<float>(t.fixedArea);
+
+	FixedPointEdgeFunction(p1, p2, minP, t.fixedArea0, t.fixedStepX0, t.fixedStepY0);
+	FixedPointEdgeFunction(p2, p0, minP, t.fixedArea1, t.fixedStepX1, t.fixedStepY1);
+	FixedPointEdgeFunction(p0, p1, minP, t.fixedArea2, t.fixedStepX2, t.fixedStepY2);
+
+	t.topLeft0 = FixedPointEdgeIsTopLeft(p1, p2);
+	t.topLeft1 = FixedPointEdgeIsTopLeft(p2, p0);
+	t.topLeft2 = FixedPointEdgeIsTopLeft(p0, p1);
+
+	return true;
+}
+
+// https://www.cs.drexel.edu/~david/Classes/Papers/comp175-06-pineda.pdf
+inline void SetupEdges(TriangleSetup& t, bool fixedPoint)
+{
+	t.fixedPoint = fixedPoint && SetupFixedPointEdges(t);
+	if (t.fixedPoint)
+	{
+		return;
+	}
+
+	t.invArea = 1.0f / t.area;
+
+	EdgeFunction(t.p1SS, t.p2SS, t.minP, t.area0, t.dxdy0);
+	EdgeFunction(t.p2SS, t.p0SS, t.minP, t.area1, t.dxdy1);
+	EdgeFunction(t.p0SS, t.p1SS, t.minP, t.area2, t.dxdy2);
+
+	t.topLeft0 = EdgeIsTopLeft(t.p1SS, t.p2SS);
+	t.topLeft1 = EdgeIsTopLeft(t.p2SS, t.p0SS);
+	t.topLeft2 = EdgeIsTopLeft(t.p0SS, t.p1SS);
+}
+
+// rasterization modes of a pass, the generic one branches on the settings in the pixel loops,
+// the specialized ones have them as compile-time constants, so every combination is a kernel of its own
+struct GenericMode
+{
+	bool useTopLeftRule;
+	bool scanlineRasterization;
+};
+
+template<bool UseTopLeftRule, bool ScanlineRasterization>
+struct SpecializedMode
+{
+	static constexpr bool useTopLeftRule = UseTopLeftRule;
+	static constexpr bool scanlineRasterization = ScanlineRasterization;
+};
+
+// function(mode) with the mode of the settings, selected once per pass
+template<typename Function>
+inline Statistics DispatchMode(const RasterizationSettings& settings, Function&& function)
+{
+	if (!settings.specializedKernels)
+	{
+		return function(GenericMode{ settings.useTopLeftRule, settings.scanlineRasterization });
+	}
+
+	if (settings.useTopLeftRule)
+	{
+		return settings.scanlineRasterization ?
+			function(SpecializedMode<true, true>()) :
+			function(SpecializedMode<true, false>());
+	}
+
+	return settings.scanlineRasterization ?
+		function(SpecializedMode<false, true>()) :
+		function(SpecializedMode<false, false>());
+}
+
+template<typename Mode>
+inline bool InsideTriangle(
+	const TriangleSetup& t,
+	const Mode& mode,
+	float area0,
+	float area1,
+	float area2)
+{
+	// edge tests, "frustum culling" for 3 lines in 2D
+	if (mode.useTopLeftRule)
+	{
+		return
+			(t.topLeft0 ? area0 >= 0.0f : area0 > 0.0f) &&
+			(t.topLeft1 ? area1 >= 0.0f : area1 > 0.0f) &&
+			(t.topLeft2 ? area2 >= 0.0f : area2 > 0.0f);
+	}
+
+	return area0 >= 0.0f && area1 >= 0.0f && area2 >= 0.0f;
+}
+
+// same operations as the block kernels, so every path produces the very same depth,
+// which the opaque pass early z test relies on
+inline float InterpolateDepth(const TriangleSetup& t, float area0, float area1)
+{
+	// convert to barycentric weights
+	float weight0 = area0 * t.invArea;
+	float weight1 = area1 * t.invArea;
+	float weight2 = 1.0f - weight0 - weight1;
+
+	return weight0 * t.z0NDC + weight1 * t.z1NDC + weight2 * t.z2NDC;
+}
+
+inline unsigned int LowestBit(uint64_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctzll(mask));
+#endif
+}
+
+// pixel centers minP + n, n = 0, 1, ..., which are <= maxP, as the shaders' loops step
+inline unsigned int PixelCentersCount(float minP, float maxP)
+{
+	if (!(minP <= maxP))
+	{
+		return 0;
+	}
+
+	unsigned int count = static_cast<unsigned int>(maxP - minP);
+	while (count > 0 && minP + count > maxP)
+	{
+		count--;
+	}
+	while (minP + (count + 1) <= maxP)
+	{
+		count++;
+	}
+
+	return count + 1;
+}
+
+// integer edge functions, stepping is exact, so any subrange of
+// [columnsBegin, columnsEnd) x [rowsBegin, rowsEnd) gives the very same values as the direct evaluation
+template<typename PixelFunction>
+inline void RasterizeFixedPoint(
+	const TriangleSetup& t,
+	bool useTopLeftRule,
+	unsigned int columnsBegin,
+	unsigned int columnsEnd,
+	unsigned int rowsBegin,
+	unsigned int rowsEnd,
+	PixelFunction&& pixel)
+{
+	// degenerate after snapping
+	if (t.fixedArea <= 0)
+	{
+		return;
+	}
+
+	// E > 0 is E - 1 >= 0 for integers, so the edge tests are sign tests only
+	int64_t bias0 = !useTopLeftRule || t.topLeft0 ? 0 : -1;
+	int64_t bias1 = !useTopLeftRule || t.topLeft1 ? 0 : -1;
+	int64_t bias2 = !useTopLeftRule || t.topLeft2 ? 0 : -1;
+
+	int64_t row0 = t.fixedArea0 + bias0 + columnsBegin * t.fixedStepX0 + rowsBegin * t.fixedStepY0;
+	int64_t row1 = t.fixedArea1 + bias1 + columnsBegin * t.fixedStepX1 + rowsBegin * t.fixedStepY1;
+	int64_t row2 = t.fixedArea2 + bias2 + columnsBegin * t.fixedStepX2 + rowsBegin * t.fixedStepY2;
+	for (unsigned int yOffset = rowsBegin; yOffset < rowsEnd; yOffset++)
+	{
+		int64_t area0 = row0;
+		int64_t area1 = row1;
+		int64_t area2 = row2;
+		for (unsigned int xOffset = columnsBegin; xOffset < columnsEnd; xOffset++)
+		{
+			if ((area0 | area1 | area2) >= 0)
+			{
+				float area0f = static_cast<float>(area0 - bias0);
+				float area1f = static_cast<float>(area1 - bias1);
+				pixel(
+					t.minP.x + xOffset,
+					t.minP.y + yOffset,
+					area0f,
+					area1f,
+					InterpolateDepth(t, area0f, area1f));
+			}
+
+			area0 += t.fixedStepX0;
+			area1 += t.fixedStepX1;
+			area2 += t.fixedStepX2;
+		}
+
+		row0 += t.fixedStepY0;
+		row1 += t.fixedStepY1;
+		row2 += t.fixedStepY2;
+	}
+}
+
+template<typename PixelFunction>
+inline void RasterizeFixedPoint(const TriangleSetup& t, bool useTopLeftRule, PixelFunction&& pixel)
+{
+	RasterizeFixedPoint(
+		t,
+		useTopLeftRule,
+		0,
+		PixelCentersCount(t.minP.x, t.maxP.x),
+		0,
+		PixelCentersCount(t.minP.y, t.maxP.y),
+		pixel);
+}
+
+// edge functions evaluated directly at every pixel, E(x + a, y + b) = E(x, y) - a * dy + b * dx,
+// a block kernel call per 8x8 pixels of [columnsBegin, columnsEnd) x [rowsBegin, rowsEnd),
+// relative to the first pixel center of the bounds, so any subrange gives the very same values
+template<typename PixelFunction>
+inline void RasterizeBlocks(
+	const TriangleSetup& t,
+	bool useTopLeftRule,
+	BlockKernel kernel,
+	unsigned int columnsBegin,
+	unsigned int columnsEnd,
+	unsigned int rowsBegin,
+	unsigned int rowsEnd,
+	PixelFunction&& pixel)
+{
+	BlockSetup block;
+	block.area[0] = t.area0;
+	block.area[1] = t.area1;
+	block.area[2] = t.area2;
+	block.dx[0] = t.dxdy0.x;
+	block.dx[1] = t.dxdy1.x;
+	block.dx[2] = t.dxdy2.x;
+	block.dy[0] = t.dxdy0.y;
+	block.dy[1] = t.dxdy1.y;
+	block.dy[2] = t.dxdy2.y;
+	block.inclusive[0] = !useTopLeftRule || t.topLeft0;
+	block.inclusive[1] = !useTopLeftRule || t.topLeft1;
+	block.inclusive[2] = !useTopLeftRule || t.topLeft2;
+	block.invArea = t.invArea;
+	block.z[0] = t.z0NDC;
+	block.z[1] = t.z1NDC;
+	block.z[2] = t.z2NDC;
+
+	BlockOutput output;
+	for (unsigned int yOffset = rowsBegin; yOffset < rowsEnd; yOffset += BlockSize)
+	{
+		block.yOffset = yOffset;
+		block.rows = std::min(BlockSize, rowsEnd - yOffset);
+		for (unsigned int xOffset = columnsBegin; xOffset < columnsEnd; xOffset += BlockSize)
+		{
+			block.xOffset = xOffset;
+			block.columns = std::min(BlockSize, columnsEnd - xOffset);
+
+			for (uint64_t mask = kernel(block, output); mask != 0; mask &= mask - 1)
+			{
+				unsigned int index = LowestBit(mask);
+				pixel(
+					t.minP.x + (xOffset + index % BlockSize),
+					t.minP.y + (yOffset + index / BlockSize),
+					output.area0[index],
+					output.area1[index],
+					output.depth[index]);
+			}
+		}
+	}
+}
+
+template<typename PixelFunction>
+inline void RasterizeBlocks(
+	const TriangleSetup& t,
+	bool useTopLeftRule,
+	BlockKernel kernel,
+	PixelFunction&& pixel)
+{
+	RasterizeBlocks(
+		t,
+		useTopLeftRule,
+		kernel,
+		0,
+		PixelCentersCount(t.minP.x, t.maxP.x),
+		0,
+		PixelCentersCount(t.minP.y, t.maxP.y),
+		pixel);
+}
+
+// pixel(x, y, area0, area1, depth) is called for every covered pixel center
+// blockKernel replaces the per-pixel stepping of the shaders, except for scanlines
+template<typename Mode, typename PixelFunction>
+inline void RasterizeTriangle(
+	const TriangleSetup& t,
+	const Mode& mode,
+	const Float2& outputRes,
+	BlockKernel blockKernel,
+	PixelFunction&& pixel)
+{
+	// scanline mode included, the integer edge walk is exact anyway
+	if (t.fixedPoint)
+	{
+		RasterizeFixedPoint(t, mode.useTopLeftRule, pixel);
+		return;
+	}
+
+	if (blockKernel && !mode.scanlineRasterization)
+	{
+		RasterizeBlocks(t, mode.useTopLeftRule, blockKernel, pixel);
+		return;
+	}
+
+	float area0 = t.area0;
+	float area1 = t.area1;
+	float area2 = t.area2;
+
+	if (mode.scanlineRasterization)
+	{
+		for (float y = t.minP.y; y <= t.maxP.y; y += 1.0f)
+		{
+			float t0 = EdgeScanlineIntersection(t.p1SS, t.p2SS, y);
+			float t1 = EdgeScanlineIntersection(t.p2SS, t.p0SS, y);
+			float t2 = EdgeScanlineIntersection(t.p0SS, t.p1SS, y);
+
+			bool t0Test = 0.0f <= t0 && t0 <= 1.0f;
+			bool t1Test = 0.0f <= t1 && t1 <= 1.0f;
+			bool t2Test = 0.0f <= t2 && t2 <= 1.0f;
+
+			// no intersection with a scanline
+			// edge functions aren't stepped to the next row here, same as in the shaders
+			if ((!t0Test && !t1Test) || (!t1Test && !t2Test) || (!t2Test && !t0Test))
+			{
+				continue;
+			}
+
+			float x0 = Lerp(t.p1SS.x, t.p2SS.x, t0);
+			float x1 = Lerp(t.p2SS.x, t.p0SS.x, t1);
+			float x2 = Lerp(t.p0SS.x, t.p1SS.x, t2);
+
+			// filtering out redundant intersection
+			float candidate0 = t0Test ? x0 : Lerp(x1, x2, 0.5f);
+			float candidate1 = t1Test ? x1 : Lerp(x2, x0, 0.5f);
+			float candidate2 = t2Test ? x2 : Lerp(x0, x1, 0.5f);
+
+			float xMin = std::min(candidate0, std::min(candidate1, candidate2));
+			float xMax = std::max(candidate0, std::max(candidate1, candidate2));
+
+			// snap min x bound to pixel center
+			xMin = ceilf(xMin - 0.5f) + 0.5f;
+
+			// top-left rule
+			if (mode.useTopLeftRule)
+			{
+				xMax += Frac(xMax) == 0.5f ? -1.0f : 0.0f;
+			}
+
+			float area0tmp = area0 - t.dxdy0.y * (xMin - t.minP.x);
+			float area1tmp = area1 - t.dxdy1.y * (xMin - t.minP.x);
+
+			for (float x = xMin; x <= xMax; x += 1.0f)
+			{
+				// spans of the triangles crossing the screen edges aren't clamped,
+				// UAV writes out of bounds are dropped on the GPU
+				if (x >= 0.0f && x < outputRes.x)
+				{
+					pixel(x, y, area0tmp, area1tmp, InterpolateDepth(t, area0tmp, area1tmp));
+				}
+
+				// E(x + a, y + b) = E(x, y) - a * dy + b * dx
+				area0tmp -= t.dxdy0.y;
+				area1tmp -= t.dxdy1.y;
+			}
+
+			area0 += t.dxdy0.x;
+			area1 += t.dxdy1.x;
+		}
+	}
+	else
+	{
+		//  --->----
+		// |
+		//  --->----
+		// |
+		//  --->----
+		// etc.
+		for (float y = t.minP.y; y <= t.maxP.y; y += 1.0f)
+		{
+			float area0tmp = area0;
+			float area1tmp = area1;
+			float area2tmp = area2;
+			for (float x = t.minP.x; x <= t.maxP.x; x += 1.0f)
+			{
+				if (InsideTriangle(t, mode, area0tmp, area1tmp, area2tmp))
+				{
+					pixel(x, y, area0tmp, area1tmp, InterpolateDepth(t, area0tmp, area1tmp));
+				}
+
+				// E(x + a, y + b) = E(x, y) - a * dy + b * dx
+				area0tmp -= t.dxdy0.y;
+				area1tmp -= t.dxdy1.y;
+				area2tmp -= t.dxdy2.y;
+			}
+
+			area0 += t.dxdy0.x;
+			area1 += t.dxdy1.x;
+			area2 += t.dxdy2.x;
+		}
+	}
+}
+
+// every pixel center of the tile is inside, the same values as the edge tests paths, without the tests
+template<typename PixelFunction>
+inline void RasterizeCoveredTile(const TriangleSetup& t, PixelFunction&& pixel)
+{
+	unsigned int columns = PixelCentersCount(t.minP.x, t.maxP.x);
+	unsigned int rows = PixelCentersCount(t.minP.y, t.maxP.y);
+	for (unsigned int yOffset = 0; yOffset < rows; yOffset++)
+	{
+		for (unsigned int xOffset = 0; xOffset < columns; xOffset++)
+		{
+			float area0;
+			float area1;
+			if (t.fixedPoint)
+			{
+				area0 = static_cast<float>(t.fixedArea0 + xOffset * t.fixedStepX0 + yOffset * t.fixedStepY0);
+				area1 = static_cast<float>(t.fixedArea1 + xOffset * t.fixedStepX1 + yOffset * t.fixedStepY1);
+			}
+			else
+			{
+				// E(x + a, y + b) = E(x, y) - a * dy + b * dx
+				area0 = t.area0 - xOffset * t.dxdy0.y + yOffset * t.dxdy0.x;
+				area1 = t.area1 - xOffset * t.dxdy1.y + yOffset * t.dxdy1.x;
+			}
+
+			pixel(t.minP.x + xOffset, t.minP.y + yOffset, area0, area1, InterpolateDepth(t, area0, area1));
+		}
+	}
+}
+
+// big triangle tile, edge functions are evaluated directly at every pixel,
+// as the tile is spread over a whole thread group on the GPU
+template<typename Mode, typename PixelFunction>
+inline void RasterizeTile(
+	const TriangleSetup& t,
+	const Mode& mode,
+	BlockKernel blockKernel,
+	bool covered,
+	PixelFunction&& pixel)
+{
+	if (covered)
+	{
+		RasterizeCoveredTile(t, pixel);
+		return;
+	}
+
+	if (t.fixedPoint)
+	{
+		RasterizeFixedPoint(t, mode.useTopLeftRule, pixel);
+		return;
+	}
+
+	// same evaluation, so the block kernel matches the shader exactly here
+	if (blockKernel)
+	{
+		RasterizeBlocks(t, mode.useTopLeftRule, blockKernel, pixel);
+		return;
+	}
+
+	for (unsigned int yOffset = 0; t.minP.y + yOffset <= t.maxP.y; yOffset++)
+	{
+		float y = t.minP.y + yOffset;
+		for (unsigned int xOffset = 0; t.minP.x + xOffset <= t.maxP.x; xOffset++)
+		{
+			float x = t.minP.x + xOffset;
+
+			// E(x + a, y + b) = E(x, y) - a * dy + b * dx
+			float area0 = t.area0 - xOffset * t.dxdy0.y + yOffset * t.dxdy0.x;
+			float area1 = t.area1 - xOffset * t.dxdy1.y + yOffset * t.dxdy1.x;
+			float area2 = t.area2 - xOffset * t.dxdy2.y + yOffset * t.dxdy2.x;
+
+			if (InsideTriangle(t, mode, area0, area1, area2))
+			{
+				pixel(x, y, area0, area1, InterpolateDepth(t, area0, area1));
+			}
+		}
+	}
+}
+
+// front part of TriangleDepthCS / TriangleOpaqueCS, from clip space positions to a triangle setup
+enum class TriangleClass
+{
+	Rejected,
+	Small,
+	Big
+};
+
+inline TriangleClass ClassifyTriangle(
+	const Float4& p0CS,
+	const Float4& p1CS,
+	const Float4& p2CS,
+	const Float2& outputRes,
+	const RasterizationSettings& settings,
+	TriangleSetup& t)
+{
+	// crude "clipping" of polygons behind the camera
+	// w in CS is a view space z
+	// TODO: implement proper near plane clipping
+	if (p0CS.w <= 0.0f || p1CS.w <= 0.0f || p2CS.w <= 0.0f)
+	{
+		return TriangleClass::Rejected;
+	}
+
+	ProjectTriangle(p0CS, p1CS, p2CS, outputRes, t);
+	if (settings.fixedPointEdges)
+	{
+		SnapVertices(t);
+	}
+
+	// backface if negative
+	if (t.area <= 0.0f)
+	{
+		return TriangleClass::Rejected;
+	}
+
+	// frustum culling
+	if (t.minP.x >= outputRes.x || t.maxP.x < 0.0f || t.maxP.y < 0.0f || t.minP.y >= outputRes.y)
+	{
+		return TriangleClass::Rejected;
+	}
+
+	ClampToScreenBounds(outputRes, t);
+
+	// small triangles between pixel centers, HLSL round() is round to nearest even
+	if (nearbyintf(t.minP.x) == nearbyintf(t.maxP.x) || nearbyintf(t.minP.y) == nearbyintf(t.maxP.y))
+	{
+		return TriangleClass::Rejected;
+	}
+
+	SnapMinBoundToPixelCenter(t);
+
+	float dimensionX = t.maxP.x - t.minP.x;
+	float dimensionY = t.maxP.y - t.minP.y;
+	if (dimensionX * dimensionY >= settings.bigTriangleThreshold)
+	{
+		return TriangleClass::Big;
+	}
+
+	SetupEdges(t, settings.fixedPointEdges);
+
+	return TriangleClass::Small;
+}
+
+inline float TilesCount(const TriangleSetup& t, float tileSize, float& tilesCountX)
+{
+	tilesCountX = ceilf((t.maxP.x - t.minP.x) / tileSize);
+	float tilesCountY = ceilf((t.maxP.y - t.minP.y) / tileSize);
+	return tilesCountX * tilesCountY;
+}
+
+// one of the tiles of a big triangle's bounds, row by row
+inline void GetBigTriangleTile(
+	const TriangleSetup& t,
+	float tileOffset,
+	float tilesCountX,
+	float tileSize,
+	Float2& tileMinP,
+	Float2& tileMaxP)
+{
+	float yTileOffset = floorf(tileOffset / tilesCountX);
+	float xTileOffset = tileOffset - yTileOffset * tilesCountX;
+
+	tileMinP = { t.minP.x + xTileOffset * tileSize, t.minP.y + yTileOffset * tileSize };
+	tileMaxP = { std::min(t.maxP.x, tileMinP.x + tileSize), std::min(t.maxP.y, tileMinP.y + tileSize) };
+}
+
+inline void NarrowToTile(float tileOffset, float tilesCountX, float tileSize, TriangleSetup& t)
+{
+	Float2 tileMinP, tileMaxP;
+	GetBigTriangleTile(t, tileOffset, tilesCountX, tileSize, tileMinP, tileMaxP);
+	t.minP = tileMinP;
+	t.maxP = tileMaxP;
+}
+
+enum class TileClass
+{
+	Outside,
+	Partial,
+	Covered
+};
+
+// edge functions at the corners of a tile, outside if they all are outside of any edge,
+// covered if they all are inside of every edge, both with a margin of a pixel step,
+// so the rounding of the per pixel edge functions can't flip a pixel center
+inline TileClass ClassifyTile(const TriangleSetup& t, const Float2& tileMinP, const Float2& tileMaxP)
+{
+	const Float2 v0[3] = { t.p1SS, t.p2SS, t.p0SS };
+	const Float2 v1[3] = { t.p2SS, t.p0SS, t.p1SS };
+	const Float2 corners[4] =
+	{
+		tileMinP,
+		{ tileMaxP.x, tileMinP.y },
+		{ tileMinP.x, tileMaxP.y },
+		tileMaxP
+	};
+
+	bool covered = true;
+	for (int edge = 0; edge < 3; edge++)
+	{
+		Float2 dxdy;
+		float minArea = FLT_MAX;
+		float maxArea = -FLT_MAX;
+		for (const Float2& corner : corners)
+		{
+			float area;
+			EdgeFunction(v0[edge], v1[edge], corner, area, dxdy);
+			minArea = std::min(minArea, area);
+			maxArea = std::max(maxArea, area);
+		}
+
+		float margin = fabsf(dxdy.x) + fabsf(dxdy.y);
+		if (maxArea < -margin)
+		{
+			return TileClass::Outside;
+		}
+
+		covered = covered && minArea > margin;
+	}
+
+	return covered ? TileClass::Covered : TileClass::Partial;
+}
+
+// tile offsets are never negative, so the sign bit is free
+inline float EncodeTileOffset(float tileOffset, bool covered)
+{
+	return AsFloat(AsUint(tileOffset) | (covered ? 0x80000000u : 0u));
+}
+
+inline float DecodeTileOffset(float tileOffset, bool& covered)
+{
+	covered = (AsUint(tileOffset) >> 31) != 0;
+	return fabsf(tileOffset);
+}
+
+// tile offset to append, false for a tile outside of the triangle
+inline bool ClassifyBigTriangleTile(
+	const TriangleSetup& t,
+	float offset,
+	float tilesCountX,
+	float tileSize,
+	size_t& outsideTiles,
+	size_t& coveredTiles,
+	float& tileOffset)
+{
+	Float2 tileMinP, tileMaxP;
+	GetBigTriangleTile(t, offset, tilesCountX, tileSize, tileMinP, tileMaxP);
+
+	TileClass tileClass = ClassifyTile(t, tileMinP, tileMaxP);
+	outsideTiles += tileClass == TileClass::Outside ? 1 : 0;
+	coveredTiles += tileClass == TileClass::Covered ? 1 : 0;
+	tileOffset = EncodeTileOffset(offset, tileClass == TileClass::Covered);
+
+	return tileClass != TileClass::Outside;
+}
+
+// front part of BigTriangleDepthCS / BigTriangleOpaqueCS, narrows the setup down to a tile
+inline void SetupBigTriangleTile(
+	const Float3& p0WS,
+	const Float3& p1WS,
+	const Float3& p2WS,
+	float tileOffset,
+	const Float4x4& VP,
+	const Float2& outputRes,
+	const RasterizationSettings& settings,
+	TriangleSetup& t)
+{
+	const float tileSize = settings.bigTriangleTileSize;
+
+	// no tests for this triangle, since it had passed them already
+	ProjectTriangle(
+		Transform(p0WS, VP),
+		Transform(p1WS, VP),
+		Transform(p2WS, VP),
+		outputRes,
+		t);
+	if (settings.fixedPointEdges)
+	{
+		SnapVertices(t);
+	}
+
+	ClampToScreenBounds(outputRes, t);
+	SnapMinBoundToPixelCenter(t);
+
+	float tilesCountX;
+	TilesCount(t, tileSize, tilesCountX);
+	NarrowToTile(tileOffset, tilesCountX, tileSize, t);
+
+	SetupEdges(t, settings.fixedPointEdges);
+}
+
+// compact big triangles mode, the setup of the triangles pass, after the bounds are snapped
+inline CompactBigTriangleDepth GetCompactBigTriangle(const TriangleSetup& t, float tilesCountX)
+{
+	return { t.p0SS, t.p1SS, t.p2SS, t.z0NDC, t.z1NDC, t.z2NDC, t.area, t.minP, t.maxP, tilesCountX, 0.0f };
+}
+
+// same as SetupBigTriangleTile, without the projection, so the very same setup
+inline void SetupCompactBigTriangleTile(
+	const CompactBigTriangleDepth& record,
+	float tileOffset,
+	const RasterizationSettings& settings,
+	TriangleSetup& t)
+{
+	t.p0SS = record.p0SS;
+	t.p1SS = record.p1SS;
+	t.p2SS = record.p2SS;
+	t.z0NDC = record.z0NDC;
+	t.z1NDC = record.z1NDC;
+	t.z2NDC = record.z2NDC;
+	t.area = record.area;
+	t.minP = record.minP;
+	t.maxP = record.maxP;
+
+	NarrowToTile(tileOffset, record.tilesCountX, settings.bigTriangleTileSize, t);
+
+	SetupEdges(t, settings.fixedPointEdges);
+}
+
+// the big triangle part of the triangle passes, the whole triangle per tile, or a record plus its tile entries,
+// records are local to the vectors given, returns the entries an ID goes with, i.e. tiles or the record
+inline size_t AppendBigTriangle(
+	const TriangleSetup& t,
+	const Float3& p0WS,
+	const Float3& p1WS,
+	const Float3& p2WS,
+	const RasterizationSettings& settings,
+	std::vector<BigTriangleDepth>& bigTriangles,
+	std::vector<CompactBigTriangleDepth>& records,
+	std::vector<BigTriangleTile>& tiles,
+	size_t& outsideTiles,
+	size_t& coveredTiles)
+{
+	float tilesCountX;
+	float totalTiles = TilesCount(t, settings.bigTriangleTileSize, tilesCountX);
+
+	unsigned int record = static_cast<unsigned int>(records.size());
+	if (settings.compactBigTriangles)
+	{
+		records.push_back(GetCompactBigTriangle(t, tilesCountX));
+	}
+
+	size_t appendedTiles = 0;
+	for (float offset = 0.0f; offset < totalTiles; offset += 1.0f)
+	{
+		float tileOffset = offset;
+		if (settings.coarseTileClassification && !ClassifyBigTriangleTile(
+			t,
+			offset,
+			tilesCountX,
+			settings.bigTriangleTileSize,
+			outsideTiles,
+			coveredTiles,
+			tileOffset))
+		{
+			continue;
+		}
+
+		if (settings.compactBigTriangles)
+		{
+			tiles.push_back({ tileOffset, record });
+		}
+		else
+		{
+			bigTriangles.push_back({ tileOffset, p0WS, p1WS, p2WS });
+		}
+		appendedTiles++;
+	}
+
+	return settings.compactBigTriangles ? 1 : appendedTiles;
+}
+
+struct ShadingAttributes
+{
+	Float3 p0WS;
+	Float3 p1WS;
+	Float3 p2WS;
+	Float3 n0;
+	Float3 n1;
+	Float3 n2;
+	Float3 c0;
+	Float3 c1;
+	Float3 c2;
+};
+
+// sort-middle records, screen space positions are kept instead of the whole setup,
+// the back end rebuilds the very same setup the front end has binned
+struct BinnedTriangle
+{
+	Float2 p0SS;
+	Float2 p1SS;
+	Float2 p2SS;
+	float z0NDC;
+	float z1NDC;
+	float z2NDC;
+};
+
+struct BinnedTriangleOpaque
+{
+	BinnedTriangle triangle;
+	float invW0;
+	float invW1;
+	float invW2;
+	Float3 p0WS;
+	Float3 p1WS;
+	Float3 p2WS;
+	unsigned int packedNormal[3];
+	unsigned int packedColor[3][2];
+	// small triangles only, same as on the GPU
+	bool useMeshColor;
+	Float3 meshColor;
+};
+
+struct Rasterizer::BinningArena
+{
+	std::vector<BinnedTriangle> triangles;
+	std::vector<BinnedTriangleOpaque> opaqueTriangles;
+	// visibility buffer mode, an ID per triangles entry
+	std::vector<unsigned int> triangleIDs;
+	// indices of the triangles above, per bin
+	std::vector<std::vector<unsigned int>> bins;
+};
+
+// the farthest depth of every screen tile, as asuint(depth), same as DepthTarget, a lower bound:
+// triangles covering every pixel center of a tile raise it, the others mark the tile dirty,
+// and a dirty tile is read back from the depth only when a test against it fails
+struct Rasterizer::CoarseDepth
+{
+	// relative, the interpolated depth may be off the vertices range by a few ulps
+	static constexpr float Epsilon = 1.0f / (1 << 16);
+
+	std::unique_ptr<std::atomic<unsigned int>[]> tiles;
+	std::unique_ptr<std::atomic<bool>[]> dirty;
+	size_t capacity = 0;
+	unsigned int tileSize = 0;
+	unsigned int countX = 0;
+	unsigned int countY = 0;
+	int width = 0;
+	int height = 0;
+
+	void Reset(const Float2& outputRes, unsigned int size)
+	{
+		width = static_cast<int>(outputRes.x);
+		height = static_cast<int>(outputRes.y);
+		tileSize = std::max(size, 1u);
+		countX = (width + tileSize - 1) / tileSize;
+		countY = (height + tileSize - 1) / tileSize;
+
+		size_t count = static_cast<size_t>(countX) * countY;
+		if (count > capacity)
+		{
+			tiles = std::make_unique<std::atomic<unsigned int>[]>(count);
+			dirty = std::make_unique<std::atomic<bool>[]>(count);
+			capacity = count;
+		}
+
+		// far plane, the depth may be filled already, so it's read back on the first failed test
+		for (size_t tile = 0; tile < count; tile++)
+		{
+			tiles[tile].store(0, std::memory_order_relaxed);
+			dirty[tile].store(true, std::memory_order_relaxed);
+		}
+	}
+
+	// pixels of the pixel centers in [minP, maxP]
+	void GetPixels(const TriangleSetup& t, int& x0, int& y0, int& x1, int& y1) const
+	{
+		x0 = std::max(static_cast<int>(floorf(t.minP.x)), 0);
+		y0 = std::max(static_cast<int>(floorf(t.minP.y)), 0);
+		x1 = std::min(static_cast<int>(floorf(t.maxP.x - 0.5f)), width - 1);
+		y1 = std::min(static_cast<int>(floorf(t.maxP.y - 0.5f)), height - 1);
+	}
+
+	void Raise(size_t tile, unsigned int depth)
+	{
+		unsigned int current = tiles[tile].load(std::memory_order_relaxed);
+		while (current < depth && !tiles[tile].compare_exchange_weak(current, depth, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	// every pixel of the bounds of t is already closer than the closest vertex,
+	// read(x, y) is the depth, concurrent writes only make it closer, so it's a lower bound anyway
+	template<typename ReadFunction>
+	bool Occluded(const TriangleSetup& t, ReadFunction&& read)
+	{
+		float maxDepth = std::max(std::max(t.z0NDC, t.z1NDC), t.z2NDC);
+		// asuint order is the float order for positive depths only
+		if (!(maxDepth >= 0.0f))
+		{
+			return false;
+		}
+
+		int x0, y0, x1, y1;
+		GetPixels(t, x0, y0, x1, y1);
+		if (x0 > x1 || y0 > y1)
+		{
+			return false;
+		}
+
+		unsigned int depth = AsUint(maxDepth + maxDepth * Epsilon);
+		for (unsigned int tileY = y0 / tileSize; tileY <= y1 / tileSize; tileY++)
+		{
+			for (unsigned int tileX = x0 / tileSize; tileX <= x1 / tileSize; tileX++)
+			{
+				size_t tile = static_cast<size_t>(tileY) * countX + tileX;
+				if (tiles[tile].load(std::memory_order_relaxed) > depth)
+				{
+					continue;
+				}
+
+				if (!dirty[tile].load(std::memory_order_relaxed) ||
+					!dirty[tile].exchange(false, std::memory_order_relaxed))
+				{
+					return false;
+				}
+
+				unsigned int farthest = UINT_MAX;
+				int tileX0 = tileX * tileSize;
+				int tileY0 = tileY * tileSize;
+				int tileX1 = std::min(tileX0 + static_cast<int>(tileSize), width);
+				int tileY1 = std::min(tileY0 + static_cast<int>(tileSize), height);
+				for (int y = tileY0; y < tileY1; y++)
+				{
+					for (int x = tileX0; x < tileX1; x++)
+					{
+						farthest = std::min(farthest, AsUint(read(x, y)));
+					}
+				}
+				Raise(tile, farthest);
+
+				if (farthest <= depth)
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// after t is rasterized, raises the whole tiles it covers, and marks the rest of them dirty
+	void Update(const TriangleSetup& t)
+	{
+		int x0, y0, x1, y1;
+		GetPixels(t, x0, y0, x1, y1);
+		if (x0 > x1 || y0 > y1)
+		{
+			return;
+		}
+
+		float minDepth = std::min(std::min(t.z0NDC, t.z1NDC), t.z2NDC);
+		bool raise =
+			minDepth >= 0.0f &&
+			x1 - x0 + 1 >= static_cast<int>(tileSize) &&
+			y1 - y0 + 1 >= static_cast<int>(tileSize);
+		unsigned int depth = AsUint(minDepth - minDepth * Epsilon);
+
+		for (unsigned int tileY = y0 / tileSize; tileY <= y1 / tileSize; tileY++)
+		{
+			for (unsigned int tileX = x0 / tileSize; tileX <= x1 / tileSize; tileX++)
+			{
+				size_t tile = static_cast<size_t>(tileY) * countX + tileX;
+
+				bool wholeTile =
+					tileX * tileSize >= static_cast<unsigned int>(x0) &&
+					tileY * tileSize >= static_cast<unsigned int>(y0) &&
+					(tileX + 1) * tileSize <= static_cast<unsigned int>(x1 + 1) &&
+					(tileY + 1) * tileSize <= static_cast<unsigned int>(y1 + 1);
+				if (raise && wholeTile)
+				{
+					Float2 tileMinP = { tileX * tileSize + 0.5f, tileY * tileSize + 0.5f };
+					Float2 tileMaxP = { tileMinP.x + (tileSize - 1), tileMinP.y + (tileSize - 1) };
+					if (ClassifyTile(t, tileMinP, tileMaxP) == TileClass::Covered)
+					{
+						Raise(tile, depth);
+						continue;
+					}
+				}
+
+				if (!dirty[tile].load(std::memory_order_relaxed))
+				{
+					dirty[tile].store(true, std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+};
+
+// vertices of the meshlet a job draws, fetched once and transformed once per instance,
+// as the groupshared cache of MESHLET_VERTEX_CACHE, SoA, so the transforms vectorize
+struct Rasterizer::MeshletVertexCache
+{
+	alignas(32) float x[MESHLET_MAX_VERTICES];
+	alignas(32) float y[MESHLET_MAX_VERTICES];
+	alignas(32) float z[MESHLET_MAX_VERTICES];
+	alignas(32) float xWS[MESHLET_MAX_VERTICES];
+	alignas(32) float yWS[MESHLET_MAX_VERTICES];
+	alignas(32) float zWS[MESHLET_MAX_VERTICES];
+	alignas(32) float xCS[MESHLET_MAX_VERTICES];
+	alignas(32) float yCS[MESHLET_MAX_VERTICES];
+	alignas(32) float zCS[MESHLET_MAX_VERTICES];
+	alignas(32) float wCS[MESHLET_MAX_VERTICES];
+	unsigned int verticesCount = 0;
+
+	// false if the meshlet has more vertices than the cache holds, or there are no meshlets
+	bool Fetch(const SceneBuffers& scene, const IndirectCommand& command)
+	{
+#ifdef MESHLET_INDICES
+		// the vertex list is followed by the packed triangles
+		verticesCount = command.startMeshletTriangleLocation - command.startMeshletVertexLocation;
+		if (verticesCount > MESHLET_MAX_VERTICES)
+		{
+			return false;
+		}
+
+		for (unsigned int v = 0; v < verticesCount; v++)
+		{
+			Float3 p = GetVertexPosition(scene, command, scene.indices[command.startMeshletVertexLocation + v]);
+			x[v] = p.x;
+			y[v] = p.y;
+			z[v] = p.z;
+		}
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	// MS -> WS, the same operations as TransformPoint(), so the results are bit exact
+	void TransformVerticesWS(const Float4x4& world)
+	{
+		// a copy, so the compiler doesn't assume it aliases the cache
+		const Float4x4 W = world;
+		for (unsigned int v = 0; v < verticesCount; v++)
+		{
+			xWS[v] = x[v] * W.m[0][0] + y[v] * W.m[1][0] + z[v] * W.m[2][0] + W.m[3][0];
+			yWS[v] = x[v] * W.m[0][1] + y[v] * W.m[1][1] + z[v] * W.m[2][1] + W.m[3][1];
+			zWS[v] = x[v] * W.m[0][2] + y[v] * W.m[1][2] + z[v] * W.m[2][2] + W.m[3][2];
+		}
+	}
+
+	// MS -> WS -> CS, the same operations as Transform(), so the results are bit exact
+	void TransformVertices(const Float4x4& world, const Float4x4& VP)
+	{
+		TransformVerticesWS(world);
+
+		const Float4x4 M = VP;
+		for (unsigned int v = 0; v < verticesCount; v++)
+		{
+			xCS[v] = xWS[v] * M.m[0][0] + yWS[v] * M.m[1][0] + zWS[v] * M.m[2][0] + M.m[3][0];
+			yCS[v] = xWS[v] * M.m[0][1] + yWS[v] * M.m[1][1] + zWS[v] * M.m[2][1] + M.m[3][1];
+			zCS[v] = xWS[v] * M.m[0][2] + yWS[v] * M.m[1][2] + zWS[v] * M.m[2][2] + M.m[3][2];
+			wCS[v] = xWS[v] * M.m[0][3] + yWS[v] * M.m[1][3] + zWS[v] * M.m[2][3] + M.m[3][3];
+		}
+	}
+
+	Float3 GetWS(unsigned int v) const
+	{
+		return { xWS[v], yWS[v], zWS[v] };
+	}
+
+	Float4 GetCS(unsigned int v) const
+	{
+		return { xCS[v], yCS[v], zCS[v], wCS[v] };
+	}
+};
+
+inline BinnedTriangle GetBinnedTriangle(const TriangleSetup& t)
+{
+	return { t.p0SS, t.p1SS, t.p2SS, t.z0NDC, t.z1NDC, t.z2NDC };
+}
+
+// same steps as ClassifyTriangle, for the triangles which have passed it
+inline void SetupBinnedTriangle(
+	const BinnedTriangle& b,
+	const Float2& outputRes,
+	const RasterizationSettings& settings,
+	TriangleSetup& t)
+{
+	t.p0SS = b.p0SS;
+	t.p1SS = b.p1SS;
+	t.p2SS = b.p2SS;
+	t.z0NDC = b.z0NDC;
+	t.z1NDC = b.z1NDC;
+	t.z2NDC = b.z2NDC;
+
+	SetupBounds(t);
+	ClampToScreenBounds(outputRes, t);
+	SnapMinBoundToPixelCenter(t);
+	SetupEdges(t, settings.fixedPointEdges);
+}
+
+// appends the triangle to every bin its pixel centers fall into, returns the bins count
+inline size_t AddToBins(
+	const TriangleSetup& t,
+	unsigned int triangle,
+	unsigned int binSize,
+	unsigned int binsCountX,
+	std::vector<std::vector<unsigned int>>& bins)
+{
+	unsigned int columnsCount = PixelCentersCount(t.minP.x, t.maxP.x);
+	unsigned int rowsCount = PixelCentersCount(t.minP.y, t.maxP.y);
+	if (columnsCount == 0 || rowsCount == 0)
+	{
+		return 0;
+	}
+
+	// pixel centers are at n + 0.5
+	unsigned int firstX = static_cast<unsigned int>(t.minP.x - 0.5f);
+	unsigned int firstY = static_cast<unsigned int>(t.minP.y - 0.5f);
+	unsigned int lastBinX = (firstX + columnsCount - 1) / binSize;
+	unsigned int lastBinY = (firstY + rowsCount - 1) / binSize;
+	for (unsigned int binY = firstY / binSize; binY <= lastBinY; binY++)
+	{
+		for (unsigned int binX = firstX / binSize; binX <= lastBinX; binX++)
+		{
+			bins[binY * binsCountX + binX].push_back(triangle);
+		}
+	}
+
+	return static_cast<size_t>(lastBinX - firstX / binSize + 1) * (lastBinY - firstY / binSize + 1);
+}
+
+// pixels of the triangle inside the bin, with the edge functions still relative to the whole
+// triangle bounds, so the values don't depend on the bin size
+template<typename PixelFunction>
+inline void RasterizeBin(
+	const TriangleSetup& t,
+	bool useTopLeftRule,
+	BlockKernel kernel,
+	unsigned int binX,
+	unsigned int binY,
+	unsigned int binSize,
+	PixelFunction&& pixel)
+{
+	unsigned int firstX = static_cast<unsigned int>(t.minP.x - 0.5f);
+	unsigned int firstY = static_cast<unsigned int>(t.minP.y - 0.5f);
+	unsigned int binMinX = binX * binSize;
+	unsigned int binMinY = binY * binSize;
+
+	unsigned int columnsBegin = binMinX > firstX ? binMinX - firstX : 0;
+	unsigned int columnsEnd = std::min(PixelCentersCount(t.minP.x, t.maxP.x), binMinX + binSize - firstX);
+	unsigned int rowsBegin = binMinY > firstY ? binMinY - firstY : 0;
+	unsigned int rowsEnd = std::min(PixelCentersCount(t.minP.y, t.maxP.y), binMinY + binSize - firstY);
+
+	if (t.fixedPoint)
+	{
+		RasterizeFixedPoint(t, useTopLeftRule, columnsBegin, columnsEnd, rowsBegin, rowsEnd, pixel);
+		return;
+	}
+
+	RasterizeBlocks(t, useTopLeftRule, kernel, columnsBegin, columnsEnd, rowsBegin, rowsEnd, pixel);
+}
+
+// binning cuts triangles at arbitrary pixels, where the incremental stepping can't resume
+// bit exactly, so it always evaluates edges directly
+inline BlockKernel SelectBlockKernel(const RasterizationSettings& settings)
+{
+	if (settings.binning)
+	{
+		return GetBlockKernel(settings.blockRasterization ? settings.blockKernelISA : BlockKernelISA::Scalar);
+	}
+
+	return settings.blockRasterization ? GetBlockKernel(settings.blockKernelISA) : nullptr;
+}
+
+inline int GetCascadeIndex(const ShadingSettings& shading, float viewDepth)
+{
+	int cascadeIdx = shading.cascadesCount - 1;
+	for (int i = shading.cascadesCount - 1; i >= 0; i--)
+	{
+		if (viewDepth <= shading.cascadeSplits[i])
+		{
+			cascadeIdx = i;
+		}
+	}
+
+	return cascadeIdx;
+}
+
+inline float GetShadow(
+	const ShadingSettings& shading,
+	const DepthTarget* shadowMaps,
+	float viewDepth,
+	const Float3& positionWS)
+{
+	if (viewDepth >= shading.shadowsDistance || shading.cascadesCount == 0)
+	{
+		return 1.0f;
+	}
+
+	int cascadeIdx = GetCascadeIndex(shading, viewDepth);
+
+	Float4 positionLCS = Transform(positionWS, shading.cascadeVP[cascadeIdx]);
+	float u = positionLCS.x * 0.5f + 0.5f;
+	float v = positionLCS.y * -0.5f + 0.5f;
+
+	float depthSM = shadowMaps[cascadeIdx].Sample(u, v);
+	// TODO: account for non-reversed Z
+	return positionLCS.z > depthSM - shading.cascadeBias[cascadeIdx] ? 1.0f : 0.0f;
+}
+
+// for debug and visualisation purposes
+inline Float3 GetCascadeColor(const ShadingSettings& shading, float viewDepth)
+{
+	static const Float3 CascadeColors[MAX_CASCADES_COUNT] =
+	{
+		{ 1.0f, 0.0f, 0.0f },
+		{ 0.0f, 1.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f },
+		{ 1.0f, 1.0f, 0.0f },
+		{ 0.5f, 0.0f, 0.0f },
+		{ 0.0f, 0.5f, 0.0f },
+		{ 0.0f, 0.0f, 0.5f },
+		{ 0.5f, 0.5f, 0.0f },
+	};
+
+	return CascadeColors[std::max(GetCascadeIndex(shading, viewDepth), 0)];
+}
+
+// the shading part of the opaque passes and the visibility resolve
+inline void ShadeVisiblePixel(
+	const TriangleSetup& t,
+	const ShadingAttributes& a,
+	const Float3* meshColor,
+	const ShadingSettings& shading,
+	const DepthTarget* shadowMaps,
+	ColorTarget& renderTarget,
+	int pixelX,
+	int pixelY,
+	float area0,
+	float area1)
+{
+	// convert to barycentric weights
+	float weight0 = area0 * t.invArea;
+	float weight1 = area1 * t.invArea;
+	float weight2 = 1.0f - weight0 - weight1;
+
+	// for perspective-correct interpolation
+	float w0 = weight0 * t.invW0;
+	float w1 = weight1 * t.invW1;
+	float w2 = weight2 * t.invW2;
+	float denom = 1.0f / (w0 + w1 + w2);
+
+	Float3 N =
+	{
+		denom * (w0 * a.n0.x + w1 * a.n1.x + w2 * a.n2.x),
+		denom * (w0 * a.n0.y + w1 * a.n1.y + w2 * a.n2.y),
+		denom * (w0 * a.n0.z + w1 * a.n1.z + w2 * a.n2.z)
+	};
+	float invLength = 1.0f / sqrtf(N.x * N.x + N.y * N.y + N.z * N.z);
+	N = { N.x * invLength, N.y * invLength, N.z * invLength };
+
+	Float3 color =
+	{
+		denom * (w0 * a.c0.x + w1 * a.c1.x + w2 * a.c2.x),
+		denom * (w0 * a.c0.y + w1 * a.c1.y + w2 * a.c2.y),
+		denom * (w0 * a.c0.z + w1 * a.c1.z + w2 * a.c2.z)
+	};
+	if (meshColor)
+	{
+		color = *meshColor;
+	}
+
+	Float3 positionWS =
+	{
+		denom * (w0 * a.p0WS.x + w1 * a.p1WS.x + w2 * a.p2WS.x),
+		denom * (w0 * a.p0WS.y + w1 * a.p1WS.y + w2 * a.p2WS.y),
+		denom * (w0 * a.p0WS.z + w1 * a.p1WS.z + w2 * a.p2WS.z)
+	};
+
+	float NdotL = Saturate(
+		shading.sunDirection.x * N.x +
+		shading.sunDirection.y * N.y +
+		shading.sunDirection.z * N.z);
+	float viewDepth = denom;
+	float shadow = GetShadow(shading, shadowMaps, viewDepth, positionWS);
+	float lighting = NdotL * shadow;
+
+	if (shading.showCascades)
+	{
+		color = GetCascadeColor(shading, viewDepth);
+	}
+
+	renderTarget.SetPixel(
+		pixelX,
+		pixelY,
+		{
+			color.x * (lighting + 0.2f * SkyColor.x),
+			color.y * (lighting + 0.2f * SkyColor.y),
+			color.z * (lighting + 0.2f * SkyColor.z),
+			1.0f
+		});
+}
+
+// done where the depth pass result matches, returns true if shaded
+inline bool ShadePixel(
+	const TriangleSetup& t,
+	const ShadingAttributes& a,
+	const Float3* meshColor,
+	const ShadingSettings& shading,
+	const DepthTarget& depth,
+	const DepthTarget* shadowMaps,
+	ColorTarget& renderTarget,
+	float x,
+	float y,
+	float area0,
+	float area1,
+	float pixelDepth)
+{
+	int pixelX = static_cast<int>(x);
+	int pixelY = static_cast<int>(y);
+
+	// early z test
+	if (depth.GetDepth(pixelX, pixelY) != pixelDepth)
+	{
+		return false;
+	}
+
+	ShadeVisiblePixel(t, a, meshColor, shading, shadowMaps, renderTarget, pixelX, pixelY, area0, area1);
+	return true;
+}
+
+template<typename Mode, typename WriteFunction, typename ReadFunction>
+size_t Rasterizer::_drawBigTriangles(
+	const Mode& mode,
+	const std::vector<BigTriangleDepth>& bigTriangles,
+	const std::vector<CompactBigTriangleDepth>& records,
+	const std::vector<BigTriangleTile>& tiles,
+	const Float4x4& VP,
+	const Float2& outputRes,
+	bool visibility,
+	BlockKernel blockKernel,
+	CoarseDepth* coarseDepth,
+	WriteFunction&& write,
+	ReadFunction&& read,
+	std::atomic<size_t>& coveredPixels,
+	std::atomic<size_t>& occludedTiles)
+{
+	size_t tilesCount = _settings.compactBigTriangles ? tiles.size() : bigTriangles.size();
+	_threadPool.ParallelFor(
+		tilesCount,
+		[&](size_t tile)
+		{
+			unsigned int ID = 0;
+			bool covered = false;
+			size_t tileCoveredPixels = 0;
+
+			TriangleSetup t;
+			if (_settings.compactBigTriangles)
+			{
+				const BigTriangleTile& bigTriangleTile = tiles[tile];
+				ID = visibility ? _bigTrianglesIDs[bigTriangleTile.record] : 0;
+				SetupCompactBigTriangleTile(
+					records[bigTriangleTile.record],
+					DecodeTileOffset(bigTriangleTile.tileOffset, covered),
+					_settings,
+					t);
+			}
+			else
+			{
+				const BigTriangleDepth& bigTriangle = bigTriangles[tile];
+				ID = visibility ? _bigTrianglesIDs[tile] : 0;
+				SetupBigTriangleTile(
+					bigTriangle.p0WS,
+					bigTriangle.p1WS,
+					bigTriangle.p2WS,
+					DecodeTileOffset(bigTriangle.tileOffset, covered),
+					VP,
+					outputRes,
+					_settings,
+					t);
+			}
+
+			if (coarseDepth && coarseDepth->Occluded(t, read))
+			{
+				occludedTiles++;
+				return;
+			}
+
+			RasterizeTile(
+				t,
+				mode,
+				blockKernel,
+				covered,
+				[&](float x, float y, float, float, float pixelDepth)
+				{
+					write(static_cast<int>(x), static_cast<int>(y), pixelDepth, ID);
+					tileCoveredPixels++;
+				});
+
+			if (coarseDepth)
+			{
+				coarseDepth->Update(t);
+			}
+
+			coveredPixels += tileCoveredPixels;
+		});
+
+	return tilesCount;
+}
+
+}
@@ -0,0 +1,171 @@
+#include "CPURasterizerKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_RASTERIZER_X64
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace CPURasterizer
+{
+
+uint64_t RasterizeBlockScalar(const BlockSetup& block, BlockOutput& output)
+{
+	uint64_t mask = 0;
+	for (unsigned int row = 0; row < block.rows; row++)
+	{
+		float yOffset = static_cast<float>(block.yOffset + row);
+		for (unsigned int column = 0; column < block.columns; column++)
+		{
+			float xOffset = static_cast<float>(block.xOffset + column);
+
+			// E(x + a, y + b) = E(x, y) - a * dy + b * dx
+			float area0 = block.area[0] - xOffset * block.dy[0] + yOffset * block.dx[0];
+			float area1 = block.area[1] - xOffset * block.dy[1] + yOffset * block.dx[1];
+			float area2 = block.area[2] - xOffset * block.dy[2] + yOffset * block.dx[2];
+
+			bool inside =
+				(block.inclusive[0] ? area0 >= 0.0f : area0 > 0.0f) &&
+				(block.inclusive[1] ? area1 >= 0.0f : area1 > 0.0f) &&
+				(block.inclusive[2] ? area2 >= 0.0f : area2 > 0.0f);
+			if (!inside)
+			{
+				continue;
+			}
+
+			// convert to barycentric weights
+			float weight0 = area0 * block.invArea;
+			float weight1 = area1 * block.invArea;
+			float weight2 = 1.0f - weight0 - weight1;
+
+			unsigned int pixel = row * BlockSize + column;
+			output.depth[pixel] = weight0 * block.z[0] + weight1 * block.z[1] + weight2 * block.z[2];
+			output.area0[pixel] = area0;
+			output.area1[pixel] = area1;
+			mask |= 1ull << pixel;
+		}
+	}
+
+	return mask;
+}
+
+#ifdef CPU_RASTERIZER_X64
+
+static void CPUID(int leaf, int subleaf, unsigned int registers[4])
+{
+#ifdef _MSC_VER
+	__cpuidex(reinterpret_cast<int*>(registers), leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// register state the OS saves on context switches
+static unsigned long long XGETBV()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+static BlockKernelISA DetectISA()
+{
+	unsigned int registers[4];
+	CPUID(0, 0, registers);
+	unsigned int maxLeaf = registers[0];
+
+	CPUID(1, 0, registers);
+	bool SSE41 = (registers[2] & (1u << 19)) != 0;
+	bool OSXSAVE = (registers[2] & (1u << 27)) != 0;
+	bool AVX = (registers[2] & (1u << 28)) != 0;
+
+	bool AVX2 = false;
+	bool AVX512F = false;
+	if (maxLeaf >= 7)
+	{
+		CPUID(7, 0, registers);
+		AVX2 = (registers[1] & (1u << 5)) != 0;
+		AVX512F = (registers[1] & (1u << 16)) != 0;
+	}
+
+	unsigned long long XCR0 = OSXSAVE ? XGETBV() : 0;
+	// XMM and YMM
+	bool OSAVX = (XCR0 & 0x6) == 0x6;
+	// and opmask, ZMM0-15 upper halves, ZMM16-31
+	bool OSAVX512 = (XCR0 & 0xE6) == 0xE6;
+
+	if (AVX512F && OSAVX512)
+	{
+		return BlockKernelISA::AVX512;
+	}
+	if (AVX && AVX2 && OSAVX)
+	{
+		return BlockKernelISA::AVX2;
+	}
+	if (SSE41)
+	{
+		return BlockKernelISA::SSE41;
+	}
+
+	return BlockKernelISA::Scalar;
+}
+
+#endif // CPU_RASTERIZER_X64
+
+BlockKernelISA GetBestBlockKernelISA()
+{
+#ifdef CPU_RASTERIZER_X64
+	static const BlockKernelISA best = DetectISA();
+	return best;
+#else
+	return BlockKernelISA::Scalar;
+#endif
+}
+
+BlockKernel GetBlockKernel(BlockKernelISA isa)
+{
+	BlockKernelISA best = GetBestBlockKernelISA();
+	if (static_cast<int>(isa) > static_cast<int>(best))
+	{
+		isa = best;
+	}
+
+	switch (isa)
+	{
+#ifdef CPU_RASTERIZER_X64
+	case BlockKernelISA::SSE41:
+		return RasterizeBlockSSE41;
+	case BlockKernelISA::AVX2:
+		return RasterizeBlockAVX2;
+	case BlockKernelISA::AVX512:
+		return RasterizeBlockAVX512;
+#endif
+	default:
+		return RasterizeBlockScalar;
+	}
+}
+
+const char* GetBlockKernelISAName(BlockKernelISA isa)
+{
+	static const char* names[] =
+	{
+		"Scalar",
+		"SSE4.1",
+		"AVX2",
+		"AVX-512"
+	};
+	static_assert(
+		sizeof(names) / sizeof(names[0]) == static_cast<unsigned int>(BlockKernelISA::Count),
+		"every ISA needs a name");
+
+	return names[static_cast<int>(isa)];
+}
+
+}
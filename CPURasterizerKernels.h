@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+// block kernels of the CPU rasterizer, evaluate the three edge functions and depth
+// of an 8x8 pixel block at once, one translation unit per instruction set
+// kernels translation units are built with their ISA enabled, so they must not
+// include anything, which instantiates inline functions shared with the rest of the code
+namespace CPURasterizer
+{
+
+enum class BlockKernelISA
+{
+	// plain C++ reference of the SIMD kernels
+	Scalar,
+	SSE41,
+	AVX2,
+	AVX512,
+	Count
+};
+
+static const unsigned int BlockSize = 8;
+static const unsigned int BlockPixelsCount = BlockSize * BlockSize;
+
+struct BlockSetup
+{
+	// edge functions at the first pixel center of the triangle bounds,
+	// E(x + a, y + b) = E(x, y) - a * dy + b * dx
+	float area[3];
+	float dx[3];
+	float dy[3];
+	// >= 0 instead of > 0, for edges passing the top-left rule
+	bool inclusive[3];
+
+	float invArea;
+	float z[3];
+
+	// block position in pixels, relative to the first pixel center
+	unsigned int xOffset;
+	unsigned int yOffset;
+	// pixel centers of the block inside the bounds, up to BlockSize
+	unsigned int columns;
+	unsigned int rows;
+};
+
+// values of the covered pixels only are written, pixel index is row * BlockSize + column
+struct alignas(64) BlockOutput
+{
+	float depth[BlockPixelsCount];
+	float area0[BlockPixelsCount];
+	float area1[BlockPixelsCount];
+};
+
+// returns the mask of the covered pixels
+typedef uint64_t (*BlockKernel)(const BlockSetup& block, BlockOutput& output);
+
+uint64_t RasterizeBlockScalar(const BlockSetup& block, BlockOutput& output);
+uint64_t RasterizeBlockSSE41(const BlockSetup& block, BlockOutput& output);
+uint64_t RasterizeBlockAVX2(const BlockSetup& block, BlockOutput& output);
+uint64_t RasterizeBlockAVX512(const BlockSetup& block, BlockOutput& output);
+
+// the widest ISA both the CPU and the OS support
+BlockKernelISA GetBestBlockKernelISA();
+// falls back to the best supported ISA, if the requested one isn't
+BlockKernel GetBlockKernel(BlockKernelISA isa);
+const char* GetBlockKernelISAName(BlockKernelISA isa);
+
+}
@@ -0,0 +1,383 @@
+#include "CPURasterizerInternal.h"
+
+namespace CPURasterizer
+{
+
+// thread groups of a multi-view job at most, and the triangle instances transformed at once,
+// then rasterized view after view, fewer ones switch the targets too often, more get evicted from the cache
+static const size_t MultiViewMaxGroupsPerJob = 256;
+static const size_t MultiViewMaxTriangles = 16384;
+
+template<typename Mode>
+Statistics Rasterizer::_drawDepthMultiView(
+	const Mode& mode,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	const unsigned int* viewMasks,
+	size_t commandsCount,
+	const Float4x4* VPs,
+	DepthTarget* depths,
+	int viewsCount)
+{
+	viewsCount = std::clamp(viewsCount, 0, MAX_CASCADES_COUNT);
+	unsigned int allViews = (1u << viewsCount) - 1;
+
+	Float2 outputRes[MAX_CASCADES_COUNT];
+	CoarseDepth* coarseDepths[MAX_CASCADES_COUNT] = {};
+	_viewBigTriangles.resize(viewsCount);
+	_multiViewTriangles.resize(_threadPool.GetThreadsCount());
+	if (_settings.coarseDepth)
+	{
+		_viewCoarseDepths.resize(std::max(_viewCoarseDepths.size(), static_cast<size_t>(viewsCount)));
+	}
+	for (int view = 0; view < viewsCount; view++)
+	{
+		outputRes[view] =
+		{
+			static_cast<float>(depths[view].GetWidth()),
+			static_cast<float>(depths[view].GetHeight())
+		};
+		_viewBigTriangles[view].depth.clear();
+		_viewBigTriangles[view].compactDepth.clear();
+		_viewBigTriangles[view].tiles.clear();
+
+		if (_settings.coarseDepth)
+		{
+			if (!_viewCoarseDepths[view])
+			{
+				_viewCoarseDepths[view] = std::make_unique<CoarseDepth>();
+			}
+			_viewCoarseDepths[view]->Reset(outputRes[view], _settings.coarseDepthTileSize);
+			coarseDepths[view] = _viewCoarseDepths[view].get();
+		}
+	}
+
+	if (_settings.meshletVertexCache)
+	{
+		_meshletVertexCaches.resize(_threadPool.GetThreadsCount());
+	}
+
+	std::atomic<size_t> pipelineTriangles = 0;
+	std::atomic<size_t> renderedTriangles = 0;
+	std::atomic<size_t> coveredPixels = 0;
+	std::atomic<size_t> outsideTiles = 0;
+	std::atomic<size_t> coveredTiles = 0;
+	std::atomic<size_t> occludedTriangles = 0;
+	std::atomic<size_t> occludedTiles = 0;
+	std::atomic<size_t> fetchedVertices = 0;
+	std::atomic<size_t> transformedVertices = 0;
+	BlockKernel blockKernel = SelectBlockKernel(_settings);
+
+	unsigned int trianglesPerJob = std::max(_settings.trianglesPerJob, 1u);
+	_setupTriangleJobs(commands, commandsCount);
+	auto start = std::chrono::steady_clock::now();
+
+	// TriangleDepthCS over the merged instance lists, a job per a few thread groups, a few jobs per thread still
+	size_t groupsCount = _triangleJobs.size();
+	size_t groupsPerJob = std::clamp<size_t>(
+		groupsCount / (static_cast<size_t>(_threadPool.GetThreadsCount()) * 4), 1, MultiViewMaxGroupsPerJob);
+	size_t jobsCount = (groupsCount + groupsPerJob - 1) / groupsPerJob;
+	_threadPool.ParallelFor(
+		jobsCount,
+		[&](size_t job)
+		{
+			size_t groupPipelineTriangles = 0;
+			size_t groupRenderedTriangles = 0;
+			size_t groupCoveredPixels = 0;
+			size_t groupOutsideTiles = 0;
+			size_t groupCoveredTiles = 0;
+			size_t groupOccludedTriangles = 0;
+			size_t groupFetchedVertices = 0;
+			size_t groupTransformedVertices = 0;
+			ViewBigTriangles bigTriangles[MAX_CASCADES_COUNT];
+
+			// MS -> WS once, kept for the views, as groupshared memory would keep them,
+			// up to MultiViewMaxTriangles at a time
+			MultiViewTriangles& triangles = _multiViewTriangles[ThreadPool::GetThreadIndex()];
+			triangles.positionsWS.clear();
+			triangles.masks.clear();
+			unsigned int batchMask = 0;
+
+			// a view after another, so a single target is written at a time
+			auto rasterizeBatch = [&]()
+			{
+				for (unsigned int views = batchMask; views != 0; views &= views - 1)
+				{
+					int view = static_cast<int>(LowestBit(views));
+					DepthTarget& depth = depths[view];
+					CoarseDepth* coarseDepth = coarseDepths[view];
+
+					for (size_t triangle = 0; triangle < triangles.masks.size(); triangle++)
+					{
+						if ((triangles.masks[triangle] & (1u << view)) == 0)
+						{
+							continue;
+						}
+
+						const Float3& p0WS = triangles.positionsWS[triangle * 3 + 0];
+						const Float3& p1WS = triangles.positionsWS[triangle * 3 + 1];
+						const Float3& p2WS = triangles.positionsWS[triangle * 3 + 2];
+
+						// one more triangle attempted to be rendered, per view, as the per-view passes count them
+						groupPipelineTriangles++;
+
+						TriangleSetup t;
+						TriangleClass triangleClass = ClassifyTriangle(
+							Transform(p0WS, VPs[view]),
+							Transform(p1WS, VPs[view]),
+							Transform(p2WS, VPs[view]),
+							outputRes[view],
+							_settings,
+							t);
+						if (triangleClass == TriangleClass::Rejected)
+						{
+							continue;
+						}
+
+						groupRenderedTriangles++;
+
+						if (triangleClass == TriangleClass::Big)
+						{
+							AppendBigTriangle(
+								t,
+								p0WS,
+								p1WS,
+								p2WS,
+								_settings,
+								bigTriangles[view].depth,
+								bigTriangles[view].compactDepth,
+								bigTriangles[view].tiles,
+								groupOutsideTiles,
+								groupCoveredTiles);
+
+							continue;
+						}
+
+						if (coarseDepth &&
+							coarseDepth->Occluded(
+								t,
+								[&](int x, int y)
+								{
+									return depth.GetDepth(x, y);
+								}))
+						{
+							groupOccludedTriangles++;
+							continue;
+						}
+
+						RasterizeTriangle(
+							t,
+							mode,
+							outputRes[view],
+							blockKernel,
+							[&](float x, float y, float, float, float pixelDepth)
+							{
+								depth.WriteMax(static_cast<int>(x), static_cast<int>(y), pixelDepth);
+								groupCoveredPixels++;
+							});
+
+						if (coarseDepth)
+						{
+							coarseDepth->Update(t);
+						}
+					}
+				}
+
+				triangles.positionsWS.clear();
+				triangles.masks.clear();
+				batchMask = 0;
+			};
+
+			auto addTriangle = [&](const Float3& p0WS, const Float3& p1WS, const Float3& p2WS, unsigned int mask)
+			{
+				triangles.positionsWS.push_back(p0WS);
+				triangles.positionsWS.push_back(p1WS);
+				triangles.positionsWS.push_back(p2WS);
+				triangles.masks.push_back(mask);
+				batchMask |= mask;
+				if (triangles.masks.size() >= MultiViewMaxTriangles)
+				{
+					rasterizeBatch();
+				}
+			};
+
+			for (size_t group = job * groupsPerJob;
+				group < std::min(groupsCount, (job + 1) * groupsPerJob);
+				group++)
+			{
+				const TriangleJob& triangleJob = _triangleJobs[group];
+				unsigned int mask = viewMasks[triangleJob.command] & allViews;
+				if (mask == 0)
+				{
+					continue;
+				}
+
+				const IndirectCommand& command = commands[triangleJob.command];
+				unsigned int firstTriangle = triangleJob.firstTriangle;
+				unsigned int lastInstance = triangleJob.firstInstance + triangleJob.instancesCount;
+
+				MeshletVertexCache* cache =
+					_settings.meshletVertexCache ? &_meshletVertexCaches[ThreadPool::GetThreadIndex()] : nullptr;
+				if (cache && cache->Fetch(scene, command))
+				{
+					groupFetchedVertices += cache->verticesCount;
+
+					for (unsigned int instanceID = triangleJob.firstInstance; instanceID < lastInstance; instanceID++)
+					{
+						const Instance& instance = scene.instances[command.startInstanceLocation + instanceID];
+						cache->TransformVerticesWS(instance.worldTransform);
+						groupTransformedVertices += cache->verticesCount;
+
+						for (unsigned int triangleIndex = firstTriangle;
+							triangleIndex < firstTriangle + trianglesPerJob &&
+							triangleIndex * 3 < command.args.indexCountPerInstance;
+							triangleIndex++)
+						{
+							unsigned int l0, l1, l2;
+							GetMeshletTriangle(scene, command, triangleIndex, l0, l1, l2);
+							addTriangle(cache->GetWS(l0), cache->GetWS(l1), cache->GetWS(l2), mask);
+						}
+					}
+
+					continue;
+				}
+
+				for (unsigned int triangleIndex = firstTriangle;
+					triangleIndex < firstTriangle + trianglesPerJob &&
+					triangleIndex * 3 < command.args.indexCountPerInstance;
+					triangleIndex++)
+				{
+					unsigned int i0, i1, i2;
+					GetTriangleIndices(scene, command, triangleIndex, i0, i1, i2);
+
+					Float3 p0 = GetVertexPosition(scene, command, i0);
+					Float3 p1 = GetVertexPosition(scene, command, i1);
+					Float3 p2 = GetVertexPosition(scene, command, i2);
+					groupFetchedVertices += 3;
+
+					for (unsigned int instanceID = triangleJob.firstInstance; instanceID < lastInstance; instanceID++)
+					{
+						const Instance& instance = scene.instances[command.startInstanceLocation + instanceID];
+						addTriangle(
+							TransformPoint(p0, instance.worldTransform),
+							TransformPoint(p1, instance.worldTransform),
+							TransformPoint(p2, instance.worldTransform),
+							mask);
+						groupTransformedVertices += 3;
+					}
+				}
+			}
+
+			rasterizeBatch();
+
+			pipelineTriangles += groupPipelineTriangles;
+			renderedTriangles += groupRenderedTriangles;
+			coveredPixels += groupCoveredPixels;
+			outsideTiles += groupOutsideTiles;
+			coveredTiles += groupCoveredTiles;
+			occludedTriangles += groupOccludedTriangles;
+			fetchedVertices += groupFetchedVertices;
+			transformedVertices += groupTransformedVertices;
+
+			for (int view = 0; view < viewsCount; view++)
+			{
+				const ViewBigTriangles& jobView = bigTriangles[view];
+				if (jobView.depth.empty() && jobView.tiles.empty())
+				{
+					continue;
+				}
+
+				std::lock_guard<std::mutex> lock(_bigTrianglesMutex);
+				ViewBigTriangles& target = _viewBigTriangles[view];
+				unsigned int firstRecord = static_cast<unsigned int>(target.compactDepth.size());
+				target.depth.insert(target.depth.end(), jobView.depth.begin(), jobView.depth.end());
+				target.compactDepth.insert(target.compactDepth.end(), jobView.compactDepth.begin(), jobView.compactDepth.end());
+				for (BigTriangleTile tile : jobView.tiles)
+				{
+					tile.record += firstRecord;
+					target.tiles.push_back(tile);
+				}
+			}
+		});
+
+	auto bigTrianglesStart = std::chrono::steady_clock::now();
+
+	// BigTriangleDepthCS, view after view
+	size_t bigTriangleTiles = 0;
+	size_t bigTriangleRecords = 0;
+	size_t bigTriangleBytes = 0;
+	for (int view = 0; view < viewsCount; view++)
+	{
+		const ViewBigTriangles& viewBigTriangles = _viewBigTriangles[view];
+		DepthTarget& depth = depths[view];
+		bigTriangleTiles += _drawBigTriangles(
+			mode,
+			viewBigTriangles.depth,
+			viewBigTriangles.compactDepth,
+			viewBigTriangles.tiles,
+			VPs[view],
+			outputRes[view],
+			false,
+			blockKernel,
+			coarseDepths[view],
+			[&](int x, int y, float pixelDepth, unsigned int)
+			{
+				depth.WriteMax(x, y, pixelDepth);
+			},
+			[&](int x, int y)
+			{
+				return depth.GetDepth(x, y);
+			},
+			coveredPixels,
+			occludedTiles);
+		bigTriangleRecords += viewBigTriangles.compactDepth.size();
+		bigTriangleBytes +=
+			viewBigTriangles.depth.size() * sizeof(BigTriangleDepth) +
+			viewBigTriangles.compactDepth.size() * sizeof(CompactBigTriangleDepth) +
+			viewBigTriangles.tiles.size() * sizeof(BigTriangleTile);
+	}
+
+	Statistics statistics;
+	statistics.pipelineTriangles = pipelineTriangles;
+	statistics.renderedTriangles = renderedTriangles;
+	statistics.bigTriangleTiles = bigTriangleTiles;
+	statistics.bigTriangleOutsideTiles = outsideTiles;
+	statistics.bigTriangleCoveredTiles = coveredTiles;
+	statistics.coarseDepthRejectedTriangles = occludedTriangles;
+	statistics.coarseDepthRejectedTiles = occludedTiles;
+	statistics.fetchedVertices = fetchedVertices;
+	statistics.transformedVertices = transformedVertices;
+	statistics.bigTriangleRecords = bigTriangleRecords;
+	statistics.bigTriangleBytes = bigTriangleBytes;
+	statistics.smallTrianglesSeconds = std::chrono::duration<double>(bigTrianglesStart - start).count();
+	statistics.bigTrianglesSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - bigTrianglesStart).count();
+	statistics.coveredPixels = coveredPixels;
+	return statistics;
+}
+
+Statistics Rasterizer::DrawDepthMultiView(
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	const unsigned int* viewMasks,
+	size_t commandsCount,
+	const Float4x4* VPs,
+	DepthTarget* depths,
+	int viewsCount)
+{
+	return DispatchMode(
+		_settings,
+		[&](const auto& mode)
+		{
+			return _drawDepthMultiView(
+				mode,
+				scene,
+				commands,
+				viewMasks,
+				commandsCount,
+				VPs,
+				depths,
+				viewsCount);
+		});
+}
+
+}
@@ -0,0 +1,91 @@
+#include "CPURasterizerKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <smmintrin.h>
+
+namespace CPURasterizer
+{
+
+// half a row of the block per iteration, see RasterizeBlockScalar
+uint64_t RasterizeBlockSSE41(const BlockSetup& block, BlockOutput& output)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 invArea = _mm_set1_ps(block.invArea);
+	const __m128 z0 = _mm_set1_ps(block.z[0]);
+	const __m128 z1 = _mm_set1_ps(block.z[1]);
+	const __m128 z2 = _mm_set1_ps(block.z[2]);
+
+	const unsigned int columnsMask = (1u << block.columns) - 1;
+
+	uint64_t mask = 0;
+
+	for (unsigned int half = 0; half < 2; half++)
+	{
+		unsigned int halfMask = (columnsMask >> (half * 4)) & 0xF;
+		if (halfMask == 0)
+		{
+			continue;
+		}
+
+		float firstColumn = static_cast<float>(block.xOffset + half * 4);
+		__m128 xOffset = _mm_add_ps(_mm_set1_ps(firstColumn), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+
+		// E(x + a, y + b) = E(x, y) - a * dy + b * dx, x part doesn't change along the column
+		__m128 partial[3];
+		__m128 dx[3];
+		for (int edge = 0; edge < 3; edge++)
+		{
+			partial[edge] = _mm_sub_ps(
+				_mm_set1_ps(block.area[edge]),
+				_mm_mul_ps(xOffset, _mm_set1_ps(block.dy[edge])));
+			dx[edge] = _mm_set1_ps(block.dx[edge]);
+		}
+
+		for (unsigned int row = 0; row < block.rows; row++)
+		{
+			__m128 yOffset = _mm_set1_ps(static_cast<float>(block.yOffset + row));
+
+			__m128 area[3];
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int edge = 0; edge < 3; edge++)
+			{
+				area[edge] = _mm_add_ps(partial[edge], _mm_mul_ps(yOffset, dx[edge]));
+				inside = _mm_and_ps(
+					inside,
+					block.inclusive[edge] ?
+						_mm_cmpge_ps(area[edge], zero) :
+						_mm_cmpgt_ps(area[edge], zero));
+			}
+
+			unsigned int bits = static_cast<unsigned int>(_mm_movemask_ps(inside)) & halfMask;
+			if (bits == 0)
+			{
+				continue;
+			}
+
+			// convert to barycentric weights
+			__m128 weight0 = _mm_mul_ps(area[0], invArea);
+			__m128 weight1 = _mm_mul_ps(area[1], invArea);
+			__m128 weight2 = _mm_sub_ps(_mm_sub_ps(one, weight0), weight1);
+
+			__m128 depth = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(weight0, z0), _mm_mul_ps(weight1, z1)),
+				_mm_mul_ps(weight2, z2));
+
+			unsigned int pixel = row * BlockSize + half * 4;
+			_mm_store_ps(output.depth + pixel, depth);
+			_mm_store_ps(output.area0 + pixel, area[0]);
+			_mm_store_ps(output.area1 + pixel, area[1]);
+
+			mask |= static_cast<uint64_t>(bits) << pixel;
+		}
+	}
+
+	return mask;
+}
+
+}
+
+#endif
@@ -0,0 +1,211 @@
+#include "CPURasterizerInternal.h"
+
+namespace CPURasterizer
+{
+
+static uint64_t PackVisibility(float depth, unsigned int ID)
+{
+	return (static_cast<uint64_t>(AsUint(depth)) << 32) | ID;
+}
+
+void VisibilityTarget::Resize(int width, int height)
+{
+	_width = width;
+	_height = height;
+	_texels.reset(new std::atomic<uint64_t>[static_cast<size_t>(width) * height]);
+	Clear();
+}
+
+void VisibilityTarget::Clear()
+{
+	// reversed Z, no triangle
+	size_t texelsCount = static_cast<size_t>(_width) * _height;
+	for (size_t texel = 0; texel < texelsCount; texel++)
+	{
+		_texels[texel].store(0, std::memory_order_relaxed);
+	}
+}
+
+void VisibilityTarget::WriteMax(int x, int y, float depth, unsigned int ID)
+{
+	// InterlockedMax on a 64-bit UAV
+	uint64_t value = PackVisibility(depth, ID);
+	std::atomic<uint64_t>& texel = _texels[static_cast<size_t>(y) * _width + x];
+	uint64_t current = texel.load(std::memory_order_relaxed);
+	while (current < value && !texel.compare_exchange_weak(current, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+void VisibilityTarget::WriteMaxExclusive(int x, int y, float depth, unsigned int ID)
+{
+	uint64_t value = PackVisibility(depth, ID);
+	std::atomic<uint64_t>& texel = _texels[static_cast<size_t>(y) * _width + x];
+	if (texel.load(std::memory_order_relaxed) < value)
+	{
+		texel.store(value, std::memory_order_relaxed);
+	}
+}
+
+float VisibilityTarget::GetDepth(int x, int y) const
+{
+	return AsFloat(static_cast<unsigned int>(_texels[static_cast<size_t>(y) * _width + x].load(std::memory_order_relaxed) >> 32));
+}
+
+unsigned int VisibilityTarget::GetID(int x, int y) const
+{
+	return static_cast<unsigned int>(_texels[static_cast<size_t>(y) * _width + x].load(std::memory_order_relaxed));
+}
+
+void Rasterizer::_setupVisibilityIDs(const IndirectCommand* commands, size_t commandsCount)
+{
+	// 0 is left for no triangle
+	_visibilityIDs.resize(commandsCount + 1);
+	_visibilityIDs[0] = 1;
+	for (size_t command = 0; command < commandsCount; command++)
+	{
+		uint64_t trianglesCount = (commands[command].args.indexCountPerInstance + 2) / 3;
+		_visibilityIDs[command + 1] =
+			_visibilityIDs[command] + trianglesCount * commands[command].args.instanceCount;
+	}
+}
+
+void Rasterizer::DecodeVisibilityID(
+	const IndirectCommand* commands,
+	unsigned int ID,
+	size_t& commandIndex,
+	unsigned int& instanceID,
+	unsigned int& triangleIndex) const
+{
+	// the command, then the instance and the triangle within it
+	commandIndex = static_cast<size_t>(
+		std::upper_bound(_visibilityIDs.begin(), _visibilityIDs.end(), static_cast<uint64_t>(ID)) -
+		_visibilityIDs.begin()) - 1;
+	unsigned int trianglesCount = (commands[commandIndex].args.indexCountPerInstance + 2) / 3;
+	uint64_t localID = ID - _visibilityIDs[commandIndex];
+	instanceID = static_cast<unsigned int>(localID / trianglesCount);
+	triangleIndex = static_cast<unsigned int>(localID % trianglesCount);
+}
+
+Statistics Rasterizer::ResolveVisibility(
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t commandsCount,
+	const Float4x4& VP,
+	const ShadingSettings& shading,
+	const VisibilityTarget& visibility,
+	const DepthTarget* shadowMaps,
+	ColorTarget& renderTarget)
+{
+	const Float2 outputRes =
+	{
+		static_cast<float>(visibility.GetWidth()),
+		static_cast<float>(visibility.GetHeight())
+	};
+
+	std::atomic<size_t> renderedTriangles = 0;
+	std::atomic<size_t> shadedPixels = 0;
+	_setupVisibilityIDs(commands, commandsCount);
+
+	// a job per row, the setup is reused while the neighboring pixels hold the same ID
+	_threadPool.ParallelFor(
+		static_cast<size_t>(visibility.GetHeight()),
+		[&](size_t row)
+		{
+			int y = static_cast<int>(row);
+
+			size_t rowRenderedTriangles = 0;
+			size_t rowShadedPixels = 0;
+			unsigned int lastID = 0;
+			TriangleSetup t = {};
+			ShadingAttributes attributes = {};
+			Float3 commandMeshColor;
+			const Float3* meshColor = nullptr;
+
+			for (int x = 0; x < visibility.GetWidth(); x++)
+			{
+				unsigned int ID = visibility.GetID(x, y);
+				if (ID == 0)
+				{
+					continue;
+				}
+
+				if (ID != lastID)
+				{
+					lastID = ID;
+					rowRenderedTriangles++;
+
+					size_t commandIndex;
+					unsigned int instanceID;
+					unsigned int triangleIndex;
+					DecodeVisibilityID(commands, ID, commandIndex, instanceID, triangleIndex);
+					const IndirectCommand& command = commands[commandIndex];
+
+					unsigned int i0, i1, i2;
+					GetTriangleIndices(scene, command, triangleIndex, i0, i1, i2);
+
+					size_t baseVertexLocation = static_cast<size_t>(command.args.baseVertexLocation);
+					const Instance& instance = scene.instances[command.startInstanceLocation + instanceID];
+					attributes.p0WS = TransformPoint(GetVertexPosition(scene, command, i0), instance.worldTransform);
+					attributes.p1WS = TransformPoint(GetVertexPosition(scene, command, i1), instance.worldTransform);
+					attributes.p2WS = TransformPoint(GetVertexPosition(scene, command, i2), instance.worldTransform);
+					attributes.n0 = UnpackNormal(scene.normals[baseVertexLocation + i0]);
+					attributes.n1 = UnpackNormal(scene.normals[baseVertexLocation + i1]);
+					attributes.n2 = UnpackNormal(scene.normals[baseVertexLocation + i2]);
+					attributes.c0 = UnpackColor(scene.colors + (baseVertexLocation + i0) * 2);
+					attributes.c1 = UnpackColor(scene.colors + (baseVertexLocation + i1) * 2);
+					attributes.c2 = UnpackColor(scene.colors + (baseVertexLocation + i2) * 2);
+
+					// it passed the very same tests in the depth pass
+					TriangleClass triangleClass = ClassifyTriangle(
+						Transform(attributes.p0WS, VP),
+						Transform(attributes.p1WS, VP),
+						Transform(attributes.p2WS, VP),
+						outputRes,
+						_settings,
+						t);
+					if (triangleClass == TriangleClass::Big)
+					{
+						SetupEdges(t, _settings.fixedPointEdges);
+					}
+
+					// small triangles only, same as the opaque pass
+					commandMeshColor = MeshColor(command.meshID);
+					meshColor = shading.showMeshlets && triangleClass == TriangleClass::Small ? &commandMeshColor : nullptr;
+				}
+
+				// direct evaluation at the pixel center, as the block kernels do
+				float xOffset = (x + 0.5f) - t.minP.x;
+				float yOffset = (y + 0.5f) - t.minP.y;
+				float area0;
+				float area1;
+				if (t.fixedPoint)
+				{
+					int64_t a = static_cast<int64_t>(xOffset);
+					int64_t b = static_cast<int64_t>(yOffset);
+					area0 = static_cast<float>(t.fixedArea0 + a * t.fixedStepX0 + b * t.fixedStepY0);
+					area1 = static_cast<float>(t.fixedArea1 + a * t.fixedStepX1 + b * t.fixedStepY1);
+				}
+				else
+				{
+					area0 = t.area0 - xOffset * t.dxdy0.y + yOffset * t.dxdy0.x;
+					area1 = t.area1 - xOffset * t.dxdy1.y + yOffset * t.dxdy1.x;
+				}
+
+				ShadeVisiblePixel(t, attributes, meshColor, shading, shadowMaps, renderTarget, x, y, area0, area1);
+				rowShadedPixels++;
+			}
+
+			renderedTriangles += rowRenderedTriangles;
+			shadedPixels += rowShadedPixels;
+		});
+
+	Statistics statistics;
+	// triangle setups, a triangle spanning several rows is counted once per row
+	statistics.renderedTriangles = renderedTriangles;
+	statistics.coveredPixels = static_cast<size_t>(visibility.GetWidth()) * visibility.GetHeight();
+	statistics.shadedPixels = shadedPixels;
+	return statistics;
+}
+
+}
@@ -1,7 +1,9 @@
 #include "CullingCommon.hlsli"
 
-RWStructuredBuffer<uint> InstanceCounters : register(u0);
+RWStructuredBuffer<uint2> CullingRanges : register(u0);
+RWStructuredBuffer<uint> VisibilityMasks : register(u1);
 
+// meshes of prefabs without objects keep empty ranges
 [numthreads(CULLING_THREADS_X, CULLING_THREADS_Y, CULLING_THREADS_Z)]
 void main(
 	uint3 groupID : SV_GroupID,
@@ -14,9 +16,24 @@ void main(
 		return;
 	}
 
-	[unroll(MAX_FRUSTUMS_COUNT)]
-	for (uint frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
+	[unroll(CULLING_LISTS_COUNT)]
+	for (uint list = 0; list < CULLING_LISTS_COUNT; list++)
 	{
-		InstanceCounters[dispatchThreadID.x + frustum * MaxSceneMeshesMetaCount] = 0;
+		CullingRanges[dispatchThreadID.x + list * MaxSceneMeshesMetaCount] = uint2(0, 0);
 	}
-}
\ No newline at end of file
+}
+
+// the hierarchical culling only writes the masks of the objects which survived ObjectCullingCS
+[numthreads(CULLING_THREADS_X, CULLING_THREADS_Y, CULLING_THREADS_Z)]
+void masksMain(
+	uint3 groupID : SV_GroupID,
+	uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint pair = dispatchThreadID.x + groupID.y * CULLING_MAX_GROUPS_X * CULLING_THREADS_X;
+	if (pair >= CompactionBlocksCount * COMPACTION_THREADS_X)
+	{
+		return;
+	}
+
+	VisibilityMasks[pair] = 0;
+}
@@ -0,0 +1,96 @@
+#include "ClusterRouting.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace CPURasterizer
+{
+
+const char* GetClusterRouteName(ClusterRoute route)
+{
+	switch (route)
+	{
+	case ClusterRoute::SoftwareMicro: return "SW micro";
+	case ClusterRoute::SoftwareBig: return "SW big";
+	case ClusterRoute::Hardware: return "HW";
+	}
+
+	return "unknown";
+}
+
+// screen area of the bounding sphere, from the tangent of its silhouette angle
+ClusterEstimate EstimateCluster(
+	const Float3& center,
+	const Float3& extents,
+	unsigned int trianglesCount,
+	const ClusterRoutingView& view)
+{
+	ClusterEstimate estimate = {};
+
+	float toCenterX = center.x - view.cameraPosition.x;
+	float toCenterY = center.y - view.cameraPosition.y;
+	float toCenterZ = center.z - view.cameraPosition.z;
+	float distanceSq = toCenterX * toCenterX + toCenterY * toCenterY + toCenterZ * toCenterZ;
+	float radiusSq = extents.x * extents.x + extents.y * extents.y + extents.z * extents.z;
+	float radius = std::sqrt(radiusSq);
+
+	if (std::sqrt(distanceSq) - radius <= view.nearZ)
+	{
+		estimate.crossesNear = true;
+		return estimate;
+	}
+
+	// the tangent of the sphere's silhouette angle
+	float projectedRadius = view.projectionScale * radius / std::sqrt(distanceSq - radiusSq);
+	estimate.screenArea = std::min(3.14159265f * projectedRadius * projectedRadius, view.width * view.height);
+	estimate.triangleArea = estimate.screenArea / static_cast<float>(std::max(trianglesCount, 1u));
+
+	return estimate;
+}
+
+ClusterRoute RouteCluster(const ClusterEstimate& estimate, const ClusterRoutingSettings& settings)
+{
+	if (estimate.crossesNear)
+	{
+		return ClusterRoute::Hardware;
+	}
+
+	if (estimate.triangleArea <= settings.microTriangleArea)
+	{
+		return ClusterRoute::SoftwareMicro;
+	}
+
+	if (estimate.triangleArea >= settings.bigTriangleArea)
+	{
+		return ClusterRoute::SoftwareBig;
+	}
+
+	return ClusterRoute::Hardware;
+}
+
+ClusterRoutingStats RouteClusters(
+	const Float3* centers,
+	const Float3* extents,
+	const unsigned int* trianglesCounts,
+	size_t clustersCount,
+	const ClusterRoutingView& view,
+	const ClusterRoutingSettings& settings,
+	std::vector<ClusterRoute>& routes)
+{
+	ClusterRoutingStats stats;
+	routes.resize(clustersCount);
+
+	for (size_t cluster = 0; cluster < clustersCount; cluster++)
+	{
+		ClusterEstimate estimate = EstimateCluster(centers[cluster], extents[cluster], trianglesCounts[cluster], view);
+		ClusterRoute route = RouteCluster(estimate, settings);
+		routes[cluster] = route;
+
+		stats.clusters[static_cast<int>(route)]++;
+		stats.triangles[static_cast<int>(route)] += trianglesCounts[cluster];
+	}
+
+	return stats;
+}
+
+}
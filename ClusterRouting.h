@@ -0,0 +1,81 @@
+#pragma once
+
+#include "CPURasterizer.h"
+
+#include <cstdint>
+#include <vector>
+
+// CPU reference of the routing of the camera visible meshlets between the rasterizers in CullingCS:
+// the screen area of a meshlet's bounding sphere over its triangles estimates their average area,
+// micro triangles go to the SW triangles pass, big ones, which it would bin into tiles anyway,
+// straight to the SW big triangles pass, the rest to the HW, as do the meshlets crossing the near plane,
+// which only the HW clips properly; the GPU puts them in lists of culled commands of their own, see HARDWARE_CULLING_LIST
+namespace CPURasterizer
+{
+
+enum class ClusterRoute
+{
+	SoftwareMicro,
+	SoftwareBig,
+	Hardware,
+};
+
+static const int ClusterRoutesCount = CLUSTER_ROUTES_COUNT;
+static_assert(static_cast<int>(ClusterRoute::SoftwareMicro) == CLUSTER_ROUTE_SOFTWARE_MICRO, "Cluster routes mismatch");
+static_assert(static_cast<int>(ClusterRoute::SoftwareBig) == CLUSTER_ROUTE_SOFTWARE_BIG, "Cluster routes mismatch");
+static_assert(static_cast<int>(ClusterRoute::Hardware) == CLUSTER_ROUTE_HARDWARE, "Cluster routes mismatch");
+
+const char* GetClusterRouteName(ClusterRoute route);
+
+// the camera, as in CullingCB
+struct ClusterRoutingView
+{
+	Float3 cameraPosition;
+	float nearZ;
+	// pixels per unit of the tangent of the view angle, 0.5 * height / tan(0.5 * fovY)
+	float projectionScale;
+	float width;
+	float height;
+};
+
+// CullingCS has them compiled in
+struct ClusterRoutingSettings
+{
+	float microTriangleArea = static_cast<float>(CLUSTER_ROUTING_MICRO_TRIANGLE_AREA);
+	float bigTriangleArea = static_cast<float>(CLUSTER_ROUTING_BIG_TRIANGLE_AREA);
+};
+
+struct ClusterEstimate
+{
+	// pixels, at most the whole screen, 0 if crossesNear
+	float screenArea;
+	float triangleArea;
+	bool crossesNear;
+};
+
+// world space AABB of a meshlet instance
+ClusterEstimate EstimateCluster(
+	const Float3& center,
+	const Float3& extents,
+	unsigned int trianglesCount,
+	const ClusterRoutingView& view);
+
+ClusterRoute RouteCluster(const ClusterEstimate& estimate, const ClusterRoutingSettings& settings);
+
+struct ClusterRoutingStats
+{
+	size_t clusters[ClusterRoutesCount] = {};
+	size_t triangles[ClusterRoutesCount] = {};
+};
+
+// a route per cluster, clusters are already culled
+ClusterRoutingStats RouteClusters(
+	const Float3* centers,
+	const Float3* extents,
+	const unsigned int* trianglesCounts,
+	size_t clustersCount,
+	const ClusterRoutingView& view,
+	const ClusterRoutingSettings& settings,
+	std::vector<ClusterRoute>& routes);
+
+}
@@ -47,9 +47,59 @@ static const DirectX::XMFLOAT4X4 Identity4x4 =
 
 struct VertexPosition
 {
+#ifdef QUANTIZED_POSITIONS
+	// [0] : |16 bits - y | 16 bits - x |
+	// [1] : |16 bits - unused | 16 bits - z |
+	// matches DXGI_FORMAT_R16G16B16A16_UNORM layout
+	unsigned int packedPosition[2];
+#else
 	DirectX::XMFLOAT3 position;
+#endif
 };
 
+#ifdef QUANTIZED_POSITIONS
+inline VertexPosition QuantizePosition(
+	const DirectX::XMFLOAT3& position,
+	const DirectX::XMFLOAT3& origin,
+	const DirectX::XMFLOAT3& scale)
+{
+	auto quantize = [](float v, float o, float s)
+	{
+		float unorm = s > 0.0f ? (v - o) / s : 0.0f;
+		unorm = unorm < 0.0f ? 0.0f : (unorm > 1.0f ? 1.0f : unorm);
+		return static_cast<unsigned int>(unorm * 65535.0f + 0.5f);
+	};
+
+	VertexPosition result;
+	result.packedPosition[0] =
+		(quantize(position.y, origin.y, scale.y) << 16) |
+		quantize(position.x, origin.x, scale.x);
+	result.packedPosition[1] = quantize(position.z, origin.z, scale.z);
+	return result;
+}
+
+// CPU reference of the shaders decoding
+inline DirectX::XMFLOAT3 DequantizePosition(
+	const VertexPosition& position,
+	const DirectX::XMFLOAT3& origin,
+	const DirectX::XMFLOAT3& scale)
+{
+	const float denom = 1.0f / 65535.0f;
+	return
+	{
+		origin.x + static_cast<float>(position.packedPosition[0] & 0xFFFF) * denom * scale.x,
+		origin.y + static_cast<float>(position.packedPosition[0] >> 16) * denom * scale.y,
+		origin.z + static_cast<float>(position.packedPosition[1] & 0xFFFF) * denom * scale.z
+	};
+}
+#endif
+
+#ifdef QUANTIZED_POSITIONS
+static const DXGI_FORMAT VertexPositionFormat = DXGI_FORMAT_R16G16B16A16_UNORM;
+#else
+static const DXGI_FORMAT VertexPositionFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+#endif
+
 struct VertexNormal
 {
 	// | 2 bits - unused | 10 bits - x | 10 bits - y | 10 bits - z |
@@ -100,8 +150,53 @@ struct MeshMeta
 	DirectX::XMFLOAT3 coneApex;
 	DirectX::XMFLOAT3 coneAxis;
 	float coneCutoff;
+
+#ifdef QUANTIZED_POSITIONS
+	// positions = origin + unorm * scale
+	DirectX::XMFLOAT3 positionsOrigin;
+	DirectX::XMFLOAT3 positionsScale;
+#endif
+
+#ifdef MESHLET_INDICES
+	// offsets into the meshlet indices buffer, see PackMeshletTriangle
+	unsigned int startMeshletVertexLocation;
+	unsigned int startMeshletTriangleLocation;
+#endif
 };
 
+#ifdef MESHLET_INDICES
+// | 8 bits - unused | 8 bits - i2 | 8 bits - i1 | 8 bits - i0 |
+// one triangle per uint, so a thread fetches its triangle with a single load,
+// local indices address the meshlet vertex list, which holds
+// vertex indices relative to baseVertexLocation
+inline unsigned int PackMeshletTriangle(
+	unsigned char i0,
+	unsigned char i1,
+	unsigned char i2)
+{
+	return
+		(static_cast<unsigned int>(i2) << 16) |
+		(static_cast<unsigned int>(i1) << 8) |
+		static_cast<unsigned int>(i0);
+}
+
+// CPU reference of GetTriangleIndices
+inline void GetMeshletTriangleIndices(
+	const unsigned int* meshletIndices,
+	unsigned int startMeshletVertexLocation,
+	unsigned int startMeshletTriangleLocation,
+	unsigned int triangleIndex,
+	unsigned int& i0,
+	unsigned int& i1,
+	unsigned int& i2)
+{
+	unsigned int packedTriangle = meshletIndices[startMeshletTriangleLocation + triangleIndex];
+	i0 = meshletIndices[startMeshletVertexLocation + (packedTriangle & 0xFF)];
+	i1 = meshletIndices[startMeshletVertexLocation + ((packedTriangle >> 8) & 0xFF)];
+	i2 = meshletIndices[startMeshletVertexLocation + ((packedTriangle >> 16) & 0xFF)];
+}
+#endif
+
 struct Frustum
 {
 	DirectX::XMFLOAT4 l;
@@ -114,24 +209,42 @@ struct Frustum
 	DirectX::XMFLOAT4 cornersWS[8];
 };
 
+// scene instances are whole objects, which are expanded to their prefab meshes
+// at culling time, the culling output has the same layout, but per mesh,
+// meshlet colors come from the meshID of the draw, see MeshColor()
 struct Instance
 {
 	DirectX::XMFLOAT4X4 worldTransform;
-	unsigned int meshID;
-	DirectX::XMFLOAT3 color;
+	// prefab index for scene instances, mesh index for culled ones
+	unsigned int ID;
 };
 
 struct Prefab
 {
 	unsigned int meshesOffset = 0;
 	unsigned int meshesCount = 0;
+	// range of scene instances placing this prefab
+	unsigned int objectsOffset = 0;
+	unsigned int objectsCount = 0;
 	AABB AABB;
 };
 
 struct IndirectCommand
 {
+	// root constants, see DRAW_CALL_CONSTANTS
 	unsigned int startInstanceLocation;
+#ifdef QUANTIZED_POSITIONS
+	DirectX::XMFLOAT3 positionsOrigin;
+	DirectX::XMFLOAT3 positionsScale;
+#endif
+	// for the Show Meshlets colors, with or without culling
+	unsigned int meshID;
 	D3D12_DRAW_INDEXED_ARGUMENTS arguments;
+#ifdef MESHLET_INDICES
+	// consumed by the SW rasterizer only, ignored by ExecuteIndirect
+	unsigned int startMeshletVertexLocation;
+	unsigned int startMeshletTriangleLocation;
+#endif
 };
 
 struct DepthSceneCB
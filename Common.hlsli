@@ -34,6 +34,19 @@ float2 UnpackTexcoords(in VertexUV packed)
 	return UnpackTexcoords(packed.packedUV);
 }
 
+#ifdef QUANTIZED_POSITIONS
+// 1 / (2 ^ N - 1), N = 16, see QuantizePosition() in Common.h
+float3 UnpackPosition(in uint2 packed, in float3 origin, in float3 scale)
+{
+	float denom = 1.0 / 65535.0;
+
+	return origin + float3(
+		packed.x & 0xFFFF,
+		packed.x >> 16,
+		packed.y & 0xFFFF) * denom * scale;
+}
+#endif
+
 float4 UnpackColor(in uint2 packed)
 {
 	return f16tof32(uint4(packed.x >> 16, packed.x, packed.y >> 16, packed.y));
@@ -44,6 +57,12 @@ float4 UnpackColor(in VertexColor packed)
 	return UnpackColor(packed.packedColor);
 }
 
+// Show Meshlets color
+float3 MeshColor(uint meshID)
+{
+	return float3(meshID & 1, (meshID & 3) / 4.0, (meshID & 7) / 8.0);
+}
+
 AABB TransformAABB(
 	in AABB box,
 	in float4x4 M)
@@ -0,0 +1,116 @@
+#include "CompactionCommon.hlsli"
+
+StructuredBuffer<Instance> Instances : register(t1);
+
+// lists mask per (object, mesh) pair, written by CullingCS
+StructuredBuffer<uint> VisibilityMasks : register(t11);
+// per list and block of pairs, see ScanBlocks()
+StructuredBuffer<uint> InstanceBlockOffsets : register(t12);
+
+// every list in a contiguous range, then every mesh in a contiguous range of its list
+RWStructuredBuffer<Instance> VisibleInstances : register(u0);
+// per (list, mesh), first and last + 1 visible instance
+RWStructuredBuffer<uint2> CullingRanges : register(u1);
+RWStructuredBuffer<uint> InstanceBlockCounts : register(u2);
+
+// pairs of a prefab are mesh major, from PairsOffset, which starts a block,
+// so the tail of its last block is empty
+uint LoadVisibilityMask(uint pair)
+{
+	return pair < PairsCount ? VisibilityMasks[PairsOffset + pair] : 0;
+}
+
+// visible instances per list of a block of pairs
+[numthreads(COMPACTION_THREADS_X, 1, 1)]
+void countMain(
+	uint3 groupID : SV_GroupID,
+	uint groupIndex : SV_GroupIndex)
+{
+	uint block = groupID.x + groupID.y * CULLING_MAX_GROUPS_X;
+	// Y spill dispatches more groups than blocks, the next prefab's blocks follow
+	if (block * COMPACTION_THREADS_X >= PairsCount)
+	{
+		return;
+	}
+
+	uint listsMask = LoadVisibilityMask(block * COMPACTION_THREADS_X + groupIndex);
+	uint listsCount = ListsCount();
+	[unroll(CULLING_LISTS_COUNT)]
+	for (uint list = 0; list < listsCount; list++)
+	{
+		ScanValues[list][groupIndex] = (listsMask >> list) & 1;
+	}
+	GroupScan(listsCount, groupIndex);
+
+	if (groupIndex < listsCount)
+	{
+		InstanceBlockCounts[groupIndex * CompactionBlocksCount + PairsOffset / COMPACTION_THREADS_X + block] =
+			ScanValues[groupIndex][COMPACTION_THREADS_X - 1];
+	}
+}
+
+[numthreads(COMPACTION_THREADS_X, 1, 1)]
+void scanMain(uint groupIndex : SV_GroupIndex)
+{
+	ScanBlocks(InstanceBlockCounts, ListsCount() * CompactionBlocksCount, groupIndex);
+}
+
+// writes every visible instance at its block offset plus the visible ones before it in the block,
+// so lists, prefabs, meshes and objects keep their order, whatever the threads do,
+// the ones past MaxVisibleInstancesCount are dropped, their ranges end there
+[numthreads(COMPACTION_THREADS_X, 1, 1)]
+void main(
+	uint3 groupID : SV_GroupID,
+	uint groupIndex : SV_GroupIndex)
+{
+	uint block = groupID.x + groupID.y * CULLING_MAX_GROUPS_X;
+	if (block * COMPACTION_THREADS_X >= PairsCount)
+	{
+		return;
+	}
+
+	uint pair = block * COMPACTION_THREADS_X + groupIndex;
+	uint listsMask = LoadVisibilityMask(pair);
+	uint listsCount = ListsCount();
+	[unroll(CULLING_LISTS_COUNT)]
+	for (uint list = 0; list < listsCount; list++)
+	{
+		ScanValues[list][groupIndex] = (listsMask >> list) & 1;
+	}
+	GroupScan(listsCount, groupIndex);
+
+	if (pair >= PairsCount)
+	{
+		return;
+	}
+
+	uint meshID = MeshesOffset + pair / ObjectsCount;
+	uint object = pair % ObjectsCount;
+	Instance instance = Instances[ObjectsOffset + object];
+	instance.ID = meshID;
+
+	uint globalBlock = PairsOffset / COMPACTION_THREADS_X + block;
+	[unroll(CULLING_LISTS_COUNT)]
+	for (uint writeList = 0; writeList < listsCount; writeList++)
+	{
+		uint visible = (listsMask >> writeList) & 1;
+		uint writeIndex =
+			InstanceBlockOffsets[writeList * CompactionBlocksCount + globalBlock] +
+			ScanValues[writeList][groupIndex] - visible;
+		if (visible && writeIndex < MaxVisibleInstancesCount)
+		{
+			VisibleInstances[writeIndex] = instance;
+		}
+
+		// the first and last objects of a mesh bound its range, visible or not
+		uint range = writeList * MaxSceneMeshesMetaCount + meshID;
+		if (object == 0)
+		{
+			CullingRanges[range].x = min(writeIndex, MaxVisibleInstancesCount);
+		}
+		if (object == ObjectsCount - 1)
+		{
+			CullingRanges[range].y = min(writeIndex + visible, MaxVisibleInstancesCount);
+		}
+	}
+}
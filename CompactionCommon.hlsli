@@ -0,0 +1,79 @@
+#ifndef COMPACTION_COMMON_HLSL
+#define COMPACTION_COMMON_HLSL
+
+#include "CullingCommon.hlsli"
+
+// a row per list, a value per thread
+groupshared uint ScanValues[CULLING_LISTS_COUNT][COMPACTION_THREADS_X];
+
+uint FrustumsCount()
+{
+	return CAMERAS_COUNT + CascadesCount;
+}
+
+// the routed camera lists follow every frustum's, the unused ones stay empty
+uint ListsCount()
+{
+	return ClusterRoutingEnabled ? CULLING_LISTS_COUNT : FrustumsCount();
+}
+
+// inclusive scan of the first rowsCount rows of ScanValues, in place
+void GroupScan(uint rowsCount, uint groupIndex)
+{
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint offset = 1; offset < COMPACTION_THREADS_X; offset <<= 1)
+	{
+		uint sums[CULLING_LISTS_COUNT];
+		[unroll(CULLING_LISTS_COUNT)]
+		for (uint row = 0; row < rowsCount; row++)
+		{
+			sums[row] = ScanValues[row][groupIndex];
+			if (groupIndex >= offset)
+			{
+				sums[row] += ScanValues[row][groupIndex - offset];
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		[unroll(CULLING_LISTS_COUNT)]
+		for (uint sumRow = 0; sumRow < rowsCount; sumRow++)
+		{
+			ScanValues[sumRow][groupIndex] = sums[sumRow];
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
+
+// exclusive scan of the per block counts, list major, in place, a single thread group,
+// a run of counts per thread, the total is written after them
+void ScanBlocks(RWStructuredBuffer<uint> blocks, uint count, uint groupIndex)
+{
+	uint countsPerThread = (count + COMPACTION_THREADS_X - 1) / COMPACTION_THREADS_X;
+	uint first = min(groupIndex * countsPerThread, count);
+	uint last = min(first + countsPerThread, count);
+
+	uint sum = 0;
+	for (uint block = first; block < last; block++)
+	{
+		sum += blocks[block];
+	}
+	ScanValues[0][groupIndex] = sum;
+	GroupScan(1, groupIndex);
+
+	uint offset = ScanValues[0][groupIndex] - sum;
+	for (uint scannedBlock = first; scannedBlock < last; scannedBlock++)
+	{
+		uint blockCount = blocks[scannedBlock];
+		blocks[scannedBlock] = offset;
+		offset += blockCount;
+	}
+
+	if (groupIndex == COMPACTION_THREADS_X - 1)
+	{
+		blocks[count] = offset;
+	}
+}
+
+#endif // COMPACTION_COMMON_HLSL
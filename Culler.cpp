@@ -4,13 +4,17 @@
 #include "DX.h"
 #include "DescriptorManager.h"
 #include "Shadows.h"
+#include "CullingReference.h"
+#include "CullingEngine.h"
+
+#include <chrono>
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
 struct CullingCB
 {
-	unsigned int maxSceneInstancesCount;
+	unsigned int maxVisibleInstancesCount;
 	unsigned int maxSceneMeshesMetaCount;
 	unsigned int totalInstancesCount;
 	unsigned int totalMeshesCount;
@@ -19,7 +23,13 @@ struct CullingCB
 	unsigned int cameraHiZCullingEnabled;
 	unsigned int shadowsHiZCullingEnabled;
 	unsigned int clusterBackfaceCullingEnabled;
-	unsigned int pad0[3];
+	unsigned int CPUOcclusionCullingEnabled;
+	unsigned int compactionBlocksCount;
+	unsigned int maxCulledCommandsCount;
+	unsigned int clusterRoutingEnabled;
+	float cameraNearZ;
+	float cameraProjectionScale;
+	unsigned int pad0;
 	XMFLOAT2 depthResolution;
 	XMFLOAT2 shadowMapResolution;
 	XMFLOAT4 cameraPosition;
@@ -29,17 +39,60 @@ struct CullingCB
 	Frustum cascade[MAX_CASCADES_COUNT];
 	XMFLOAT4X4 prevFrameCameraVP;
 	XMFLOAT4X4 prevFrameCascadeVP[MAX_CASCADES_COUNT];
+	unsigned int pad1[60];
 };
 static_assert(
 	(sizeof(CullingCB) % 256) == 0,
 	"Constant Buffer size must be 256-byte aligned");
 
-Culler::Culler()
+// root constants, see CullingPrefab in CullingCommon.hlsli
+struct CullingPrefabConstants
+{
+	unsigned int objectsOffset;
+	unsigned int objectsCount;
+	unsigned int meshesOffset;
+	unsigned int meshesCount;
+	AABB prefabAABB;
+	unsigned int pairsCount;
+	unsigned int pairsOffset;
+};
+
+// thread per (object, mesh) pair, computed in 64 bits, since big grids of big prefabs
+// overflow 32 bits, the shaders index pairs with 32 bits, Y groups spill included,
+// the pairs only cost a visibility mask each, the culled instances are compacted into the visible ones
+static unsigned int CullingPairsCount(const Prefab& prefab)
+{
+	uint64_t pairsCount = static_cast<uint64_t>(prefab.objectsCount) * prefab.meshesCount;
+	ASSERT(
+		pairsCount <= UINT32_MAX - static_cast<uint64_t>(CULLING_MAX_GROUPS_X) * CULLING_THREADS_X,
+		"%llu (object, mesh) pairs don't fit a culling dispatch",
+		static_cast<unsigned long long>(pairsCount))
+
+	return static_cast<unsigned int>(pairsCount);
+}
+
+// bigger culling dispatches spill into the Y dimension
+static unsigned int CullingDispatchX(unsigned int groupsCount)
+{
+	return std::min(groupsCount, static_cast<unsigned int>(CULLING_MAX_GROUPS_X));
+}
+
+static unsigned int CullingDispatchY(unsigned int groupsCount)
+{
+	return Utils::DispatchSize(CULLING_MAX_GROUPS_X, groupsCount);
+}
+
+Culler::Culler(unsigned int maxVisibleInstancesCount, unsigned int maxCulledCommandsCount) :
+	_maxVisibleInstancesCount(maxVisibleInstancesCount),
+	_maxCulledCommandsCount(maxCulledCommandsCount)
 {
 	_createClearPSO();
 	_createCullingPSO();
+	_createCompactionPSO();
 	_createGenerateCommandsPSO();
-	_createCullingCounters();
+	_createCompactionResources();
+	_createVisibleObjectsResources();
+	_createCPUOccludedObjectsResources();
 
 	Utils::CreateCBResources(
 		sizeof(CullingCB) * DX::FramesCount,
@@ -48,8 +101,9 @@ Culler::Culler()
 
 	// Allocate a buffer that can be used to reset the UAV counters and
 	// initialize it to 0.
+	// also resets the visible objects counter along with its dispatch arguments
 	auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	auto desc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(unsigned int));
+	auto desc = CD3DX12_RESOURCE_DESC::Buffer(4 * sizeof(unsigned int));
 	SUCCESS(DX::Device->CreateCommittedResource(
 		&prop,
 		D3D12_HEAP_FLAG_NONE,
@@ -66,15 +120,17 @@ Culler::Culler()
 		0,
 		&readRange,
 		reinterpret_cast<void**>(&pMappedCounterReset)));
-	ZeroMemory(pMappedCounterReset, sizeof(unsigned int));
+	ZeroMemory(pMappedCounterReset, 4 * sizeof(unsigned int));
 	_culledCommandsCounterReset->Unmap(0, nullptr);
+
+	_occlusionBuffer.Resize(Settings::CPUOcclusionWidth, Settings::CPUOcclusionHeight);
 }
 
 void Culler::Update()
 {
 	Camera& camera = Scene::CurrentScene->camera;
 	CullingCB cullingData = {};
-	cullingData.maxSceneInstancesCount = static_cast<unsigned int>(Scene::MaxSceneInstancesCount);
+	cullingData.maxVisibleInstancesCount = _maxVisibleInstancesCount;
 	cullingData.maxSceneMeshesMetaCount = static_cast<unsigned int>(Scene::MaxSceneMeshesMetaCount);
 	cullingData.totalInstancesCount = static_cast<unsigned int>(Scene::CurrentScene->instancesCPU.size());
 	cullingData.totalMeshesCount = static_cast<unsigned int>(Scene::CurrentScene->meshesMetaCPU.size());
@@ -83,6 +139,18 @@ void Culler::Update()
 	cullingData.cameraHiZCullingEnabled = Settings::CameraHiZCullingEnabled ? 1 : 0;
 	cullingData.shadowsHiZCullingEnabled = Settings::ShadowsHiZCullingEnabled ? 1 : 0;
 	cullingData.clusterBackfaceCullingEnabled = Settings::ClusterBackfaceCullingEnabled ? 1 : 0;
+	cullingData.CPUOcclusionCullingEnabled = Settings::CPUOcclusionCullingEnabled ? 1 : 0;
+
+	// every prefab starts a block of the visibility masks, so a compaction group never mixes two of them
+	_prefabPairsOffsets.clear();
+	_compactionBlocksCount = 0;
+	for (const auto& prefab : Scene::CurrentScene->prefabs)
+	{
+		_prefabPairsOffsets.push_back(_compactionBlocksCount * COMPACTION_THREADS_X);
+		_compactionBlocksCount += Utils::DispatchSize(COMPACTION_THREADS_X, CullingPairsCount(prefab));
+	}
+	cullingData.compactionBlocksCount = _compactionBlocksCount;
+	cullingData.maxCulledCommandsCount = _maxCulledCommandsCount;
 	cullingData.depthResolution =
 	{
 		static_cast<float>(Settings::BackBufferWidth),
@@ -99,6 +167,10 @@ void Culler::Update()
 		&cullingData.lightDirection,
 		XMVector3Normalize(XMLoadFloat3(&Scene::CurrentScene->lightDirection)));
 	cullingData.camera = camera.GetFrustum();
+	cullingData.clusterRoutingEnabled = Settings::ClusterRouting() ? 1 : 0;
+	cullingData.cameraNearZ = camera.GetNearZ();
+	cullingData.cameraProjectionScale =
+		0.5f * cullingData.depthResolution.y / tanf(0.5f * camera.GetFovY());
 	cullingData.prevFrameCameraVP = camera.GetPrevFrameVP();
 
 	for (int cascade = 0; cascade < Settings::CascadesCount; cascade++)
@@ -112,77 +184,241 @@ void Culler::Update()
 		_cullingCBData + DX::FrameIndex * sizeof(CullingCB),
 		&cullingData,
 		sizeof(CullingCB));
+
+	if (Settings::CPUOcclusionCullingEnabled)
+	{
+		RunCPUOcclusion();
+	}
+
+	if (_CPUReference.valid() &&
+		_CPUReference.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		PrintCPUReference(_CPUReference.get());
+	}
 }
 
-void Culler::Cull(
-	ID3D12GraphicsCommandList* commandList,
-	ComPtr<ID3D12Resource> visibleInstances,
-	ComPtr<ID3D12Resource>* culledCommands,
-	ComPtr<ID3D12Resource>* culledCommandsCounters)
+static CullingReference::Inputs GetCPUCullingInputs()
 {
-	PIXBeginEvent(commandList, 0, L"Culling");
+	Camera& camera = Scene::CurrentScene->camera;
 
-	CD3DX12_RESOURCE_BARRIER barriers[2 + 2 * MAX_FRUSTUMS_COUNT] = {};
-	for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
+	CullingReference::Inputs inputs;
+	inputs.camera = camera.GetFrustum();
+	inputs.cascadesCount = Settings::CascadesCount;
+	for (int cascade = 0; cascade < Settings::CascadesCount; cascade++)
 	{
-		barriers[frustum] = CD3DX12_RESOURCE_BARRIER::Transition(
-			culledCommandsCounters[frustum].Get(),
-			D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
-			D3D12_RESOURCE_STATE_COPY_DEST);
+		inputs.cascade[cascade] = Shadows::Sun.GetCascadeFrustum(cascade);
 	}
-	commandList->ResourceBarrier(MAX_FRUSTUMS_COUNT, barriers);
+	inputs.cameraPosition = camera.GetPosition();
+	XMStoreFloat3(
+		&inputs.lightDirection,
+		XMVector3Normalize(XMLoadFloat3(&Scene::CurrentScene->lightDirection)));
+	inputs.frustumCullingEnabled = Settings::FrustumCullingEnabled;
+	inputs.clusterBackfaceCullingEnabled = Settings::ClusterBackfaceCullingEnabled;
+	inputs.cameraVP = camera.GetVP();
+
+	return inputs;
+}
 
-	// reset the UAV counters for this frame
-	for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
+// validation only, the scenes' CPU data isn't modified after loading, the inputs are copied
+static CPUReferenceStats RunCPUReferenceTests(const Scene& scene, const CullingReference::Inputs& inputs)
+{
+	// a pool of its own, the frame one is used by the CPU occlusion meanwhile
+	ThreadPool threadPool;
+	CPUReferenceStats result;
+	result.frustumsCount = 1 + inputs.cascadesCount;
+
+	auto flatStart = std::chrono::steady_clock::now();
+	result.flat = CullingReference::CullFlat(scene, inputs, threadPool);
+	auto hierarchicalStart = std::chrono::steady_clock::now();
+	result.hierarchical = CullingReference::CullHierarchical(scene, inputs, threadPool);
+	auto hierarchicalEnd = std::chrono::steady_clock::now();
+
+	CPURasterizer::CullingEngine engine;
+	std::vector<uint32_t> visibility;
+	auto engineStart = std::chrono::steady_clock::now();
+	result.engine = CullingReference::CullWithEngine(
+		scene,
+		inputs,
+		engine,
+		threadPool,
+		visibility);
+	auto engineEnd = std::chrono::steady_clock::now();
+	result.engineISA = CPURasterizer::GetBlockKernelISAName(engine.GetISA());
+	result.engineLanes = engine.GetLanesCount();
+
+	std::chrono::duration<double, std::milli> flatTime = hierarchicalStart - flatStart;
+	std::chrono::duration<double, std::milli> hierarchicalTime = hierarchicalEnd - hierarchicalStart;
+	std::chrono::duration<double, std::milli> engineTime = engineEnd - engineStart;
+	result.flatTime = flatTime.count();
+	result.hierarchicalTime = hierarchicalTime.count();
+	result.engineTime = engineTime.count();
+
+	return result;
+}
+
+static void PrintCPUReference(const CPUReferenceStats& result)
+{
+	PrintToOutput(
+		"CPU culling, flat: %zu meshlet tests, %.2f ms\n",
+		result.flat.meshletTests,
+		result.flatTime);
+	PrintToOutput(
+		"CPU culling, hierarchical: %zu object tests, %zu rejected, "
+		"%zu meshlet tests, %zu skipped, %.2f ms\n",
+		result.hierarchical.objectTests,
+		result.hierarchical.objectsRejected,
+		result.hierarchical.meshletTests,
+		result.hierarchical.meshletTestsSkipped,
+		result.hierarchicalTime);
+	PrintToOutput(
+		"CPU culling, engine (%s, %u lanes): %zu meshlet tests, %.2f ms\n",
+		result.engineISA,
+		result.engineLanes,
+		result.engine.meshletTests,
+		result.engineTime);
+	for (int frustum = 0; frustum < result.frustumsCount; frustum++)
 	{
-		commandList->CopyBufferRegion(
-			culledCommandsCounters[frustum].Get(),
-			0,
-			_culledCommandsCounterReset.Get(),
-			0,
-			sizeof(unsigned int));
+		// meshlet bounds may stick out of the object bounds,
+		// so hierarchical culling can only reject more,
+		// the engine does the flat tests, rounding aside
+		PrintToOutput(
+			"frustum %d visible mesh instances, flat: %zu, hierarchical: %zu, engine: %zu\n",
+			frustum,
+			result.flat.visibleMeshInstances[frustum],
+			result.hierarchical.visibleMeshInstances[frustum],
+			result.engine.visibleMeshInstances[frustum]);
 	}
+}
 
-	D3D12_GPU_VIRTUAL_ADDRESS cbAdress = _cullingCB->GetGPUVirtualAddress() + DX::FrameIndex * sizeof(CullingCB);
+void Culler::RunCPUReference()
+{
+	if (IsCPUReferenceRunning())
+	{
+		return;
+	}
 
-	for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
+	const Scene* scene = Scene::CurrentScene;
+	CullingReference::Inputs inputs = GetCPUCullingInputs();
+	_CPUReference = std::async(
+		std::launch::async,
+		[scene, inputs]()
+		{
+			return RunCPUReferenceTests(*scene, inputs);
+		});
+}
+
+void Culler::RunCPUOcclusion()
+{
+	CullingReference::Inputs inputs = GetCPUCullingInputs();
+
+	auto renderStart = std::chrono::steady_clock::now();
+	_CPUOcclusionStats.occluders = CullingReference::RenderOccluders(
+		*Scene::CurrentScene,
+		inputs,
+		Settings::CPUOccludersTrianglesBudget,
+		_occlusionBuffer,
+		_threadPool);
+	auto testStart = std::chrono::steady_clock::now();
+	_occludedObjects.assign(Scene::CurrentScene->instancesCPU.size(), 0);
+	inputs.occlusion = &_occlusionBuffer;
+	inputs.occludedObjects = _occludedObjects.data();
+	_CPUOcclusionStats.culling = CullingReference::CullHierarchical(
+		*Scene::CurrentScene,
+		inputs,
+		_threadPool);
+
+	// the slot of this frame isn't read by the GPU anymore, as the culling CB
+	unsigned int* occludedObjects = _CPUOccludedObjectsData + DX::FrameIndex * _CPUOccludedObjectsWords;
+	memset(occludedObjects, 0, _CPUOccludedObjectsWords * sizeof(unsigned int));
+	for (size_t object = 0; object < _occludedObjects.size(); object++)
 	{
-		barriers[2 * frustum] = CD3DX12_RESOURCE_BARRIER::Transition(
-			culledCommandsCounters[frustum].Get(),
-			D3D12_RESOURCE_STATE_COPY_DEST,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		barriers[2 * frustum + 1] =
-			CD3DX12_RESOURCE_BARRIER::Transition(
-				culledCommands[frustum].Get(),
-				Settings::SWREnabled
-				? D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
-				: D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
-				D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		occludedObjects[object / 32] |= static_cast<unsigned int>(_occludedObjects[object]) << (object % 32);
 	}
-	barriers[_countof(barriers) - 2] =
-		CD3DX12_RESOURCE_BARRIER::Transition(
-			visibleInstances.Get(),
-			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	barriers[_countof(barriers) - 1] =
-		CD3DX12_RESOURCE_BARRIER::Transition(
-			_cullingCounters.Get(),
-			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	auto testEnd = std::chrono::steady_clock::now();
+
+	std::chrono::duration<double, std::milli> renderTime = testStart - renderStart;
+	std::chrono::duration<double, std::milli> testTime = testEnd - testStart;
+	_CPUOcclusionStats.renderTime = renderTime.count();
+	_CPUOcclusionStats.testTime = testTime.count();
+}
+
+void Culler::Cull(
+	ID3D12GraphicsCommandList* commandList,
+	ComPtr<ID3D12Resource> visibleInstances,
+	ComPtr<ID3D12Resource> culledCommands,
+	ComPtr<ID3D12Resource> culledCommandsCounters)
+{
+	PIXBeginEvent(commandList, 0, L"Culling");
+
+	// SRVs of the SW passes, arguments of the HW draws, the routed HW meshlets of the SW frame too
+	const D3D12_RESOURCE_STATES culledCommandsState =
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+
+	CD3DX12_RESOURCE_BARRIER barriers[7] = {};
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		culledCommandsCounters.Get(),
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
+		culledCommands.Get(),
+		culledCommandsState,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(
+		visibleInstances.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	barriers[3] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_visibilityMasks.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	barriers[4] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_instanceBlocks.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	barriers[5] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_cullingRanges.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	barriers[6] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_commandBlocks.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 	commandList->ResourceBarrier(_countof(barriers), barriers);
 
+	D3D12_GPU_VIRTUAL_ADDRESS cbAdress = _cullingCB->GetGPUVirtualAddress() + DX::FrameIndex * sizeof(CullingCB);
+	unsigned int meshesCount = static_cast<unsigned int>(Scene::CurrentScene->meshesMetaCPU.size());
+
 	// clear
 	commandList->SetComputeRootSignature(_clearRS.Get());
 	commandList->SetPipelineState(_clearPSO.Get());
 	commandList->SetComputeRootConstantBufferView(
 		0, cbAdress);
 	commandList->SetComputeRootDescriptorTable(
-		1, Descriptors::SV.GetGPUHandle(CullingCountersUAV));
+		1, Descriptors::SV.GetGPUHandle(CullingRangesUAV));
+	commandList->SetComputeRootDescriptorTable(
+		2, Descriptors::SV.GetGPUHandle(VisibilityMasksUAV));
 	commandList->Dispatch(
-		Utils::DispatchSize(CULLING_THREADS_X, static_cast<unsigned int>(Scene::CurrentScene->meshesMetaCPU.size())),
+		Utils::DispatchSize(CULLING_THREADS_X, meshesCount),
 		1,
 		1);
 
+	// the flat culling writes every mask
+	if (Settings::HierarchicalCullingEnabled)
+	{
+		commandList->SetPipelineState(_clearMasksPSO.Get());
+		unsigned int groupsCount = Utils::DispatchSize(
+			CULLING_THREADS_X,
+			_compactionBlocksCount * COMPACTION_THREADS_X);
+		commandList->Dispatch(
+			CullingDispatchX(groupsCount),
+			CullingDispatchY(groupsCount),
+			1);
+	}
+
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(_visibilityMasks.Get());
+	barriers[1] = CD3DX12_RESOURCE_BARRIER::UAV(_cullingRanges.Get());
+	commandList->ResourceBarrier(2, barriers);
+
 	// culling
 	commandList->SetComputeRootSignature(_cullingRS.Get());
 	commandList->SetPipelineState(_cullingPSO.Get());
@@ -196,77 +432,277 @@ void Culler::Cull(
 		3, Descriptors::SV.GetGPUHandle(PrevFrameDepthSRV));
 	commandList->SetComputeRootDescriptorTable(
 		4, Descriptors::SV.GetGPUHandle(PrevFrameShadowMapSRV));
+	commandList->SetComputeRootDescriptorTable(
+		5, Descriptors::SV.GetGPUHandle(VisibilityMasksUAV));
+	commandList->SetComputeRootDescriptorTable(
+		10, Descriptors::SV.GetGPUHandle(CPUOccludedObjectsSRV + DX::FrameIndex * PerFrameDescriptorsCount));
+	// objects are expanded to their prefab meshes, thread per (object, mesh) pair
+	const auto& prefabs = Scene::CurrentScene->prefabs;
+	for (size_t prefab = 0; prefab < prefabs.size(); prefab++)
+	{
+		_setPrefabConstants(commandList, prefab);
+
+		if (Settings::HierarchicalCullingEnabled)
+		{
+			_cullHierarchical(commandList, prefabs[prefab]);
+		}
+		else
+		{
+			unsigned int groupsCount = Utils::DispatchSize(
+				CULLING_THREADS_X,
+				CullingPairsCount(prefabs[prefab]));
+			commandList->Dispatch(
+				CullingDispatchX(groupsCount),
+				CullingDispatchY(groupsCount),
+				1);
+		}
+	}
+
+	// count the visible instances of every block of pairs, per list
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_visibilityMasks.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(1, barriers);
+
+	commandList->SetPipelineState(_compactionCountPSO.Get());
+	commandList->SetComputeRootDescriptorTable(
+		8, Descriptors::SV.GetGPUHandle(VisibilityMasksSRV));
+	commandList->SetComputeRootDescriptorTable(
+		11, Descriptors::SV.GetGPUHandle(InstanceBlocksUAV));
+	for (size_t prefab = 0; prefab < prefabs.size(); prefab++)
+	{
+		_setPrefabConstants(commandList, prefab);
+
+		unsigned int groupsCount = Utils::DispatchSize(
+			COMPACTION_THREADS_X,
+			CullingPairsCount(prefabs[prefab]));
+		commandList->Dispatch(
+			CullingDispatchX(groupsCount),
+			CullingDispatchY(groupsCount),
+			1);
+	}
+
+	// offsets of the blocks
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(_instanceBlocks.Get());
+	commandList->ResourceBarrier(1, barriers);
+
+	commandList->SetPipelineState(_compactionScanPSO.Get());
+	commandList->Dispatch(1, 1, 1);
+
+	// scatter the visible instances, the ranges of their meshes along
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_instanceBlocks.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(1, barriers);
+
+	commandList->SetPipelineState(_compactionPSO.Get());
 	commandList->SetComputeRootDescriptorTable(
 		5, Descriptors::SV.GetGPUHandle(VisibleInstancesUAV + DX::FrameIndex * PerFrameDescriptorsCount));
 	commandList->SetComputeRootDescriptorTable(
-		6, Descriptors::SV.GetGPUHandle(CullingCountersUAV));
-	commandList->Dispatch(
-		Utils::DispatchSize(CULLING_THREADS_X, static_cast<unsigned int>(Scene::CurrentScene->instancesCPU.size())),
-		1,
-		1);
+		6, Descriptors::SV.GetGPUHandle(CullingRangesUAV));
+	commandList->SetComputeRootDescriptorTable(
+		9, Descriptors::SV.GetGPUHandle(InstanceBlocksSRV));
+	for (size_t prefab = 0; prefab < prefabs.size(); prefab++)
+	{
+		_setPrefabConstants(commandList, prefab);
+
+		unsigned int groupsCount = Utils::DispatchSize(
+			COMPACTION_THREADS_X,
+			CullingPairsCount(prefabs[prefab]));
+		commandList->Dispatch(
+			CullingDispatchX(groupsCount),
+			CullingDispatchY(groupsCount),
+			1);
+	}
 
-	// gererate commands
+	// gererate commands, the same count, scan and scatter over the meshes
 	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
 		visibleInstances.Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
-		_cullingCounters.Get(),
+		_cullingRanges.Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	commandList->ResourceBarrier(2, barriers);
 
+	unsigned int meshBlocksCount = Utils::DispatchSize(COMPACTION_THREADS_X, meshesCount);
+
 	commandList->SetComputeRootSignature(_generateHWRCommandsRS.Get());
-	commandList->SetPipelineState(_generateHWRCommandsPSO.Get());
+	commandList->SetPipelineState(
+		Settings::SWREnabled
+		? _countSWRCommandsPSO.Get()
+		: _countHWRCommandsPSO.Get());
 	commandList->SetComputeRootConstantBufferView(
 		0, cbAdress);
 	commandList->SetComputeRootDescriptorTable(
 		1, Scene::CurrentScene->meshesMetaGPU.GetSRV());
 	commandList->SetComputeRootDescriptorTable(
-		2, Descriptors::SV.GetGPUHandle(CullingCountersSRV));
+		2, Descriptors::SV.GetGPUHandle(CullingRangesSRV));
+	commandList->SetComputeRootDescriptorTable(
+		3, Descriptors::SV.GetGPUHandle(CommandBlocksSRV));
+	commandList->SetComputeRootDescriptorTable(
+		4, Descriptors::SV.GetGPUHandle(CulledCommandsUAV + DX::FrameIndex * PerFrameDescriptorsCount));
+	commandList->SetComputeRootDescriptorTable(
+		5, Descriptors::SV.GetGPUHandle(CommandBlocksUAV));
+	commandList->Dispatch(meshBlocksCount, 1, 1);
+
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(_commandBlocks.Get());
+	commandList->ResourceBarrier(1, barriers);
+
+	commandList->SetPipelineState(_scanCommandsPSO.Get());
+	commandList->Dispatch(1, 1, 1);
+
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_commandBlocks.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(1, barriers);
+
+	commandList->SetPipelineState(
+		Settings::SWREnabled
+		? _generateSWRCommandsPSO.Get()
+		: _generateHWRCommandsPSO.Get());
+	// group 0 writes the commands counts even without meshes
+	commandList->Dispatch(std::max(meshBlocksCount, 1u), 1, 1);
+
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		culledCommands.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		culledCommandsState);
+	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
+		culledCommandsCounters.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+	commandList->ResourceBarrier(2, barriers);
+
+	PIXEndEvent(commandList);
+}
+
+void Culler::_setPrefabConstants(
+	ID3D12GraphicsCommandList* commandList,
+	size_t prefabIndex)
+{
+	const Prefab& prefab = Scene::CurrentScene->prefabs[prefabIndex];
+	CullingPrefabConstants prefabData =
+	{
+		prefab.objectsOffset,
+		prefab.objectsCount,
+		prefab.meshesOffset,
+		prefab.meshesCount,
+		prefab.AABB,
+		CullingPairsCount(prefab),
+		_prefabPairsOffsets[prefabIndex]
+	};
+	commandList->SetComputeRoot32BitConstants(
+		7,
+		sizeof(prefabData) / sizeof(unsigned int),
+		&prefabData,
+		0);
+}
+
+void Culler::_cullHierarchical(
+	ID3D12GraphicsCommandList* commandList,
+	const Prefab& prefab)
+{
+	commandList->CopyBufferRegion(
+		_visibleObjectsCounter.Get(),
+		0,
+		_culledCommandsCounterReset.Get(),
+		0,
+		4 * sizeof(unsigned int));
+
+	CD3DX12_RESOURCE_BARRIER barriers[2] = {};
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_visibleObjectsCounter.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	commandList->ResourceBarrier(1, barriers);
+
+	// objects level
+	commandList->SetPipelineState(_objectCullingPSO.Get());
+	commandList->SetComputeRootDescriptorTable(
+		5, Descriptors::SV.GetGPUHandle(VisibleObjectsUAV));
 	commandList->SetComputeRootDescriptorTable(
-		3, Descriptors::SV.GetGPUHandle(CulledCommandsUAV + DX::FrameIndex * PerFrameDescriptorsCount));
+		6, Descriptors::SV.GetGPUHandle(VisibleObjectsCounterUAV));
+	unsigned int groupsCount = Utils::DispatchSize(CULLING_THREADS_X, prefab.objectsCount);
 	commandList->Dispatch(
-		Utils::DispatchSize(CULLING_THREADS_X, static_cast<unsigned int>(Scene::CurrentScene->meshesMetaCPU.size())),
-		1,
+		CullingDispatchX(groupsCount),
+		CullingDispatchY(groupsCount),
 		1);
 
-	for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
-	{
-		barriers[2 * frustum] = CD3DX12_RESOURCE_BARRIER::Transition(
-			culledCommands[frustum].Get(),
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-			Settings::SWREnabled
-			? D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
-			: D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
-		barriers[2 * frustum + 1] =
-			CD3DX12_RESOURCE_BARRIER::Transition(
-				culledCommandsCounters[frustum].Get(),
-				D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
-	}
-	commandList->ResourceBarrier(2 * MAX_FRUSTUMS_COUNT, barriers);
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(_visibleObjectsCounter.Get());
+	commandList->ResourceBarrier(1, barriers);
 
-	PIXEndEvent(commandList);
+	commandList->SetPipelineState(_objectCullingArgumentsPSO.Get());
+	commandList->Dispatch(1, 1, 1);
+
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_visibleObjectsCounter.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_visibleObjects.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	commandList->ResourceBarrier(2, barriers);
+
+	// meshlets level, only for the objects which survived
+	commandList->SetPipelineState(_hierarchicalCullingPSO.Get());
+	commandList->SetComputeRootDescriptorTable(
+		5, Descriptors::SV.GetGPUHandle(VisibilityMasksUAV));
+	commandList->SetComputeRootDescriptorTable(
+		8, Descriptors::SV.GetGPUHandle(VisibleObjectsSRV));
+	commandList->SetComputeRootDescriptorTable(
+		9, Descriptors::SV.GetGPUHandle(VisibleObjectsCounterSRV));
+	commandList->ExecuteIndirect(
+		_dispatchCS.Get(),
+		1,
+		_visibleObjectsCounter.Get(),
+		sizeof(unsigned int),
+		nullptr,
+		0);
+
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_visibleObjectsCounter.Get(),
+		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_COPY_DEST);
+	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_visibleObjects.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	commandList->ResourceBarrier(2, barriers);
 }
 
-void Culler::_createCullingCounters()
+void Culler::_createVisibleObjectsResources()
 {
-	// buffers with counters for culling
-	size_t bufferSize = Scene::MaxSceneMeshesMetaCount * sizeof(unsigned int) * MAX_FRUSTUMS_COUNT;
 	auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+
+	// object instance index and frustums mask
+	const size_t visibleObjectStride = 2 * sizeof(unsigned int);
 	auto desc = CD3DX12_RESOURCE_DESC::Buffer(
-		bufferSize,
+		Scene::MaxSceneObjectsCount * visibleObjectStride,
 		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
+	SUCCESS(DX::Device->CreateCommittedResource(
+		&prop,
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		nullptr,
+		IID_PPV_ARGS(&_visibleObjects)));
+	NAME_D3D12_OBJECT(_visibleObjects);
+
 	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
 	UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
 	UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 	UAVDesc.Buffer.FirstElement = 0;
 	UAVDesc.Buffer.CounterOffsetInBytes = 0;
 	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
-	UAVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneMeshesMetaCount * MAX_FRUSTUMS_COUNT);
-	UAVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
+	UAVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneObjectsCount);
+	UAVDesc.Buffer.StructureByteStride = visibleObjectStride;
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
 	SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
@@ -274,40 +710,207 @@ void Culler::_createCullingCounters()
 	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
 	SRVDesc.Buffer.FirstElement = 0;
 	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-	SRVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneMeshesMetaCount * MAX_FRUSTUMS_COUNT);
+	SRVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneObjectsCount);
+	SRVDesc.Buffer.StructureByteStride = visibleObjectStride;
+
+	DX::Device->CreateUnorderedAccessView(
+		_visibleObjects.Get(),
+		nullptr,
+		&UAVDesc,
+		Descriptors::SV.GetCPUHandle(VisibleObjectsUAV));
+
+	DX::Device->CreateShaderResourceView(
+		_visibleObjects.Get(),
+		&SRVDesc,
+		Descriptors::SV.GetCPUHandle(VisibleObjectsSRV));
+
+	// count followed by the meshlet culling dispatch arguments
+	desc = CD3DX12_RESOURCE_DESC::Buffer(
+		4 * sizeof(unsigned int),
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+	SUCCESS(DX::Device->CreateCommittedResource(
+		&prop,
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&_visibleObjectsCounter)));
+	NAME_D3D12_OBJECT(_visibleObjectsCounter);
+
+	UAVDesc.Buffer.NumElements = 4;
+	UAVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
+	SRVDesc.Buffer.NumElements = 4;
 	SRVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
 
+	DX::Device->CreateUnorderedAccessView(
+		_visibleObjectsCounter.Get(),
+		nullptr,
+		&UAVDesc,
+		Descriptors::SV.GetCPUHandle(VisibleObjectsCounterUAV));
+
+	DX::Device->CreateShaderResourceView(
+		_visibleObjectsCounter.Get(),
+		&SRVDesc,
+		Descriptors::SV.GetCPUHandle(VisibleObjectsCounterSRV));
+
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[1] = {};
+	argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+
+	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+	commandSignatureDesc.pArgumentDescs = argumentDescs;
+	commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+	commandSignatureDesc.ByteStride = sizeof(D3D12_DISPATCH_ARGUMENTS);
+
+	SUCCESS(DX::Device->CreateCommandSignature(
+		&commandSignatureDesc,
+		nullptr,
+		IID_PPV_ARGS(&_dispatchCS)));
+	NAME_D3D12_OBJECT(_dispatchCS);
+}
+
+void Culler::_createCPUOccludedObjectsResources()
+{
+	_CPUOccludedObjectsWords = std::max<size_t>((Scene::MaxSceneObjectsCount + 31) / 32, 1);
+	size_t frameSize = _CPUOccludedObjectsWords * sizeof(unsigned int);
+
+	// written on the CPU every frame, read once by the culling
+	Utils::CreateCBResources(
+		frameSize * DX::FramesCount,
+		reinterpret_cast<void**>(&_CPUOccludedObjectsData),
+		_CPUOccludedObjects);
+	NAME_D3D12_OBJECT(_CPUOccludedObjects);
+	memset(_CPUOccludedObjectsData, 0, frameSize * DX::FramesCount);
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
+	SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	SRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+	SRVDesc.Buffer.NumElements = static_cast<unsigned int>(_CPUOccludedObjectsWords);
+	SRVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
+
+	for (int frame = 0; frame < DX::FramesCount; frame++)
+	{
+		SRVDesc.Buffer.FirstElement = frame * _CPUOccludedObjectsWords;
+		DX::Device->CreateShaderResourceView(
+			_CPUOccludedObjects.Get(),
+			&SRVDesc,
+			Descriptors::SV.GetCPUHandle(CPUOccludedObjectsSRV + frame * PerFrameDescriptorsCount));
+	}
+}
+
+// SRV and UAV of a default heap buffer of elementsCount elements of a stride,
+// read by default, see the transitions in Cull()
+static void CreateCompactionBuffer(
+	size_t elementsCount,
+	unsigned int stride,
+	ComPtr<ID3D12Resource>& buffer,
+	CBVSRVUAVIndices SRV,
+	CBVSRVUAVIndices UAV)
+{
+	auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	auto desc = CD3DX12_RESOURCE_DESC::Buffer(
+		elementsCount * stride,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
+	UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	UAVDesc.Buffer.FirstElement = 0;
+	UAVDesc.Buffer.CounterOffsetInBytes = 0;
+	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+	UAVDesc.Buffer.NumElements = static_cast<unsigned int>(elementsCount);
+	UAVDesc.Buffer.StructureByteStride = stride;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
+	SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	SRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	SRVDesc.Buffer.FirstElement = 0;
+	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+	SRVDesc.Buffer.NumElements = static_cast<unsigned int>(elementsCount);
+	SRVDesc.Buffer.StructureByteStride = stride;
+
 	SUCCESS(DX::Device->CreateCommittedResource(
 		&prop,
 		D3D12_HEAP_FLAG_NONE,
 		&desc,
 		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
 		nullptr,
-		IID_PPV_ARGS(&_cullingCounters)));
-	NAME_D3D12_OBJECT(_cullingCounters);
+		IID_PPV_ARGS(&buffer)));
 
 	DX::Device->CreateUnorderedAccessView(
-		_cullingCounters.Get(),
+		buffer.Get(),
 		nullptr,
 		&UAVDesc,
-		Descriptors::SV.GetCPUHandle(CullingCountersUAV));
+		Descriptors::SV.GetCPUHandle(UAV));
 
 	DX::Device->CreateShaderResourceView(
-		_cullingCounters.Get(),
+		buffer.Get(),
 		&SRVDesc,
-		Descriptors::SV.GetCPUHandle(CullingCountersSRV));
+		Descriptors::SV.GetCPUHandle(SRV));
+}
+
+void Culler::_createCompactionResources()
+{
+	// every prefab may leave its last block partially empty
+	size_t maxInstanceBlocksCount =
+		Scene::MaxSceneInstancesCount / COMPACTION_THREADS_X + Scene::MaxScenePrefabsCount;
+	size_t maxMeshBlocksCount =
+		(Scene::MaxSceneMeshesMetaCount + COMPACTION_THREADS_X - 1) / COMPACTION_THREADS_X;
+
+	// lists mask per (object, mesh) pair
+	CreateCompactionBuffer(
+		maxInstanceBlocksCount * COMPACTION_THREADS_X,
+		sizeof(unsigned int),
+		_visibilityMasks,
+		VisibilityMasksSRV,
+		VisibilityMasksUAV);
+	NAME_D3D12_OBJECT(_visibilityMasks);
+
+	// counts, then offsets, per list and block, followed by the total
+	CreateCompactionBuffer(
+		maxInstanceBlocksCount * CULLING_LISTS_COUNT + 1,
+		sizeof(unsigned int),
+		_instanceBlocks,
+		InstanceBlocksSRV,
+		InstanceBlocksUAV);
+	NAME_D3D12_OBJECT(_instanceBlocks);
+
+	// visible instances per (list, mesh), first and last + 1
+	CreateCompactionBuffer(
+		Scene::MaxSceneMeshesMetaCount * CULLING_LISTS_COUNT,
+		2 * sizeof(unsigned int),
+		_cullingRanges,
+		CullingRangesSRV,
+		CullingRangesUAV);
+	NAME_D3D12_OBJECT(_cullingRanges);
+
+	CreateCompactionBuffer(
+		maxMeshBlocksCount * CULLING_LISTS_COUNT + 1,
+		sizeof(unsigned int),
+		_commandBlocks,
+		CommandBlocksSRV,
+		CommandBlocksUAV);
+	NAME_D3D12_OBJECT(_commandBlocks);
 }
 
 void Culler::_createClearPSO()
 {
-	CD3DX12_ROOT_PARAMETER1 computeRootParameters[2] = {};
+	CD3DX12_ROOT_PARAMETER1 computeRootParameters[3] = {};
 	computeRootParameters[0].InitAsConstantBufferView(0);
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[1] = {};
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[2] = {};
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
 		1,
 		0);
 	computeRootParameters[1].InitAsDescriptorTable(1, &ranges[0]);
+	ranges[1].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		1,
+		1);
+	computeRootParameters[2].InitAsDescriptorTable(1, &ranges[1]);
 
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC computeRootSignatureDesc;
 	computeRootSignatureDesc.Init_1_1(_countof(computeRootParameters), computeRootParameters);
@@ -327,13 +930,23 @@ void Culler::_createClearPSO()
 
 	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_clearPSO)));
 	NAME_D3D12_OBJECT(_clearPSO);
+
+	computeShader = Utils::CompileShader(
+		L"ClearCS.hlsl",
+		nullptr,
+		"masksMain",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_clearMasksPSO)));
+	NAME_D3D12_OBJECT(_clearMasksPSO);
 }
 
 void Culler::_createCullingPSO()
 {
-	CD3DX12_ROOT_PARAMETER1 computeRootParameters[7] = {};
+	CD3DX12_ROOT_PARAMETER1 computeRootParameters[12] = {};
 	computeRootParameters[0].InitAsConstantBufferView(0);
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[6] = {};
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[10] = {};
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
 		1,
@@ -366,6 +979,31 @@ void Culler::_createCullingPSO()
 		1,
 		1);
 	computeRootParameters[6].InitAsDescriptorTable(1, &ranges[5]);
+	// see CullingPrefabConstants
+	computeRootParameters[7].InitAsConstants(sizeof(CullingPrefabConstants) / sizeof(unsigned int), 1);
+	// visible objects of the hierarchical culling
+	ranges[6].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+		1,
+		3 + MAX_CASCADES_COUNT);
+	computeRootParameters[8].InitAsDescriptorTable(1, &ranges[6]);
+	ranges[7].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+		1,
+		4 + MAX_CASCADES_COUNT);
+	computeRootParameters[9].InitAsDescriptorTable(1, &ranges[7]);
+	// objects occluded in the CPU occlusion buffer
+	ranges[8].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+		1,
+		5 + MAX_CASCADES_COUNT);
+	computeRootParameters[10].InitAsDescriptorTable(1, &ranges[8]);
+	// per block counts of the compaction, it reuses the root signature, see CompactionCS.hlsl
+	ranges[9].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		1,
+		2);
+	computeRootParameters[11].InitAsDescriptorTable(1, &ranges[9]);
 
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC computeRootSignatureDesc;
 	computeRootSignatureDesc.Init_1_1(
@@ -391,13 +1029,80 @@ void Culler::_createCullingPSO()
 
 	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_cullingPSO)));
 	NAME_D3D12_OBJECT(_cullingPSO);
+
+	const D3D_SHADER_MACRO defines[] = { { "HIERARCHICAL_CULLING", "1" }, { nullptr, nullptr } };
+	computeShader = Utils::CompileShader(
+		L"CullingCS.hlsl",
+		defines,
+		"main",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_hierarchicalCullingPSO)));
+	NAME_D3D12_OBJECT(_hierarchicalCullingPSO);
+
+	computeShader = Utils::CompileShader(
+		L"ObjectCullingCS.hlsl",
+		nullptr,
+		"main",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_objectCullingPSO)));
+	NAME_D3D12_OBJECT(_objectCullingPSO);
+
+	computeShader = Utils::CompileShader(
+		L"ObjectCullingCS.hlsl",
+		nullptr,
+		"argumentsMain",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_objectCullingArgumentsPSO)));
+	NAME_D3D12_OBJECT(_objectCullingArgumentsPSO);
+}
+
+void Culler::_createCompactionPSO()
+{
+	D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
+	psoDesc.pRootSignature = _cullingRS.Get();
+
+	ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
+		L"CompactionCS.hlsl",
+		nullptr,
+		"countMain",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_compactionCountPSO)));
+	NAME_D3D12_OBJECT(_compactionCountPSO);
+
+	computeShader = Utils::CompileShader(
+		L"CompactionCS.hlsl",
+		nullptr,
+		"scanMain",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_compactionScanPSO)));
+	NAME_D3D12_OBJECT(_compactionScanPSO);
+
+	computeShader = Utils::CompileShader(
+		L"CompactionCS.hlsl",
+		nullptr,
+		"main",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_compactionPSO)));
+	NAME_D3D12_OBJECT(_compactionPSO);
 }
 
 void Culler::_createGenerateCommandsPSO()
 {
-	CD3DX12_ROOT_PARAMETER1 computeRootParameters[4] = {};
+	CD3DX12_ROOT_PARAMETER1 computeRootParameters[6] = {};
 	computeRootParameters[0].InitAsConstantBufferView(0);
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[3] = {};
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[5] = {};
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
 		1,
@@ -411,10 +1116,21 @@ void Culler::_createGenerateCommandsPSO()
 		1);
 	computeRootParameters[2].InitAsDescriptorTable(1, &ranges[1]);
 	ranges[2].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+		1,
+		2);
+	computeRootParameters[3].InitAsDescriptorTable(1, &ranges[2]);
+	// culled commands and their counts
+	ranges[3].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
-		MAX_FRUSTUMS_COUNT,
+		2,
 		0);
-	computeRootParameters[3].InitAsDescriptorTable(1, &ranges[2]);
+	computeRootParameters[4].InitAsDescriptorTable(1, &ranges[3]);
+	ranges[4].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		1,
+		2);
+	computeRootParameters[5].InitAsDescriptorTable(1, &ranges[4]);
 
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC computeRootSignatureDesc;
 	computeRootSignatureDesc.Init_1_1(
@@ -438,4 +1154,46 @@ void Culler::_createGenerateCommandsPSO()
 
 	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_generateHWRCommandsPSO)));
 	NAME_D3D12_OBJECT(_generateHWRCommandsPSO);
+
+	computeShader = Utils::CompileShader(
+		L"GenerateCommandsCS.hlsl",
+		nullptr,
+		"countMain",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_countHWRCommandsPSO)));
+	NAME_D3D12_OBJECT(_countHWRCommandsPSO);
+
+	computeShader = Utils::CompileShader(
+		L"GenerateCommandsCS.hlsl",
+		nullptr,
+		"scanMain",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_scanCommandsPSO)));
+	NAME_D3D12_OBJECT(_scanCommandsPSO);
+
+	// INSTANCE_SLICES only slices the SW commands
+	const D3D_SHADER_MACRO defines[] = { { "SWR_COMMANDS", "1" }, { nullptr, nullptr } };
+	computeShader = Utils::CompileShader(
+		L"GenerateCommandsCS.hlsl",
+		defines,
+		"main",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_generateSWRCommandsPSO)));
+	NAME_D3D12_OBJECT(_generateSWRCommandsPSO);
+
+	computeShader = Utils::CompileShader(
+		L"GenerateCommandsCS.hlsl",
+		defines,
+		"countMain",
+		"cs_5_0");
+	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_countSWRCommandsPSO)));
+	NAME_D3D12_OBJECT(_countSWRCommandsPSO);
 }
\ No newline at end of file
@@ -2,35 +2,118 @@
 
 #include "Settings.h"
 #include "CPUGPUCommon.h"
+#include "CullingReference.h"
+#include "MaskedOcclusion.h"
+#include "ThreadPool.h"
+
+#include <future>
+
+// per frame results of the CPU occlusion culling
+struct CPUOcclusionStats
+{
+	CullingReference::OccludersStats occluders;
+	CullingReference::Stats culling;
+	double renderTime = 0.0;
+	double testTime = 0.0;
+};
+
+// results of the CPU culling reference, flat, hierarchical and on the SIMD culling engine
+struct CPUReferenceStats
+{
+	CullingReference::Stats flat;
+	CullingReference::Stats hierarchical;
+	CullingReference::Stats engine;
+	const char* engineISA = "";
+	unsigned int engineLanes = 0;
+	double flatTime = 0.0;
+	double hierarchicalTime = 0.0;
+	double engineTime = 0.0;
+	int frustumsCount = 0;
+};
 
 class Culler
 {
 public:
 
-	Culler();
+	// capacities of the culled instances of all the lists and of the culled commands of a list
+	Culler(unsigned int maxVisibleInstancesCount, unsigned int maxCulledCommandsCount);
 	void Update();
+	// culls the current scene on the CPU, flat and hierarchical, on a thread of its own,
+	// so the frames go on meanwhile, Update() prints the tests counts once it's done
+	void RunCPUReference();
+	bool IsCPUReferenceRunning() const { return _CPUReference.valid(); }
+	// renders the biggest camera visible meshlets into the occlusion buffer,
+	// then culls the current scene hierarchically against it, same frame, no GPU readback,
+	// the objects occluded as a whole skip the camera in the GPU culling of this frame
+	void RunCPUOcclusion();
+	const CPUOcclusionStats& GetCPUOcclusionStats() const { return _CPUOcclusionStats; }
 	void Cull(
 		ID3D12GraphicsCommandList* commandList,
 		Microsoft::WRL::ComPtr<ID3D12Resource> visibleInstances,
-		Microsoft::WRL::ComPtr<ID3D12Resource>* culledCommands,
-		Microsoft::WRL::ComPtr<ID3D12Resource>* culledCommandsCounters);
+		Microsoft::WRL::ComPtr<ID3D12Resource> culledCommands,
+		Microsoft::WRL::ComPtr<ID3D12Resource> culledCommandsCounters);
 
 private:
 
 	void _createClearPSO();
 	void _createCullingPSO();
 	void _createGenerateCommandsPSO();
-	void _createCullingCounters();
+	void _createCompactionPSO();
+	void _createCompactionResources();
+	void _createVisibleObjectsResources();
+	void _createCPUOccludedObjectsResources();
+	// see CullingPrefab in CullingCommon.hlsli
+	void _setPrefabConstants(
+		ID3D12GraphicsCommandList* commandList,
+		size_t prefabIndex);
+	// objects against prefab bounds first, then meshlets of the surviving ones
+	void _cullHierarchical(
+		ID3D12GraphicsCommandList* commandList,
+		const Prefab& prefab);
 
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> _clearRS;
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> _clearPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _clearMasksPSO;
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> _cullingRS;
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> _cullingPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _objectCullingPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _objectCullingArgumentsPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _hierarchicalCullingPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _compactionCountPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _compactionScanPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _compactionPSO;
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> _dispatchCS;
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> _generateHWRCommandsRS;
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> _generateHWRCommandsPSO;
-	Microsoft::WRL::ComPtr<ID3D12Resource> _cullingCounters;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _generateSWRCommandsPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _countHWRCommandsPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _countSWRCommandsPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _scanCommandsPSO;
+	// compaction of the culling results, see CompactionCS.hlsl
+	Microsoft::WRL::ComPtr<ID3D12Resource> _visibilityMasks;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _instanceBlocks;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _cullingRanges;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _commandBlocks;
+	// first pair of every prefab of the current scene in the visibility masks
+	std::vector<unsigned int> _prefabPairsOffsets;
+	unsigned int _compactionBlocksCount = 0;
+	unsigned int _maxVisibleInstancesCount = 0;
+	unsigned int _maxCulledCommandsCount = 0;
 	Microsoft::WRL::ComPtr<ID3D12Resource> _culledCommandsCounterReset;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _visibleObjects;
+	Microsoft::WRL::ComPtr<ID3D12Resource> _visibleObjectsCounter;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> _cullingCB;
 	unsigned char* _cullingCBData;
+
+	// bit per scene object, per frame, see CPUOccludedObjects in CullingCommon.hlsli
+	Microsoft::WRL::ComPtr<ID3D12Resource> _CPUOccludedObjects;
+	unsigned int* _CPUOccludedObjectsData;
+	size_t _CPUOccludedObjectsWords = 0;
+
+	CPURasterizer::OcclusionBuffer _occlusionBuffer;
+	std::vector<uint8_t> _occludedObjects;
+	ThreadPool _threadPool;
+	CPUOcclusionStats _CPUOcclusionStats;
+	std::future<CPUReferenceStats> _CPUReference;
 };
\ No newline at end of file
@@ -5,7 +5,7 @@
 
 cbuffer CullingCB : register(b0)
 {
-	uint MaxSceneInstancesCount;
+	uint MaxVisibleInstancesCount;
 	uint MaxSceneMeshesMetaCount;
 	uint TotalInstancesCount;
 	uint TotalMeshesCount;
@@ -14,8 +14,17 @@ cbuffer CullingCB : register(b0)
 	uint CameraHiZCullingEnabled;
 	uint ShadowsHiZCullingEnabled;
 	uint ClusterBackfaceCullingEnabled;
-	uint pad0;
-	uint2 pad1;
+	uint CPUOcclusionCullingEnabled;
+	// blocks of COMPACTION_THREADS_X pairs, every prefab starts one
+	uint CompactionBlocksCount;
+	// per list, in the culled commands buffer
+	uint MaxCulledCommandsCount;
+	// the camera visible meshlets go to the lists of their routes, see CameraCullingList()
+	uint ClusterRoutingEnabled;
+	float CameraNearZ;
+	// pixels per unit of the tangent of the view angle
+	float CameraProjectionScale;
+	uint Pad0;
 	float2 DepthResolution;
 	float2 ShadowMapResolution;
 	float4 CameraPosition;
@@ -27,4 +36,203 @@ cbuffer CullingCB : register(b0)
 	float4x4 PrevFrameCascadeVP[MAX_CASCADES_COUNT];
 };
 
+// prefab processed by the current culling dispatch
+cbuffer CullingPrefab : register(b1)
+{
+	uint ObjectsOffset;
+	uint ObjectsCount;
+	uint MeshesOffset;
+	uint MeshesCount;
+	AABB PrefabAABB;
+	// ObjectsCount * MeshesCount, range checked on the CPU
+	uint PairsCount;
+	// first pair of the prefab in the visibility masks, a multiple of COMPACTION_THREADS_X
+	uint PairsOffset;
+};
+
+SamplerState DepthSampler : register(s0);
+
+// bit per scene object, set for the objects the CPU occlusion buffer occludes in this frame
+StructuredBuffer<uint> CPUOccludedObjects : register(t13);
+
+bool CPUOccludedObject(uint objectID)
+{
+	return CPUOcclusionCullingEnabled && (CPUOccludedObjects[objectID / 32] & (1u << (objectID % 32)));
+}
+
+bool FrustumVsAABB(Frustum f, AABB box)
+{
+	float3 pMax = box.center + box.extents;
+	float3 pMin = box.center - box.extents;
+
+	uint sameSideCornersXMin = 0;
+	uint sameSideCornersXMax = 0;
+	uint sameSideCornersYMin = 0;
+	uint sameSideCornersYMax = 0;
+	uint sameSideCornersZMin = 0;
+	uint sameSideCornersZMax = 0;
+	[unroll]
+	for (uint i = 0; i < 8; i++)
+	{
+		sameSideCornersXMin += (f.corners[i].x < pMin.x) ? 1 : 0;
+		sameSideCornersXMax += (f.corners[i].x > pMax.x) ? 1 : 0;
+		sameSideCornersYMin += (f.corners[i].y < pMin.y) ? 1 : 0;
+		sameSideCornersYMax += (f.corners[i].y > pMax.y) ? 1 : 0;
+		sameSideCornersZMin += (f.corners[i].z < pMin.z) ? 1 : 0;
+		sameSideCornersZMax += (f.corners[i].z > pMax.z) ? 1 : 0;
+	}
+
+	return
+		!(sameSideCornersXMin == 8
+		|| sameSideCornersXMax == 8
+		|| sameSideCornersYMin == 8
+		|| sameSideCornersYMax == 8
+		|| sameSideCornersZMin == 8
+		|| sameSideCornersZMax == 8);
+}
+
+bool AABBVsPlane(AABB box, float4 plane)
+{
+	float r = dot(box.extents, abs(plane.xyz));
+	float s = dot(plane.xyz, box.center) + plane.w;
+	return r + s >= 0.0;
+}
+
+bool AABBVsFrustum(AABB box, Frustum frustum)
+{
+	bool largeAABBTest = FrustumVsAABB(frustum, box);
+	bool l = AABBVsPlane(box, frustum.left);
+	bool r = AABBVsPlane(box, frustum.right);
+	bool b = AABBVsPlane(box, frustum.bottom);
+	bool t = AABBVsPlane(box, frustum.top);
+	bool n = AABBVsPlane(box, frustum.near);
+	bool f = AABBVsPlane(box, frustum.far);
+
+	return l && r && b && t && n && f && largeAABBTest;
+}
+
+bool AABBVsHiZ(
+	in AABB box,
+	in float4x4 VP,
+	in float2 HiZResolution,
+	in Texture2D HiZ)
+{
+	float3 boxCorners[8] =
+	{
+		box.center + box.extents * float3(1.0, 1.0, 1.0),
+		box.center + box.extents * float3(1.0, 1.0, -1.0),
+		box.center + box.extents * float3(1.0, -1.0, 1.0),
+		box.center + box.extents * float3(1.0, -1.0, -1.0),
+		box.center + box.extents * float3(-1.0, 1.0, 1.0),
+		box.center + box.extents * float3(-1.0, 1.0, -1.0),
+		box.center + box.extents * float3(-1.0, -1.0, 1.0),
+		box.center + box.extents * float3(-1.0, -1.0, -1.0)
+	};
+
+	float3 minP = FloatMax.xxx;
+	float3 maxP = -FloatMax.xxx;
+	float minW = FloatMax;
+	[unroll]
+	for (uint corner = 0; corner < 8; corner++)
+	{
+		float4 cornerNDC = mul(
+			VP,
+			float4(boxCorners[corner], 1.0));
+		minW = min(minW, cornerNDC.w);
+		cornerNDC.xyz /= cornerNDC.w;
+
+		minP = min(minP, cornerNDC.xyz);
+		maxP = max(maxP, cornerNDC.xyz);
+	}
+
+	// boxes crossing the near plane don't project to bounds, whole objects often do
+	if (minW <= 0.0)
+	{
+		return true;
+	}
+	// NDC -> DX [0,1]
+	minP.xy = minP.xy * float2(0.5, -0.5) + float2(0.5, 0.5);
+	maxP.xy = maxP.xy * float2(0.5, -0.5) + float2(0.5, 0.5);
+
+	float mipLevel = ceil(log2(0.5 * max(
+		(maxP.x - minP.x) * HiZResolution.x,
+		(maxP.y - minP.y) * HiZResolution.y)));
+	float tileDepth = HiZ.SampleLevel(
+		DepthSampler,
+		(minP.xy + maxP.xy) * 0.5,
+		mipLevel).r;
+
+	return !(tileDepth > maxP.z);
+}
+
+bool BackfacingMeshlet(
+	in float3 cameraPosition,
+	in float3 coneApex,
+	in float3 coneAxis,
+	in float coneCutoff)
+{
+	return dot(normalize(coneApex - cameraPosition), coneAxis) >= coneCutoff;
+}
+
+bool BackfacingMeshletOrthographic(float3 coneAxis, float coneCutoff)
+{
+	return dot(-LightDirection.xyz, coneAxis) >= coneCutoff;
+}
+
+// same math as EstimateCluster and RouteCluster in ClusterRouting.cpp,
+// average triangle area of a meshlet from the screen area of its bounding sphere
+uint ClusterRoute(AABB box, uint trianglesCount)
+{
+	float3 toCenter = box.center - CameraPosition.xyz;
+	float distanceSq = dot(toCenter, toCenter);
+	float radiusSq = dot(box.extents, box.extents);
+	float radius = sqrt(radiusSq);
+
+	// only the HW clips properly
+	if (sqrt(distanceSq) - radius <= CameraNearZ)
+	{
+		return CLUSTER_ROUTE_HARDWARE;
+	}
+
+	// the tangent of the sphere's silhouette angle
+	float projectedRadius = CameraProjectionScale * radius / sqrt(distanceSq - radiusSq);
+	float screenArea = min(
+		3.14159265 * projectedRadius * projectedRadius,
+		DepthResolution.x * DepthResolution.y);
+	float triangleArea = screenArea / max(trianglesCount, 1);
+
+	if (triangleArea <= CLUSTER_ROUTING_MICRO_TRIANGLE_AREA)
+	{
+		return CLUSTER_ROUTE_SOFTWARE_MICRO;
+	}
+
+	if (triangleArea >= CLUSTER_ROUTING_BIG_TRIANGLE_AREA)
+	{
+		return CLUSTER_ROUTE_SOFTWARE_BIG;
+	}
+
+	return CLUSTER_ROUTE_HARDWARE;
+}
+
+// list of a camera visible meshlet, the camera one, unless it's routed elsewhere
+uint CameraCullingList(AABB box, uint trianglesCount)
+{
+	if (!ClusterRoutingEnabled)
+	{
+		return 0;
+	}
+
+	uint route = ClusterRoute(box, trianglesCount);
+	if (route == CLUSTER_ROUTE_SOFTWARE_BIG)
+	{
+		return SOFTWARE_BIG_CULLING_LIST;
+	}
+	if (route == CLUSTER_ROUTE_HARDWARE)
+	{
+		return HARDWARE_CULLING_LIST;
+	}
+
+	return 0;
+}
+
 #endif // CULLING_COMMON_HLSL
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "CullingEngine.h"
+#include "CullingKernels.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace CPURasterizer
+{
+
+static_assert(sizeof(Instance) % sizeof(float) == 0, "instance transforms are read as a float stride");
+
+CullingEngine::CullingEngine(BlockKernelISA isa)
+{
+	SetISA(isa);
+}
+
+void CullingEngine::SetISA(BlockKernelISA isa)
+{
+	BlockKernelISA best = GetBestBlockKernelISA();
+	if (static_cast<int>(isa) > static_cast<int>(best))
+	{
+		isa = best;
+	}
+
+	// there's no 4 lanes kernel
+	_isa = isa == BlockKernelISA::SSE41 ? BlockKernelISA::Scalar : isa;
+	_lanesCount = GetCullingKernelLanes(_isa);
+}
+
+void CullingEngine::Cull(ThreadPool& pool, const CullingView& view, const CullingPrefab& prefab, uint32_t* visibility) const
+{
+	CullingKernelView kernelView = {};
+	kernelView.frustumsCount = std::min<unsigned int>(view.frustumsCount, MAX_FRUSTUMS_COUNT);
+	kernelView.frustumCullingEnabled = view.frustumCullingEnabled ? 1 : 0;
+	kernelView.clusterBackfaceCullingEnabled = view.clusterBackfaceCullingEnabled ? 1 : 0;
+	kernelView.cameraPosition[0] = view.cameraPosition.x;
+	kernelView.cameraPosition[1] = view.cameraPosition.y;
+	kernelView.cameraPosition[2] = view.cameraPosition.z;
+
+	for (unsigned int frustum = 0; frustum < kernelView.frustumsCount; frustum++)
+	{
+		const CullingFrustum& source = view.frustums[frustum];
+		const Float4* planes[6] = { &source.l, &source.r, &source.b, &source.t, &source.n, &source.f };
+		for (int plane = 0; plane < 6; plane++)
+		{
+			kernelView.planes[frustum][plane][0] = planes[plane]->x;
+			kernelView.planes[frustum][plane][1] = planes[plane]->y;
+			kernelView.planes[frustum][plane][2] = planes[plane]->z;
+			kernelView.planes[frustum][plane][3] = planes[plane]->w;
+		}
+
+		float* cornersMin = kernelView.cornersMin[frustum];
+		float* cornersMax = kernelView.cornersMax[frustum];
+		for (int i = 0; i < 3; i++)
+		{
+			cornersMin[i] = 3.402823466e+38f;
+			cornersMax[i] = -3.402823466e+38f;
+		}
+		for (const Float4& corner : source.cornersWS)
+		{
+			const float p[3] = { corner.x, corner.y, corner.z };
+			for (int i = 0; i < 3; i++)
+			{
+				cornersMin[i] = std::min(cornersMin[i], p[i]);
+				cornersMax[i] = std::max(cornersMax[i], p[i]);
+			}
+		}
+	}
+
+	std::vector<CullingKernelMesh> meshes(prefab.meshesCount);
+	for (size_t mesh = 0; mesh < prefab.meshesCount; mesh++)
+	{
+		const CullingMesh& source = prefab.meshes[mesh];
+		CullingKernelMesh& kernelMesh = meshes[mesh];
+		const Float3* vectors[4] = { &source.center, &source.extents, &source.coneApex, &source.coneAxis };
+		float* kernelVectors[4] = { kernelMesh.center, kernelMesh.extents, kernelMesh.coneApex, kernelMesh.coneAxis };
+		for (int vector = 0; vector < 4; vector++)
+		{
+			kernelVectors[vector][0] = vectors[vector]->x;
+			kernelVectors[vector][1] = vectors[vector]->y;
+			kernelVectors[vector][2] = vectors[vector]->z;
+		}
+		kernelMesh.coneCutoff = source.coneCutoff;
+
+		// BackfacingMeshletOrthographic
+		float cosine =
+			-view.lightDirection.x * source.coneAxis.x +
+			-view.lightDirection.y * source.coneAxis.y +
+			-view.lightDirection.z * source.coneAxis.z;
+		kernelMesh.backfacingInCascades = cosine >= source.coneCutoff ? 1 : 0;
+	}
+
+	CullingKernel kernel = GetCullingKernel(_isa);
+	size_t jobsCount = (prefab.objectsCount + ObjectsPerJob - 1) / ObjectsPerJob;
+	pool.ParallelFor(jobsCount, [&](size_t job)
+	{
+		CullingKernelJob kernelJob;
+		kernelJob.view = &kernelView;
+		// same layout as Instance in Common.h
+		kernelJob.transforms = &prefab.instances[0].worldTransform.m[0][0];
+		kernelJob.transformStride = sizeof(Instance) / sizeof(float);
+		kernelJob.meshes = meshes.data();
+		kernelJob.meshesCount = prefab.meshesCount;
+		kernelJob.firstObject = job * ObjectsPerJob;
+		kernelJob.objectsCount = std::min(ObjectsPerJob, prefab.objectsCount - kernelJob.firstObject);
+		kernelJob.visibility = visibility;
+		kernel(kernelJob);
+	});
+}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "CPURasterizer.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+
+// CullingCS on the CPU, every (object, mesh) pair of a prefab against the camera and the cascades:
+// TransformAABB, the cone test, the frustum planes and corners, no Hi-Z, as there's no previous frame depth,
+// a batch of 8 (AVX2) or 16 (AVX-512) objects per kernel call, a lane per object, jobs of objects on a pool,
+// the result is a frustums mask per pair, which StreamCompaction turns into the visible instances and commands
+namespace CPURasterizer
+{
+
+// same layout as Frustum in Common.h, planes point inside
+struct CullingFrustum
+{
+	Float4 l;
+	Float4 r;
+	Float4 b;
+	Float4 t;
+	Float4 n;
+	Float4 f;
+
+	Float4 cornersWS[8];
+};
+
+// bounds and cone of MeshMeta
+struct CullingMesh
+{
+	Float3 center;
+	Float3 extents;
+	Float3 coneApex;
+	Float3 coneAxis;
+	float coneCutoff;
+};
+
+// as CullingCB
+struct CullingView
+{
+	// camera, then cascades
+	CullingFrustum frustums[MAX_FRUSTUMS_COUNT];
+	unsigned int frustumsCount = 1;
+	Float3 cameraPosition;
+	// normalized
+	Float3 lightDirection;
+	bool frustumCullingEnabled = true;
+	bool clusterBackfaceCullingEnabled = true;
+};
+
+// as CullingPrefab, instances are the prefab's objects
+struct CullingPrefab
+{
+	const Instance* instances = nullptr;
+	size_t objectsCount = 0;
+	const CullingMesh* meshes = nullptr;
+	size_t meshesCount = 0;
+};
+
+class CullingEngine
+{
+public:
+
+	// Scalar is the reference, SSE4.1 falls back to it, unsupported ISAs to the best supported one
+	explicit CullingEngine(BlockKernelISA isa = GetBestBlockKernelISA());
+
+	void SetISA(BlockKernelISA isa);
+	BlockKernelISA GetISA() const { return _isa; }
+	// objects per kernel batch
+	unsigned int GetLanesCount() const { return _lanesCount; }
+
+	// a frustums mask per pair, pair = object * meshesCount + mesh, as the CullingCS threads go
+	void Cull(ThreadPool& pool, const CullingView& view, const CullingPrefab& prefab, uint32_t* visibility) const;
+
+	// a multiple of every lanes count
+	static const size_t ObjectsPerJob = 1024;
+
+private:
+
+	BlockKernelISA _isa;
+	unsigned int _lanesCount;
+};
+
+}
@@ -0,0 +1,144 @@
+#include "CullingKernels.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CULLING_KERNELS_X64
+#endif
+
+namespace CPURasterizer
+{
+
+// CullingCS for a single object, the reference of the SIMD kernels
+void CullObjectsScalar(const CullingKernelJob& job)
+{
+	const CullingKernelView& view = *job.view;
+
+	for (size_t object = job.firstObject; object < job.firstObject + job.objectsCount; object++)
+	{
+		const float* M = job.transforms + object * job.transformStride;
+
+		for (size_t mesh = 0; mesh < job.meshesCount; mesh++)
+		{
+			const CullingKernelMesh& meshMeta = job.meshes[mesh];
+
+			// TransformAABB, the translation first, then the rows
+			float center[3];
+			float extents[3];
+			float coneApex[3];
+			for (int i = 0; i < 3; i++)
+			{
+				center[i] = M[12 + i];
+				coneApex[i] = M[12 + i];
+				extents[i] = 0.0f;
+				for (int j = 0; j < 3; j++)
+				{
+					center[i] += M[4 * j + i] * meshMeta.center[j];
+					coneApex[i] += M[4 * j + i] * meshMeta.coneApex[j];
+					extents[i] += std::fabs(M[4 * j + i]) * meshMeta.extents[j];
+				}
+			}
+
+			uint32_t visibleMask = 0;
+			for (unsigned int frustum = 0; frustum < view.frustumsCount; frustum++)
+			{
+				bool backfacing = meshMeta.backfacingInCascades != 0;
+				if (frustum == 0)
+				{
+					// BackfacingMeshlet, dot(normalize(coneApex - cameraPosition), coneAxis)
+					float v[3];
+					for (int i = 0; i < 3; i++)
+					{
+						v[i] = coneApex[i] - view.cameraPosition[i];
+					}
+					float invLength = 1.0f / std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+					float cosine =
+						v[0] * invLength * meshMeta.coneAxis[0] +
+						v[1] * invLength * meshMeta.coneAxis[1] +
+						v[2] * invLength * meshMeta.coneAxis[2];
+					backfacing = cosine >= meshMeta.coneCutoff;
+				}
+
+				if (backfacing && view.clusterBackfaceCullingEnabled)
+				{
+					continue;
+				}
+
+				if (view.frustumCullingEnabled)
+				{
+					bool inside = true;
+					for (int plane = 0; plane < 6; plane++)
+					{
+						const float* p = view.planes[frustum][plane];
+						float r =
+							extents[0] * std::fabs(p[0]) +
+							extents[1] * std::fabs(p[1]) +
+							extents[2] * std::fabs(p[2]);
+						float s = p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3];
+						inside = inside && r + s >= 0.0f;
+					}
+
+					for (int i = 0; i < 3; i++)
+					{
+						inside = inside
+							&& !(view.cornersMax[frustum][i] < center[i] - extents[i])
+							&& !(view.cornersMin[frustum][i] > center[i] + extents[i]);
+					}
+
+					if (!inside)
+					{
+						continue;
+					}
+				}
+
+				visibleMask |= 1u << frustum;
+			}
+
+			job.visibility[object * job.meshesCount + mesh] = visibleMask;
+		}
+	}
+}
+
+unsigned int GetCullingKernelLanes(BlockKernelISA isa)
+{
+	BlockKernelISA best = GetBestBlockKernelISA();
+	if (static_cast<int>(isa) > static_cast<int>(best))
+	{
+		isa = best;
+	}
+
+	switch (isa)
+	{
+#ifdef CULLING_KERNELS_X64
+	case BlockKernelISA::AVX2:
+		return 8;
+	case BlockKernelISA::AVX512:
+		return 16;
+#endif
+	default:
+		return 1;
+	}
+}
+
+CullingKernel GetCullingKernel(BlockKernelISA isa)
+{
+	BlockKernelISA best = GetBestBlockKernelISA();
+	if (static_cast<int>(isa) > static_cast<int>(best))
+	{
+		isa = best;
+	}
+
+	switch (isa)
+	{
+#ifdef CULLING_KERNELS_X64
+	case BlockKernelISA::AVX2:
+		return CullObjectsAVX2;
+	case BlockKernelISA::AVX512:
+		return CullObjectsAVX512;
+#endif
+	default:
+		return CullObjectsScalar;
+	}
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "CPUGPUCommon.h"
+#include "CPURasterizerKernels.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// meshlet culling kernels of the CPU culling engine, CullingCS for a batch of objects at once,
+// a SIMD lane per object, one translation unit per instruction set, as the block kernels,
+// every kernel does the same operations in the same order, so the masks match bit for bit
+namespace CPURasterizer
+{
+
+struct CullingKernelView
+{
+	// camera, then cascades, l, r, b, t, n, f, inside is dot(xyz, p) + w >= 0
+	float planes[MAX_FRUSTUMS_COUNT][6][4];
+	// bounds of the world space corners, a box is outside if it's past them on an axis,
+	// same as all 8 corners on the same side in FrustumVsAABB
+	float cornersMin[MAX_FRUSTUMS_COUNT][3];
+	float cornersMax[MAX_FRUSTUMS_COUNT][3];
+	float cameraPosition[3];
+	unsigned int frustumsCount;
+	unsigned int frustumCullingEnabled;
+	unsigned int clusterBackfaceCullingEnabled;
+};
+
+struct CullingKernelMesh
+{
+	float center[3];
+	float extents[3];
+	float coneApex[3];
+	// not rotated, as on the GPU
+	float coneAxis[3];
+	float coneCutoff;
+	// the cascades cone test doesn't depend on the object
+	unsigned int backfacingInCascades;
+};
+
+struct CullingKernelJob
+{
+	const CullingKernelView* view;
+	// row vectors, the translation in the last row, a matrix every transformStride floats
+	const float* transforms;
+	size_t transformStride;
+	const CullingKernelMesh* meshes;
+	size_t meshesCount;
+	size_t firstObject;
+	size_t objectsCount;
+	// a frustums mask per (object, mesh) pair, pair = object * meshesCount + mesh
+	uint32_t* visibility;
+};
+
+typedef void (*CullingKernel)(const CullingKernelJob& job);
+
+void CullObjectsScalar(const CullingKernelJob& job);
+void CullObjectsAVX2(const CullingKernelJob& job);
+void CullObjectsAVX512(const CullingKernelJob& job);
+
+// objects per kernel batch, SSE4.1 falls back to the scalar kernel
+unsigned int GetCullingKernelLanes(BlockKernelISA isa);
+// falls back to the best supported ISA, if the requested one isn't
+CullingKernel GetCullingKernel(BlockKernelISA isa);
+
+}
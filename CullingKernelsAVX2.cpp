@@ -0,0 +1,167 @@
+#include "CullingKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+namespace CPURasterizer
+{
+
+static __m256 Abs(__m256 value)
+{
+	return _mm256_and_ps(value, _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)));
+}
+
+// a lane per object, the tail lanes repeat the last object and aren't written, see CullObjectsScalar
+void CullObjectsAVX2(const CullingKernelJob& job)
+{
+	const CullingKernelView& view = *job.view;
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	alignas(32) float rows[4][3][8];
+	alignas(32) uint32_t masks[8];
+
+	size_t lastObject = job.firstObject + job.objectsCount;
+	for (size_t batch = job.firstObject; batch < lastObject; batch += 8)
+	{
+		size_t lanes = lastObject - batch < 8 ? lastObject - batch : 8;
+
+		// to SoA, once per batch for all of the meshes
+		for (size_t lane = 0; lane < 8; lane++)
+		{
+			const float* M = job.transforms + (batch + (lane < lanes ? lane : lanes - 1)) * job.transformStride;
+			for (int j = 0; j < 4; j++)
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					rows[j][i][lane] = M[4 * j + i];
+				}
+			}
+		}
+
+		__m256 m[4][3];
+		__m256 absM[3][3];
+		for (int j = 0; j < 4; j++)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				m[j][i] = _mm256_load_ps(rows[j][i]);
+				if (j < 3)
+				{
+					absM[j][i] = Abs(m[j][i]);
+				}
+			}
+		}
+
+		for (size_t mesh = 0; mesh < job.meshesCount; mesh++)
+		{
+			const CullingKernelMesh& meshMeta = job.meshes[mesh];
+
+			__m256 center[3];
+			__m256 extents[3];
+			__m256 coneApex[3];
+			for (int i = 0; i < 3; i++)
+			{
+				center[i] = m[3][i];
+				coneApex[i] = m[3][i];
+				extents[i] = zero;
+				for (int j = 0; j < 3; j++)
+				{
+					center[i] = _mm256_add_ps(center[i], _mm256_mul_ps(m[j][i], _mm256_set1_ps(meshMeta.center[j])));
+					coneApex[i] = _mm256_add_ps(coneApex[i], _mm256_mul_ps(m[j][i], _mm256_set1_ps(meshMeta.coneApex[j])));
+					extents[i] = _mm256_add_ps(extents[i], _mm256_mul_ps(absM[j][i], _mm256_set1_ps(meshMeta.extents[j])));
+				}
+			}
+
+			__m256 boxMin[3];
+			__m256 boxMax[3];
+			for (int i = 0; i < 3; i++)
+			{
+				boxMin[i] = _mm256_sub_ps(center[i], extents[i]);
+				boxMax[i] = _mm256_add_ps(center[i], extents[i]);
+			}
+
+			__m256i visibleMask = _mm256_setzero_si256();
+			for (unsigned int frustum = 0; frustum < view.frustumsCount; frustum++)
+			{
+				__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				if (view.clusterBackfaceCullingEnabled)
+				{
+					if (frustum == 0)
+					{
+						__m256 v[3];
+						for (int i = 0; i < 3; i++)
+						{
+							v[i] = _mm256_sub_ps(coneApex[i], _mm256_set1_ps(view.cameraPosition[i]));
+						}
+						__m256 lengthSq = _mm256_add_ps(
+							_mm256_add_ps(_mm256_mul_ps(v[0], v[0]), _mm256_mul_ps(v[1], v[1])),
+							_mm256_mul_ps(v[2], v[2]));
+						__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+						__m256 cosine = _mm256_add_ps(
+							_mm256_add_ps(
+								_mm256_mul_ps(_mm256_mul_ps(v[0], invLength), _mm256_set1_ps(meshMeta.coneAxis[0])),
+								_mm256_mul_ps(_mm256_mul_ps(v[1], invLength), _mm256_set1_ps(meshMeta.coneAxis[1]))),
+							_mm256_mul_ps(_mm256_mul_ps(v[2], invLength), _mm256_set1_ps(meshMeta.coneAxis[2])));
+						visible = _mm256_cmp_ps(cosine, _mm256_set1_ps(meshMeta.coneCutoff), _CMP_NGE_UQ);
+					}
+					else if (meshMeta.backfacingInCascades)
+					{
+						continue;
+					}
+				}
+
+				if (view.frustumCullingEnabled)
+				{
+					for (int plane = 0; plane < 6; plane++)
+					{
+						const float* p = view.planes[frustum][plane];
+						__m256 planeAbs[3];
+						for (int i = 0; i < 3; i++)
+						{
+							planeAbs[i] = Abs(_mm256_set1_ps(p[i]));
+						}
+						__m256 r = _mm256_add_ps(
+							_mm256_add_ps(
+								_mm256_mul_ps(extents[0], planeAbs[0]),
+								_mm256_mul_ps(extents[1], planeAbs[1])),
+							_mm256_mul_ps(extents[2], planeAbs[2]));
+						__m256 s = _mm256_add_ps(
+							_mm256_add_ps(
+								_mm256_add_ps(
+									_mm256_mul_ps(_mm256_set1_ps(p[0]), center[0]),
+									_mm256_mul_ps(_mm256_set1_ps(p[1]), center[1])),
+								_mm256_mul_ps(_mm256_set1_ps(p[2]), center[2])),
+							_mm256_set1_ps(p[3]));
+						visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(r, s), zero, _CMP_GE_OQ));
+					}
+
+					for (int i = 0; i < 3; i++)
+					{
+						visible = _mm256_and_ps(
+							visible,
+							_mm256_cmp_ps(_mm256_set1_ps(view.cornersMax[frustum][i]), boxMin[i], _CMP_NLT_UQ));
+						visible = _mm256_and_ps(
+							visible,
+							_mm256_cmp_ps(_mm256_set1_ps(view.cornersMin[frustum][i]), boxMax[i], _CMP_NGT_UQ));
+					}
+				}
+
+				visibleMask = _mm256_or_si256(
+					visibleMask,
+					_mm256_and_si256(_mm256_castps_si256(visible), _mm256_set1_epi32(static_cast<int>(1u << frustum))));
+			}
+
+			_mm256_store_si256(reinterpret_cast<__m256i*>(masks), visibleMask);
+			for (size_t lane = 0; lane < lanes; lane++)
+			{
+				job.visibility[(batch + lane) * job.meshesCount + mesh] = masks[lane];
+			}
+		}
+	}
+}
+
+}
+
+#endif
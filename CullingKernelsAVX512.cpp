@@ -0,0 +1,174 @@
+#include "CullingKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+namespace CPURasterizer
+{
+
+static __m512 Abs(__m512 value)
+{
+	return _mm512_castsi512_ps(_mm512_and_epi32(_mm512_castps_si512(value), _mm512_set1_epi32(0x7FFFFFFF)));
+}
+
+// a lane per object, the frustum tests are mask registers, see CullObjectsAVX2
+void CullObjectsAVX512(const CullingKernelJob& job)
+{
+	const CullingKernelView& view = *job.view;
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 one = _mm512_set1_ps(1.0f);
+
+	alignas(64) float rows[4][3][16];
+	alignas(64) uint32_t masks[16];
+
+	size_t lastObject = job.firstObject + job.objectsCount;
+	for (size_t batch = job.firstObject; batch < lastObject; batch += 16)
+	{
+		size_t lanes = lastObject - batch < 16 ? lastObject - batch : 16;
+
+		// to SoA, once per batch for all of the meshes
+		for (size_t lane = 0; lane < 16; lane++)
+		{
+			const float* M = job.transforms + (batch + (lane < lanes ? lane : lanes - 1)) * job.transformStride;
+			for (int j = 0; j < 4; j++)
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					rows[j][i][lane] = M[4 * j + i];
+				}
+			}
+		}
+
+		__m512 m[4][3];
+		__m512 absM[3][3];
+		for (int j = 0; j < 4; j++)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				m[j][i] = _mm512_load_ps(rows[j][i]);
+				if (j < 3)
+				{
+					absM[j][i] = Abs(m[j][i]);
+				}
+			}
+		}
+
+		for (size_t mesh = 0; mesh < job.meshesCount; mesh++)
+		{
+			const CullingKernelMesh& meshMeta = job.meshes[mesh];
+
+			__m512 center[3];
+			__m512 extents[3];
+			__m512 coneApex[3];
+			for (int i = 0; i < 3; i++)
+			{
+				center[i] = m[3][i];
+				coneApex[i] = m[3][i];
+				extents[i] = zero;
+				for (int j = 0; j < 3; j++)
+				{
+					center[i] = _mm512_add_ps(center[i], _mm512_mul_ps(m[j][i], _mm512_set1_ps(meshMeta.center[j])));
+					coneApex[i] = _mm512_add_ps(coneApex[i], _mm512_mul_ps(m[j][i], _mm512_set1_ps(meshMeta.coneApex[j])));
+					extents[i] = _mm512_add_ps(extents[i], _mm512_mul_ps(absM[j][i], _mm512_set1_ps(meshMeta.extents[j])));
+				}
+			}
+
+			__m512 boxMin[3];
+			__m512 boxMax[3];
+			for (int i = 0; i < 3; i++)
+			{
+				boxMin[i] = _mm512_sub_ps(center[i], extents[i]);
+				boxMax[i] = _mm512_add_ps(center[i], extents[i]);
+			}
+
+			__m512i visibleMask = _mm512_setzero_si512();
+			for (unsigned int frustum = 0; frustum < view.frustumsCount; frustum++)
+			{
+				__mmask16 visible = 0xFFFF;
+				if (view.clusterBackfaceCullingEnabled)
+				{
+					if (frustum == 0)
+					{
+						__m512 v[3];
+						for (int i = 0; i < 3; i++)
+						{
+							v[i] = _mm512_sub_ps(coneApex[i], _mm512_set1_ps(view.cameraPosition[i]));
+						}
+						__m512 lengthSq = _mm512_add_ps(
+							_mm512_add_ps(_mm512_mul_ps(v[0], v[0]), _mm512_mul_ps(v[1], v[1])),
+							_mm512_mul_ps(v[2], v[2]));
+						// zero masked, GCC warns about the undefined source of _mm512_sqrt_ps
+						__m512 invLength = _mm512_div_ps(one, _mm512_maskz_sqrt_ps(0xFFFF, lengthSq));
+						__m512 cosine = _mm512_add_ps(
+							_mm512_add_ps(
+								_mm512_mul_ps(_mm512_mul_ps(v[0], invLength), _mm512_set1_ps(meshMeta.coneAxis[0])),
+								_mm512_mul_ps(_mm512_mul_ps(v[1], invLength), _mm512_set1_ps(meshMeta.coneAxis[1]))),
+							_mm512_mul_ps(_mm512_mul_ps(v[2], invLength), _mm512_set1_ps(meshMeta.coneAxis[2])));
+						visible = _mm512_cmp_ps_mask(cosine, _mm512_set1_ps(meshMeta.coneCutoff), _CMP_NGE_UQ);
+					}
+					else if (meshMeta.backfacingInCascades)
+					{
+						continue;
+					}
+				}
+
+				if (view.frustumCullingEnabled)
+				{
+					for (int plane = 0; plane < 6; plane++)
+					{
+						const float* p = view.planes[frustum][plane];
+						__m512 planeAbs[3];
+						for (int i = 0; i < 3; i++)
+						{
+							planeAbs[i] = Abs(_mm512_set1_ps(p[i]));
+						}
+						__m512 r = _mm512_add_ps(
+							_mm512_add_ps(
+								_mm512_mul_ps(extents[0], planeAbs[0]),
+								_mm512_mul_ps(extents[1], planeAbs[1])),
+							_mm512_mul_ps(extents[2], planeAbs[2]));
+						__m512 s = _mm512_add_ps(
+							_mm512_add_ps(
+								_mm512_add_ps(
+									_mm512_mul_ps(_mm512_set1_ps(p[0]), center[0]),
+									_mm512_mul_ps(_mm512_set1_ps(p[1]), center[1])),
+								_mm512_mul_ps(_mm512_set1_ps(p[2]), center[2])),
+							_mm512_set1_ps(p[3]));
+						visible = _mm512_mask_cmp_ps_mask(visible, _mm512_add_ps(r, s), zero, _CMP_GE_OQ);
+					}
+
+					for (int i = 0; i < 3; i++)
+					{
+						visible = _mm512_mask_cmp_ps_mask(
+							visible,
+							_mm512_set1_ps(view.cornersMax[frustum][i]),
+							boxMin[i],
+							_CMP_NLT_UQ);
+						visible = _mm512_mask_cmp_ps_mask(
+							visible,
+							_mm512_set1_ps(view.cornersMin[frustum][i]),
+							boxMax[i],
+							_CMP_NGT_UQ);
+					}
+				}
+
+				visibleMask = _mm512_mask_or_epi32(
+					visibleMask,
+					visible,
+					visibleMask,
+					_mm512_set1_epi32(static_cast<int>(1u << frustum)));
+			}
+
+			_mm512_store_si512(masks, visibleMask);
+			for (size_t lane = 0; lane < lanes; lane++)
+			{
+				job.visibility[(batch + lane) * job.meshesCount + mesh] = masks[lane];
+			}
+		}
+	}
+}
+
+}
+
+#endif
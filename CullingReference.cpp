@@ -0,0 +1,476 @@
+#include "CullingReference.h"
+#include "CullingEngine.h"
+#include "MaskedOcclusion.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace CullingReference
+{
+
+// objects are processed in chunks, so the stats are merged rarely
+static const size_t ObjectsChunkSize = 1024;
+// in the occlusion buffer pixels, smaller meshlets hardly occlude anything
+static const float MinOccluderArea = 64.0f;
+
+static bool FrustumVsAABB(const Frustum& f, const AABB& box)
+{
+	XMFLOAT3 pMax =
+	{
+		box.center.x + box.extents.x,
+		box.center.y + box.extents.y,
+		box.center.z + box.extents.z
+	};
+	XMFLOAT3 pMin =
+	{
+		box.center.x - box.extents.x,
+		box.center.y - box.extents.y,
+		box.center.z - box.extents.z
+	};
+
+	int sameSideCorners[6] = {};
+	for (int i = 0; i < 8; i++)
+	{
+		sameSideCorners[0] += f.cornersWS[i].x < pMin.x ? 1 : 0;
+		sameSideCorners[1] += f.cornersWS[i].x > pMax.x ? 1 : 0;
+		sameSideCorners[2] += f.cornersWS[i].y < pMin.y ? 1 : 0;
+		sameSideCorners[3] += f.cornersWS[i].y > pMax.y ? 1 : 0;
+		sameSideCorners[4] += f.cornersWS[i].z < pMin.z ? 1 : 0;
+		sameSideCorners[5] += f.cornersWS[i].z > pMax.z ? 1 : 0;
+	}
+
+	for (int side = 0; side < 6; side++)
+	{
+		if (sameSideCorners[side] == 8)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool AABBVsPlane(const AABB& box, const XMFLOAT4& plane)
+{
+	float r =
+		box.extents.x * fabsf(plane.x) +
+		box.extents.y * fabsf(plane.y) +
+		box.extents.z * fabsf(plane.z);
+	float s =
+		plane.x * box.center.x +
+		plane.y * box.center.y +
+		plane.z * box.center.z +
+		plane.w;
+	return r + s >= 0.0f;
+}
+
+bool AABBVsFrustum(const AABB& box, const Frustum& frustum)
+{
+	return
+		AABBVsPlane(box, frustum.l) &&
+		AABBVsPlane(box, frustum.r) &&
+		AABBVsPlane(box, frustum.b) &&
+		AABBVsPlane(box, frustum.t) &&
+		AABBVsPlane(box, frustum.n) &&
+		AABBVsPlane(box, frustum.f) &&
+		FrustumVsAABB(frustum, box);
+}
+
+static bool BackfacingMeshlet(
+	FXMVECTOR cameraPosition,
+	FXMVECTOR coneApex,
+	FXMVECTOR coneAxis,
+	float coneCutoff)
+{
+	return XMVectorGetX(XMVector3Dot(
+		XMVector3Normalize(coneApex - cameraPosition),
+		coneAxis)) >= coneCutoff;
+}
+
+static bool BackfacingMeshletOrthographic(
+	FXMVECTOR lightDirection,
+	FXMVECTOR coneAxis,
+	float coneCutoff)
+{
+	return XMVectorGetX(XMVector3Dot(-lightDirection, coneAxis)) >= coneCutoff;
+}
+
+static const Frustum& GetFrustum(const Inputs& inputs, int frustum)
+{
+	return frustum == 0 ? inputs.camera : inputs.cascade[frustum - 1];
+}
+
+// AABB and XMFLOAT4X4 have the same layouts as the CPU rasterizer types
+static bool OccludedInCamera(const Inputs& inputs, const AABB& box)
+{
+	return inputs.occlusion->IsOccluded(
+		reinterpret_cast<const CPURasterizer::Float3&>(box.center),
+		reinterpret_cast<const CPURasterizer::Float3&>(box.extents),
+		reinterpret_cast<const CPURasterizer::Float4x4&>(inputs.cameraVP));
+}
+
+static float ProjectedAreaInCamera(
+	const Inputs& inputs,
+	const CPURasterizer::OcclusionBuffer& occlusion,
+	const AABB& box)
+{
+	return occlusion.GetProjectedArea(
+		reinterpret_cast<const CPURasterizer::Float3&>(box.center),
+		reinterpret_cast<const CPURasterizer::Float3&>(box.extents),
+		reinterpret_cast<const CPURasterizer::Float4x4&>(inputs.cameraVP));
+}
+
+// mirrors the meshlet level of CullingCS, returns the mask of frustums it's visible in
+static unsigned int CullMesh(
+	const Inputs& inputs,
+	const MeshMeta& mesh,
+	const Instance& instance,
+	unsigned int frustumsMask,
+	Stats& stats)
+{
+	XMMATRIX worldTransform = XMLoadFloat4x4(&instance.worldTransform);
+	AABB meshAABB = Utils::TransformAABB(mesh.AABB, worldTransform);
+	// TODO: cone axis should be rotated properly, same as on the GPU
+	XMVECTOR coneApex = XMVector3Transform(XMLoadFloat3(&mesh.coneApex), worldTransform);
+	XMVECTOR coneAxis = XMLoadFloat3(&mesh.coneAxis);
+
+	unsigned int visibleMask = 0;
+	for (int frustum = 0; frustum < 1 + inputs.cascadesCount; frustum++)
+	{
+		if (!(frustumsMask & (1u << frustum)))
+		{
+			continue;
+		}
+
+		stats.meshletTests++;
+
+		bool backfacing = frustum == 0
+			? BackfacingMeshlet(XMLoadFloat3(&inputs.cameraPosition), coneApex, coneAxis, mesh.coneCutoff)
+			: BackfacingMeshletOrthographic(XMLoadFloat3(&inputs.lightDirection), coneAxis, mesh.coneCutoff);
+		if (backfacing && inputs.clusterBackfaceCullingEnabled)
+		{
+			continue;
+		}
+
+		if (inputs.frustumCullingEnabled && !AABBVsFrustum(meshAABB, GetFrustum(inputs, frustum)))
+		{
+			continue;
+		}
+
+		if (frustum == 0 && inputs.occlusion)
+		{
+			stats.meshletOcclusionTests++;
+			if (OccludedInCamera(inputs, meshAABB))
+			{
+				stats.meshletsOccluded++;
+				continue;
+			}
+		}
+
+		visibleMask |= 1u << frustum;
+	}
+
+	return visibleMask;
+}
+
+static void AddVisible(unsigned int visibleMask, Stats& stats)
+{
+	for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
+	{
+		stats.visibleMeshInstances[frustum] += (visibleMask >> frustum) & 1;
+	}
+}
+
+static void MergeStats(const Stats& source, Stats& destination, std::mutex& mutex)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	destination.objectTests += source.objectTests;
+	destination.objectsRejected += source.objectsRejected;
+	destination.meshletTests += source.meshletTests;
+	destination.meshletTestsSkipped += source.meshletTestsSkipped;
+	destination.objectOcclusionTests += source.objectOcclusionTests;
+	destination.objectsOccluded += source.objectsOccluded;
+	destination.meshletOcclusionTests += source.meshletOcclusionTests;
+	destination.meshletsOccluded += source.meshletsOccluded;
+	for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
+	{
+		destination.visibleMeshInstances[frustum] += source.visibleMeshInstances[frustum];
+	}
+}
+
+static Stats Cull(const Scene& scene, const Inputs& inputs, bool hierarchical, ThreadPool& threadPool)
+{
+	const unsigned int allFrustums = (1u << (1 + inputs.cascadesCount)) - 1;
+
+	Stats result;
+	std::mutex resultMutex;
+
+	for (const auto& prefab : scene.prefabs)
+	{
+		size_t chunksCount = (prefab.objectsCount + ObjectsChunkSize - 1) / ObjectsChunkSize;
+		threadPool.ParallelFor(
+			chunksCount,
+			[&](size_t chunk)
+			{
+				Stats stats;
+				size_t chunkEnd = std::min<size_t>((chunk + 1) * ObjectsChunkSize, prefab.objectsCount);
+				for (size_t object = chunk * ObjectsChunkSize; object < chunkEnd; object++)
+				{
+					const Instance& instance = scene.instancesCPU[prefab.objectsOffset + object];
+
+					unsigned int frustumsMask = allFrustums;
+					if (hierarchical)
+					{
+						AABB objectAABB = Utils::TransformAABB(
+							prefab.AABB,
+							XMLoadFloat4x4(&instance.worldTransform));
+
+						for (int frustum = 0; frustum < 1 + inputs.cascadesCount; frustum++)
+						{
+							stats.objectTests++;
+							if (inputs.frustumCullingEnabled && !AABBVsFrustum(objectAABB, GetFrustum(inputs, frustum)))
+							{
+								frustumsMask &= ~(1u << frustum);
+								stats.meshletTestsSkipped += prefab.meshesCount;
+							}
+						}
+
+						if (frustumsMask == 0)
+						{
+							stats.objectsRejected++;
+						}
+
+						if (inputs.occlusion && (frustumsMask & 1u))
+						{
+							stats.objectOcclusionTests++;
+							if (OccludedInCamera(inputs, objectAABB))
+							{
+								frustumsMask &= ~1u;
+								stats.objectsOccluded++;
+								stats.meshletTestsSkipped += prefab.meshesCount;
+								if (inputs.occludedObjects)
+								{
+									inputs.occludedObjects[prefab.objectsOffset + object] = 1;
+								}
+							}
+						}
+					}
+
+					if (frustumsMask == 0)
+					{
+						continue;
+					}
+
+					for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
+					{
+						AddVisible(
+							CullMesh(
+								inputs,
+								scene.meshesMetaCPU[prefab.meshesOffset + mesh],
+								instance,
+								frustumsMask,
+								stats),
+							stats);
+					}
+				}
+
+				MergeStats(stats, result, resultMutex);
+			});
+	}
+
+	return result;
+}
+
+Stats CullFlat(const Scene& scene, const Inputs& inputs, ThreadPool& threadPool)
+{
+	return Cull(scene, inputs, false, threadPool);
+}
+
+Stats CullHierarchical(const Scene& scene, const Inputs& inputs, ThreadPool& threadPool)
+{
+	return Cull(scene, inputs, true, threadPool);
+}
+
+Stats CullWithEngine(
+	const Scene& scene,
+	const Inputs& inputs,
+	const CPURasterizer::CullingEngine& engine,
+	ThreadPool& threadPool,
+	std::vector<uint32_t>& visibility)
+{
+	// Frustum, XMFLOAT3 and Instance have the same layouts as the engine types
+	CPURasterizer::CullingView view;
+	view.frustumsCount = 1 + inputs.cascadesCount;
+	for (int frustum = 0; frustum < 1 + inputs.cascadesCount; frustum++)
+	{
+		view.frustums[frustum] = reinterpret_cast<const CPURasterizer::CullingFrustum&>(GetFrustum(inputs, frustum));
+	}
+	view.cameraPosition = reinterpret_cast<const CPURasterizer::Float3&>(inputs.cameraPosition);
+	view.lightDirection = reinterpret_cast<const CPURasterizer::Float3&>(inputs.lightDirection);
+	view.frustumCullingEnabled = inputs.frustumCullingEnabled;
+	view.clusterBackfaceCullingEnabled = inputs.clusterBackfaceCullingEnabled;
+
+	size_t pairsCount = 0;
+	for (const auto& prefab : scene.prefabs)
+	{
+		pairsCount += static_cast<size_t>(prefab.objectsCount) * prefab.meshesCount;
+	}
+	visibility.resize(pairsCount);
+
+	Stats stats;
+	std::vector<CPURasterizer::CullingMesh> meshes;
+	size_t firstPair = 0;
+	for (const auto& prefab : scene.prefabs)
+	{
+		meshes.resize(prefab.meshesCount);
+		for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
+		{
+			const MeshMeta& meshMeta = scene.meshesMetaCPU[prefab.meshesOffset + mesh];
+			meshes[mesh].center = reinterpret_cast<const CPURasterizer::Float3&>(meshMeta.AABB.center);
+			meshes[mesh].extents = reinterpret_cast<const CPURasterizer::Float3&>(meshMeta.AABB.extents);
+			meshes[mesh].coneApex = reinterpret_cast<const CPURasterizer::Float3&>(meshMeta.coneApex);
+			meshes[mesh].coneAxis = reinterpret_cast<const CPURasterizer::Float3&>(meshMeta.coneAxis);
+			meshes[mesh].coneCutoff = meshMeta.coneCutoff;
+		}
+
+		CPURasterizer::CullingPrefab culled;
+		culled.instances = reinterpret_cast<const CPURasterizer::Instance*>(
+			scene.instancesCPU.data() + prefab.objectsOffset);
+		culled.objectsCount = prefab.objectsCount;
+		culled.meshes = meshes.data();
+		culled.meshesCount = prefab.meshesCount;
+		engine.Cull(threadPool, view, culled, visibility.data() + firstPair);
+
+		size_t prefabPairs = static_cast<size_t>(prefab.objectsCount) * prefab.meshesCount;
+		stats.meshletTests += prefabPairs * view.frustumsCount;
+		for (size_t pair = firstPair; pair < firstPair + prefabPairs; pair++)
+		{
+			AddVisible(visibility[pair], stats);
+		}
+		firstPair += prefabPairs;
+	}
+
+	return stats;
+}
+
+struct OccluderCandidate
+{
+	float area;
+	unsigned int object;
+	unsigned int mesh;
+};
+
+OccludersStats RenderOccluders(
+	const Scene& scene,
+	const Inputs& inputs,
+	size_t trianglesBudget,
+	CPURasterizer::OcclusionBuffer& occlusion,
+	ThreadPool& threadPool)
+{
+	XMVECTOR cameraPosition = XMLoadFloat3(&inputs.cameraPosition);
+
+	std::vector<OccluderCandidate> candidates;
+	std::mutex candidatesMutex;
+
+	for (const auto& prefab : scene.prefabs)
+	{
+		size_t chunksCount = (prefab.objectsCount + ObjectsChunkSize - 1) / ObjectsChunkSize;
+		threadPool.ParallelFor(
+			chunksCount,
+			[&](size_t chunk)
+			{
+				std::vector<OccluderCandidate> chunkCandidates;
+				size_t chunkEnd = std::min<size_t>((chunk + 1) * ObjectsChunkSize, prefab.objectsCount);
+				for (size_t object = chunk * ObjectsChunkSize; object < chunkEnd; object++)
+				{
+					const Instance& instance = scene.instancesCPU[prefab.objectsOffset + object];
+					XMMATRIX worldTransform = XMLoadFloat4x4(&instance.worldTransform);
+
+					AABB objectAABB = Utils::TransformAABB(prefab.AABB, worldTransform);
+					if ((inputs.frustumCullingEnabled && !AABBVsFrustum(objectAABB, inputs.camera))
+						|| ProjectedAreaInCamera(inputs, occlusion, objectAABB) < MinOccluderArea)
+					{
+						continue;
+					}
+
+					for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
+					{
+						const MeshMeta& meshMeta = scene.meshesMetaCPU[prefab.meshesOffset + mesh];
+
+						// same as CullMesh, backfacing meshlets wouldn't rasterize anyway
+						XMVECTOR coneApex = XMVector3Transform(XMLoadFloat3(&meshMeta.coneApex), worldTransform);
+						if (inputs.clusterBackfaceCullingEnabled && BackfacingMeshlet(
+							cameraPosition,
+							coneApex,
+							XMLoadFloat3(&meshMeta.coneAxis),
+							meshMeta.coneCutoff))
+						{
+							continue;
+						}
+
+						float area = ProjectedAreaInCamera(
+							inputs,
+							occlusion,
+							Utils::TransformAABB(meshMeta.AABB, worldTransform));
+						if (area >= MinOccluderArea)
+						{
+							chunkCandidates.push_back(
+								{
+									area,
+									static_cast<unsigned int>(prefab.objectsOffset + object),
+									prefab.meshesOffset + mesh
+								});
+						}
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(candidatesMutex);
+				candidates.insert(candidates.end(), chunkCandidates.begin(), chunkCandidates.end());
+			});
+	}
+
+	// the biggest ones first, ties are broken, so the selection doesn't depend on the threads
+	std::sort(
+		candidates.begin(),
+		candidates.end(),
+		[](const OccluderCandidate& a, const OccluderCandidate& b)
+		{
+			if (a.area != b.area)
+			{
+				return a.area > b.area;
+			}
+			return a.object != b.object ? a.object < b.object : a.mesh < b.mesh;
+		});
+
+	OccludersStats stats;
+	stats.candidates = candidates.size();
+
+	occlusion.Clear();
+	CPURasterizer::SceneBuffers buffers = scene.GetCPURasterizerBuffers();
+	const auto& VP = reinterpret_cast<const CPURasterizer::Float4x4&>(inputs.cameraVP);
+	for (const OccluderCandidate& candidate : candidates)
+	{
+		size_t triangles = scene.meshesMetaCPU[candidate.mesh].indexCountPerInstance / 3;
+		if (stats.triangles + triangles > trianglesBudget)
+		{
+			break;
+		}
+
+		occlusion.RenderOccluder(
+			buffers,
+			scene.GetCPURasterizerCommand(candidate.mesh),
+			reinterpret_cast<const CPURasterizer::Float4x4&>(scene.instancesCPU[candidate.object].worldTransform),
+			VP);
+
+		stats.meshlets++;
+		stats.triangles += triangles;
+	}
+
+	return stats;
+}
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Common.h"
+
+#include <cstdint>
+#include <vector>
+
+class Scene;
+class ThreadPool;
+
+namespace CPURasterizer
+{
+class OcclusionBuffer;
+class CullingEngine;
+}
+
+// CPU reference of the GPU culling, flat and hierarchical,
+// counts the tests done and skipped at each level
+// Hi-Z is left out, since there's no previous frame depth on the CPU,
+// camera occlusion is tested against the current frame occluders instead, see RenderOccluders
+namespace CullingReference
+{
+
+struct Inputs
+{
+	Frustum camera;
+	Frustum cascade[MAX_CASCADES_COUNT];
+	int cascadesCount = 0;
+	DirectX::XMFLOAT3 cameraPosition;
+	DirectX::XMFLOAT3 lightDirection;
+	bool frustumCullingEnabled = true;
+	bool clusterBackfaceCullingEnabled = true;
+	// camera frustum only, the occlusion buffer is tested if set
+	DirectX::XMFLOAT4X4 cameraVP;
+	const CPURasterizer::OcclusionBuffer* occlusion = nullptr;
+	// a byte per scene object, set to 1 for the objects occluded as a whole, if set
+	uint8_t* occludedObjects = nullptr;
+};
+
+// tests are counted per frustum
+struct Stats
+{
+	size_t objectTests = 0;
+	// objects outside of every frustum, counted once
+	size_t objectsRejected = 0;
+	size_t meshletTests = 0;
+	// meshlet tests of the objects rejected as a whole
+	size_t meshletTestsSkipped = 0;
+	// camera occlusion, of the objects and meshlets inside of the camera frustum
+	size_t objectOcclusionTests = 0;
+	size_t objectsOccluded = 0;
+	size_t meshletOcclusionTests = 0;
+	size_t meshletsOccluded = 0;
+	size_t visibleMeshInstances[MAX_FRUSTUMS_COUNT] = {};
+};
+
+struct OccludersStats
+{
+	// (object, mesh) pairs big enough on the screen
+	size_t candidates = 0;
+	size_t meshlets = 0;
+	size_t triangles = 0;
+};
+
+// every (object, mesh) pair against every frustum, as CullingCS does
+Stats CullFlat(const Scene& scene, const Inputs& inputs, ThreadPool& threadPool);
+
+// objects against prefab bounds, then meshes of the surviving ones
+// against the frustums their object is inside of
+Stats CullHierarchical(const Scene& scene, const Inputs& inputs, ThreadPool& threadPool);
+
+// the tests of CullFlat, without the occlusion, on the SIMD culling engine,
+// the frustums mask of every (object, mesh) pair is kept in visibility, prefab after prefab
+Stats CullWithEngine(
+	const Scene& scene,
+	const Inputs& inputs,
+	const CPURasterizer::CullingEngine& engine,
+	ThreadPool& threadPool,
+	std::vector<uint32_t>& visibility);
+
+// clears the occlusion buffer and renders the camera visible meshlets with the biggest screen bounds
+// into it, until trianglesBudget is reached
+OccludersStats RenderOccluders(
+	const Scene& scene,
+	const Inputs& inputs,
+	size_t trianglesBudget,
+	CPURasterizer::OcclusionBuffer& occlusion,
+	ThreadPool& threadPool);
+
+bool AABBVsFrustum(const AABB& box, const Frustum& frustum);
+
+}
@@ -192,6 +192,25 @@ void CreateDevice()
 		sizeof(Options)));
 	ASSERT(Options.WorkGraphsTier != D3D12_WORK_GRAPHS_TIER_NOT_SUPPORTED, "Device does not report support for work graphs.")
 #endif
+
+#ifdef FIXED_POINT_EDGES
+	// the SM 5.0 shaders hold the fixed point edge functions in doubles
+	D3D12_FEATURE_DATA_D3D12_OPTIONS doubleOptions = {};
+	SUCCESS(Device->CheckFeatureSupport(
+		D3D12_FEATURE_D3D12_OPTIONS,
+		&doubleOptions,
+		sizeof(doubleOptions)));
+	ASSERT(doubleOptions.DoublePrecisionFloatShaderOps, "Device does not report support for doubles in shaders, required by FIXED_POINT_EDGES.")
+#ifdef USE_WORK_GRAPHS
+	// the work graphs in 64-bit integers
+	D3D12_FEATURE_DATA_D3D12_OPTIONS1 int64Options = {};
+	SUCCESS(Device->CheckFeatureSupport(
+		D3D12_FEATURE_D3D12_OPTIONS1,
+		&int64Options,
+		sizeof(int64Options)));
+	ASSERT(int64Options.Int64ShaderOps, "Device does not report support for 64-bit integers in shaders, required by FIXED_POINT_EDGES.")
+#endif
+#endif
 }
 
 void CreateCommandAllocators()
@@ -36,6 +36,7 @@ cbuffer DepthSceneCB : register(b0)
 	int UseTopLeftRule;
 	int ScanlineRasterization;
 	uint TotalTriangles;
+	uint FrustumIndex;
 };
 
 StructuredBuffer<VertexPosition> Positions : register(t10);
@@ -45,8 +46,13 @@ StructuredBuffer<uint> Indices : register(t21);
 StructuredBuffer<Instance> Instances : register(t22);
 
 RWTexture2D<uint> Depth : register(u0);
+#ifdef COMPACT_BIG_TRIANGLES
+AppendStructuredBuffer<BigTriangleTile> BigTriangles : register(u1);
+#else
 AppendStructuredBuffer<BigTriangleDepth> BigTriangles : register(u1);
+#endif
 RWStructuredBuffer<uint> Statistics : register(u2);
+RWStructuredBuffer<uint> BigTriangleRecords : register(u3);
 
 groupshared IndirectCommand Command;
 groupshared uint2 StatisticsSM;
@@ -81,11 +87,12 @@ void TriangleRasterizationNode(
 		{
 			uint i0, i1, i2;
 			GetTriangleIndices(
-				Command.args.startIndexLocation + (groupThreadID.x + groupID.y * SWR_WG_TRIANGLE_THREADS_X) * 3,
+				Command,
+				groupThreadID.x + groupID.y * SWR_WG_TRIANGLE_THREADS_X,
 				i0, i1, i2);
 
 			float3 p0, p1, p2;
-			GetTriangleVertexPositions(i0, i1, i2, Command.args.baseVertexLocation, p0, p1, p2);
+			GetTriangleVertexPositions(i0, i1, i2, Command, p0, p1, p2);
 
 			for (uint instanceID = 0; instanceID < Command.args.instanceCount; instanceID++)
 			{
@@ -115,6 +122,9 @@ void TriangleRasterizationNode(
 				GetSSPositions(p0CS.xy, p1CS.xy, p2CS.xy, invW0, invW1, invW2, p0SS, p1SS, p2SS);
 
 				float area = Area(p0SS.xy, p1SS.xy, p2SS.xy);
+#ifdef FIXED_POINT_EDGES
+				SnapVertices(p0SS, p1SS, p2SS, area);
+#endif
 
 				// backface if negative
 				[branch]
@@ -173,6 +183,35 @@ void TriangleRasterizationNode(
 				[branch]
 				if (dimensions.x * dimensions.y >= BigTriangleThreshold)
 				{
+					float2 tilesCount = ceil(dimensions / BigTriangleTileSize);
+					float totalTiles = tilesCount.x * tilesCount.y;
+					uint outsideTiles = 0;
+					uint coveredTiles = 0;
+
+#ifdef COMPACT_BIG_TRIANGLES
+					uint record;
+					[branch]
+					if (AllocateBigTriangleRecord(FrustumIndex, record))
+					{
+						WriteBigTriangleSetup(
+							record,
+							p0SS, p1SS, p2SS,
+							float3(z0NDC, z1NDC, z2NDC),
+							area,
+							minP.xy,
+							maxP.xy,
+							tilesCount.x);
+						AppendBigTriangleTiles(
+							record,
+							p0SS, p1SS, p2SS,
+							minP.xy,
+							maxP.xy,
+							tilesCount.x,
+							totalTiles,
+							outsideTiles,
+							coveredTiles);
+					}
+#else
 					BigTriangleDepth result;
 					result.p0WSX = p0WS.x;
 					result.p0WSY = p0WS.y;
@@ -184,17 +223,32 @@ void TriangleRasterizationNode(
 					result.p2WSY = p2WS.y;
 					result.p2WSZ = p2WS.z;
 
-					float2 tilesCount = ceil(dimensions / BigTriangleTileSize);
-					float totalTiles = tilesCount.x * tilesCount.y;
 					for (float offset = 0.0; offset < totalTiles; offset += 1.0)
 					{
+#ifdef COARSE_TILE_CLASSIFICATION
+						if (!ClassifyBigTriangleTile(
+							p0SS, p1SS, p2SS,
+							minP.xy,
+							maxP.xy,
+							tilesCount.x,
+							offset,
+							outsideTiles,
+							coveredTiles,
+							result.tileOffset))
+						{
+							continue;
+						}
+#else
 						result.tileOffset = offset;
+#endif
 
 						// seemingly vastly inefficient way to write out that data,
 						// but the more reasonable/parallel approach isn't faster, and is in fact slower
 						// see the same code in the "experimental" branch
 						BigTriangles.Append(result);
 					}
+#endif
+					CountBigTriangleTiles(FrustumIndex, totalTiles, outsideTiles, coveredTiles);
 
 					continue;
 				}
@@ -212,7 +266,19 @@ void TriangleRasterizationNode(
 				float area2;
 				EdgeFunction(p0SS.xy, p1SS.xy, minP.xy, area2, dxdy2);
 
-				if (ScanlineRasterization)
+#ifdef FIXED_POINT_EDGES
+				FixedPointEdges fixedEdges;
+				bool fixedPoint = SetupFixedPointEdges(p0SS.xy, p1SS.xy, p2SS.xy, minP.xy, UseTopLeftRule, fixedEdges);
+				if (fixedPoint)
+				{
+					invArea = fixedEdges.invArea;
+				}
+#else
+				bool fixedPoint = false;
+#endif
+
+				// the integer edge walk is exact, no need for scanlines
+				if (ScanlineRasterization && !fixedPoint)
 				{
 					for (float y = minP.y; y <= maxP.y; y += 1.0)
 					{
@@ -288,6 +354,9 @@ void TriangleRasterizationNode(
 						float area0tmp = area0;
 						float area1tmp = area1;
 						float area2tmp = area2;
+#ifdef FIXED_POINT_EDGES
+						FixedPoint3 fixedAreaTmp = fixedEdges.area;
+#endif
 						for (float x = minP.x; x <= maxP.x; x += 1.0)
 						{
 							// edge tests, "frustum culling" for 3 lines in 2D
@@ -302,6 +371,15 @@ void TriangleRasterizationNode(
 							{
 								insideTriangle = area0tmp >= 0.0 && area1tmp >= 0.0 && area2tmp >= 0.0;
 							}
+#ifdef FIXED_POINT_EDGES
+							if (fixedPoint)
+							{
+								insideTriangle = all(fixedAreaTmp >= 0);
+								// unbiased, for the barycentric weights
+								area0tmp = float(fixedAreaTmp.x - fixedEdges.bias.x);
+								area1tmp = float(fixedAreaTmp.y - fixedEdges.bias.y);
+							}
+#endif
 
 							[branch]
 							if (insideTriangle)
@@ -321,11 +399,17 @@ void TriangleRasterizationNode(
 							area0tmp -= dxdy0.y;
 							area1tmp -= dxdy1.y;
 							area2tmp -= dxdy2.y;
+#ifdef FIXED_POINT_EDGES
+							fixedAreaTmp += fixedEdges.stepX;
+#endif
 						}
 
 						area0 += dxdy0.x;
 						area1 += dxdy1.x;
 						area2 += dxdy2.x;
+#ifdef FIXED_POINT_EDGES
+						fixedEdges.area += fixedEdges.stepY;
+#endif
 					}
 				}
 			}
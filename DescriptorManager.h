@@ -8,8 +8,18 @@ enum CBVSRVUAVIndices
 {
 	MeshesMetaSRV,
 	InstancesSRV = MeshesMetaSRV + ScenesCount,
-	CullingCountersSRV = InstancesSRV + ScenesCount,
-	CullingCountersUAV,
+	VisibilityMasksSRV = InstancesSRV + ScenesCount,
+	VisibilityMasksUAV,
+	InstanceBlocksSRV,
+	InstanceBlocksUAV,
+	CullingRangesSRV,
+	CullingRangesUAV,
+	CommandBlocksSRV,
+	CommandBlocksUAV,
+	VisibleObjectsSRV,
+	VisibleObjectsUAV,
+	VisibleObjectsCounterSRV,
+	VisibleObjectsCounterUAV,
 	GUIFontTextureSRV,
 	HWRShadowMapSRV,
 	VertexPositionsSRV,
@@ -18,7 +28,8 @@ enum CBVSRVUAVIndices
 	VertexTexcoordsSRV = VertexColorsSRV + ScenesCount,
 	IndicesSRV = VertexTexcoordsSRV + ScenesCount,
 	IndicesSOASRV = IndicesSRV + ScenesCount,
-	SWRDepthSRV = IndicesSOASRV + ScenesCount,
+	MeshletIndicesSRV = IndicesSOASRV + ScenesCount,
+	SWRDepthSRV = MeshletIndicesSRV + ScenesCount,
 	SWRDepthUAV,
 	PrevFrameDepthSRV,
 	PrevFrameDepthMipsSRV,
@@ -33,18 +44,27 @@ enum CBVSRVUAVIndices
 	BigTrianglesDepthUAV = BigTrianglesDepthSRV + MAX_FRUSTUMS_COUNT,
 	BigTrianglesOpaqueSRV = BigTrianglesDepthUAV + MAX_FRUSTUMS_COUNT,
 	BigTrianglesOpaqueUAV,
+	BigTrianglesDepthRecordsSRV,
+	BigTrianglesDepthRecordsUAV = BigTrianglesDepthRecordsSRV + MAX_FRUSTUMS_COUNT,
+	BigTrianglesOpaqueRecordsSRV = BigTrianglesDepthRecordsUAV + MAX_FRUSTUMS_COUNT,
+	BigTrianglesOpaqueRecordsUAV,
 	SWRStatsUAV,
+	SWRCommandsSRV,
 
-	SingleDescriptorsCount,
+	SingleDescriptorsCount = SWRCommandsSRV + ScenesCount,
 
 	// descriptors for frame resources
 	VisibleInstancesSRV = SingleDescriptorsCount,
-	VisibleInstancesUAV = VisibleInstancesSRV + MAX_FRUSTUMS_COUNT,
+	VisibleInstancesUAV,
+	// GenerateCommandsCS binds both as a table
 	CulledCommandsUAV,
-	CulledCommandsCountersSRV = CulledCommandsUAV + MAX_FRUSTUMS_COUNT,
-	CulledCommandsSRV = CulledCommandsCountersSRV + MAX_FRUSTUMS_COUNT,
+	CulledCommandsCountersUAV,
+	// per list views of the frame's buffers, see CULLING_LISTS_COUNT
+	CulledCommandsCountersSRV,
+	CulledCommandsSRV = CulledCommandsCountersSRV + CULLING_LISTS_COUNT,
+	CPUOccludedObjectsSRV = CulledCommandsSRV + CULLING_LISTS_COUNT,
 
-	PerFrameDescriptorsCount = CulledCommandsSRV + MAX_FRUSTUMS_COUNT - VisibleInstancesSRV,
+	PerFrameDescriptorsCount = CPUOccludedObjectsSRV + 1 - VisibleInstancesSRV,
 	CBVUAVSRVCount = SingleDescriptorsCount + PerFrameDescriptorsCount * DX::FramesCount
 };
 
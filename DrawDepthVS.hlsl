@@ -8,11 +8,21 @@ cbuffer DepthSceneCB : register(b0)
 cbuffer DrawCallConstants : register(b1)
 {
 	uint StartInstanceLocation;
+#ifdef QUANTIZED_POSITIONS
+	float3 PositionsOrigin;
+	float3 PositionsScale;
+#endif
+	uint MeshID;
 };
 
 struct VSInput
 {
+#ifdef QUANTIZED_POSITIONS
+	// R16G16B16A16_UNORM
+	float4 position : POSITION;
+#else
 	float3 position : POSITION;
+#endif
 };
 
 struct VSOutput
@@ -26,9 +36,15 @@ VSOutput main(VSInput input, uint instanceID : SV_InstanceID)
 {
 	VSOutput result;
 
+#ifdef QUANTIZED_POSITIONS
+	float3 position = PositionsOrigin + input.position.xyz * PositionsScale;
+#else
+	float3 position = input.position;
+#endif
+
 	float4 positionWS = mul(
 		Instances[StartInstanceLocation + instanceID].worldTransform,
-		float4(input.position, 1.0));
+		float4(position, 1.0));
 	result.positionCS = mul(VP, positionWS);
 
 	return result;
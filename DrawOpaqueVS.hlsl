@@ -16,11 +16,21 @@ cbuffer SceneCB : register(b0)
 cbuffer DrawCallConstants : register(b1)
 {
 	uint StartInstanceLocation;
+#ifdef QUANTIZED_POSITIONS
+	float3 PositionsOrigin;
+	float3 PositionsScale;
+#endif
+	uint MeshID;
 };
 
 struct VSInput
 {
+#ifdef QUANTIZED_POSITIONS
+	// R16G16B16A16_UNORM
+	float4 position : POSITION;
+#else
 	float3 position : POSITION;
+#endif
 	uint normal : NORMAL;
 	uint2 color : COLOR;
 	uint uv : TEXCOORD0;
@@ -44,16 +54,22 @@ VSOutput main(VSInput input, uint instanceID : SV_InstanceID)
 
 	Instance instance = Instances[StartInstanceLocation + instanceID];
 
+#ifdef QUANTIZED_POSITIONS
+	float3 position = PositionsOrigin + input.position.xyz * PositionsScale;
+#else
+	float3 position = input.position;
+#endif
+
 	result.positionWS = mul(
 		instance.worldTransform,
-		float4(input.position, 1.0)).xyz;
+		float4(position, 1.0)).xyz;
 	result.positionCS = mul(VP, float4(result.positionWS, 1.0));
 	result.linearDepth = result.positionCS.w;
 	result.normal = UnpackNormal(input.normal);
 	result.color = UnpackColor(input.color);
 	if (ShowMeshlets)
 	{
-		result.color = float4(instance.color, 1.0);
+		result.color = float4(MeshColor(MeshID), 1.0);
 	}
 	result.uv = UnpackTexcoords(input.uv);
 
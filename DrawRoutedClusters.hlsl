@@ -0,0 +1,128 @@
+// the camera meshlets CullingCS routes to the HW in the SW frame, see HARDWARE_CULLING_LIST,
+// rasterized by the HW, but depth tested and shaded against the SW depth and render target,
+// the same vertex shader for both passes, so their depths match exactly
+
+#include "TypesAndConstants.hlsli"
+
+// same layout as in TriangleOpaqueCS
+cbuffer SceneCB : register(b0)
+{
+	float4x4 VP;
+	float4x4 CascadeVP[MAX_CASCADES_COUNT];
+	float4 SunDirection;
+	float4 CascadeBias[MAX_CASCADES_COUNT / 4];
+	float4 CascadeSplits[MAX_CASCADES_COUNT / 4];
+	float2 OutputRes;
+	float2 InvOutputRes;
+	float BigTriangleThreshold;
+	float BigTriangleTileSize;
+	int ShowCascades;
+	int ShowMeshlets;
+	int UseTopLeftRule;
+	int CascadesCount;
+	int ScanlineRasterization;
+	float ShadowsDistance;
+	uint TotalTriangles;
+};
+
+cbuffer DrawCallConstants : register(b1)
+{
+	uint StartInstanceLocation;
+#ifdef QUANTIZED_POSITIONS
+	float3 PositionsOrigin;
+	float3 PositionsScale;
+#endif
+	uint MeshID;
+};
+
+struct VSInput
+{
+#ifdef QUANTIZED_POSITIONS
+	// R16G16B16A16_UNORM
+	float4 position : POSITION;
+#else
+	float3 position : POSITION;
+#endif
+	uint normal : NORMAL;
+	uint2 color : COLOR;
+	uint uv : TEXCOORD0;
+};
+
+struct VSOutput
+{
+	float4 positionCS : SV_POSITION;
+	float3 positionWS : POSITIONWS;
+	float linearDepth : LDEPTH;
+	float3 normal : NORMAL;
+	float4 color : COLOR;
+	float2 uv : TEXCOORD0;
+};
+
+SamplerState PointClampSampler : register(s0);
+
+StructuredBuffer<Instance> Instances : register(t0);
+Texture2D Depth : register(t10);
+Texture2DArray ShadowMap : register(t11);
+
+RWTexture2D<uint> DepthUAV : register(u0);
+RWTexture2D<float4> RenderTarget : register(u1);
+
+#include "Common.hlsli"
+
+VSOutput vsMain(VSInput input, uint instanceID : SV_InstanceID)
+{
+	VSOutput result;
+
+	Instance instance = Instances[StartInstanceLocation + instanceID];
+
+#ifdef QUANTIZED_POSITIONS
+	float3 position = PositionsOrigin + input.position.xyz * PositionsScale;
+#else
+	float3 position = input.position;
+#endif
+
+	result.positionWS = mul(
+		instance.worldTransform,
+		float4(position, 1.0)).xyz;
+	result.positionCS = mul(VP, float4(result.positionWS, 1.0));
+	result.linearDepth = result.positionCS.w;
+	result.normal = UnpackNormal(input.normal);
+	result.color = UnpackColor(input.color);
+	if (ShowMeshlets)
+	{
+		result.color = float4(MeshColor(MeshID), 1.0);
+	}
+	result.uv = UnpackTexcoords(input.uv);
+
+	return result;
+}
+
+// reversed Z, as the SW triangles passes
+void depthPS(VSOutput input)
+{
+	InterlockedMax(DepthUAV[uint2(input.positionCS.xy)], asuint(input.positionCS.z));
+}
+
+// early z test, the SW opaque passes shade the pixels the SW won
+void opaquePS(VSOutput input)
+{
+	uint2 pixel = uint2(input.positionCS.xy);
+	[branch]
+	if (Depth[pixel].r != input.positionCS.z)
+	{
+		return;
+	}
+
+	float NdotL = saturate(dot(SunDirection.xyz, normalize(input.normal)));
+	float shadow = GetShadow(input.linearDepth, input.positionWS);
+	float3 ambient = 0.2 * SkyColor;
+
+	float3 result = input.color.rgb * (NdotL * shadow + ambient);
+	if (ShowCascades)
+	{
+		result = GetCascadeColor(input.linearDepth, input.positionWS);
+		result *= (NdotL * shadow + ambient);
+	}
+
+	RenderTarget[pixel] = float4(result, 1.0);
+}
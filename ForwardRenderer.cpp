@@ -5,6 +5,8 @@
 #include "imgui_impl_win32.h"
 #include "imgui_impl_dx12.h"
 
+#include <algorithm>
+
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
@@ -37,7 +39,9 @@ void ForwardRenderer::Initialize()
 	Settings::Demo.AssetsPath = _assetsPath;
 	Utils::InitializeResources();
 
-	_culler = std::make_unique<decltype(_culler)::element_type>();
+	_culler = std::make_unique<decltype(_culler)::element_type>(
+		_maxVisibleInstancesCount,
+		_maxCulledCommandsCount);
 
 	_HWR = std::make_unique<decltype(_HWR)::element_type>();
 	_HWR->Resize(this, _width, _height);
@@ -132,13 +136,20 @@ void ForwardRenderer::_createFrameResources()
 
 void ForwardRenderer::_createVisibleInstancesBuffer()
 {
-	size_t bufferSize = Scene::MaxSceneInstancesCount * sizeof(Instance) * MAX_FRUSTUMS_COUNT;
+	// the visible instances of every frustum, compacted one after another,
+	// the commands point at their instances from the start of the buffer
+	size_t instancesCount = std::min<size_t>(
+		Scene::MaxSceneInstancesCount * MAX_FRUSTUMS_COUNT,
+		Settings::MaxVisibleInstancesCount);
+	_maxVisibleInstancesCount = static_cast<unsigned int>(instancesCount);
+	size_t bufferSize = instancesCount * sizeof(Instance);
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
 	SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	SRVDesc.Format = DXGI_FORMAT_UNKNOWN;
 	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-	SRVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneInstancesCount);
+	SRVDesc.Buffer.FirstElement = 0;
+	SRVDesc.Buffer.NumElements = static_cast<unsigned int>(instancesCount);
 	SRVDesc.Buffer.StructureByteStride = sizeof(Instance);
 	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
@@ -152,7 +163,7 @@ void ForwardRenderer::_createVisibleInstancesBuffer()
 	UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
 	UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 	UAVDesc.Buffer.FirstElement = 0;
-	UAVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneInstancesCount * MAX_FRUSTUMS_COUNT);
+	UAVDesc.Buffer.NumElements = static_cast<unsigned int>(instancesCount);
 	UAVDesc.Buffer.StructureByteStride = sizeof(Instance);
 	UAVDesc.Buffer.CounterOffsetInBytes = 0;
 	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
@@ -176,23 +187,25 @@ void ForwardRenderer::_createVisibleInstancesBuffer()
 			&UAVDesc,
 			Descriptors::SV.GetCPUHandle(VisibleInstancesUAV + frame * PerFrameDescriptorsCount));
 
-		for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
-		{
-			SRVDesc.Buffer.FirstElement = frustum * Scene::MaxSceneInstancesCount;
-
-			DX::Device->CreateShaderResourceView(
-				_visibleInstances[frame].Get(),
-				&SRVDesc,
-				Descriptors::SV.GetCPUHandle(VisibleInstancesSRV + frame * PerFrameDescriptorsCount + frustum));
-		}
+		DX::Device->CreateShaderResourceView(
+			_visibleInstances[frame].Get(),
+			&SRVDesc,
+			Descriptors::SV.GetCPUHandle(VisibleInstancesSRV + frame * PerFrameDescriptorsCount));
 	}
 }
 
 void ForwardRenderer::_createCulledCommandsBuffers()
 {
+	size_t maxCommandsCount = Scene::MaxSceneMeshesMetaCount;
+#ifdef INSTANCE_SLICES
+	// a command per slice of the visible instances of a mesh
+	maxCommandsCount += (_maxVisibleInstancesCount + INSTANCES_PER_SLICE - 1) / INSTANCES_PER_SLICE;
+#endif
+	_maxCulledCommandsCount = static_cast<unsigned int>(maxCommandsCount);
+
 	CD3DX12_RESOURCE_DESC commandBufferDesc =
 		CD3DX12_RESOURCE_DESC::Buffer(
-			Scene::MaxSceneMeshesMetaCount * sizeof(IndirectCommand),
+			maxCommandsCount * CULLING_LISTS_COUNT * sizeof(IndirectCommand),
 			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 	auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
 
@@ -200,8 +213,6 @@ void ForwardRenderer::_createCulledCommandsBuffers()
 	UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
 	UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 	UAVDesc.Buffer.FirstElement = 0;
-	UAVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneMeshesMetaCount);
-	UAVDesc.Buffer.StructureByteStride = sizeof(IndirectCommand);
 	UAVDesc.Buffer.CounterOffsetInBytes = 0;
 	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 
@@ -209,70 +220,85 @@ void ForwardRenderer::_createCulledCommandsBuffers()
 	SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	SRVDesc.Format = DXGI_FORMAT_UNKNOWN;
 	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-	SRVDesc.Buffer.FirstElement = 0;
 	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
 
-	static D3D12_DISPATCH_ARGUMENTS dispatch;
-	dispatch.ThreadGroupCountX = 0;
-	dispatch.ThreadGroupCountY = SWR_THREAD_GROUPS_Y;
-	dispatch.ThreadGroupCountZ = 1;
+	// GenerateCommandsCS writes the commands counts, the rest stays
+	D3D12_DISPATCH_ARGUMENTS dispatch[CULLING_LISTS_COUNT] = {};
+	for (int list = 0; list < CULLING_LISTS_COUNT; list++)
+	{
+		dispatch[list].ThreadGroupCountX = 0;
+		dispatch[list].ThreadGroupCountY = SWR_THREAD_GROUPS_Y;
+		dispatch[list].ThreadGroupCountZ = 1;
+	}
 
 	for (int frame = 0; frame < DX::FramesCount; frame++)
 	{
-		for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
-		{
-			Utils::CreateDefaultHeapBuffer(
-				COMMAND_LIST.Get(),
-				&dispatch,
-				sizeof(D3D12_DISPATCH_ARGUMENTS),
-				_culledCommandsCounters[frame][frustum],
-				_culledCommandsCountersUpload[frame][frustum],
-				D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
-				true);
-			SetNameIndexed(
-				_culledCommandsCounters[frame][frustum].Get(),
-				L"_culledCommandsCounters",
-				frame * MAX_FRUSTUMS_COUNT + frustum);
-			SetNameIndexed(
-				_culledCommandsCountersUpload[frame][frustum].Get(),
-				L"_culledCommandsCountersUpload",
-				frame * MAX_FRUSTUMS_COUNT + frustum);
+		Utils::CreateDefaultHeapBuffer(
+			COMMAND_LIST.Get(),
+			dispatch,
+			sizeof(dispatch),
+			_culledCommandsCounters[frame],
+			_culledCommandsCountersUpload[frame],
+			D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+			true);
+		SetNameIndexed(
+			_culledCommandsCounters[frame].Get(),
+			L"_culledCommandsCounters",
+			frame);
+		SetNameIndexed(
+			_culledCommandsCountersUpload[frame].Get(),
+			L"_culledCommandsCountersUpload",
+			frame);
+
+		UAVDesc.Buffer.NumElements = static_cast<unsigned int>(sizeof(dispatch) / sizeof(unsigned int));
+		UAVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
+
+		DX::Device->CreateUnorderedAccessView(
+			_culledCommandsCounters[frame].Get(),
+			nullptr,
+			&UAVDesc,
+			Descriptors::SV.GetCPUHandle(CulledCommandsCountersUAV + frame * PerFrameDescriptorsCount));
 
+		SUCCESS(DX::Device->CreateCommittedResource(
+			&prop,
+			D3D12_HEAP_FLAG_NONE,
+			&commandBufferDesc,
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+			nullptr,
+			IID_PPV_ARGS(&_culledCommands[frame])));
+		SetNameIndexed(
+			_culledCommands[frame].Get(),
+			L"_culledCommands",
+			frame);
+
+		UAVDesc.Buffer.NumElements = static_cast<unsigned int>(maxCommandsCount * CULLING_LISTS_COUNT);
+		UAVDesc.Buffer.StructureByteStride = sizeof(IndirectCommand);
+
+		DX::Device->CreateUnorderedAccessView(
+			_culledCommands[frame].Get(),
+			nullptr,
+			&UAVDesc,
+			Descriptors::SV.GetCPUHandle(CulledCommandsUAV + frame * PerFrameDescriptorsCount));
+
+		for (int list = 0; list < CULLING_LISTS_COUNT; list++)
+		{
+			SRVDesc.Buffer.FirstElement = list;
 			SRVDesc.Buffer.NumElements = 1;
 			SRVDesc.Buffer.StructureByteStride = sizeof(D3D12_DISPATCH_ARGUMENTS);
 
 			DX::Device->CreateShaderResourceView(
-				_culledCommandsCounters[frame][frustum].Get(),
+				_culledCommandsCounters[frame].Get(),
 				&SRVDesc,
-				Descriptors::SV.GetCPUHandle(CulledCommandsCountersSRV + frustum + frame * PerFrameDescriptorsCount));
-
-			SUCCESS(DX::Device->CreateCommittedResource(
-				&prop,
-				D3D12_HEAP_FLAG_NONE,
-				&commandBufferDesc,
-				Settings::SWREnabled
-				? D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
-				: D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
-				nullptr,
-				IID_PPV_ARGS(&_culledCommands[frame][frustum])));
-			SetNameIndexed(
-				_culledCommands[frame][frustum].Get(),
-				L"_culledCommands",
-				frame * MAX_FRUSTUMS_COUNT + frustum);
-
-			DX::Device->CreateUnorderedAccessView(
-				_culledCommands[frame][frustum].Get(),
-				_culledCommandsCounters[frame][frustum].Get(),
-				&UAVDesc,
-				Descriptors::SV.GetCPUHandle(CulledCommandsUAV + frustum + frame * PerFrameDescriptorsCount));
-
-			SRVDesc.Buffer.NumElements = static_cast<unsigned int>(Scene::MaxSceneMeshesMetaCount);
+				Descriptors::SV.GetCPUHandle(CulledCommandsCountersSRV + list + frame * PerFrameDescriptorsCount));
+
+			SRVDesc.Buffer.FirstElement = list * maxCommandsCount;
+			SRVDesc.Buffer.NumElements = static_cast<unsigned int>(maxCommandsCount);
 			SRVDesc.Buffer.StructureByteStride = sizeof(IndirectCommand);
 
 			DX::Device->CreateShaderResourceView(
-				_culledCommands[frame][frustum].Get(),
+				_culledCommands[frame].Get(),
 				&SRVDesc,
-				Descriptors::SV.GetCPUHandle(CulledCommandsSRV + frustum + frame * PerFrameDescriptorsCount));
+				Descriptors::SV.GetCPUHandle(CulledCommandsSRV + list + frame * PerFrameDescriptorsCount));
 		}
 	}
 }
@@ -872,6 +898,10 @@ void ForwardRenderer::_newFrameGUI()
 		if (Settings::SWREnabled)
 		{
 			ImGui::Checkbox("Use Work Graphs", &Settings::SWRWGEnabled);
+			if (!Settings::SWRWGEnabled)
+			{
+				ImGui::Checkbox("Route Meshlets to SW/HW", &Settings::ClusterRoutingEnabled);
+			}
 		}
 
 		ImGui::Checkbox(
@@ -890,6 +920,41 @@ void ForwardRenderer::_newFrameGUI()
 			"Enable Shadows Hi-Z Culling",
 			&Settings::ShadowsHiZCullingEnabled);
 
+		ImGui::Checkbox(
+			"Enable Hierarchical Culling",
+			&Settings::HierarchicalCullingEnabled);
+
+		if (_culler->IsCPUReferenceRunning())
+		{
+			ImGui::Text("Running CPU Culling Reference...");
+		}
+		else if (ImGui::Button("Run CPU Culling Reference"))
+		{
+			_culler->RunCPUReference();
+		}
+
+		ImGui::Checkbox(
+			"Enable CPU Occlusion Culling",
+			&Settings::CPUOcclusionCullingEnabled);
+
+		if (Settings::CPUOcclusionCullingEnabled)
+		{
+			const CPUOcclusionStats& occlusion = _culler->GetCPUOcclusionStats();
+			const CullingReference::Stats& culling = occlusion.culling;
+
+			ImGui::Text(
+				"CPU Occluders: %zu meshlets, %.1f K triangles, %.2f ms",
+				occlusion.occluders.meshlets,
+				occlusion.occluders.triangles / 1'000.0f,
+				occlusion.renderTime);
+
+			ImGui::Text(
+				"CPU Occluded: %.1f%% objects, %.1f%% meshlets, %.2f ms",
+				100.0f * culling.objectsOccluded / std::max<size_t>(culling.objectOcclusionTests, 1),
+				100.0f * culling.meshletsOccluded / std::max<size_t>(culling.meshletOcclusionTests, 1),
+				occlusion.testTime);
+		}
+
 		if (!Settings::FrustumCullingEnabled
 			&& !Settings::CameraHiZCullingEnabled
 			&& !Settings::ShadowsHiZCullingEnabled
@@ -28,22 +28,34 @@ public:
 	virtual void KeyPressed(unsigned char key);
 
 	void PreparePrevFrameDepth(ID3D12Resource* depth);
-	ID3D12Resource* GetCulledCommands(int frame, int frustum)
+	// every list of a frame in the same buffers, at the offsets below, a list per frustum,
+	// then the routed camera ones, see CULLING_LISTS_COUNT
+	ID3D12Resource* GetCulledCommands(int frame)
 	{
 		assert(frame >= 0);
 		assert(frame < DX::FramesCount);
-		assert(frustum >= 0);
-		assert(frustum < Settings::FrustumsCount);
-		return _culledCommands[frame][frustum].Get();
+		return _culledCommands[frame].Get();
 	}
-	ID3D12Resource* GetCulledCommandsCounter(int frame, int frustum)
+	UINT64 GetCulledCommandsOffset(int list) const
+	{
+		assert(list >= 0);
+		assert(list < CULLING_LISTS_COUNT);
+		return static_cast<UINT64>(list) * _maxCulledCommandsCount * sizeof(IndirectCommand);
+	}
+	ID3D12Resource* GetCulledCommandsCounter(int frame)
 	{
 		assert(frame >= 0);
 		assert(frame < DX::FramesCount);
-		assert(frustum >= 0);
-		assert(frustum < Settings::FrustumsCount);
-		return _culledCommandsCounters[frame][frustum].Get();
+		return _culledCommandsCounters[frame].Get();
+	}
+	UINT64 GetCulledCommandsCounterOffset(int list) const
+	{
+		assert(list >= 0);
+		assert(list < CULLING_LISTS_COUNT);
+		return static_cast<UINT64>(list) * sizeof(D3D12_DISPATCH_ARGUMENTS);
 	}
+	// capacity of the culled commands of a list, more than the meshes with INSTANCE_SLICES
+	unsigned int GetMaxCulledCommandsCount() const { return _maxCulledCommandsCount; }
 
 private:
 
@@ -69,14 +81,16 @@ private:
 	Microsoft::WRL::ComPtr<ID3D12Resource> _visibleInstances[DX::FramesCount];
 	Microsoft::WRL::ComPtr<ID3D12Resource> _prevFrameDepthBuffer;
 	// per frame granularity for async compute and graphics work
-	Microsoft::WRL::ComPtr<ID3D12Resource> _culledCommands[DX::FramesCount][MAX_FRUSTUMS_COUNT];
-	// first 4 bytes used as a counter
-	// all 12 bytes are used as a dispatch indirect command
-	// [0] - counter / group count X
+	// _maxCulledCommandsCount commands per list
+	Microsoft::WRL::ComPtr<ID3D12Resource> _culledCommands[DX::FramesCount];
+	unsigned int _maxCulledCommandsCount = 0;
+	unsigned int _maxVisibleInstancesCount = 0;
+	// 12 bytes per list, used as a dispatch indirect command
+	// [0] - commands count / group count X
 	// [1] - group count Y
 	// [2] - group count Z
-	Microsoft::WRL::ComPtr<ID3D12Resource> _culledCommandsCounters[DX::FramesCount][MAX_FRUSTUMS_COUNT];
-	Microsoft::WRL::ComPtr<ID3D12Resource> _culledCommandsCountersUpload[DX::FramesCount][MAX_FRUSTUMS_COUNT];
+	Microsoft::WRL::ComPtr<ID3D12Resource> _culledCommandsCounters[DX::FramesCount];
+	Microsoft::WRL::ComPtr<ID3D12Resource> _culledCommandsCountersUpload[DX::FramesCount];
 
 	std::unique_ptr<Culler> _culler;
 	std::unique_ptr<HardwareRasterization> _HWR;
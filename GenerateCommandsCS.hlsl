@@ -1,100 +1,143 @@
-#include "CullingCommon.hlsli"
+#include "CompactionCommon.hlsli"
 
 StructuredBuffer<MeshMeta> MeshesMeta : register(t0);
-StructuredBuffer<uint> InstanceCounters : register(t1);
+// per (list, mesh), first and last + 1 visible instance, see CompactionCS
+StructuredBuffer<uint2> CullingRanges : register(t1);
+// per list and block of meshes, see ScanBlocks()
+StructuredBuffer<uint> CommandBlockOffsets : register(t2);
 
-// TODO: remove hardcode and reduce atomics use per group
-AppendStructuredBuffer<IndirectCommand> CameraCommands : register(u0);
-AppendStructuredBuffer<IndirectCommand> Cascade0Commands : register(u1);
-AppendStructuredBuffer<IndirectCommand> Cascade1Commands : register(u2);
-AppendStructuredBuffer<IndirectCommand> Cascade2Commands : register(u3);
-AppendStructuredBuffer<IndirectCommand> Cascade3Commands : register(u4);
-AppendStructuredBuffer<IndirectCommand> Cascade4Commands : register(u5);
-AppendStructuredBuffer<IndirectCommand> Cascade5Commands : register(u6);
-AppendStructuredBuffer<IndirectCommand> Cascade6Commands : register(u7);
-AppendStructuredBuffer<IndirectCommand> Cascade7Commands : register(u8);
+// a range of MaxCulledCommandsCount commands per list
+RWStructuredBuffer<IndirectCommand> CulledCommands : register(u0);
+// D3D12_DISPATCH_ARGUMENTS per list, 3 uints, x is the commands count
+RWStructuredBuffer<uint> CulledCommandsCounters : register(u1);
+RWStructuredBuffer<uint> CommandBlockCounts : register(u2);
 
-[numthreads(CULLING_THREADS_X, CULLING_THREADS_Y, CULLING_THREADS_Z)]
-void main(
-	uint3 groupID : SV_GroupID,
-	uint3 dispatchThreadID : SV_DispatchThreadID,
-	uint3 groupThreadID : SV_GroupThreadID,
-	uint groupIndex : SV_GroupIndex)
+uint CommandsCount(uint2 range)
 {
-	if (dispatchThreadID.x >= TotalMeshesCount)
-	{
-		return;
-	}
-
-	MeshMeta meshMeta = MeshesMeta[dispatchThreadID.x];
+	uint instanceCount = range.y - range.x;
+#if defined(INSTANCE_SLICES) && defined(SWR_COMMANDS)
+	// a command per slice, so the SW rasterizer spreads the instances over thread groups,
+	// the HW draws them in a single command anyway
+	return (instanceCount + INSTANCES_PER_SLICE - 1) / INSTANCES_PER_SLICE;
+#else
+	return instanceCount > 0 ? 1 : 0;
+#endif
+}
 
-	IndirectCommand result;
-	result.startInstanceLocation = meshMeta.startInstanceLocation;
-	result.args.indexCountPerInstance = meshMeta.indexCountPerInstance;
-	result.args.startIndexLocation = meshMeta.startIndexLocation;
-	result.args.baseVertexLocation = meshMeta.baseVertexLocation;
-	result.args.startInstanceLocation = 0;
-
-	uint cameraCount = InstanceCounters[0 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cameraCount > 0)
+void WriteCommands(uint writeIndex, IndirectCommand command, uint2 range)
+{
+	command.startInstanceLocation = range.x;
+	uint instanceCount = range.y - range.x;
+#if defined(INSTANCE_SLICES) && defined(SWR_COMMANDS)
+	for (uint firstInstance = 0; firstInstance < instanceCount; firstInstance += INSTANCES_PER_SLICE)
 	{
-		result.args.instanceCount = cameraCount;
-		CameraCommands.Append(result);
+		IndirectCommand slice = command;
+		slice.startInstanceLocation += firstInstance;
+		slice.args.instanceCount = min(instanceCount - firstInstance, INSTANCES_PER_SLICE);
+		CulledCommands[writeIndex++] = slice;
 	}
-
-	uint cascade0Count = InstanceCounters[1 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade0Count > 0)
+#else
+	if (instanceCount > 0)
 	{
-		result.args.instanceCount = cascade0Count;
-		Cascade0Commands.Append(result);
+		command.args.instanceCount = instanceCount;
+		CulledCommands[writeIndex] = command;
 	}
+#endif
+}
 
-	uint cascade1Count = InstanceCounters[2 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade1Count > 0)
-	{
-		result.args.instanceCount = cascade1Count;
-		Cascade1Commands.Append(result);
-	}
+uint MeshBlocksCount()
+{
+	return (TotalMeshesCount + COMPACTION_THREADS_X - 1) / COMPACTION_THREADS_X;
+}
 
-	uint cascade2Count = InstanceCounters[3 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade2Count > 0)
+// commands of every list in a thread's mesh, scanned over the group
+void ScanMeshCommands(uint mesh, uint groupIndex)
+{
+	uint listsCount = ListsCount();
+	[unroll(CULLING_LISTS_COUNT)]
+	for (uint list = 0; list < listsCount; list++)
 	{
-		result.args.instanceCount = cascade2Count;
-		Cascade2Commands.Append(result);
+		ScanValues[list][groupIndex] = mesh < TotalMeshesCount
+			? CommandsCount(CullingRanges[list * MaxSceneMeshesMetaCount + mesh])
+			: 0;
 	}
+	GroupScan(listsCount, groupIndex);
+}
 
-	uint cascade3Count = InstanceCounters[4 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade3Count > 0)
-	{
-		result.args.instanceCount = cascade3Count;
-		Cascade3Commands.Append(result);
-	}
+// commands per list of a block of meshes
+[numthreads(COMPACTION_THREADS_X, 1, 1)]
+void countMain(
+	uint3 groupID : SV_GroupID,
+	uint3 dispatchThreadID : SV_DispatchThreadID,
+	uint groupIndex : SV_GroupIndex)
+{
+	ScanMeshCommands(dispatchThreadID.x, groupIndex);
 
-	uint cascade4Count = InstanceCounters[5 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade4Count > 0)
+	if (groupIndex < ListsCount())
 	{
-		result.args.instanceCount = cascade4Count;
-		Cascade4Commands.Append(result);
+		CommandBlockCounts[groupIndex * MeshBlocksCount() + groupID.x] =
+			ScanValues[groupIndex][COMPACTION_THREADS_X - 1];
 	}
+}
+
+[numthreads(COMPACTION_THREADS_X, 1, 1)]
+void scanMain(uint groupIndex : SV_GroupIndex)
+{
+	ScanBlocks(CommandBlockCounts, ListsCount() * MeshBlocksCount(), groupIndex);
+}
 
-	uint cascade5Count = InstanceCounters[6 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade5Count > 0)
+// writes the commands of every non-empty (list, mesh) range in mesh order,
+// at the offset of its block in the list plus the commands before it in the block
+[numthreads(COMPACTION_THREADS_X, 1, 1)]
+void main(
+	uint3 groupID : SV_GroupID,
+	uint3 dispatchThreadID : SV_DispatchThreadID,
+	uint groupIndex : SV_GroupIndex)
+{
+	ScanMeshCommands(dispatchThreadID.x, groupIndex);
+
+	uint listsCount = ListsCount();
+	uint blocksCount = MeshBlocksCount();
+	// ExecuteIndirect counts, the lists which aren't rendered get none
+	if (groupID.x == 0 && groupIndex < CULLING_LISTS_COUNT)
 	{
-		result.args.instanceCount = cascade5Count;
-		Cascade5Commands.Append(result);
+		uint count = groupIndex < listsCount
+			? CommandBlockOffsets[(groupIndex + 1) * blocksCount] - CommandBlockOffsets[groupIndex * blocksCount]
+			: 0;
+		CulledCommandsCounters[groupIndex * 3] = count;
 	}
 
-	uint cascade6Count = InstanceCounters[7 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade6Count > 0)
+	if (dispatchThreadID.x >= TotalMeshesCount)
 	{
-		result.args.instanceCount = cascade6Count;
-		Cascade6Commands.Append(result);
+		return;
 	}
 
-	uint cascade7Count = InstanceCounters[8 * MaxSceneMeshesMetaCount + dispatchThreadID.x];
-	if (cascade7Count > 0)
+	MeshMeta meshMeta = MeshesMeta[dispatchThreadID.x];
+
+	IndirectCommand result;
+	result.startInstanceLocation = 0;
+	result.meshID = dispatchThreadID.x;
+#ifdef QUANTIZED_POSITIONS
+	result.positionsOrigin = meshMeta.positionsOrigin;
+	result.positionsScale = meshMeta.positionsScale;
+#endif
+	result.args.indexCountPerInstance = meshMeta.indexCountPerInstance;
+	result.args.instanceCount = 0;
+	result.args.startIndexLocation = meshMeta.startIndexLocation;
+	result.args.baseVertexLocation = meshMeta.baseVertexLocation;
+	result.args.startInstanceLocation = 0;
+#ifdef MESHLET_INDICES
+	result.startMeshletVertexLocation = meshMeta.startMeshletVertexLocation;
+	result.startMeshletTriangleLocation = meshMeta.startMeshletTriangleLocation;
+#endif
+
+	[unroll(CULLING_LISTS_COUNT)]
+	for (uint list = 0; list < listsCount; list++)
 	{
-		result.args.instanceCount = cascade7Count;
-		Cascade7Commands.Append(result);
+		uint2 range = CullingRanges[list * MaxSceneMeshesMetaCount + dispatchThreadID.x];
+		uint writeIndex =
+			CommandBlockOffsets[list * blocksCount + groupID.x] - CommandBlockOffsets[list * blocksCount] +
+			ScanValues[list][groupIndex] - CommandsCount(range);
+		WriteCommands(list * MaxCulledCommandsCount + writeIndex, result, range);
 	}
-}
\ No newline at end of file
+}
@@ -112,7 +112,7 @@ void HardwareRasterization::_createMDIStuff()
 	argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
 	argumentDescs[0].Constant.RootParameterIndex = 1;
 	argumentDescs[0].Constant.DestOffsetIn32BitValues = 0;
-	argumentDescs[0].Constant.Num32BitValuesToSet = 1;
+	argumentDescs[0].Constant.Num32BitValuesToSet = DRAW_CALL_CONSTANTS;
 	argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
 
 	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
@@ -212,11 +212,11 @@ void HardwareRasterization::_drawDepth()
 	{
 		COMMAND_LIST->ExecuteIndirect(
 			_commandSignature.Get(),
-			static_cast<unsigned int>(Scene::CurrentScene->meshesMetaCPU.size()),
-			_renderer->GetCulledCommands(DX::FrameIndex, 0),
-			0,
-			_renderer->GetCulledCommandsCounter(DX::FrameIndex, 0),
-			0);
+			_renderer->GetMaxCulledCommandsCount(),
+			_renderer->GetCulledCommands(DX::FrameIndex),
+			_renderer->GetCulledCommandsOffset(0),
+			_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+			_renderer->GetCulledCommandsCounterOffset(0));
 	}
 	else
 	{
@@ -225,11 +225,7 @@ void HardwareRasterization::_drawDepth()
 			for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
 			{
 				const auto& currentMesh = Scene::CurrentScene->meshesMetaCPU[prefab.meshesOffset + mesh];
-				unsigned int commandData[] =
-				{
-					currentMesh.startInstanceLocation
-				};
-				COMMAND_LIST->SetGraphicsRoot32BitConstants(1, _countof(commandData), commandData, 0);
+				_setDrawCallConstants(prefab.meshesOffset + mesh, prefab.objectsOffset);
 				COMMAND_LIST->DrawIndexedInstanced(
 					currentMesh.indexCountPerInstance,
 					currentMesh.instanceCount,
@@ -271,7 +267,7 @@ void HardwareRasterization::_drawShadows()
 		COMMAND_LIST->SetGraphicsRootDescriptorTable(
 			2,
 			Settings::CullingEnabled
-			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + cascade + DX::FrameIndex * PerFrameDescriptorsCount)
+			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + DX::FrameIndex * PerFrameDescriptorsCount)
 			: Scene::CurrentScene->instancesGPU.GetSRV());
 		auto shadowMapDSVHandle = Descriptors::DS.GetCPUHandle(CascadeDSV + cascade - 1);
 		COMMAND_LIST->OMSetRenderTargets(
@@ -285,11 +281,11 @@ void HardwareRasterization::_drawShadows()
 		{
 			COMMAND_LIST->ExecuteIndirect(
 				_commandSignature.Get(),
-				static_cast<unsigned int>(Scene::CurrentScene->meshesMetaCPU.size()),
-				_renderer->GetCulledCommands(DX::FrameIndex, cascade),
-				0,
-				_renderer->GetCulledCommandsCounter(DX::FrameIndex, cascade),
-				0);
+				_renderer->GetMaxCulledCommandsCount(),
+				_renderer->GetCulledCommands(DX::FrameIndex),
+				_renderer->GetCulledCommandsOffset(cascade),
+				_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+				_renderer->GetCulledCommandsCounterOffset(cascade));
 		}
 		else
 		{
@@ -298,11 +294,7 @@ void HardwareRasterization::_drawShadows()
 				for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
 				{
 					const auto& currentMesh = Scene::CurrentScene->meshesMetaCPU[prefab.meshesOffset + mesh];
-					unsigned int commandData[] =
-					{
-						currentMesh.startInstanceLocation
-					};
-					COMMAND_LIST->SetGraphicsRoot32BitConstants(1, _countof(commandData), commandData, 0);
+					_setDrawCallConstants(prefab.meshesOffset + mesh, prefab.objectsOffset);
 					COMMAND_LIST->DrawIndexedInstanced(
 						currentMesh.indexCountPerInstance,
 						currentMesh.instanceCount,
@@ -372,11 +364,11 @@ void HardwareRasterization::_drawOpaque(ID3D12Resource* renderTarget)
 	{
 		COMMAND_LIST->ExecuteIndirect(
 			_commandSignature.Get(),
-			static_cast<unsigned int>(Scene::CurrentScene->meshesMetaCPU.size()),
-			_renderer->GetCulledCommands(DX::FrameIndex, 0),
-			0,
-			_renderer->GetCulledCommandsCounter(DX::FrameIndex, 0),
-			0);
+			_renderer->GetMaxCulledCommandsCount(),
+			_renderer->GetCulledCommands(DX::FrameIndex),
+			_renderer->GetCulledCommandsOffset(0),
+			_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+			_renderer->GetCulledCommandsCounterOffset(0));
 	}
 	else
 	{
@@ -385,11 +377,7 @@ void HardwareRasterization::_drawOpaque(ID3D12Resource* renderTarget)
 			for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
 			{
 				const auto& currentMesh = Scene::CurrentScene->meshesMetaCPU[prefab.meshesOffset + mesh];
-				unsigned int commandData[] =
-				{
-					currentMesh.startInstanceLocation
-				};
-				COMMAND_LIST->SetGraphicsRoot32BitConstants(1, _countof(commandData), commandData, 0);
+				_setDrawCallConstants(prefab.meshesOffset + mesh, prefab.objectsOffset);
 				COMMAND_LIST->DrawIndexedInstanced(
 					currentMesh.indexCountPerInstance,
 					currentMesh.instanceCount,
@@ -408,11 +396,35 @@ void HardwareRasterization::_endFrame()
 
 }
 
+void HardwareRasterization::_setDrawCallConstants(
+	unsigned int meshID,
+	unsigned int startInstanceLocation)
+{
+	const auto& mesh = Scene::CurrentScene->meshesMetaCPU[meshID];
+
+	// same layout as the root constants part of IndirectCommand
+	unsigned int commandData[] =
+	{
+		startInstanceLocation,
+#ifdef QUANTIZED_POSITIONS
+		Utils::AsUINT(mesh.positionsOrigin.x),
+		Utils::AsUINT(mesh.positionsOrigin.y),
+		Utils::AsUINT(mesh.positionsOrigin.z),
+		Utils::AsUINT(mesh.positionsScale.x),
+		Utils::AsUINT(mesh.positionsScale.y),
+		Utils::AsUINT(mesh.positionsScale.z),
+#endif
+		meshID
+	};
+	static_assert(_countof(commandData) == DRAW_CALL_CONSTANTS, "Draw call constants layout mismatch");
+	COMMAND_LIST->SetGraphicsRoot32BitConstants(1, _countof(commandData), commandData, 0);
+}
+
 void HardwareRasterization::_createHWRRS()
 {
 	CD3DX12_ROOT_PARAMETER1 rootParameters[4] = {};
 	rootParameters[0].InitAsConstantBufferView(0);
-	rootParameters[1].InitAsConstants(1, 1);
+	rootParameters[1].InitAsConstants(DRAW_CALL_CONSTANTS, 1);
 	CD3DX12_DESCRIPTOR_RANGE1 ranges[2] = {};
 	ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 	rootParameters[2].InitAsDescriptorTable(
@@ -465,7 +477,7 @@ void HardwareRasterization::_createDepthPassPSO()
 		{
 			"POSITION",
 			0,
-			DXGI_FORMAT_R32G32B32_FLOAT,
+			VertexPositionFormat,
 			0,
 			0,
 			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
@@ -519,7 +531,7 @@ void HardwareRasterization::_createOpaquePassPSO()
 		{
 			"POSITION",
 			0,
-			DXGI_FORMAT_R32G32B32_FLOAT,
+			VertexPositionFormat,
 			0,
 			0,
 			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
@@ -39,6 +39,11 @@ private:
 	void _drawOpaque(ID3D12Resource* renderTarget);
 	void _endFrame();
 
+	// non-culled draws read scene instances, so start instance is the prefab objects offset
+	void _setDrawCallConstants(
+		unsigned int meshID,
+		unsigned int startInstanceLocation);
+
 	CD3DX12_VIEWPORT _viewport;
 	CD3DX12_RECT _scissorRect;
 
@@ -0,0 +1,365 @@
+#include "MaskedOcclusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// SSE2 is a part of x64, so no runtime dispatch is needed here
+#if defined(_M_X64) || defined(__x86_64__)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace CPURasterizer
+{
+
+static const uint32_t FullMask = 0xFFFFFFFFu;
+
+// mul(M, float4(p, 1.0)) of the shaders
+static Float4 Transform(const Float3& p, const Float4x4& M)
+{
+	return
+	{
+		p.x * M.m[0][0] + p.y * M.m[1][0] + p.z * M.m[2][0] + M.m[3][0],
+		p.x * M.m[0][1] + p.y * M.m[1][1] + p.z * M.m[2][1] + M.m[3][1],
+		p.x * M.m[0][2] + p.y * M.m[1][2] + p.z * M.m[2][2] + M.m[3][2],
+		p.x * M.m[0][3] + p.y * M.m[1][3] + p.z * M.m[2][3] + M.m[3][3]
+	};
+}
+
+static Float3 TransformPoint(const Float3& p, const Float4x4& M)
+{
+	Float4 result = Transform(p, M);
+	return { result.x, result.y, result.z };
+}
+
+// same edge functions as the SW rasterizer, E(x + a, y + b) = E(x, y) - a * dy + b * dx
+struct OccluderEdge
+{
+	float x0;
+	float y0;
+	float dx;
+	float dy;
+
+	float Evaluate(float x, float y) const
+	{
+		return dx * (y - y0) - (x - x0) * dy;
+	}
+};
+
+static OccluderEdge SetupEdge(const Float3& v0, const Float3& v1)
+{
+	return { v0.x, v0.y, v1.x - v0.x, v1.y - v0.y };
+}
+
+// pixel centers of the tile inside of the triangle, inclusive on the edges,
+// a pixel center on an edge is still on the occluder surface
+static uint32_t TileCoverage(const OccluderEdge edges[3], float x, float y)
+{
+#ifdef OCCLUSION_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 columns = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 four = _mm_set1_ps(4.0f);
+
+	__m128 offsetLow[3];
+	__m128 offsetHigh[3];
+	float area[3];
+	for (int edge = 0; edge < 3; edge++)
+	{
+		__m128 dy = _mm_set1_ps(edges[edge].dy);
+		offsetLow[edge] = _mm_mul_ps(columns, dy);
+		offsetHigh[edge] = _mm_mul_ps(_mm_add_ps(columns, four), dy);
+		area[edge] = edges[edge].Evaluate(x, y);
+	}
+
+	uint32_t mask = 0;
+	for (int row = 0; row < OcclusionBuffer::TileHeight; row++)
+	{
+		__m128 insideLow = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		__m128 insideHigh = insideLow;
+		for (int edge = 0; edge < 3; edge++)
+		{
+			__m128 rowArea = _mm_set1_ps(area[edge] + static_cast<float>(row) * edges[edge].dx);
+			insideLow = _mm_and_ps(insideLow, _mm_cmpge_ps(_mm_sub_ps(rowArea, offsetLow[edge]), zero));
+			insideHigh = _mm_and_ps(insideHigh, _mm_cmpge_ps(_mm_sub_ps(rowArea, offsetHigh[edge]), zero));
+		}
+
+		uint32_t rowMask =
+			static_cast<uint32_t>(_mm_movemask_ps(insideLow)) |
+			(static_cast<uint32_t>(_mm_movemask_ps(insideHigh)) << 4);
+		mask |= rowMask << (row * OcclusionBuffer::TileWidth);
+	}
+
+	return mask;
+#else
+	float area[3];
+	for (int edge = 0; edge < 3; edge++)
+	{
+		area[edge] = edges[edge].Evaluate(x, y);
+	}
+
+	uint32_t mask = 0;
+	for (int row = 0; row < OcclusionBuffer::TileHeight; row++)
+	{
+		for (int column = 0; column < OcclusionBuffer::TileWidth; column++)
+		{
+			bool inside = true;
+			for (int edge = 0; edge < 3; edge++)
+			{
+				float rowArea = area[edge] + static_cast<float>(row) * edges[edge].dx;
+				inside = inside && rowArea - static_cast<float>(column) * edges[edge].dy >= 0.0f;
+			}
+			mask |= (inside ? 1u : 0u) << (row * OcclusionBuffer::TileWidth + column);
+		}
+	}
+
+	return mask;
+#endif
+}
+
+void OcclusionBuffer::Resize(int width, int height)
+{
+	_tilesCountX = (width + TileWidth - 1) / TileWidth;
+	_tilesCountY = (height + TileHeight - 1) / TileHeight;
+	_width = _tilesCountX * TileWidth;
+	_height = _tilesCountY * TileHeight;
+	_tiles.resize(static_cast<size_t>(_tilesCountX) * _tilesCountY);
+	Clear();
+}
+
+void OcclusionBuffer::Clear()
+{
+	for (Tile& tile : _tiles)
+	{
+		// far plane, nothing is occluded
+		tile.mask = 0;
+		tile.zMin0 = 0.0f;
+		tile.zMin1 = FLT_MAX;
+	}
+}
+
+// the merge heuristic of the paper, with the depths negated for reversed Z
+void OcclusionBuffer::_updateTile(Tile& tile, uint32_t mask, float z)
+{
+	// behind the layer covering the whole tile already
+	if (z <= tile.zMin0)
+	{
+		return;
+	}
+
+	// the new triangle is much closer than the working layer, so start a new one with it
+	float distance1t = z - tile.zMin1;
+	float distance01 = tile.zMin1 - tile.zMin0;
+	if (distance1t > distance01)
+	{
+		tile.zMin1 = FLT_MAX;
+		tile.mask = 0;
+	}
+
+	tile.zMin1 = std::min(tile.zMin1, z);
+	tile.mask |= mask;
+
+	if (tile.mask == FullMask)
+	{
+		tile.zMin0 = std::max(tile.zMin0, tile.zMin1);
+		tile.zMin1 = FLT_MAX;
+		tile.mask = 0;
+	}
+}
+
+bool OcclusionBuffer::RenderTriangle(const Float4& p0CS, const Float4& p1CS, const Float4& p2CS)
+{
+	// no clipping, triangles crossing the near plane just don't occlude
+	if (p0CS.w <= 0.0f || p1CS.w <= 0.0f || p2CS.w <= 0.0f)
+	{
+		return false;
+	}
+
+	// CS -> NDC -> DX [0,1] -> SS, z stays in NDC
+	auto project = [this](const Float4& p) -> Float3
+	{
+		float invW = 1.0f / p.w;
+		return
+		{
+			(p.x * invW * 0.5f + 0.5f) * _width,
+			(p.y * invW * -0.5f + 0.5f) * _height,
+			p.z * invW
+		};
+	};
+	Float3 v0 = project(p0CS);
+	Float3 v1 = project(p1CS);
+	Float3 v2 = project(p2CS);
+
+	// backface if negative
+	Float2 e0 = { v1.x - v0.x, v1.y - v0.y };
+	Float2 e1 = { v2.x - v0.x, v2.y - v0.y };
+	float area = e0.x * e1.y - e1.x * e0.y;
+	if (!(area > 0.0f))
+	{
+		return false;
+	}
+
+	// pixel centers inside of the bounds, clamped before the conversion, vertices may be far off screen
+	float minPX = std::max(std::min(std::min(v0.x, v1.x), v2.x), 0.0f);
+	float minPY = std::max(std::min(std::min(v0.y, v1.y), v2.y), 0.0f);
+	float maxPX = std::min(std::max(std::max(v0.x, v1.x), v2.x), static_cast<float>(_width));
+	float maxPY = std::min(std::max(std::max(v0.y, v1.y), v2.y), static_cast<float>(_height));
+	if (!(minPX <= maxPX && minPY <= maxPY))
+	{
+		return false;
+	}
+
+	int minX = static_cast<int>(ceilf(minPX - 0.5f));
+	int minY = static_cast<int>(ceilf(minPY - 0.5f));
+	int maxX = std::min(static_cast<int>(floorf(maxPX - 0.5f)), _width - 1);
+	int maxY = std::min(static_cast<int>(floorf(maxPY - 0.5f)), _height - 1);
+	if (minX > maxX || minY > maxY)
+	{
+		return false;
+	}
+
+	OccluderEdge edges[3] =
+	{
+		SetupEdge(v1, v2),
+		SetupEdge(v2, v0),
+		SetupEdge(v0, v1)
+	};
+
+	// z = z0 + dzdx * (x - x0) + dzdy * (y - y0), NDC depth is linear in screen space
+	float invArea = 1.0f / area;
+	float dzdx = ((v1.z - v0.z) * e1.y - (v2.z - v0.z) * e0.y) * invArea;
+	float dzdy = ((v2.z - v0.z) * e0.x - (v1.z - v0.z) * e1.x) * invArea;
+	float minZ = std::min(std::min(v0.z, v1.z), v2.z);
+	// the farthest pixel center of a tile is one of its corners
+	float tileDzdx = std::min(dzdx * (TileWidth - 1), 0.0f);
+	float tileDzdy = std::min(dzdy * (TileHeight - 1), 0.0f);
+
+	for (int tileY = minY / TileHeight; tileY <= maxY / TileHeight; tileY++)
+	{
+		float y = static_cast<float>(tileY * TileHeight) + 0.5f;
+		for (int tileX = minX / TileWidth; tileX <= maxX / TileWidth; tileX++)
+		{
+			float x = static_cast<float>(tileX * TileWidth) + 0.5f;
+
+			uint32_t mask = TileCoverage(edges, x, y);
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			float z = v0.z + dzdx * (x - v0.x) + dzdy * (y - v0.y) + tileDzdx + tileDzdy;
+			_updateTile(_tiles[tileY * _tilesCountX + tileX], mask, std::max(z, minZ));
+		}
+	}
+
+	return true;
+}
+
+size_t OcclusionBuffer::RenderOccluder(
+	const SceneBuffers& scene,
+	const IndirectCommand& command,
+	const Float4x4& worldTransform,
+	const Float4x4& VP)
+{
+	size_t rendered = 0;
+	for (unsigned int triangleIndex = 0;
+		triangleIndex * 3 < command.args.indexCountPerInstance;
+		triangleIndex++)
+	{
+		Float3 positions[3];
+		GetTrianglePositions(scene, command, triangleIndex, positions);
+
+		// MS -> WS -> CS
+		Float4 p0CS = Transform(TransformPoint(positions[0], worldTransform), VP);
+		Float4 p1CS = Transform(TransformPoint(positions[1], worldTransform), VP);
+		Float4 p2CS = Transform(TransformPoint(positions[2], worldTransform), VP);
+
+		rendered += RenderTriangle(p0CS, p1CS, p2CS) ? 1 : 0;
+	}
+
+	return rendered;
+}
+
+bool OcclusionBuffer::_projectAABB(
+	const Float3& center,
+	const Float3& extents,
+	const Float4x4& VP,
+	ScreenBounds& bounds) const
+{
+	bounds = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int corner = 0; corner < 8; corner++)
+	{
+		Float3 p =
+		{
+			center.x + ((corner & 1) ? extents.x : -extents.x),
+			center.y + ((corner & 2) ? extents.y : -extents.y),
+			center.z + ((corner & 4) ? extents.z : -extents.z)
+		};
+
+		Float4 pCS = Transform(p, VP);
+		if (pCS.w <= 0.0f)
+		{
+			return false;
+		}
+
+		float invW = 1.0f / pCS.w;
+		float x = (pCS.x * invW * 0.5f + 0.5f) * _width;
+		float y = (pCS.y * invW * -0.5f + 0.5f) * _height;
+		bounds.minX = std::min(bounds.minX, x);
+		bounds.minY = std::min(bounds.minY, y);
+		bounds.maxX = std::max(bounds.maxX, x);
+		bounds.maxY = std::max(bounds.maxY, y);
+		bounds.maxZ = std::max(bounds.maxZ, pCS.z * invW);
+	}
+
+	return true;
+}
+
+bool OcclusionBuffer::IsOccluded(const Float3& center, const Float3& extents, const Float4x4& VP) const
+{
+	ScreenBounds bounds;
+	if (!_projectAABB(center, extents, VP, bounds))
+	{
+		return false;
+	}
+
+	// off screen, frustum culling rejects it
+	if (bounds.maxX < 0.0f || bounds.maxY < 0.0f || bounds.minX >= _width || bounds.minY >= _height)
+	{
+		return false;
+	}
+
+	// every tile the bounds touch, not just the covered pixel centers
+	int minTileX = static_cast<int>(std::max(bounds.minX, 0.0f)) / TileWidth;
+	int minTileY = static_cast<int>(std::max(bounds.minY, 0.0f)) / TileHeight;
+	int maxTileX = static_cast<int>(std::min(bounds.maxX, _width - 1.0f)) / TileWidth;
+	int maxTileY = static_cast<int>(std::min(bounds.maxY, _height - 1.0f)) / TileHeight;
+
+	for (int tileY = minTileY; tileY <= maxTileY; tileY++)
+	{
+		for (int tileX = minTileX; tileX <= maxTileX; tileX++)
+		{
+			if (!(bounds.maxZ < _tiles[tileY * _tilesCountX + tileX].zMin0))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+float OcclusionBuffer::GetProjectedArea(const Float3& center, const Float3& extents, const Float4x4& VP) const
+{
+	ScreenBounds bounds;
+	if (!_projectAABB(center, extents, VP, bounds))
+	{
+		return 0.0f;
+	}
+
+	float width = std::min(bounds.maxX, static_cast<float>(_width)) - std::max(bounds.minX, 0.0f);
+	float height = std::min(bounds.maxY, static_cast<float>(_height)) - std::max(bounds.minY, 0.0f);
+	return std::max(width, 0.0f) * std::max(height, 0.0f);
+}
+
+}
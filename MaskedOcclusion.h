@@ -0,0 +1,80 @@
+#pragma once
+
+#include "CPURasterizer.h"
+
+#include <cstdint>
+#include <vector>
+
+// low resolution occlusion buffer in the spirit of masked software occlusion culling
+// (Hasselgren et al. 2016): instead of a depth per pixel, every 8x4 pixel tile keeps
+// a coverage mask and two depth layers, occluders are rasterized into it with SIMD,
+// occludees are tested against it conservatively, reversed Z as everywhere else
+namespace CPURasterizer
+{
+
+class OcclusionBuffer
+{
+public:
+
+	static const int TileWidth = 8;
+	static const int TileHeight = 4;
+
+	// rounded up to whole tiles
+	void Resize(int width, int height);
+	void Clear();
+
+	// front facing triangles in front of the near plane only, returns true if rasterized
+	bool RenderTriangle(const Float4& p0CS, const Float4& p1CS, const Float4& p2CS);
+	// every triangle of the command for a single instance, returns the rasterized ones count
+	size_t RenderOccluder(
+		const SceneBuffers& scene,
+		const IndirectCommand& command,
+		const Float4x4& worldTransform,
+		const Float4x4& VP);
+
+	// world space AABB, true only if it's hidden behind the occluders for sure,
+	// boxes crossing the near plane are never occluded
+	bool IsOccluded(const Float3& center, const Float3& extents, const Float4x4& VP) const;
+	// screen area of the AABB bounds in the buffer pixels, 0 if it crosses the near plane
+	float GetProjectedArea(const Float3& center, const Float3& extents, const Float4x4& VP) const;
+
+	int GetWidth() const { return _width; }
+	int GetHeight() const { return _height; }
+
+private:
+
+	struct Tile
+	{
+		// pixels covered by the working layer, bit is row * TileWidth + column
+		uint32_t mask;
+		// farthest depth of the whole tile, conservative
+		float zMin0;
+		// farthest depth of the working layer
+		float zMin1;
+	};
+
+	struct ScreenBounds
+	{
+		float minX;
+		float minY;
+		float maxX;
+		float maxY;
+		// the closest one
+		float maxZ;
+	};
+
+	bool _projectAABB(
+		const Float3& center,
+		const Float3& extents,
+		const Float4x4& VP,
+		ScreenBounds& bounds) const;
+	void _updateTile(Tile& tile, uint32_t mask, float z);
+
+	std::vector<Tile> _tiles;
+	int _width = 0;
+	int _height = 0;
+	int _tilesCountX = 0;
+	int _tilesCountY = 0;
+};
+
+}
@@ -0,0 +1,83 @@
+#include "CullingCommon.hlsli"
+
+StructuredBuffer<Instance> Instances : register(t1);
+
+Texture2D PrevFrameDepth : register(t2);
+Texture2D CascadeShadowMap[MAX_CASCADES_COUNT] : register(t3);
+
+// x : object instance index, y : mask of frustums the object is inside of
+RWStructuredBuffer<uint2> VisibleObjects : register(u0);
+// [0] : visible objects count, [1..3] : meshlet culling dispatch arguments
+RWStructuredBuffer<uint> VisibleObjectsCounter : register(u1);
+
+// first level of the hierarchical culling, whole objects against prefab bounds,
+// cone culling is left to meshlets, since it makes no sense for a whole object
+[numthreads(CULLING_THREADS_X, CULLING_THREADS_Y, CULLING_THREADS_Z)]
+void main(
+	uint3 groupID : SV_GroupID,
+	uint3 dispatchThreadID : SV_DispatchThreadID,
+	uint3 groupThreadID : SV_GroupThreadID,
+	uint groupIndex : SV_GroupIndex)
+{
+	uint object = dispatchThreadID.x + groupID.y * CULLING_MAX_GROUPS_X * CULLING_THREADS_X;
+	if (object >= ObjectsCount)
+	{
+		return;
+	}
+
+	Instance instance = Instances[ObjectsOffset + object];
+	AABB objectAABB = TransformAABB(PrefabAABB, instance.worldTransform);
+
+	uint frustumsMask = 0;
+
+	bool cameraFC = AABBVsFrustum(objectAABB, Camera);
+	if ((cameraFC || !FrustumCullingEnabled) && !CPUOccludedObject(ObjectsOffset + object))
+	{
+		bool cameraHiZC = AABBVsHiZ(
+			objectAABB,
+			PrevFrameCameraVP,
+			DepthResolution,
+			PrevFrameDepth);
+		if (cameraHiZC || !CameraHiZCullingEnabled)
+		{
+			frustumsMask |= 1;
+		}
+	}
+
+	[unroll(MAX_CASCADES_COUNT)]
+	for (uint cascade = 0; cascade < CascadesCount; cascade++)
+	{
+		bool notFrustumCulled = AABBVsFrustum(objectAABB, Cascade[cascade]);
+		if (notFrustumCulled || !FrustumCullingEnabled)
+		{
+			bool HiZ = AABBVsHiZ(
+				objectAABB,
+				PrevFrameCascadeVP[cascade],
+				ShadowMapResolution,
+				CascadeShadowMap[cascade]);
+			if (HiZ || !ShadowsHiZCullingEnabled)
+			{
+				frustumsMask |= 2u << cascade;
+			}
+		}
+	}
+
+	if (frustumsMask != 0)
+	{
+		uint writeIndex;
+		InterlockedAdd(VisibleObjectsCounter[0], 1, writeIndex);
+
+		VisibleObjects[writeIndex] = uint2(ObjectsOffset + object, frustumsMask);
+	}
+}
+
+// sizes the meshlet culling dispatch to the surviving objects only
+[numthreads(1, 1, 1)]
+void argumentsMain()
+{
+	// no more than PairsCount, which leaves room for the rounding, see CullingPairsCount() in Culler.cpp
+	uint groupsCount = (VisibleObjectsCounter[0] * MeshesCount + CULLING_THREADS_X - 1) / CULLING_THREADS_X;
+	VisibleObjectsCounter[1] = min(groupsCount, CULLING_MAX_GROUPS_X);
+	VisibleObjectsCounter[2] = (groupsCount + CULLING_MAX_GROUPS_X - 1) / CULLING_MAX_GROUPS_X;
+	VisibleObjectsCounter[3] = 1;
+}
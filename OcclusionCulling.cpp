@@ -0,0 +1,403 @@
+#include "OcclusionCulling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace CPURasterizer
+{
+
+// uv of the screen bounds, y goes down, and the closest depth
+struct ScreenBounds
+{
+	float minX;
+	float minY;
+	float maxX;
+	float maxY;
+	float maxZ;
+};
+
+enum class Projection
+{
+	Outside,
+	CrossesNear,
+	Inside,
+};
+
+// clip space corners against the frustum planes, reversed Z, so the near plane is z == w,
+// the box is outside only if every corner is outside of the same plane
+static Projection ProjectBounds(const InstanceBounds& bounds, const Float4x4& VP, ScreenBounds& screen)
+{
+	unsigned int outsideMask = 0x3F;
+	bool crossesNear = false;
+	float minX = 1e30f;
+	float minY = 1e30f;
+	float maxX = -1e30f;
+	float maxY = -1e30f;
+	float maxZ = -1e30f;
+
+	for (int corner = 0; corner < 8; corner++)
+	{
+		float p[3] =
+		{
+			bounds.center.x + ((corner & 1) ? bounds.extents.x : -bounds.extents.x),
+			bounds.center.y + ((corner & 2) ? bounds.extents.y : -bounds.extents.y),
+			bounds.center.z + ((corner & 4) ? bounds.extents.z : -bounds.extents.z)
+		};
+
+		// row vectors
+		float clip[4];
+		for (int i = 0; i < 4; i++)
+		{
+			clip[i] = p[0] * VP.m[0][i] + p[1] * VP.m[1][i] + p[2] * VP.m[2][i] + VP.m[3][i];
+		}
+
+		unsigned int outside = 0;
+		outside |= clip[0] < -clip[3] ? 1u : 0u;
+		outside |= clip[0] > clip[3] ? 2u : 0u;
+		outside |= clip[1] < -clip[3] ? 4u : 0u;
+		outside |= clip[1] > clip[3] ? 8u : 0u;
+		outside |= clip[2] < 0.0f ? 16u : 0u;
+		outside |= clip[2] > clip[3] ? 32u : 0u;
+		outsideMask &= outside;
+
+		if (clip[3] <= 0.0f)
+		{
+			crossesNear = true;
+			continue;
+		}
+
+		float invW = 1.0f / clip[3];
+		minX = std::min(minX, clip[0] * invW);
+		minY = std::min(minY, clip[1] * invW);
+		maxX = std::max(maxX, clip[0] * invW);
+		maxY = std::max(maxY, clip[1] * invW);
+		maxZ = std::max(maxZ, clip[2] * invW);
+	}
+
+	if (outsideMask != 0)
+	{
+		return Projection::Outside;
+	}
+
+	if (crossesNear)
+	{
+		return Projection::CrossesNear;
+	}
+
+	// NDC -> DX [0,1]
+	screen.minX = minX * 0.5f + 0.5f;
+	screen.maxX = maxX * 0.5f + 0.5f;
+	screen.minY = -maxY * 0.5f + 0.5f;
+	screen.maxY = -minY * 0.5f + 0.5f;
+	screen.maxZ = maxZ;
+
+	return Projection::Inside;
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void DepthPyramid::Build(const DepthTarget& depth)
+{
+	int width = depth.GetWidth();
+	int height = depth.GetHeight();
+
+	// same as Utils::MipsCount
+	int mipsCount = 1;
+	for (int size = std::max(width, height); size > 1; size >>= 1)
+	{
+		mipsCount++;
+	}
+	_mips.resize(mipsCount);
+
+	Mip& top = _mips[0];
+	top.width = width;
+	top.height = height;
+	top.depth.resize(static_cast<size_t>(width) * height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			top.depth[y * width + x] = depth.GetDepth(x, y);
+		}
+	}
+
+	for (int mip = 1; mip < mipsCount; mip++)
+	{
+		const Mip& input = _mips[mip - 1];
+		Mip& output = _mips[mip];
+		output.width = std::max(input.width >> 1, 1);
+		output.height = std::max(input.height >> 1, 1);
+		output.depth.resize(static_cast<size_t>(output.width) * output.height);
+
+		for (int y = 0; y < output.height; y++)
+		{
+			// the last texels take the odd row and column too
+			int inputY0 = 2 * y;
+			int inputY1 = y == output.height - 1 ? input.height - 1 : 2 * y + 1;
+			for (int x = 0; x < output.width; x++)
+			{
+				int inputX0 = 2 * x;
+				int inputX1 = x == output.width - 1 ? input.width - 1 : 2 * x + 1;
+
+				float result = 1.0f;
+				for (int inputY = inputY0; inputY <= inputY1; inputY++)
+				{
+					for (int inputX = inputX0; inputX <= inputX1; inputX++)
+					{
+						result = std::min(result, input.depth[inputY * input.width + inputX]);
+					}
+				}
+				output.depth[y * output.width + x] = result;
+			}
+		}
+	}
+}
+
+bool DepthPyramid::IsVisible(const InstanceBounds& bounds, const Float4x4& VP) const
+{
+	ScreenBounds screen;
+	if (_mips.empty() || ProjectBounds(bounds, VP, screen) != Projection::Inside)
+	{
+		return true;
+	}
+
+	// pixels, whose centers the box may cover
+	const Mip& top = _mips[0];
+	int x0 = std::min(std::max(static_cast<int>(floorf(screen.minX * top.width)), 0), top.width - 1);
+	int y0 = std::min(std::max(static_cast<int>(floorf(screen.minY * top.height)), 0), top.height - 1);
+	int x1 = std::min(std::max(static_cast<int>(floorf(screen.maxX * top.width)), 0), top.width - 1);
+	int y1 = std::min(std::max(static_cast<int>(floorf(screen.maxY * top.height)), 0), top.height - 1);
+
+	int mip = 0;
+	while (mip + 1 < GetMipsCount() &&
+		((x1 >> mip) - (x0 >> mip) > 1 || (y1 >> mip) - (y0 >> mip) > 1))
+	{
+		mip++;
+	}
+
+	// a texel of mip m covers the texels j >> m of mip 0, the last ones take the rest
+	const Mip& level = _mips[mip];
+	int levelX0 = std::min(x0 >> mip, level.width - 1);
+	int levelY0 = std::min(y0 >> mip, level.height - 1);
+	int levelX1 = std::min(x1 >> mip, level.width - 1);
+	int levelY1 = std::min(y1 >> mip, level.height - 1);
+
+	float farthest = 1.0f;
+	for (int y = levelY0; y <= levelY1; y++)
+	{
+		for (int x = levelX0; x <= levelX1; x++)
+		{
+			farthest = std::min(farthest, level.depth[y * level.width + x]);
+		}
+	}
+
+	return !(farthest > screen.maxZ);
+}
+
+void OcclusionCulling::SetMode(OcclusionCullingMode mode)
+{
+	_mode = mode;
+	Reset();
+}
+
+void OcclusionCulling::Reset()
+{
+	std::fill(_visibility.begin(), _visibility.end(), 0u);
+	_hasPrevFrame = false;
+}
+
+void OcclusionCulling::_setVisible(size_t instance, bool visible)
+{
+	uint32_t bit = 1u << (instance % 32);
+	if (visible)
+	{
+		_visibility[instance / 32] |= bit;
+	}
+	else
+	{
+		_visibility[instance / 32] &= ~bit;
+	}
+}
+
+OcclusionCullingStats OcclusionCulling::DrawDepth(
+	Rasterizer& rasterizer,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	const InstanceBounds* bounds,
+	size_t instancesCount,
+	const Float4x4& VP,
+	DepthTarget& depth)
+{
+	if (_drawn.size() != instancesCount)
+	{
+		_visibility.resize((instancesCount + 31) / 32);
+		_drawn.resize(instancesCount);
+		_insideFrustum.resize(instancesCount);
+		Reset();
+	}
+
+	OcclusionCullingStats stats;
+	stats.instances = instancesCount;
+
+	depth.Clear();
+
+	auto drawCommands = [&]()
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (!_commands.empty())
+		{
+			rasterizer.DrawDepth(scene, _commands.data(), _commands.size(), VP, depth);
+		}
+		stats.drawSeconds += SecondsSince(start);
+	};
+
+	auto start = std::chrono::steady_clock::now();
+
+	ScreenBounds screen;
+	for (size_t instance = 0; instance < instancesCount; instance++)
+	{
+		_insideFrustum[instance] = ProjectBounds(bounds[instance], VP, screen) != Projection::Outside ? 1 : 0;
+		_drawn[instance] = 0;
+		stats.frustumVisible += _insideFrustum[instance];
+	}
+
+	_commands.clear();
+
+	if (_mode == OcclusionCullingMode::TwoPhase)
+	{
+		// the first phase, no tests, the history says they were visible last frame
+		for (size_t instance = 0; instance < instancesCount; instance++)
+		{
+			if (_insideFrustum[instance] && IsVisible(instance))
+			{
+				_drawn[instance] = 1;
+				_commands.push_back(commands[instance]);
+			}
+		}
+		stats.firstPhaseDrawn = _commands.size();
+		stats.cullingSeconds += SecondsSince(start);
+
+		drawCommands();
+
+		// the second phase, every instance against the depth of the first one,
+		// the ones drawn already only update their history
+		start = std::chrono::steady_clock::now();
+		_pyramid.Build(depth);
+
+		_commands.clear();
+		for (size_t instance = 0; instance < instancesCount; instance++)
+		{
+			bool visible = false;
+			if (_insideFrustum[instance])
+			{
+				stats.occlusionTests++;
+				visible = _pyramid.IsVisible(bounds[instance], VP);
+			}
+			_setVisible(instance, visible);
+
+			if (visible && !_drawn[instance])
+			{
+				_drawn[instance] = 1;
+				_commands.push_back(commands[instance]);
+			}
+		}
+		stats.secondPhaseDrawn = _commands.size();
+		stats.drawn = stats.firstPhaseDrawn + stats.secondPhaseDrawn;
+		stats.cullingSeconds += SecondsSince(start);
+
+		drawCommands();
+	}
+	else
+	{
+		bool testPrevFrame = _mode == OcclusionCullingMode::PrevFrameDepth && _hasPrevFrame;
+		for (size_t instance = 0; instance < instancesCount; instance++)
+		{
+			bool visible = _insideFrustum[instance] != 0;
+			if (visible && testPrevFrame)
+			{
+				stats.occlusionTests++;
+				visible = _pyramid.IsVisible(bounds[instance], _prevFrameVP);
+			}
+			_setVisible(instance, visible);
+
+			if (visible)
+			{
+				_drawn[instance] = 1;
+				_commands.push_back(commands[instance]);
+			}
+		}
+		stats.drawn = _commands.size();
+		stats.cullingSeconds += SecondsSince(start);
+
+		drawCommands();
+
+		// for the next frame, as PreparePrevFrameDepth does
+		if (_mode == OcclusionCullingMode::PrevFrameDepth)
+		{
+			start = std::chrono::steady_clock::now();
+			_pyramid.Build(depth);
+			_prevFrameVP = VP;
+			_hasPrevFrame = true;
+			stats.cullingSeconds += SecondsSince(start);
+		}
+	}
+
+	return stats;
+}
+
+Statistics FindVisibleInstances(
+	Rasterizer& rasterizer,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t instancesCount,
+	const Float4x4& VP,
+	VisibilityTarget& visibility,
+	std::vector<uint8_t>& visible)
+{
+	visibility.Clear();
+	Statistics statistics = rasterizer.DrawVisibility(scene, commands, instancesCount, VP, visibility);
+
+	visible.assign(instancesCount, 0);
+	for (int y = 0; y < visibility.GetHeight(); y++)
+	{
+		for (int x = 0; x < visibility.GetWidth(); x++)
+		{
+			unsigned int ID = visibility.GetID(x, y);
+			if (ID == 0)
+			{
+				continue;
+			}
+
+			// a command per instance
+			size_t instance;
+			unsigned int instanceID;
+			unsigned int triangleIndex;
+			rasterizer.DecodeVisibilityID(commands, ID, instance, instanceID, triangleIndex);
+			visible[instance] = 1;
+		}
+	}
+
+	return statistics;
+}
+
+void CompareWithVisible(
+	const std::vector<uint8_t>& drawn,
+	const std::vector<uint8_t>& visible,
+	OcclusionCullingStats& stats)
+{
+	stats.visible = 0;
+	stats.falseCulled = 0;
+	stats.falseVisible = 0;
+	for (size_t instance = 0; instance < std::min(drawn.size(), visible.size()); instance++)
+	{
+		stats.visible += visible[instance];
+		stats.falseCulled += (visible[instance] && !drawn[instance]) ? 1 : 0;
+		stats.falseVisible += (!visible[instance] && drawn[instance]) ? 1 : 0;
+	}
+}
+
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "CPURasterizer.h"
+
+#include <cstdint>
+#include <vector>
+
+// CPU reference of the camera occlusion culling loop, over the depth the CPU rasterizer renders,
+// an instance is a command with its world space bounds, as an (object, mesh) pair of CullingCS is:
+// the current scheme tests every instance against the previous frame depth pyramid, reprojected with
+// the previous frame VP, so newly disoccluded instances show up a frame late,
+// the two-phase one draws the instances visible last frame first, builds the pyramid of their depth,
+// then tests every instance against it and draws the newly visible ones, the visibility is kept per instance
+namespace CPURasterizer
+{
+
+// world space AABB
+struct InstanceBounds
+{
+	Float3 center;
+	Float3 extents;
+};
+
+// the farthest depth of every 2x2 texels of the mip above, reversed Z, mip 0 is the depth itself,
+// odd sizes fold the last row and column into the last texels, as GenerateHiZMipCS does
+class DepthPyramid
+{
+public:
+
+	void Build(const DepthTarget& depth);
+
+	// conservative, false only if the box is behind the depth at every pixel its screen bounds touch,
+	// the mip is picked, so they touch 2x2 texels at most, as AABBVsHiZ does,
+	// boxes crossing the near plane are always visible
+	bool IsVisible(const InstanceBounds& bounds, const Float4x4& VP) const;
+
+	int GetMipsCount() const { return static_cast<int>(_mips.size()); }
+
+private:
+
+	struct Mip
+	{
+		std::vector<float> depth;
+		int width;
+		int height;
+	};
+
+	std::vector<Mip> _mips;
+};
+
+enum class OcclusionCullingMode
+{
+	// frustum culling only
+	None,
+	// CullingCS with the camera Hi-Z culling
+	PrevFrameDepth,
+	TwoPhase,
+};
+
+struct OcclusionCullingStats
+{
+	size_t instances = 0;
+	size_t frustumVisible = 0;
+	// instances tested against a depth pyramid
+	size_t occlusionTests = 0;
+	// two-phase only, from the visibility history, then the ones the second phase found
+	size_t firstPhaseDrawn = 0;
+	size_t secondPhaseDrawn = 0;
+	size_t drawn = 0;
+	// see CompareWithVisible
+	size_t visible = 0;
+	// visible, but not drawn, i.e. popping in late
+	size_t falseCulled = 0;
+	// drawn, but without a single visible pixel
+	size_t falseVisible = 0;
+	// frustum and occlusion tests, pyramid builds included, and depth passes
+	double cullingSeconds = 0.0;
+	double drawSeconds = 0.0;
+};
+
+class OcclusionCulling
+{
+public:
+
+	explicit OcclusionCulling(OcclusionCullingMode mode = OcclusionCullingMode::TwoPhase) : _mode(mode) {}
+
+	void SetMode(OcclusionCullingMode mode);
+	OcclusionCullingMode GetMode() const { return _mode; }
+
+	// forgets the previous frames, so every instance inside of the frustum is drawn the next frame
+	void Reset();
+
+	// camera depth of a frame, which is cleared first, commands and bounds are per instance,
+	// an instance keeps its index between frames, it's reset when the instances count changes
+	OcclusionCullingStats DrawDepth(
+		Rasterizer& rasterizer,
+		const SceneBuffers& scene,
+		const IndirectCommand* commands,
+		const InstanceBounds* bounds,
+		size_t instancesCount,
+		const Float4x4& VP,
+		DepthTarget& depth);
+
+	// by the last DrawDepth
+	bool IsDrawn(size_t instance) const { return _drawn[instance] != 0; }
+	// the persistent history, drawn the next frame in the first phase
+	bool IsVisible(size_t instance) const { return (_visibility[instance / 32] >> (instance % 32)) & 1; }
+
+	const std::vector<uint8_t>& GetDrawn() const { return _drawn; }
+
+private:
+
+	void _setVisible(size_t instance, bool visible);
+
+	OcclusionCullingMode _mode;
+
+	// a bit per instance, as the GPU would keep it in a buffer
+	std::vector<uint32_t> _visibility;
+	std::vector<uint8_t> _drawn;
+	std::vector<uint8_t> _insideFrustum;
+	std::vector<IndirectCommand> _commands;
+
+	DepthPyramid _pyramid;
+	// previous frame depth mode
+	Float4x4 _prevFrameVP = {};
+	bool _hasPrevFrame = false;
+};
+
+// instances with at least one pixel in the visibility buffer of all of them, i.e. what
+// perfect culling would draw, visible is an instance flag, same indices as the commands,
+// returns the DrawVisibility statistics, instances past its IDs are in droppedIDTriangles
+Statistics FindVisibleInstances(
+	Rasterizer& rasterizer,
+	const SceneBuffers& scene,
+	const IndirectCommand* commands,
+	size_t instancesCount,
+	const Float4x4& VP,
+	VisibilityTarget& visibility,
+	std::vector<uint8_t>& visible);
+
+// fills visible, falseCulled and falseVisible
+void CompareWithVisible(
+	const std::vector<uint8_t>& drawn,
+	const std::vector<uint8_t>& visible,
+	OcclusionCullingStats& stats);
+
+}
@@ -39,6 +39,11 @@ public:
 	void FinishMeasure(ID3D12GraphicsCommandList* commandList);
 
 	float GetTimeMS(ID3D12CommandQueue* queue);
+	// the frame read by the last GetTimeMS(), not averaged
+	float GetLastTimeMS() const
+	{
+		return _lastFrames[(_lastFramesIndex + FrameCountToAverage - 1) % FrameCountToAverage];
+	}
 
 private:
 
@@ -1,6 +1,19 @@
 #ifndef RASTERIZATION_HLSL
 #define RASTERIZATION_HLSL
 
+// rasterization mode permutations, a PSO each, so the kernels don't branch on the constants
+#ifdef TOP_LEFT_RULE
+#define USE_TOP_LEFT_RULE true
+#else
+#define USE_TOP_LEFT_RULE false
+#endif
+
+#ifdef SCANLINE_RASTERIZATION
+#define USE_SCANLINE_RASTERIZATION true
+#else
+#define USE_SCANLINE_RASTERIZATION false
+#endif
+
 float Area(in float2 v0, in float2 v1, in float2 v2)
 {
 	float2 e0 = v1 - v0;
@@ -48,38 +61,280 @@ float EdgeScanlineIntersection(in float2 v0, in float2 v1, in float y)
 	return ((denom == 0.0) ? FloatMax : (y - v0.y) * rcp(denom));
 }
 
+// one of the tiles of a big triangle's bounds, row by row
+void GetBigTriangleTile(
+	in float2 minP,
+	in float2 maxP,
+	in float tilesCountX,
+	in float tileOffset,
+	out float2 tileMinP,
+	out float2 tileMaxP)
+{
+	float yTileOffset = floor(tileOffset / tilesCountX);
+	float xTileOffset = tileOffset - yTileOffset * tilesCountX;
+	tileMinP = minP + float2(xTileOffset, yTileOffset) * BigTriangleTileSize;
+	tileMaxP = min(maxP, tileMinP + BigTriangleTileSize.xx);
+}
+
+#ifdef COARSE_TILE_CLASSIFICATION
+
+// edge functions at the corners of a tile, outside if they all are outside of any edge,
+// covered if they all are inside of every edge, both with a margin of a pixel step,
+// so the rounding of the per pixel edge functions can't flip a pixel center
+uint ClassifyTile(
+	in float2 p0SS, in float2 p1SS, in float2 p2SS,
+	in float2 tileMinP,
+	in float2 tileMaxP)
+{
+	float2 v0[3] = { p1SS, p2SS, p0SS };
+	float2 v1[3] = { p2SS, p0SS, p1SS };
+
+	bool covered = true;
+	[unroll]
+	for (uint edge = 0; edge < 3; edge++)
+	{
+		float2 dxdy;
+		float area00, area10, area01, area11;
+		EdgeFunction(v0[edge], v1[edge], tileMinP, area00, dxdy);
+		EdgeFunction(v0[edge], v1[edge], float2(tileMaxP.x, tileMinP.y), area10, dxdy);
+		EdgeFunction(v0[edge], v1[edge], float2(tileMinP.x, tileMaxP.y), area01, dxdy);
+		EdgeFunction(v0[edge], v1[edge], tileMaxP, area11, dxdy);
+
+		float margin = abs(dxdy.x) + abs(dxdy.y);
+		if (max(max(area00, area10), max(area01, area11)) < -margin)
+		{
+			return TILE_OUTSIDE;
+		}
+
+		covered = covered && min(min(area00, area10), min(area01, area11)) > margin;
+	}
+
+	return covered ? TILE_COVERED : TILE_PARTIAL;
+}
+
+// tile offsets are never negative, so the sign bit is free
+float EncodeTileOffset(in float tileOffset, in bool covered)
+{
+	return asfloat(asuint(tileOffset) | (covered ? 0x80000000 : 0));
+}
+
+float DecodeTileOffset(in float tileOffset, out bool covered)
+{
+	covered = (asuint(tileOffset) >> 31) != 0;
+	return abs(tileOffset);
+}
+
+#endif // COARSE_TILE_CLASSIFICATION
+
+#ifdef FIXED_POINT_EDGES
+
+// halfway cases round up, same as SnapToSubpixels() in CPURasterizerInternal.h
+FixedPoint2 SnapToSubpixels(in float2 p)
+{
+	return FixedPoint2(floor(p * FIXED_POINT_SUBPIXEL_STEPS + 0.5));
+}
+
+FixedPoint FixedPointArea(in FixedPoint2 v0, in FixedPoint2 v1, in FixedPoint2 v2)
+{
+	FixedPoint2 e0 = v1 - v0;
+	FixedPoint2 e1 = v2 - v0;
+	return e0.x * e1.y - e1.x * e0.y;
+}
+
+// 64-bit edge functions don't overflow for the vertices inside of it,
+// the rest stays on floats
+bool InsideGuardBand(in float2 p0SS, in float2 p1SS, in float2 p2SS)
+{
+	return all(abs(p0SS) < FIXED_POINT_GUARD_BAND) &&
+		all(abs(p1SS) < FIXED_POINT_GUARD_BAND) &&
+		all(abs(p2SS) < FIXED_POINT_GUARD_BAND);
+}
+
+// right after the projection, so culling and bounds see the same triangle the edge functions do
+void SnapVertices(
+	inout float2 p0SS,
+	inout float2 p1SS,
+	inout float2 p2SS,
+	inout float area)
+{
+	if (!InsideGuardBand(p0SS, p1SS, p2SS))
+	{
+		return;
+	}
+
+	FixedPoint2 v0 = SnapToSubpixels(p0SS);
+	FixedPoint2 v1 = SnapToSubpixels(p1SS);
+	FixedPoint2 v2 = SnapToSubpixels(p2SS);
+
+	float invSteps = 1.0 / FIXED_POINT_SUBPIXEL_STEPS;
+	p0SS = float2(v0) * invSteps;
+	p1SS = float2(v1) * invSteps;
+	p2SS = float2(v2) * invSteps;
+	// exact sign, degenerate triangles are culled
+	area = float(FixedPointArea(v0, v1, v2)) * invSteps * invSteps;
+}
+
+void FixedPointEdgeFunction(
+	in FixedPoint2 v0,
+	in FixedPoint2 v1,
+	in FixedPoint2 p,
+	in bool useTopLeftRule,
+	out FixedPoint area,
+	out FixedPoint bias,
+	out FixedPoint stepX,
+	out FixedPoint stepY)
+{
+	FixedPoint2 e0 = v1 - v0;
+	FixedPoint2 e1 = p - v0;
+	// same as EdgeIsTopLeft
+	bool top = e0.y == 0 && e0.x > 0;
+	bool left = e0.y < 0;
+	// integers, so > 0 is >= 1
+	bias = (!useTopLeftRule || top || left) ? 0 : -1;
+	area = e0.x * e1.y - e1.x * e0.y + bias;
+	// a pixel is FIXED_POINT_SUBPIXEL_STEPS sub-pixels
+	stepX = -e0.y * FIXED_POINT_SUBPIXEL_STEPS;
+	stepY = e0.x * FIXED_POINT_SUBPIXEL_STEPS;
+}
+
+// false for triangles outside of the guard band, expects the snapped vertices
+bool SetupFixedPointEdges(
+	in float2 p0SS,
+	in float2 p1SS,
+	in float2 p2SS,
+	in float2 minP,
+	in bool useTopLeftRule,
+	out FixedPointEdges edges)
+{
+	edges = (FixedPointEdges)0;
+	if (!InsideGuardBand(p0SS, p1SS, p2SS))
+	{
+		return false;
+	}
+
+	FixedPoint2 v0 = SnapToSubpixels(p0SS);
+	FixedPoint2 v1 = SnapToSubpixels(p1SS);
+	FixedPoint2 v2 = SnapToSubpixels(p2SS);
+	// pixel centers are exact in sub-pixels
+	FixedPoint2 p = SnapToSubpixels(minP);
+
+	edges.invArea = 1.0 / float(FixedPointArea(v0, v1, v2));
+
+	FixedPointEdgeFunction(v1, v2, p, useTopLeftRule, edges.area.x, edges.bias.x, edges.stepX.x, edges.stepY.x);
+	FixedPointEdgeFunction(v2, v0, p, useTopLeftRule, edges.area.y, edges.bias.y, edges.stepX.y, edges.stepY.y);
+	FixedPointEdgeFunction(v0, v1, p, useTopLeftRule, edges.area.z, edges.bias.z, edges.stepX.z, edges.stepY.z);
+
+	return true;
+}
+
+#endif // FIXED_POINT_EDGES
+
 #ifndef BIG_TRIANGLES
 
+// triangleIndex is local to the command's meshlet
 void GetTriangleIndices(
-	in uint startIndexLocation,
+	in IndirectCommand command,
+	in uint triangleIndex,
 	out uint i0,
 	out uint i1,
 	out uint i2)
 {
-#ifdef GPU_SOA_BUFFERS
-	startIndexLocation /= INDICES_STRIDE;
+#if defined(MESHLET_INDICES)
+	// see PackMeshletTriangle
+	uint packedTriangle = Indices[command.startMeshletTriangleLocation + triangleIndex];
+	i0 = Indices[command.startMeshletVertexLocation + (packedTriangle & 0xFF)];
+	i1 = Indices[command.startMeshletVertexLocation + ((packedTriangle >> 8) & 0xFF)];
+	i2 = Indices[command.startMeshletVertexLocation + ((packedTriangle >> 16) & 0xFF)];
+#elif defined(GPU_SOA_BUFFERS)
+	uint startIndexLocation = command.args.startIndexLocation / INDICES_STRIDE + triangleIndex;
 	i0 = Indices[0 * TotalTriangles + startIndexLocation];
 	i1 = Indices[1 * TotalTriangles + startIndexLocation];
 	i2 = Indices[2 * TotalTriangles + startIndexLocation];
 #else
+	uint startIndexLocation = command.args.startIndexLocation + triangleIndex * 3;
 	i0 = Indices[startIndexLocation + 0];
 	i1 = Indices[startIndexLocation + 1];
 	i2 = Indices[startIndexLocation + 2];
 #endif
 }
 
+float3 GetVertexPosition(in uint i, in IndirectCommand command)
+{
+	uint baseVertexLocation = command.args.baseVertexLocation;
+#ifdef QUANTIZED_POSITIONS
+	return UnpackPosition(Positions[baseVertexLocation + i].packedPosition, command.positionsOrigin, command.positionsScale);
+#else
+	return Positions[baseVertexLocation + i].position;
+#endif
+}
+
 void GetTriangleVertexPositions(
 	in uint i0, in uint i1, in uint i2,
-	in uint baseVertexLocation,
+	in IndirectCommand command,
 	out float3 p0,
 	out float3 p1,
 	out float3 p2)
 {
-	p0 = Positions[baseVertexLocation + i0].position;
-	p1 = Positions[baseVertexLocation + i1].position;
-	p2 = Positions[baseVertexLocation + i2].position;
+	p0 = GetVertexPosition(i0, command);
+	p1 = GetVertexPosition(i1, command);
+	p2 = GetVertexPosition(i2, command);
 }
 
+#if defined(MESHLET_VERTEX_CACHE) && defined(MESHLET_INDICES)
+
+// the meshlet's vertices, transformed for the current instance
+groupshared float3 VertexCacheWS[MESHLET_MAX_VERTICES];
+groupshared float4 VertexCacheCS[MESHLET_MAX_VERTICES];
+
+// indices into the command's meshlet vertices, see PackMeshletTriangle
+void GetMeshletTriangle(
+	in IndirectCommand command,
+	in uint triangleIndex,
+	out uint l0,
+	out uint l1,
+	out uint l2)
+{
+	uint packedTriangle = Indices[command.startMeshletTriangleLocation + triangleIndex];
+	l0 = packedTriangle & 0xFF;
+	l1 = (packedTriangle >> 8) & 0xFF;
+	l2 = (packedTriangle >> 16) & 0xFF;
+}
+
+// a vertex per thread, the caller syncs the group before and after
+void CacheMeshletVertices(in IndirectCommand command, in Instance instance, in uint groupIndex)
+{
+	// the vertex list is followed by the packed triangles
+	uint verticesCount = command.startMeshletTriangleLocation - command.startMeshletVertexLocation;
+	for (uint v = groupIndex; v < verticesCount; v += SWR_TRIANGLE_THREADS_X * SWR_TRIANGLE_THREADS_Y * SWR_TRIANGLE_THREADS_Z)
+	{
+		float3 p = GetVertexPosition(Indices[command.startMeshletVertexLocation + v], command);
+
+		// MS -> WS -> VS -> CS
+		float3 pWS = mul(instance.worldTransform, float4(p, 1.0)).xyz;
+		VertexCacheWS[v] = pWS;
+		VertexCacheCS[v] = mul(VP, float4(pWS, 1.0));
+	}
+}
+
+void GetCachedPositions(
+	in uint l0, in uint l1, in uint l2,
+	out float3 p0WS,
+	out float3 p1WS,
+	out float3 p2WS,
+	out float4 p0CS,
+	out float4 p1CS,
+	out float4 p2CS)
+{
+	p0WS = VertexCacheWS[l0];
+	p1WS = VertexCacheWS[l1];
+	p2WS = VertexCacheWS[l2];
+	p0CS = VertexCacheCS[l0];
+	p1CS = VertexCacheCS[l1];
+	p2CS = VertexCacheCS[l2];
+}
+
+#endif // MESHLET_VERTEX_CACHE
+
 #ifdef OPAQUE
 
 void GetPackedVertexNormals(
@@ -120,6 +375,176 @@ void GetPackedVertexUVs(
 
 #endif // OPAQUE
 
+#ifdef COARSE_TILE_CLASSIFICATION
+
+// tile offset to append, false for a tile outside of the triangle
+bool ClassifyBigTriangleTile(
+	in float2 p0SS, in float2 p1SS, in float2 p2SS,
+	in float2 minP,
+	in float2 maxP,
+	in float tilesCountX,
+	in float offset,
+	inout uint outsideTiles,
+	inout uint coveredTiles,
+	out float tileOffset)
+{
+	float2 tileMinP, tileMaxP;
+	GetBigTriangleTile(minP, maxP, tilesCountX, offset, tileMinP, tileMaxP);
+
+	uint tileClass = ClassifyTile(p0SS, p1SS, p2SS, tileMinP, tileMaxP);
+	outsideTiles += tileClass == TILE_OUTSIDE ? 1 : 0;
+	coveredTiles += tileClass == TILE_COVERED ? 1 : 0;
+	tileOffset = EncodeTileOffset(offset, tileClass == TILE_COVERED);
+
+	return tileClass != TILE_OUTSIDE;
+}
+
+#endif // COARSE_TILE_CLASSIFICATION
+
+void CountBigTriangleTiles(
+	in uint bigTrianglesBuffer,
+	in float totalTiles,
+	in uint outsideTiles,
+	in uint coveredTiles)
+{
+	InterlockedAdd(Statistics[BIG_TRIANGLE_TILES_STAT + bigTrianglesBuffer], uint(totalTiles) - outsideTiles);
+#ifdef COARSE_TILE_CLASSIFICATION
+	InterlockedAdd(Statistics[BIG_TRIANGLE_OUTSIDE_TILES_STAT + bigTrianglesBuffer], outsideTiles);
+	InterlockedAdd(Statistics[BIG_TRIANGLE_COVERED_TILES_STAT + bigTrianglesBuffer], coveredTiles);
+#endif
+}
+
+#ifdef COMPACT_BIG_TRIANGLES
+
+#ifdef OPAQUE
+#define BIG_TRIANGLE_RECORD_FIELDS BIG_TRIANGLE_OPAQUE_RECORD_FIELDS
+#else
+#define BIG_TRIANGLE_RECORD_FIELDS BIG_TRIANGLE_DEPTH_RECORD_FIELDS
+#endif
+
+// counted in the statistics buffer, so the records count is read back along with it,
+// false when the records buffer is full, the triangle is dropped then, and counted as such
+bool AllocateBigTriangleRecord(in uint bigTrianglesBuffer, out uint record)
+{
+	InterlockedAdd(Statistics[BIG_TRIANGLE_RECORDS_STAT + bigTrianglesBuffer], 1, record);
+
+	uint fieldsCount, stride;
+	BigTriangleRecords.GetDimensions(fieldsCount, stride);
+
+	[branch]
+	if (record < fieldsCount / BIG_TRIANGLE_RECORD_FIELDS)
+	{
+		return true;
+	}
+
+	InterlockedAdd(Statistics[BIG_TRIANGLE_DROPPED_STAT + bigTrianglesBuffer], 1);
+	return false;
+}
+
+// everything BigTriangle*CS needs to start rasterizing any of the tiles
+void WriteBigTriangleSetup(
+	in uint record,
+	in float2 p0SS, in float2 p1SS, in float2 p2SS,
+	in float3 zNDC,
+	in float area,
+	in float2 minP,
+	in float2 maxP,
+	in float tilesCountX)
+{
+	uint base = record * BIG_TRIANGLE_RECORD_FIELDS;
+	BigTriangleRecords[base + RECORD_P0_SS_FLOAT2 + 0] = asuint(p0SS.x);
+	BigTriangleRecords[base + RECORD_P0_SS_FLOAT2 + 1] = asuint(p0SS.y);
+	BigTriangleRecords[base + RECORD_P1_SS_FLOAT2 + 0] = asuint(p1SS.x);
+	BigTriangleRecords[base + RECORD_P1_SS_FLOAT2 + 1] = asuint(p1SS.y);
+	BigTriangleRecords[base + RECORD_P2_SS_FLOAT2 + 0] = asuint(p2SS.x);
+	BigTriangleRecords[base + RECORD_P2_SS_FLOAT2 + 1] = asuint(p2SS.y);
+	BigTriangleRecords[base + RECORD_Z_NDC_FLOAT3 + 0] = asuint(zNDC.x);
+	BigTriangleRecords[base + RECORD_Z_NDC_FLOAT3 + 1] = asuint(zNDC.y);
+	BigTriangleRecords[base + RECORD_Z_NDC_FLOAT3 + 2] = asuint(zNDC.z);
+	BigTriangleRecords[base + RECORD_AREA_FLOAT] = asuint(area);
+	BigTriangleRecords[base + RECORD_MIN_P_FLOAT2 + 0] = asuint(minP.x);
+	BigTriangleRecords[base + RECORD_MIN_P_FLOAT2 + 1] = asuint(minP.y);
+	BigTriangleRecords[base + RECORD_MAX_P_FLOAT2 + 0] = asuint(maxP.x);
+	BigTriangleRecords[base + RECORD_MAX_P_FLOAT2 + 1] = asuint(maxP.y);
+	BigTriangleRecords[base + RECORD_TILES_X_FLOAT] = asuint(tilesCountX);
+}
+
+#ifdef OPAQUE
+
+void WriteBigTriangleAttributes(
+	in uint record,
+	in float3 invW,
+	in float3 p0WS, in float3 p1WS, in float3 p2WS,
+	in VertexNormal n0P, in VertexNormal n1P, in VertexNormal n2P,
+	in VertexColor c0P, in VertexColor c1P, in VertexColor c2P)
+{
+	uint base = record * BIG_TRIANGLE_RECORD_FIELDS;
+	BigTriangleRecords[base + RECORD_INV_W_FLOAT3 + 0] = asuint(invW.x);
+	BigTriangleRecords[base + RECORD_INV_W_FLOAT3 + 1] = asuint(invW.y);
+	BigTriangleRecords[base + RECORD_INV_W_FLOAT3 + 2] = asuint(invW.z);
+	BigTriangleRecords[base + RECORD_P0_WS_FLOAT3 + 0] = asuint(p0WS.x);
+	BigTriangleRecords[base + RECORD_P0_WS_FLOAT3 + 1] = asuint(p0WS.y);
+	BigTriangleRecords[base + RECORD_P0_WS_FLOAT3 + 2] = asuint(p0WS.z);
+	BigTriangleRecords[base + RECORD_P1_WS_FLOAT3 + 0] = asuint(p1WS.x);
+	BigTriangleRecords[base + RECORD_P1_WS_FLOAT3 + 1] = asuint(p1WS.y);
+	BigTriangleRecords[base + RECORD_P1_WS_FLOAT3 + 2] = asuint(p1WS.z);
+	BigTriangleRecords[base + RECORD_P2_WS_FLOAT3 + 0] = asuint(p2WS.x);
+	BigTriangleRecords[base + RECORD_P2_WS_FLOAT3 + 1] = asuint(p2WS.y);
+	BigTriangleRecords[base + RECORD_P2_WS_FLOAT3 + 2] = asuint(p2WS.z);
+	BigTriangleRecords[base + RECORD_N0_PACKED_UINT] = n0P.packedNormal;
+	BigTriangleRecords[base + RECORD_N1_PACKED_UINT] = n1P.packedNormal;
+	BigTriangleRecords[base + RECORD_N2_PACKED_UINT] = n2P.packedNormal;
+	BigTriangleRecords[base + RECORD_C0_PACKED_UINT2 + 0] = c0P.packedColor.x;
+	BigTriangleRecords[base + RECORD_C0_PACKED_UINT2 + 1] = c0P.packedColor.y;
+	BigTriangleRecords[base + RECORD_C1_PACKED_UINT2 + 0] = c1P.packedColor.x;
+	BigTriangleRecords[base + RECORD_C1_PACKED_UINT2 + 1] = c1P.packedColor.y;
+	BigTriangleRecords[base + RECORD_C2_PACKED_UINT2 + 0] = c2P.packedColor.x;
+	BigTriangleRecords[base + RECORD_C2_PACKED_UINT2 + 1] = c2P.packedColor.y;
+	// TODO: add this
+	BigTriangleRecords[base + RECORD_UV0_PACKED_UINT] = 0;
+	BigTriangleRecords[base + RECORD_UV1_PACKED_UINT] = 0;
+	BigTriangleRecords[base + RECORD_UV2_PACKED_UINT] = 0;
+}
+
+#endif // OPAQUE
+
+// a small entry per tile, instead of the whole triangle per tile
+void AppendBigTriangleTiles(
+	in uint record,
+	in float2 p0SS, in float2 p1SS, in float2 p2SS,
+	in float2 minP,
+	in float2 maxP,
+	in float tilesCountX,
+	in float totalTiles,
+	inout uint outsideTiles,
+	inout uint coveredTiles)
+{
+	BigTriangleTile result;
+	result.record = record;
+	for (float offset = 0.0; offset < totalTiles; offset += 1.0)
+	{
+#ifdef COARSE_TILE_CLASSIFICATION
+		if (!ClassifyBigTriangleTile(
+			p0SS, p1SS, p2SS,
+			minP,
+			maxP,
+			tilesCountX,
+			offset,
+			outsideTiles,
+			coveredTiles,
+			result.tileOffset))
+		{
+			continue;
+		}
+#else
+		result.tileOffset = offset;
+#endif
+		BigTriangles.Append(result);
+	}
+}
+
+#endif // COMPACT_BIG_TRIANGLES
+
 #endif // BIG_TRIANGLES
 
 void GetCSPositions(
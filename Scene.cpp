@@ -2,10 +2,22 @@
 #include "DX.h"
 #include "DescriptorManager.h"
 #include "CPUGPUCommon.h"
+#include "SceneCache.h"
+#include "ThreadPool.h"
 
+#include <chrono>
+#include <cstddef>
 #include <iostream>
 #include <unordered_map>
 
+// the headless rasterizer reads these buffers as is
+static_assert(sizeof(CPURasterizer::Instance) == sizeof(Instance), "Instance layout mismatch");
+static_assert(sizeof(CPURasterizer::IndirectCommand) == sizeof(IndirectCommand), "IndirectCommand layout mismatch");
+static_assert(
+	offsetof(CPURasterizer::IndirectCommand, args) == offsetof(IndirectCommand, arguments),
+	"IndirectCommand layout mismatch");
+static_assert(sizeof(VertexPosition) % sizeof(float) == 0, "VertexPosition layout mismatch");
+
 #define FAST_OBJ_IMPLEMENTATION
 #include "fast_obj.h"
 #include "meshoptimizer/src/meshoptimizer.h"
@@ -16,6 +28,8 @@ Scene Scene::BuddhaScene;
 size_t Scene::MaxSceneFacesCount = 0;
 size_t Scene::MaxSceneInstancesCount = 0;
 size_t Scene::MaxSceneMeshesMetaCount = 0;
+size_t Scene::MaxSceneObjectsCount = 0;
+size_t Scene::MaxScenePrefabsCount = 0;
 
 using namespace DirectX;
 
@@ -48,10 +62,13 @@ void Scene::LoadBuddha()
 	_createIBResources(Buddha);
 	_createMeshMetaResources(Buddha);
 	_createInstancesBufferResources(Buddha);
+	_createSWRCommandsResources(Buddha);
 
 	MaxSceneFacesCount = std::max(MaxSceneFacesCount, totalFacesCount);
-	MaxSceneInstancesCount = std::max(MaxSceneInstancesCount, instancesCPU.size());
+	MaxSceneInstancesCount = std::max(MaxSceneInstancesCount, meshInstancesCount);
 	MaxSceneMeshesMetaCount = std::max(MaxSceneMeshesMetaCount, meshesMetaCPU.size());
+	MaxSceneObjectsCount = std::max(MaxSceneObjectsCount, instancesCPU.size());
+	MaxScenePrefabsCount = std::max(MaxScenePrefabsCount, prefabs.size());
 }
 
 void Scene::LoadPlant()
@@ -83,10 +100,13 @@ void Scene::LoadPlant()
 	_createIBResources(Plant);
 	_createMeshMetaResources(Plant);
 	_createInstancesBufferResources(Plant);
+	_createSWRCommandsResources(Plant);
 
 	MaxSceneFacesCount = std::max(MaxSceneFacesCount, totalFacesCount);
-	MaxSceneInstancesCount = std::max(MaxSceneInstancesCount, instancesCPU.size());
+	MaxSceneInstancesCount = std::max(MaxSceneInstancesCount, meshInstancesCount);
 	MaxSceneMeshesMetaCount = std::max(MaxSceneMeshesMetaCount, meshesMetaCPU.size());
+	MaxSceneObjectsCount = std::max(MaxSceneObjectsCount, instancesCPU.size());
+	MaxScenePrefabsCount = std::max(MaxScenePrefabsCount, prefabs.size());
 }
 
 void Scene::_loadObj(
@@ -96,338 +116,799 @@ void Scene::_loadObj(
 	unsigned int instancesCountX,
 	unsigned int instancesCountZ)
 {
-	fastObjMesh* OBJMesh = fast_obj_read(OBJPath.c_str());
-	if (!OBJMesh)
-	{
-		PrintToOutput("Error loading %s: file not found\n", OBJPath.c_str());
-		ASSERT(false)
-	}
-
-	std::vector<MeshMeta> meshesMeta;
-	XMVECTOR objectMin = g_XMFltMax.v;
-	XMVECTOR objectMax = -g_XMFltMax.v;
+	const std::string cachePath = OBJPath + ".cache";
+	unsigned long long cacheKey = SceneCache::ComputeKey(
+		OBJPath,
+		translation,
+		scale,
+		instancesCountX,
+		instancesCountZ);
 
-	std::vector<XMFLOAT3> unindexedPositions;
-	std::vector<XMFLOAT3> unindexedNormals;
-	std::vector<XMFLOAT4> unindexedColors;
-	std::vector<XMFLOAT2> unindexedUVs;
+	// cache holds the whole scene geometry, so it's only valid for the first object
+	bool cacheable = prefabs.empty();
 
-	unsigned int positionsCPUOldSize = 0;
-	unsigned int normalsCPUOldSize = 0;
-	unsigned int colorsCPUOldSize = 0;
-	unsigned int texcoordsCPUOldSize = 0;
-	unsigned int indicesCPUOldSize = 0;
+	auto loadStart = std::chrono::steady_clock::now();
 
 	size_t facesCount = 0;
-	for (unsigned int group = 0; group < OBJMesh->group_count; group++)
+	bool cached = cacheable && SceneCache::Load(cachePath, cacheKey, *this, facesCount);
+	if (!cached)
+	{
+		facesCount = _cookObj(OBJPath, scale);
+	}
+
+	std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
+	size_t geometrySize =
+		positionsCPU.size() * sizeof(decltype(positionsCPU)::value_type) +
+		normalsCPU.size() * sizeof(decltype(normalsCPU)::value_type) +
+		colorsCPU.size() * sizeof(decltype(colorsCPU)::value_type) +
+		texcoordsCPU.size() * sizeof(decltype(texcoordsCPU)::value_type) +
+		indicesCPU.size() * sizeof(decltype(indicesCPU)::value_type) +
+#ifdef GPU_SOA_BUFFERS
+		indicesSOACPU.size() * sizeof(decltype(indicesSOACPU)::value_type) +
+#endif
+#ifdef MESHLET_INDICES
+		meshletIndicesCPU.size() * sizeof(decltype(meshletIndicesCPU)::value_type) +
+#endif
+		meshesMetaCPU.size() * sizeof(decltype(meshesMetaCPU)::value_type);
+	PrintToOutput(
+		"%s %s in %.2f s, geometry: %.1f MB, peak commit size: %.1f MB\n",
+		OBJPath.c_str(),
+		cached ? "read from cache" : "cooked",
+		loadTime.count(),
+		geometrySize / (1024.0 * 1024.0),
+		Utils::GetPeakCommitSize() / (1024.0 * 1024.0));
+
+	_generateInstances(
+		static_cast<unsigned int>(prefabs.size() - 1),
+		translation,
+		instancesCountX,
+		instancesCountZ);
+
+	totalFacesCount += facesCount * instancesCountX * instancesCountZ;
+
+	if (cacheable && !cached)
 	{
-		const fastObjGroup& currentGroup = OBJMesh->groups[group];
+		SceneCache::Save(cachePath, cacheKey, *this, facesCount);
+	}
+}
+
+// results of a single OBJ group cooking, offsets are group-relative
+struct CookedGroup
+{
+	std::vector<VertexPosition> positions;
+	std::vector<VertexNormal> normals;
+	std::vector<VertexColor> colors;
+	std::vector<VertexUV> texcoords;
+	std::vector<unsigned int> indices;
+#ifdef MESHLET_INDICES
+	std::vector<unsigned int> meshletIndices;
+#endif
+	std::vector<MeshMeta> meshesMeta;
+	XMFLOAT3 min;
+	XMFLOAT3 max;
+	size_t facesCount = 0;
+#ifdef QUANTIZED_POSITIONS
+	float maxPositionError = 0.0f;
+#endif
+};
 
-		size_t currentFacesCount = currentGroup.face_count;
-		facesCount += currentFacesCount;
+// what's kept of a cooked group once it's written to the scene buffers
+struct CookedGroupBounds
+{
+	XMFLOAT3 min;
+	XMFLOAT3 max;
+	size_t facesCount = 0;
+#ifdef QUANTIZED_POSITIONS
+	float maxPositionError = 0.0f;
+#endif
+};
 
-		unindexedPositions.reserve(currentFacesCount * 3);
-		unindexedNormals.reserve(currentFacesCount * 3);
-		unindexedColors.reserve(currentFacesCount * 3);
-		unindexedUVs.reserve(currentFacesCount * 3);
+// indexed, but not yet optimized group geometry
+struct GroupVertices
+{
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT4> colors;
+	std::vector<XMFLOAT2> UVs;
+	std::vector<unsigned int> indices;
+	size_t verticesCount = 0;
+};
+
+static void FetchVertex(
+	const fastObjMesh* OBJMesh,
+	const fastObjIndex& attributeIndices,
+	float scale,
+	XMFLOAT3& position,
+	XMFLOAT3& normal,
+	XMFLOAT4& color,
+	XMFLOAT2& UV)
+{
+	position = { 0.0f, 0.0f, 0.0f };
+	if (attributeIndices.p)
+	{
+		position =
+		{
+			OBJMesh->positions[3 * attributeIndices.p + 0],
+			OBJMesh->positions[3 * attributeIndices.p + 1],
+			OBJMesh->positions[3 * attributeIndices.p + 2]
+		};
 
-		decltype(unindexedPositions)::value_type tmpPosition = {};
-		decltype(unindexedNormals)::value_type tmpNormal = {};
-		decltype(unindexedUVs)::value_type tmpUV = {};
-		decltype(unindexedColors)::value_type tmpColor = {};
+		position.x *= scale;
+		position.y *= scale;
+		position.z *= scale;
+	}
 
-		XMVECTOR min = g_XMFltMax.v;
-		XMVECTOR max = -g_XMFltMax.v;
+	UV = { 0.0f, 0.0f };
+	if (attributeIndices.t)
+	{
+		UV =
+		{
+			OBJMesh->texcoords[2 * attributeIndices.t + 0],
+			OBJMesh->texcoords[2 * attributeIndices.t + 1]
+		};
+	}
 
-		int idx = 0;
-		for (unsigned int face = 0; face < currentGroup.face_count; face++)
+	normal = { 0.0f, 0.0f, 0.0f };
+	if (attributeIndices.n)
+	{
+		normal =
 		{
-			// TODO: ensure triangulation
-			unsigned int fv = OBJMesh->face_vertices[currentGroup.face_offset + face];
+			OBJMesh->normals[3 * attributeIndices.n + 0],
+			OBJMesh->normals[3 * attributeIndices.n + 1],
+			OBJMesh->normals[3 * attributeIndices.n + 2]
+		};
+		XMStoreFloat3(
+			&normal,
+			XMVector3Normalize(XMLoadFloat3(&normal)));
+	}
 
-			for (unsigned int vertex = 0; vertex < fv; vertex++)
-			{
-				fastObjIndex attributeIndices =
-					OBJMesh->indices[currentGroup.index_offset + idx];
+	color = { 0.8f, 0.8f, 0.8f, 1.0f };
+}
 
-				tmpPosition = { 0.0f, 0.0f, 0.0f };
-				if (attributeIndices.p)
-				{
-					tmpPosition =
-					{
-						OBJMesh->positions[3 * attributeIndices.p + 0],
-						OBJMesh->positions[3 * attributeIndices.p + 1],
-						OBJMesh->positions[3 * attributeIndices.p + 2]
-					};
-
-					tmpPosition.x *= scale;
-					tmpPosition.y *= scale;
-					tmpPosition.z *= scale;
-				}
+// expands every face corner, then dedupes by attribute values,
+// peak memory is several times the final group size
+static void IndexGroupUnindexed(
+	const fastObjMesh* OBJMesh,
+	const fastObjGroup& currentGroup,
+	float scale,
+	GroupVertices& vertices)
+{
+	size_t currentFacesCount = currentGroup.face_count;
 
-				unindexedPositions.push_back(tmpPosition);
+	auto& unindexedPositions = vertices.positions;
+	auto& unindexedNormals = vertices.normals;
+	auto& unindexedColors = vertices.colors;
+	auto& unindexedUVs = vertices.UVs;
 
-				min = XMVectorMin(min, XMLoadFloat3(&tmpPosition));
-				max = XMVectorMax(max, XMLoadFloat3(&tmpPosition));
+	unindexedPositions.reserve(currentFacesCount * 3);
+	unindexedNormals.reserve(currentFacesCount * 3);
+	unindexedColors.reserve(currentFacesCount * 3);
+	unindexedUVs.reserve(currentFacesCount * 3);
 
-				tmpUV = { 0.0f, 0.0f };
-				if (attributeIndices.t)
-				{
-					tmpUV =
-					{
-						OBJMesh->texcoords[2 * attributeIndices.t + 0],
-						OBJMesh->texcoords[2 * attributeIndices.t + 1]
-					};
-				}
+	XMFLOAT3 tmpPosition = {};
+	XMFLOAT3 tmpNormal = {};
+	XMFLOAT2 tmpUV = {};
+	XMFLOAT4 tmpColor = {};
 
-				unindexedUVs.push_back(tmpUV);
+	int idx = 0;
+	for (unsigned int face = 0; face < currentGroup.face_count; face++)
+	{
+		// TODO: ensure triangulation
+		unsigned int fv = OBJMesh->face_vertices[currentGroup.face_offset + face];
 
-				tmpNormal = { 0.0f, 0.0f, 0.0f };
-				if (attributeIndices.n)
-				{
-					tmpNormal =
-					{
-						OBJMesh->normals[3 * attributeIndices.n + 0],
-						OBJMesh->normals[3 * attributeIndices.n + 1],
-						OBJMesh->normals[3 * attributeIndices.n + 2]
-					};
-					XMStoreFloat3(
-						&tmpNormal,
-						XMVector3Normalize(XMLoadFloat3(&tmpNormal)));
-				}
+		for (unsigned int vertex = 0; vertex < fv; vertex++)
+		{
+			fastObjIndex attributeIndices =
+				OBJMesh->indices[currentGroup.index_offset + idx];
 
-				unindexedNormals.push_back(tmpNormal);
+			FetchVertex(OBJMesh, attributeIndices, scale, tmpPosition, tmpNormal, tmpColor, tmpUV);
 
-				tmpColor = { 0.8f, 0.8f, 0.8f, 1.0f };
-				unindexedColors.push_back(tmpColor);
+			unindexedPositions.push_back(tmpPosition);
+			unindexedUVs.push_back(tmpUV);
+			unindexedNormals.push_back(tmpNormal);
+			unindexedColors.push_back(tmpColor);
 
-				idx++;
-			}
+			idx++;
 		}
+	}
 
-		// optimize mesh data and perform indexing
-		meshopt_Stream streams[] =
+	// perform indexing
+	meshopt_Stream streams[] =
+	{
 		{
-			{
-				unindexedPositions.data(),
-				sizeof(decltype(unindexedPositions)::value_type),
-				sizeof(decltype(unindexedPositions)::value_type)
-			},
-			{
-				unindexedNormals.data(),
-				sizeof(decltype(unindexedNormals)::value_type),
-				sizeof(decltype(unindexedNormals)::value_type)
-			},
-			{
-				unindexedColors.data(),
-				sizeof(decltype(unindexedColors)::value_type),
-				sizeof(decltype(unindexedColors)::value_type)
-			},
-			{
-				unindexedUVs.data(),
-				sizeof(decltype(unindexedUVs)::value_type),
-				sizeof(decltype(unindexedUVs)::value_type)
-			}
-		};
-
-		size_t indexCount = currentFacesCount * 3;
-		std::vector<unsigned int> remap(indexCount);
-		size_t uniqueVertexCount = meshopt_generateVertexRemapMulti(
-			remap.data(),
-			nullptr,
-			indexCount,
-			unindexedPositions.size(),
-			streams,
-			_countof(streams));
-
-		positionsCPUOldSize = static_cast<unsigned int>(positionsCPU.size());
-		normalsCPUOldSize = static_cast<unsigned int>(normalsCPU.size());
-		colorsCPUOldSize = static_cast<unsigned int>(colorsCPU.size());
-		texcoordsCPUOldSize = static_cast<unsigned int>(texcoordsCPU.size());
-
-		positionsCPU.resize(positionsCPUOldSize + uniqueVertexCount);
-		normalsCPU.resize(normalsCPUOldSize + uniqueVertexCount);
-		colorsCPU.resize(colorsCPUOldSize + uniqueVertexCount);
-		texcoordsCPU.resize(texcoordsCPUOldSize + uniqueVertexCount);
-		indicesCPU.resize(indicesCPUOldSize + indexCount);
-
-		meshopt_remapIndexBuffer(
-			indicesCPU.data() + indicesCPUOldSize,
-			nullptr,
-			indexCount,
-			remap.data());
-		meshopt_remapVertexBuffer(
-			unindexedPositions.data(),
 			unindexedPositions.data(),
-			unindexedPositions.size(),
 			sizeof(decltype(unindexedPositions)::value_type),
-			remap.data());
-		meshopt_remapVertexBuffer(
-			unindexedNormals.data(),
+			sizeof(decltype(unindexedPositions)::value_type)
+		},
+		{
 			unindexedNormals.data(),
-			unindexedNormals.size(),
 			sizeof(decltype(unindexedNormals)::value_type),
-			remap.data());
-		meshopt_remapVertexBuffer(
-			unindexedColors.data(),
+			sizeof(decltype(unindexedNormals)::value_type)
+		},
+		{
 			unindexedColors.data(),
-			unindexedColors.size(),
 			sizeof(decltype(unindexedColors)::value_type),
-			remap.data());
-		meshopt_remapVertexBuffer(
-			unindexedUVs.data(),
+			sizeof(decltype(unindexedColors)::value_type)
+		},
+		{
 			unindexedUVs.data(),
-			unindexedUVs.size(),
 			sizeof(decltype(unindexedUVs)::value_type),
-			remap.data());
-		meshopt_optimizeVertexCache(
-			indicesCPU.data() + indicesCPUOldSize,
-			indicesCPU.data() + indicesCPUOldSize,
-			indexCount,
-			unindexedPositions.size());
-
-		// generate meshlets for more efficient culling
-		// not for use with mesh shaders
-		const size_t maxVertices = 128;
-		const size_t maxTriangles = MESHLET_SIZE;
-		// 0.0 had better results overall
-		const float coneWeight = 0.0f;
-
-		size_t maxMeshlets = meshopt_buildMeshletsBound(
-			indexCount,
-			maxVertices,
-			maxTriangles);
-		std::vector<meshopt_Meshlet> meshlets(maxMeshlets);
-		// indices into positionsCPU + offset
-		std::vector<unsigned int> meshletVertices(maxMeshlets * maxVertices);
-		std::vector<unsigned char> meshletTriangles(maxMeshlets * maxTriangles * 3);
-
-		size_t meshletCount = meshopt_buildMeshlets(
-			meshlets.data(),
-			meshletVertices.data(),
-			meshletTriangles.data(),
-			indicesCPU.data() + indicesCPUOldSize,
-			indexCount,
-			reinterpret_cast<float*>(unindexedPositions.data()),
-			uniqueVertexCount,
-			sizeof(decltype(unindexedPositions)::value_type),
-			maxVertices,
-			maxTriangles,
-			coneWeight);
+			sizeof(decltype(unindexedUVs)::value_type)
+		}
+	};
+
+	size_t indexCount = currentFacesCount * 3;
+	std::vector<unsigned int> remap(indexCount);
+	vertices.verticesCount = meshopt_generateVertexRemapMulti(
+		remap.data(),
+		nullptr,
+		indexCount,
+		unindexedPositions.size(),
+		streams,
+		_countof(streams));
+
+	vertices.indices.resize(indexCount);
+	meshopt_remapIndexBuffer(
+		vertices.indices.data(),
+		nullptr,
+		indexCount,
+		remap.data());
+	meshopt_remapVertexBuffer(
+		unindexedPositions.data(),
+		unindexedPositions.data(),
+		unindexedPositions.size(),
+		sizeof(decltype(unindexedPositions)::value_type),
+		remap.data());
+	meshopt_remapVertexBuffer(
+		unindexedNormals.data(),
+		unindexedNormals.data(),
+		unindexedNormals.size(),
+		sizeof(decltype(unindexedNormals)::value_type),
+		remap.data());
+	meshopt_remapVertexBuffer(
+		unindexedColors.data(),
+		unindexedColors.data(),
+		unindexedColors.size(),
+		sizeof(decltype(unindexedColors)::value_type),
+		remap.data());
+	meshopt_remapVertexBuffer(
+		unindexedUVs.data(),
+		unindexedUVs.data(),
+		unindexedUVs.size(),
+		sizeof(decltype(unindexedUVs)::value_type),
+		remap.data());
+}
+
+static size_t HashAttributeIndices(const fastObjIndex& attributeIndices)
+{
+	size_t hash = attributeIndices.p * 73856093u;
+	hash ^= attributeIndices.t * 19349663u;
+	hash ^= attributeIndices.n * 83492791u;
+	return hash ^ (hash >> 16);
+}
+
+static bool SameAttributeIndices(const fastObjIndex& a, const fastObjIndex& b)
+{
+	return a.p == b.p && a.t == b.t && a.n == b.n;
+}
+
+// dedupes by OBJ (p, t, n) triples as faces are read, so only unique
+// vertices and the index buffer are ever stored
+static void IndexGroupStreaming(
+	const fastObjMesh* OBJMesh,
+	const fastObjGroup& currentGroup,
+	float scale,
+	GroupVertices& vertices)
+{
+	const unsigned int emptySlot = ~0u;
+
+	// open addressing, kept at most half full
+	std::vector<fastObjIndex> uniqueAttributeIndices;
+	std::vector<unsigned int> table(1024, emptySlot);
 
-		const meshopt_Meshlet& last = meshlets[meshletCount - 1];
+	vertices.indices.reserve(currentGroup.face_count * 3);
 
-		// trimming
-		meshletVertices.resize(last.vertex_offset + last.vertex_count);
-		meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
-		meshlets.resize(meshletCount);
+	XMFLOAT3 tmpPosition = {};
+	XMFLOAT3 tmpNormal = {};
+	XMFLOAT2 tmpUV = {};
+	XMFLOAT4 tmpColor = {};
 
-		indicesCPU.resize(indicesCPUOldSize + meshletTriangles.size());
+	int idx = 0;
+	for (unsigned int face = 0; face < currentGroup.face_count; face++)
+	{
+		// TODO: ensure triangulation
+		unsigned int fv = OBJMesh->face_vertices[currentGroup.face_offset + face];
 
-		MeshMeta mesh = {};
-		for (const auto& meshlet : meshlets)
+		for (unsigned int vertex = 0; vertex < fv; vertex++)
 		{
-			meshopt_optimizeMeshlet(
-				&meshletVertices[meshlet.vertex_offset],
-				&meshletTriangles[meshlet.triangle_offset],
-				meshlet.triangle_count,
-				meshlet.vertex_count);
-
-			meshopt_Bounds bounds = meshopt_computeMeshletBounds(
-				&meshletVertices[meshlet.vertex_offset],
-				&meshletTriangles[meshlet.triangle_offset],
-				meshlet.triangle_count,
-				reinterpret_cast<float*>(unindexedPositions.data()),
-				uniqueVertexCount,
-				sizeof(decltype(unindexedPositions)::value_type));
-			memcpy(&mesh.AABB.center, &bounds.center, sizeof(decltype(mesh.AABB.center)));
-			mesh.AABB.extents =
+			fastObjIndex attributeIndices =
+				OBJMesh->indices[currentGroup.index_offset + idx];
+
+			size_t mask = table.size() - 1;
+			size_t slot = HashAttributeIndices(attributeIndices) & mask;
+			while (table[slot] != emptySlot &&
+				!SameAttributeIndices(uniqueAttributeIndices[table[slot]], attributeIndices))
 			{
-				bounds.radius,
-				bounds.radius,
-				bounds.radius
-			};
+				slot = (slot + 1) & mask;
+			}
 
-			mesh.indexCountPerInstance = meshlet.triangle_count * 3;
-			mesh.instanceCount = 1;
-			mesh.startIndexLocation = indicesCPUOldSize;
-			mesh.baseVertexLocation = positionsCPUOldSize;
-			mesh.startInstanceLocation = 0;
+			unsigned int index = table[slot];
+			if (index == emptySlot)
+			{
+				index = static_cast<unsigned int>(uniqueAttributeIndices.size());
+				table[slot] = index;
+				uniqueAttributeIndices.push_back(attributeIndices);
 
-			memcpy(&mesh.coneApex, &bounds.cone_apex, sizeof(decltype(mesh.coneApex)));
-			memcpy(&mesh.coneAxis, &bounds.cone_axis, sizeof(decltype(mesh.coneAxis)));
-			mesh.coneCutoff = bounds.cone_cutoff;
+				FetchVertex(OBJMesh, attributeIndices, scale, tmpPosition, tmpNormal, tmpColor, tmpUV);
 
-			meshesMeta.push_back(mesh);
+				vertices.positions.push_back(tmpPosition);
+				vertices.UVs.push_back(tmpUV);
+				vertices.normals.push_back(tmpNormal);
+				vertices.colors.push_back(tmpColor);
 
-			for (unsigned int vertex = 0; vertex < meshlet.triangle_count * 3; vertex++)
-			{
-				indicesCPU[indicesCPUOldSize + vertex] = meshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + vertex]];
+				if (uniqueAttributeIndices.size() * 2 > table.size())
+				{
+					table.assign(table.size() * 2, emptySlot);
+					mask = table.size() - 1;
+					for (unsigned int unique = 0; unique < uniqueAttributeIndices.size(); unique++)
+					{
+						slot = HashAttributeIndices(uniqueAttributeIndices[unique]) & mask;
+						while (table[slot] != emptySlot)
+						{
+							slot = (slot + 1) & mask;
+						}
+						table[slot] = unique;
+					}
+				}
 			}
 
-			indicesCPUOldSize += meshlet.triangle_count * 3;
+			vertices.indices.push_back(index);
+
+			idx++;
+		}
+	}
+
+	vertices.verticesCount = vertices.positions.size();
+}
+
+// indexed group geometry, split into meshlets, what the cooked group sizes depend on
+struct GroupMeshlets
+{
+	GroupVertices vertices;
+	std::vector<meshopt_Meshlet> meshlets;
+	// indices into group positions
+	std::vector<unsigned int> meshletVertices;
+	std::vector<unsigned char> meshletTriangles;
+};
+
+static void BuildGroupMeshlets(
+	const fastObjMesh* OBJMesh,
+	const fastObjGroup& currentGroup,
+	float scale,
+	GroupMeshlets& group)
+{
+	GroupVertices& vertices = group.vertices;
+	if (Settings::StreamingOBJIngestion)
+	{
+		IndexGroupStreaming(OBJMesh, currentGroup, scale, vertices);
+	}
+	else
+	{
+		IndexGroupUnindexed(OBJMesh, currentGroup, scale, vertices);
+	}
+
+	auto& positions = vertices.positions;
+	auto& indices = vertices.indices;
+	size_t indexCount = indices.size();
+
+	// optimize mesh data
+	meshopt_optimizeVertexCache(
+		indices.data(),
+		indices.data(),
+		indexCount,
+		positions.size());
+
+	// generate meshlets for more efficient culling
+	// not for use with mesh shaders
+	const size_t maxVertices = MESHLET_MAX_VERTICES;
+	const size_t maxTriangles = MESHLET_SIZE;
+	// 0.0 had better results overall
+	const float coneWeight = 0.0f;
+
+	size_t maxMeshlets = meshopt_buildMeshletsBound(
+		indexCount,
+		maxVertices,
+		maxTriangles);
+	group.meshlets.resize(maxMeshlets);
+	group.meshletVertices.resize(maxMeshlets * maxVertices);
+	group.meshletTriangles.resize(maxMeshlets * maxTriangles * 3);
+
+	size_t meshletCount = meshopt_buildMeshlets(
+		group.meshlets.data(),
+		group.meshletVertices.data(),
+		group.meshletTriangles.data(),
+		indices.data(),
+		indexCount,
+		reinterpret_cast<float*>(positions.data()),
+		vertices.verticesCount,
+		sizeof(decltype(positions)::value_type),
+		maxVertices,
+		maxTriangles,
+		coneWeight);
+
+	const meshopt_Meshlet& last = group.meshlets[meshletCount - 1];
+
+	// trimming
+	group.meshletVertices.resize(last.vertex_offset + last.vertex_count);
+	group.meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
+	group.meshlets.resize(meshletCount);
+}
+
+// element counts of a cooked group, so its ranges in the scene buffers are known before cooking it
+struct CookedGroupCounts
+{
+	size_t vertices = 0;
+	size_t indices = 0;
+	size_t meshes = 0;
+#ifdef MESHLET_INDICES
+	size_t meshletIndices = 0;
+#endif
+};
+
+// indexing and meshlets only, the group is cooked again once the ranges are allocated
+static void CountGroup(
+	const fastObjMesh* OBJMesh,
+	unsigned int group,
+	float scale,
+	CookedGroupCounts& counts)
+{
+	const fastObjGroup& currentGroup = OBJMesh->groups[group];
+	if (currentGroup.face_count == 0)
+	{
+		return;
+	}
+
+	GroupMeshlets groupMeshlets;
+	BuildGroupMeshlets(OBJMesh, currentGroup, scale, groupMeshlets);
+
+	counts.vertices = groupMeshlets.vertices.verticesCount;
+	counts.indices = groupMeshlets.vertices.indices.size();
+	counts.meshes = groupMeshlets.meshlets.size();
+#ifdef MESHLET_INDICES
+	for (const auto& meshlet : groupMeshlets.meshlets)
+	{
+		counts.meshletIndices += meshlet.vertex_count + meshlet.triangle_count;
+	}
+#endif
+}
+
+static void CookGroup(
+	const fastObjMesh* OBJMesh,
+	unsigned int group,
+	float scale,
+	CookedGroup& cooked)
+{
+	const fastObjGroup& currentGroup = OBJMesh->groups[group];
+
+	size_t currentFacesCount = currentGroup.face_count;
+	cooked.facesCount = currentFacesCount;
+
+	XMVECTOR min = g_XMFltMax.v;
+	XMVECTOR max = -g_XMFltMax.v;
+
+	if (currentFacesCount == 0)
+	{
+		XMStoreFloat3(&cooked.min, min);
+		XMStoreFloat3(&cooked.max, max);
+		return;
+	}
+
+	GroupMeshlets groupMeshlets;
+	BuildGroupMeshlets(OBJMesh, currentGroup, scale, groupMeshlets);
+
+	auto& positions = groupMeshlets.vertices.positions;
+	auto& normals = groupMeshlets.vertices.normals;
+	auto& colors = groupMeshlets.vertices.colors;
+	auto& UVs = groupMeshlets.vertices.UVs;
+	auto& indices = groupMeshlets.vertices.indices;
+	const auto& meshlets = groupMeshlets.meshlets;
+	auto& meshletVertices = groupMeshlets.meshletVertices;
+	auto& meshletTriangles = groupMeshlets.meshletTriangles;
+	size_t uniqueVertexCount = groupMeshlets.vertices.verticesCount;
+	size_t indexCount = indices.size();
+
+	for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
+	{
+		min = XMVectorMin(min, XMLoadFloat3(&positions[vertex]));
+		max = XMVectorMax(max, XMLoadFloat3(&positions[vertex]));
+	}
+
+#ifdef QUANTIZED_POSITIONS
+	// the whole vertex range shares quantization bounds,
+	// since vertices are shared between the group meshlets
+	XMFLOAT3 positionsOrigin;
+	XMFLOAT3 positionsScale;
+	XMStoreFloat3(&positionsOrigin, min);
+	XMStoreFloat3(&positionsScale, max - min);
+	// dequantized positions may be off by a half step, keep them in meshlets bounds
+	float quantizationError =
+		0.5f / 65535.0f * std::max(positionsScale.x, std::max(positionsScale.y, positionsScale.z));
+#endif
+
+	cooked.positions.resize(uniqueVertexCount);
+	cooked.normals.resize(uniqueVertexCount);
+	cooked.colors.resize(uniqueVertexCount);
+	cooked.texcoords.resize(uniqueVertexCount);
+
+	// meshlet indices are expanded in place, over the consumed source indices
+	cooked.indices = std::move(indices);
+
+	unsigned int indicesOffset = 0;
+
+#ifdef MESHLET_INDICES
+	// vertex list and packed triangles of every meshlet, back to back
+	cooked.meshletIndices.reserve(meshletVertices.size() + indexCount / 3);
+#endif
+
+	MeshMeta mesh = {};
+	for (const auto& meshlet : meshlets)
+	{
+		meshopt_optimizeMeshlet(
+			&meshletVertices[meshlet.vertex_offset],
+			&meshletTriangles[meshlet.triangle_offset],
+			meshlet.triangle_count,
+			meshlet.vertex_count);
+
+		meshopt_Bounds bounds = meshopt_computeMeshletBounds(
+			&meshletVertices[meshlet.vertex_offset],
+			&meshletTriangles[meshlet.triangle_offset],
+			meshlet.triangle_count,
+			reinterpret_cast<float*>(positions.data()),
+			uniqueVertexCount,
+			sizeof(decltype(positions)::value_type));
+		memcpy(&mesh.AABB.center, &bounds.center, sizeof(decltype(mesh.AABB.center)));
+		mesh.AABB.extents =
+		{
+			bounds.radius,
+			bounds.radius,
+			bounds.radius
+		};
+#ifdef QUANTIZED_POSITIONS
+		mesh.AABB.extents.x += quantizationError;
+		mesh.AABB.extents.y += quantizationError;
+		mesh.AABB.extents.z += quantizationError;
+		mesh.positionsOrigin = positionsOrigin;
+		mesh.positionsScale = positionsScale;
+#endif
+
+		mesh.indexCountPerInstance = meshlet.triangle_count * 3;
+		mesh.instanceCount = 1;
+		mesh.startIndexLocation = indicesOffset;
+		mesh.baseVertexLocation = 0;
+		mesh.startInstanceLocation = 0;
+
+		memcpy(&mesh.coneApex, &bounds.cone_apex, sizeof(decltype(mesh.coneApex)));
+		memcpy(&mesh.coneAxis, &bounds.cone_axis, sizeof(decltype(mesh.coneAxis)));
+		mesh.coneCutoff = bounds.cone_cutoff;
+
+#ifdef MESHLET_INDICES
+		mesh.startMeshletVertexLocation = static_cast<unsigned int>(cooked.meshletIndices.size());
+		cooked.meshletIndices.insert(
+			cooked.meshletIndices.end(),
+			meshletVertices.begin() + meshlet.vertex_offset,
+			meshletVertices.begin() + meshlet.vertex_offset + meshlet.vertex_count);
+
+		mesh.startMeshletTriangleLocation = static_cast<unsigned int>(cooked.meshletIndices.size());
+		for (unsigned int triangle = 0; triangle < meshlet.triangle_count; triangle++)
+		{
+			const unsigned char* localIndices = &meshletTriangles[meshlet.triangle_offset + triangle * 3];
+			cooked.meshletIndices.push_back(
+				PackMeshletTriangle(localIndices[0], localIndices[1], localIndices[2]));
+		}
+#endif
+
+		cooked.meshesMeta.push_back(mesh);
+
+		for (unsigned int vertex = 0; vertex < meshlet.triangle_count * 3; vertex++)
+		{
+			cooked.indices[indicesOffset + vertex] = meshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + vertex]];
 		}
 
-		// trimming
-		indicesCPU.resize(indicesCPUOldSize);
+		indicesOffset += meshlet.triangle_count * 3;
+	}
+
+	// trimming
+	cooked.indices.resize(indicesOffset);
 
-		objectMin = XMVectorMin(objectMin, min);
-		objectMax = XMVectorMax(objectMax, max);
+	XMStoreFloat3(&cooked.min, min);
+	XMStoreFloat3(&cooked.max, max);
+
+	// pack vertex attributes
+#ifdef QUANTIZED_POSITIONS
+	for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
+	{
+		auto& dst = cooked.positions[vertex];
+		auto& src = positions[vertex];
+		dst = QuantizePosition(src, positionsOrigin, positionsScale);
+
+		XMFLOAT3 decoded = DequantizePosition(dst, positionsOrigin, positionsScale);
+		XMFLOAT3 error;
+		XMStoreFloat3(&error, XMVectorAbs(XMLoadFloat3(&decoded) - XMLoadFloat3(&src)));
+		cooked.maxPositionError = std::max(
+			cooked.maxPositionError,
+			std::max(error.x, std::max(error.y, error.z)));
+	}
+#else
+	for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
+	{
+		auto& dst = cooked.positions[vertex].position;
+		auto& src = positions[vertex];
+		dst = src;
+	}
+#endif
 
-		// pack vertex attributes
-		// TODO: pack positions
+	if (!normals.empty())
+	{
 		for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
 		{
-			auto& dst = positionsCPU[positionsCPUOldSize + vertex].position;
-			auto& src = unindexedPositions[vertex];
-			dst = src;
+			auto& dst = cooked.normals[vertex].packedNormal;
+			auto& src = normals[vertex];
+			dst =
+				(meshopt_quantizeUnorm(src.x * 0.5f + 0.5f, 10) << 20) |
+				(meshopt_quantizeUnorm(src.y * 0.5f + 0.5f, 10) << 10) |
+				meshopt_quantizeUnorm(src.z * 0.5f + 0.5f, 10);
 		}
+	}
 
-		if (!unindexedNormals.empty())
+	if (!UVs.empty())
+	{
+		for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
 		{
-			for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
-			{
-				auto& dst = normalsCPU[normalsCPUOldSize + vertex].packedNormal;
-				auto& src = unindexedNormals[vertex];
-				dst =
-					(meshopt_quantizeUnorm(src.x * 0.5f + 0.5f, 10) << 20) |
-					(meshopt_quantizeUnorm(src.y * 0.5f + 0.5f, 10) << 10) |
-					meshopt_quantizeUnorm(src.z * 0.5f + 0.5f, 10);
-			}
+			auto& dst = cooked.texcoords[vertex].packedUV;
+			auto& src = UVs[vertex];
+			dst |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.x)) << 16);
+			dst |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.y)));
 		}
+	}
 
-		if (!unindexedUVs.empty())
+	if (!colors.empty())
+	{
+		for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
 		{
-			for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
-			{
-				auto& dst = texcoordsCPU[texcoordsCPUOldSize + vertex].packedUV;
-				auto& src = unindexedUVs[vertex];
-				dst |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.x)) << 16);
-				dst |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.y)));
-			}
+			auto& dst = cooked.colors[vertex].packedColor;
+			auto& src = colors[vertex];
+			dst[0] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.x)) << 16);
+			dst[0] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.y)));
+			dst[1] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.z)) << 16);
+			dst[1] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.w)));
 		}
+	}
+}
+
+size_t Scene::_cookObj(const std::string& OBJPath, float scale)
+{
+	fastObjMesh* OBJMesh = fast_obj_read(OBJPath.c_str());
+	if (!OBJMesh)
+	{
+		PrintToOutput("Error loading %s: file not found\n", OBJPath.c_str());
+		ASSERT(false)
+	}
+
+	// groups are independent, so they are counted, then cooked concurrently,
+	// each one straight into its range of the scene buffers,
+	// only the groups in flight are held besides the final buffers
+	ThreadPool threadPool(Settings::LoadingThreadsCount);
+	std::vector<CookedGroupCounts> groupCounts(OBJMesh->group_count);
+	threadPool.ParallelFor(
+		groupCounts.size(),
+		[&](size_t group)
+		{
+			CountGroup(OBJMesh, static_cast<unsigned int>(group), scale, groupCounts[group]);
+		});
+
+	// ranges in groups order, so the result doesn't depend on threads count
+	CookedGroupCounts objectOffsets;
+	objectOffsets.vertices = positionsCPU.size();
+	objectOffsets.indices = indicesCPU.size();
+	objectOffsets.meshes = meshesMetaCPU.size();
+#ifdef MESHLET_INDICES
+	objectOffsets.meshletIndices = meshletIndicesCPU.size();
+#endif
+	std::vector<CookedGroupCounts> groupOffsets(groupCounts.size());
+	CookedGroupCounts objectEnd = objectOffsets;
+	for (size_t group = 0; group < groupCounts.size(); group++)
+	{
+		groupOffsets[group] = objectEnd;
+		objectEnd.vertices += groupCounts[group].vertices;
+		objectEnd.indices += groupCounts[group].indices;
+		objectEnd.meshes += groupCounts[group].meshes;
+#ifdef MESHLET_INDICES
+		objectEnd.meshletIndices += groupCounts[group].meshletIndices;
+#endif
+	}
+
+#ifdef MESHLET_INDICES
+	// index memory of this object only, for the layouts comparison
+	size_t objectIndicesSize = (objectEnd.indices - objectOffsets.indices) * sizeof(unsigned int);
+	size_t objectMeshletIndicesSize = (objectEnd.meshletIndices - objectOffsets.meshletIndices) * sizeof(unsigned int);
+#endif
+
+	// allocated once, at their final sizes
+	positionsCPU.resize(objectEnd.vertices);
+	normalsCPU.resize(objectEnd.vertices);
+	colorsCPU.resize(objectEnd.vertices);
+	texcoordsCPU.resize(objectEnd.vertices);
+	indicesCPU.resize(objectEnd.indices);
+	meshesMetaCPU.resize(objectEnd.meshes);
+#ifdef MESHLET_INDICES
+	meshletIndicesCPU.resize(objectEnd.meshletIndices);
+#endif
 
-		if (!unindexedColors.empty())
+	std::vector<CookedGroupBounds> groupBounds(groupCounts.size());
+	threadPool.ParallelFor(
+		groupCounts.size(),
+		[&](size_t group)
 		{
-			for (size_t vertex = 0; vertex < uniqueVertexCount; vertex++)
+			CookedGroup cooked;
+			CookGroup(OBJMesh, static_cast<unsigned int>(group), scale, cooked);
+
+			const CookedGroupCounts& counts = groupCounts[group];
+			ASSERT(
+				cooked.positions.size() == counts.vertices &&
+				cooked.indices.size() == counts.indices &&
+				cooked.meshesMeta.size() == counts.meshes,
+				"Group %zu of %s cooked to other sizes than counted", group, OBJPath.c_str())
+
+			const CookedGroupCounts& offsets = groupOffsets[group];
+			std::copy(cooked.positions.begin(), cooked.positions.end(), positionsCPU.begin() + offsets.vertices);
+			std::copy(cooked.normals.begin(), cooked.normals.end(), normalsCPU.begin() + offsets.vertices);
+			std::copy(cooked.colors.begin(), cooked.colors.end(), colorsCPU.begin() + offsets.vertices);
+			std::copy(cooked.texcoords.begin(), cooked.texcoords.end(), texcoordsCPU.begin() + offsets.vertices);
+			std::copy(cooked.indices.begin(), cooked.indices.end(), indicesCPU.begin() + offsets.indices);
+#ifdef MESHLET_INDICES
+			std::copy(cooked.meshletIndices.begin(), cooked.meshletIndices.end(), meshletIndicesCPU.begin() + offsets.meshletIndices);
+#endif
+
+			for (size_t mesh = 0; mesh < cooked.meshesMeta.size(); mesh++)
 			{
-				auto& dst = colorsCPU[colorsCPUOldSize + vertex].packedColor;
-				auto& src = unindexedColors[vertex];
-				dst[0] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.x)) << 16);
-				dst[0] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.y)));
-				dst[1] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.z)) << 16);
-				dst[1] |= (static_cast<unsigned int>(meshopt_quantizeHalf(src.w)));
+				MeshMeta& meshMeta = meshesMetaCPU[offsets.meshes + mesh];
+				meshMeta = cooked.meshesMeta[mesh];
+				meshMeta.startIndexLocation += static_cast<unsigned int>(offsets.indices);
+				meshMeta.baseVertexLocation = static_cast<unsigned int>(offsets.vertices);
+#ifdef MESHLET_INDICES
+				meshMeta.startMeshletVertexLocation += static_cast<unsigned int>(offsets.meshletIndices);
+				meshMeta.startMeshletTriangleLocation += static_cast<unsigned int>(offsets.meshletIndices);
+#endif
 			}
-		}
 
-		unindexedPositions.clear();
-		unindexedNormals.clear();
-		unindexedColors.clear();
-		unindexedUVs.clear();
-	}
+			// the group geometry is released here, only its bounds are kept
+			CookedGroupBounds& bounds = groupBounds[group];
+			bounds.min = cooked.min;
+			bounds.max = cooked.max;
+			bounds.facesCount = cooked.facesCount;
+#ifdef QUANTIZED_POSITIONS
+			bounds.maxPositionError = cooked.maxPositionError;
+#endif
+		});
 
 	fast_obj_destroy(OBJMesh);
 
+#ifdef QUANTIZED_POSITIONS
+	float maxPositionError = 0.0f;
+#endif
+	XMVECTOR objectMin = g_XMFltMax.v;
+	XMVECTOR objectMax = -g_XMFltMax.v;
+	size_t facesCount = 0;
+	for (const auto& bounds : groupBounds)
+	{
+		objectMin = XMVectorMin(objectMin, XMLoadFloat3(&bounds.min));
+		objectMax = XMVectorMax(objectMax, XMLoadFloat3(&bounds.max));
+		facesCount += bounds.facesCount;
+#ifdef QUANTIZED_POSITIONS
+		maxPositionError = std::max(maxPositionError, bounds.maxPositionError);
+#endif
+	}
+
 #ifdef GPU_SOA_BUFFERS
 	indicesSOACPU.resize(indicesCPU.size());
 	unsigned int totalTrianglesCount = static_cast<unsigned int>(indicesCPU.size() / 3);
@@ -439,58 +920,147 @@ void Scene::_loadObj(
 	}
 #endif
 
-	AABB objectBoundingVolume;
-	XMStoreFloat3(&objectBoundingVolume.center, (objectMin + objectMax) * 0.5f);
-	XMStoreFloat3(&objectBoundingVolume.extents, (objectMax - objectMin) * 0.5f);
+#ifdef MESHLET_INDICES
+	// previously the SW rasterizer read an SOA copy of the 32-bit indices
+	PrintToOutput(
+		"%s index memory: %.1f MB (32-bit + SOA copy) -> %.1f MB (32-bit for HW + %.1f MB meshlet-local)\n",
+		OBJPath.c_str(),
+		2 * objectIndicesSize / (1024.0 * 1024.0),
+		(objectIndicesSize + objectMeshletIndicesSize) / (1024.0 * 1024.0),
+		objectMeshletIndicesSize / (1024.0 * 1024.0));
+#endif
 
 	Prefab newPrefab;
-	newPrefab.meshesOffset = static_cast<unsigned int>(meshesMetaCPU.size());
-	newPrefab.meshesCount = static_cast<unsigned int>(meshesMeta.size());
+	newPrefab.meshesOffset = static_cast<unsigned int>(objectOffsets.meshes);
+	newPrefab.meshesCount = static_cast<unsigned int>(objectEnd.meshes - objectOffsets.meshes);
+	XMStoreFloat3(&newPrefab.AABB.center, (objectMin + objectMax) * 0.5f);
+	XMStoreFloat3(&newPrefab.AABB.extents, (objectMax - objectMin) * 0.5f);
 	prefabs.push_back(newPrefab);
 
-	meshesMetaCPU.insert(meshesMetaCPU.end(), meshesMeta.begin(), meshesMeta.end());
+#ifdef QUANTIZED_POSITIONS
+	PrintToOutput(
+		"%s quantized positions: %.1f MB -> %.1f MB, max error %f (%f of object diagonal)\n",
+		OBJPath.c_str(),
+		(objectEnd.vertices - objectOffsets.vertices) * sizeof(XMFLOAT3) / (1024.0 * 1024.0),
+		(objectEnd.vertices - objectOffsets.vertices) * sizeof(VertexPosition) / (1024.0 * 1024.0),
+		maxPositionError,
+		maxPositionError / std::max(newPrefab.AABB.GetDiagonalLength(), FLT_MIN));
+#endif
+
+	return facesCount;
+}
+
+void Scene::_generateInstances(
+	unsigned int prefabID,
+	float translation,
+	unsigned int instancesCountX,
+	unsigned int instancesCountZ)
+{
+	Prefab& prefab = prefabs[prefabID];
+	const AABB& objectBoundingVolume = prefab.AABB;
+	const unsigned int totalObjectInstances = instancesCountX * instancesCountZ;
+
+	// one instance per object, meshes are expanded at culling time
+	prefab.objectsOffset = static_cast<unsigned int>(instancesCPU.size());
+	prefab.objectsCount = totalObjectInstances;
+	instancesCPU.resize(instancesCPU.size() + totalObjectInstances);
+	for (unsigned int instanceZ = 0; instanceZ < instancesCountZ; instanceZ++)
+	{
+		for (unsigned int instanceX = 0; instanceX < instancesCountX; instanceX++)
+		{
+			XMMATRIX transform = XMMatrixTranslation(
+				(translation + objectBoundingVolume.extents.x * 2.0f) *
+				instanceX,
+				0.0f,
+				(translation + objectBoundingVolume.extents.z * 2.0f) *
+				instanceZ);
+
+			Instance& instance = instancesCPU[prefab.objectsOffset + instanceZ * instancesCountX + instanceX];
+			XMStoreFloat4x4(&instance.worldTransform, transform);
+			instance.ID = prefabID;
+
+			sceneAABB = Utils::MergeAABBs(sceneAABB, Utils::TransformAABB(objectBoundingVolume, transform));
+		}
+	}
 
-	// generate instances
+	// the culling compacts the visible instances, the (object, mesh) pairs only cost a visibility mask each,
+	// see CompactionCS.hlsl, the culled instances are bounded by Settings::MaxVisibleInstancesCount
+	for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
+	{
+		meshesMetaCPU[prefab.meshesOffset + mesh].instanceCount = totalObjectInstances;
+	}
+	meshInstancesCount += static_cast<size_t>(totalObjectInstances) * prefab.meshesCount;
+
+	// visibility masks are indexed with 32 bits
+	ASSERT(
+		meshInstancesCount <= UINT32_MAX,
+		"%zu (object, mesh) pairs don't fit the visibility masks",
+		meshInstancesCount)
+
+	PrintToOutput(
+		"%u object instances: %.1f KB, visibility masks: %.1f MB\n",
+		totalObjectInstances,
+		totalObjectInstances * sizeof(Instance) / 1024.0,
+		static_cast<double>(meshInstancesCount) * sizeof(unsigned int) / (1024.0 * 1024.0));
+}
 
-	const unsigned int totalMeshInstances = instancesCountX * instancesCountZ;
+CPURasterizer::SceneBuffers Scene::GetCPURasterizerBuffers() const
+{
+	CPURasterizer::SceneBuffers buffers;
+	buffers.positions = positionsCPU.data();
+	buffers.normals = reinterpret_cast<const unsigned int*>(normalsCPU.data());
+	buffers.colors = reinterpret_cast<const unsigned int*>(colorsCPU.data());
+#if defined(MESHLET_INDICES)
+	buffers.indices = meshletIndicesCPU.data();
+#elif defined(GPU_SOA_BUFFERS)
+	buffers.indices = indicesSOACPU.data();
+#else
+	buffers.indices = indicesCPU.data();
+#endif
+	buffers.totalTriangles = static_cast<unsigned int>(indicesCPU.size() / 3);
+	buffers.instances = reinterpret_cast<const CPURasterizer::Instance*>(instancesCPU.data());
 
-	totalFacesCount += facesCount * totalMeshInstances;
+	return buffers;
+}
 
-	unsigned int newInstancesOffset = static_cast<unsigned int>(instancesCPU.size());
-	instancesCPU.resize(instancesCPU.size() + newPrefab.meshesCount * instancesCountX * instancesCountZ);
-	for (unsigned int mesh = 0; mesh < newPrefab.meshesCount; mesh++)
+void Scene::GetCPURasterizerCommands(std::vector<CPURasterizer::IndirectCommand>& commands) const
+{
+	commands.clear();
+	for (const auto& prefab : prefabs)
 	{
-		unsigned int meshIndex = newPrefab.meshesOffset + mesh;
-		auto& currentMesh = meshesMetaCPU[meshIndex];
-		currentMesh.instanceCount = totalMeshInstances;
-		currentMesh.startInstanceLocation = newInstancesOffset + mesh * totalMeshInstances;
-		for (unsigned int instanceZ = 0; instanceZ < instancesCountZ; instanceZ++)
+		for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
 		{
-			for (unsigned int instanceX = 0; instanceX < instancesCountX; instanceX++)
-			{
-				XMMATRIX transform = XMMatrixTranslation(
-					(translation + objectBoundingVolume.extents.x * 2.0f) *
-					instanceX,
-					0.0f,
-					(translation + objectBoundingVolume.extents.z * 2.0f) *
-					instanceZ);
-
-				Instance& instance = instancesCPU[currentMesh.startInstanceLocation + instanceZ * instancesCountX + instanceX];
-				XMStoreFloat4x4(&instance.worldTransform, transform);
-				instance.meshID = meshIndex;
-				instance.color =
-				{
-					static_cast<float>(meshIndex & 1),
-					static_cast<float>(meshIndex & 3) / 4,
-					static_cast<float>(meshIndex & 7) / 8
-				};
-
-				sceneAABB = Utils::MergeAABBs(sceneAABB, Utils::TransformAABB(objectBoundingVolume, transform));
-			}
+			CPURasterizer::IndirectCommand command = GetCPURasterizerCommand(prefab.meshesOffset + mesh);
+			command.startInstanceLocation = prefab.objectsOffset;
+			command.args.instanceCount = prefab.objectsCount;
+			command.args.startInstanceLocation = prefab.objectsOffset;
+			commands.push_back(command);
 		}
 	}
 }
 
+CPURasterizer::IndirectCommand Scene::GetCPURasterizerCommand(unsigned int mesh) const
+{
+	const MeshMeta& currentMesh = meshesMetaCPU[mesh];
+
+	CPURasterizer::IndirectCommand command = {};
+#ifdef QUANTIZED_POSITIONS
+	memcpy(&command.positionsOrigin, &currentMesh.positionsOrigin, sizeof(command.positionsOrigin));
+	memcpy(&command.positionsScale, &currentMesh.positionsScale, sizeof(command.positionsScale));
+#endif
+	command.meshID = mesh;
+	command.args.indexCountPerInstance = currentMesh.indexCountPerInstance;
+	command.args.instanceCount = 1;
+	command.args.startIndexLocation = currentMesh.startIndexLocation;
+	command.args.baseVertexLocation = currentMesh.baseVertexLocation;
+#ifdef MESHLET_INDICES
+	command.startMeshletVertexLocation = currentMesh.startMeshletVertexLocation;
+	command.startMeshletTriangleLocation = currentMesh.startMeshletTriangleLocation;
+#endif
+
+	return command;
+}
+
 void Scene::_createVBResources(ScenesIndices sceneIndex)
 {
 	positionsGPU.Initialize(
@@ -551,6 +1121,17 @@ void Scene::_createIBResources(ScenesIndices sceneIndex)
 		IndicesSOASRV + sceneIndex,
 		L"IndicesSOA");
 #endif
+
+#ifdef MESHLET_INDICES
+	meshletIndicesGPU.Initialize(
+		COMMAND_LIST.Get(),
+		meshletIndicesCPU.data(),
+		meshletIndicesCPU.size(),
+		sizeof(decltype(meshletIndicesCPU)::value_type),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		MeshletIndicesSRV + sceneIndex,
+		L"MeshletIndices");
+#endif
 }
 
 void Scene::_createMeshMetaResources(ScenesIndices sceneIndex)
@@ -575,4 +1156,37 @@ void Scene::_createInstancesBufferResources(ScenesIndices sceneIndex)
 		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
 		InstancesSRV + sceneIndex,
 		L"Instances");
+}
+
+void Scene::_createSWRCommandsResources(ScenesIndices sceneIndex)
+{
+	std::vector<CPURasterizer::IndirectCommand> commands;
+	GetCPURasterizerCommands(commands);
+
+	SWRCommandsCPU.clear();
+	for (const CPURasterizer::IndirectCommand& command : commands)
+	{
+		IndirectCommand result;
+		memcpy(&result, &command, sizeof(result));
+#ifdef INSTANCE_SLICES
+		unsigned int instanceCount = command.args.instanceCount;
+		for (unsigned int firstInstance = 0; firstInstance < instanceCount; firstInstance += INSTANCES_PER_SLICE)
+		{
+			result.startInstanceLocation = command.startInstanceLocation + firstInstance;
+			result.arguments.InstanceCount = std::min(instanceCount - firstInstance, static_cast<unsigned int>(INSTANCES_PER_SLICE));
+			SWRCommandsCPU.push_back(result);
+		}
+#else
+		SWRCommandsCPU.push_back(result);
+#endif
+	}
+
+	SWRCommandsGPU.Initialize(
+		COMMAND_LIST.Get(),
+		SWRCommandsCPU.data(),
+		SWRCommandsCPU.size(),
+		sizeof(decltype(SWRCommandsCPU)::value_type),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		SWRCommandsSRV + sceneIndex,
+		L"SWRCommands");
 }
\ No newline at end of file
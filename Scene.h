@@ -3,6 +3,7 @@
 #include "Camera.h"
 #include "Settings.h"
 #include "DX.h"
+#include "CPURasterizer.h"
 
 class Scene
 {
@@ -15,6 +16,13 @@ public:
 	void LoadPlant();
 	void LoadBuddha();
 
+	// views of the CPU buffers, as the SW rasterizer binds them
+	CPURasterizer::SceneBuffers GetCPURasterizerBuffers() const;
+	// a command per mesh, drawing every object of its prefab, as with culling disabled
+	void GetCPURasterizerCommands(std::vector<CPURasterizer::IndirectCommand>& commands) const;
+	// geometry of a single mesh, instances are left for the caller
+	CPURasterizer::IndirectCommand GetCPURasterizerCommand(unsigned int mesh) const;
+
 	Camera camera;
 	float FOV = 90.0f;
 	float nearZ = Settings::CameraNearZ;
@@ -31,19 +39,30 @@ public:
 	std::vector<unsigned int> indicesCPU;
 #ifdef GPU_SOA_BUFFERS
 	std::vector<unsigned int> indicesSOACPU;
+#endif
+#ifdef MESHLET_INDICES
+	// per-meshlet vertex lists and packed 8-bit triangles, see MeshMeta
+	std::vector<unsigned int> meshletIndicesCPU;
 #endif
 	// mesh is a smallest entity with it's own bounding volume
 	std::vector<MeshMeta> meshesMetaCPU;
-	// unique objects in the scene
+	// unique objects in the scene, each one places a whole prefab
 	std::vector<Instance> instancesCPU;
+	// what the SW rasterizer draws with culling disabled, GetCPURasterizerCommands, sliced as GenerateCommandsCS does
+	std::vector<IndirectCommand> SWRCommandsCPU;
 
 	std::vector<Prefab> prefabs;
 
 	static size_t MaxSceneFacesCount;
+	// (object, mesh) pairs, see meshInstancesCount
 	static size_t MaxSceneInstancesCount;
 	static size_t MaxSceneMeshesMetaCount;
+	static size_t MaxSceneObjectsCount;
+	static size_t MaxScenePrefabsCount;
 
 	size_t totalFacesCount = 0;
+	// (object, mesh) pairs, which culling expands instances to, a visibility mask each
+	size_t meshInstancesCount = 0;
 	AABB sceneAABB;
 
 	// GPU Resources
@@ -57,9 +76,13 @@ public:
 	Utils::GPUBuffer indicesGPU;
 	Utils::GPUBuffer meshesMetaGPU;
 	Utils::GPUBuffer instancesGPU;
+	Utils::GPUBuffer SWRCommandsGPU;
 #ifdef GPU_SOA_BUFFERS
 	Utils::GPUBuffer indicesSOAGPU;
 #endif
+#ifdef MESHLET_INDICES
+	Utils::GPUBuffer meshletIndicesGPU;
+#endif
 
 private:
 
@@ -69,9 +92,18 @@ private:
 		float scale = 1.0f,
 		unsigned int instancesCountX = 1,
 		unsigned int instancesCountZ = 1);
+	// parses OBJ and builds meshlets, returns faces count
+	size_t _cookObj(const std::string& OBJPath, float scale);
+	// places the prefab on a grid, fills its objects range
+	void _generateInstances(
+		unsigned int prefabID,
+		float translation,
+		unsigned int instancesCountX,
+		unsigned int instancesCountZ);
 
 	void _createVBResources(ScenesIndices sceneIndex);
 	void _createIBResources(ScenesIndices sceneIndex);
 	void _createMeshMetaResources(ScenesIndices sceneIndex);
 	void _createInstancesBufferResources(ScenesIndices sceneIndex);
+	void _createSWRCommandsResources(ScenesIndices sceneIndex);
 };
\ No newline at end of file
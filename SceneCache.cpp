@@ -0,0 +1,257 @@
+#include "SceneCache.h"
+#include "Scene.h"
+#include "Utils.h"
+
+#include <fstream>
+
+namespace SceneCache
+{
+
+static const unsigned int Magic = 0x4353524B; // "KRSC"
+
+enum CachedArrays
+{
+	Positions,
+	Normals,
+	Colors,
+	Texcoords,
+	Indices,
+	IndicesSOA,
+	MeshletIndices,
+	MeshesMeta,
+	Prefabs,
+	CachedArraysCount
+};
+
+struct Header
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long key;
+	unsigned long long payloadHash;
+	unsigned long long facesCount;
+	unsigned long long counts[CachedArraysCount];
+};
+
+struct ArrayView
+{
+	void* data;
+	size_t count;
+	size_t stride;
+};
+
+template<typename T>
+static ArrayView View(const std::vector<T>& v)
+{
+	return { const_cast<T*>(v.data()), v.size(), sizeof(T) };
+}
+
+static void GetArrays(const Scene& scene, ArrayView (&arrays)[CachedArraysCount])
+{
+	arrays[Positions] = View(scene.positionsCPU);
+	arrays[Normals] = View(scene.normalsCPU);
+	arrays[Colors] = View(scene.colorsCPU);
+	arrays[Texcoords] = View(scene.texcoordsCPU);
+	arrays[Indices] = View(scene.indicesCPU);
+#ifdef GPU_SOA_BUFFERS
+	arrays[IndicesSOA] = View(scene.indicesSOACPU);
+#else
+	arrays[IndicesSOA] = { nullptr, 0, sizeof(unsigned int) };
+#endif
+#ifdef MESHLET_INDICES
+	arrays[MeshletIndices] = View(scene.meshletIndicesCPU);
+#else
+	arrays[MeshletIndices] = { nullptr, 0, sizeof(unsigned int) };
+#endif
+	arrays[MeshesMeta] = View(scene.meshesMetaCPU);
+	arrays[Prefabs] = View(scene.prefabs);
+}
+
+static void ResizeArrays(Scene& scene, const Header& header)
+{
+	scene.positionsCPU.resize(header.counts[Positions]);
+	scene.normalsCPU.resize(header.counts[Normals]);
+	scene.colorsCPU.resize(header.counts[Colors]);
+	scene.texcoordsCPU.resize(header.counts[Texcoords]);
+	scene.indicesCPU.resize(header.counts[Indices]);
+#ifdef GPU_SOA_BUFFERS
+	scene.indicesSOACPU.resize(header.counts[IndicesSOA]);
+#endif
+#ifdef MESHLET_INDICES
+	scene.meshletIndicesCPU.resize(header.counts[MeshletIndices]);
+#endif
+	scene.meshesMetaCPU.resize(header.counts[MeshesMeta]);
+	scene.prefabs.resize(header.counts[Prefabs]);
+}
+
+unsigned long long Hash(const void* data, size_t sizeInBytes, unsigned long long seed)
+{
+	// FNV-1a over 64-bit words, the tail is processed bytewise
+	const unsigned long long prime = 1099511628211ull;
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	unsigned long long hash = seed;
+
+	size_t wordsCount = sizeInBytes / sizeof(unsigned long long);
+	for (size_t word = 0; word < wordsCount; word++)
+	{
+		unsigned long long value;
+		memcpy(&value, bytes + word * sizeof(value), sizeof(value));
+		hash = (hash ^ value) * prime;
+	}
+
+	for (size_t byte = wordsCount * sizeof(unsigned long long); byte < sizeInBytes; byte++)
+	{
+		hash = (hash ^ bytes[byte]) * prime;
+	}
+
+	return hash;
+}
+
+unsigned long long ComputeKey(
+	const std::string& sourcePath,
+	float translation,
+	float scale,
+	unsigned int instancesCountX,
+	unsigned int instancesCountZ)
+{
+	unsigned long long key = Hash(&Version, sizeof(Version));
+
+	std::ifstream source(sourcePath, std::ios::binary);
+	if (!source)
+	{
+		return 0;
+	}
+
+	std::vector<char> chunk(64 * 1024 * 1024);
+	while (source)
+	{
+		source.read(chunk.data(), chunk.size());
+		key = Hash(chunk.data(), static_cast<size_t>(source.gcount()), key);
+	}
+
+	struct
+	{
+		float translation;
+		float scale;
+		unsigned int instancesCountX;
+		unsigned int instancesCountZ;
+		unsigned int meshletSize;
+		unsigned int SOAIndices;
+		unsigned int meshletIndices;
+		unsigned int streamingIngestion;
+		unsigned int positionStride;
+		unsigned int meshMetaStride;
+	} parameters =
+	{
+		translation,
+		scale,
+		instancesCountX,
+		instancesCountZ,
+		MESHLET_SIZE,
+#ifdef GPU_SOA_BUFFERS
+		1,
+#else
+		0,
+#endif
+#ifdef MESHLET_INDICES
+		1,
+#else
+		0,
+#endif
+		Settings::StreamingOBJIngestion ? 1u : 0u,
+		sizeof(VertexPosition),
+		sizeof(MeshMeta)
+	};
+
+	return Hash(&parameters, sizeof(parameters), key);
+}
+
+bool Load(
+	const std::string& cachePath,
+	unsigned long long key,
+	Scene& scene,
+	size_t& facesCount)
+{
+	std::ifstream file(cachePath, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	Header header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file ||
+		header.magic != Magic ||
+		header.version != Version ||
+		header.key != key)
+	{
+		PrintToOutput("Scene cache %s is stale, rebuilding\n", cachePath.c_str());
+		return false;
+	}
+
+	ResizeArrays(scene, header);
+
+	ArrayView arrays[CachedArraysCount];
+	GetArrays(scene, arrays);
+
+	unsigned long long payloadHash = Hash(nullptr, 0);
+	for (const auto& array : arrays)
+	{
+		size_t sizeInBytes = array.count * array.stride;
+		file.read(static_cast<char*>(array.data), sizeInBytes);
+		payloadHash = Hash(array.data, sizeInBytes, payloadHash);
+	}
+
+	if (!file || payloadHash != header.payloadHash)
+	{
+		PrintToOutput("Scene cache %s is corrupted, rebuilding\n", cachePath.c_str());
+
+		header = {};
+		ResizeArrays(scene, header);
+
+		return false;
+	}
+
+	facesCount = static_cast<size_t>(header.facesCount);
+
+	return true;
+}
+
+void Save(
+	const std::string& cachePath,
+	unsigned long long key,
+	const Scene& scene,
+	size_t facesCount)
+{
+	ArrayView arrays[CachedArraysCount];
+	GetArrays(scene, arrays);
+
+	Header header = {};
+	header.magic = Magic;
+	header.version = Version;
+	header.key = key;
+	header.payloadHash = Hash(nullptr, 0);
+	header.facesCount = facesCount;
+	for (unsigned int array = 0; array < CachedArraysCount; array++)
+	{
+		header.counts[array] = arrays[array].count;
+		header.payloadHash = Hash(
+			arrays[array].data,
+			arrays[array].count * arrays[array].stride,
+			header.payloadHash);
+	}
+
+	std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const auto& array : arrays)
+	{
+		file.write(static_cast<const char*>(array.data), array.count * array.stride);
+	}
+
+	if (!file)
+	{
+		PrintToOutput("Failed to write scene cache %s\n", cachePath.c_str());
+	}
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Common.h"
+
+class Scene;
+
+// cooked scene geometry, so startup doesn't have to re-parse OBJ files
+// and rebuild meshlets every launch
+namespace SceneCache
+{
+
+// bump whenever the layout of any cached array changes
+static const unsigned int Version = 3;
+
+unsigned long long Hash(
+	const void* data,
+	size_t sizeInBytes,
+	unsigned long long seed = 14695981039346656037ull);
+
+// hash of the source file contents and everything that affects the cooked data
+unsigned long long ComputeKey(
+	const std::string& sourcePath,
+	float translation,
+	float scale,
+	unsigned int instancesCountX,
+	unsigned int instancesCountZ);
+
+// fills scene geometry arrays, returns false on any mismatch
+bool Load(
+	const std::string& cachePath,
+	unsigned long long key,
+	Scene& scene,
+	size_t& facesCount);
+
+void Save(
+	const std::string& cachePath,
+	unsigned long long key,
+	const Scene& scene,
+	size_t facesCount);
+
+}
@@ -18,10 +18,16 @@ bool Settings::FrustumCullingEnabled = true;
 bool Settings::CameraHiZCullingEnabled = true;
 bool Settings::ShadowsHiZCullingEnabled = true;
 bool Settings::ClusterBackfaceCullingEnabled = true;
+bool Settings::HierarchicalCullingEnabled = true;
+bool Settings::CPUOcclusionCullingEnabled = false;
+unsigned int Settings::CPUOccludersTrianglesBudget = 1 << 15;
 bool Settings::SWREnabled = false;
 bool Settings::SWRWGEnabled = false;
+bool Settings::ClusterRoutingEnabled = false;
 bool Settings::ShowMeshlets = false;
 bool Settings::FreezeCulling = false;
+unsigned int Settings::LoadingThreadsCount = 0;
+bool Settings::StreamingOBJIngestion = true;
 const float Settings::CameraNearZ = 0.001f;
 const float Settings::CameraFarZ = 10000.0f;
 const float Settings::GUITransparency = 0.7f;
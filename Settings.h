@@ -17,6 +17,9 @@ public:
 	// TODO: eliminate hardcode
 	static const int ShadowMapMipsCount = 12;
 	static const int CameraCount = 1;
+	// culled instances of all the frustums together, the compaction packs the visible ones,
+	// so it's bounded by what's visible, not by the (object, mesh) pairs, the ones past it aren't drawn
+	static const unsigned int MaxVisibleInstancesCount = 1 << 20;
 	static int CascadesCount;
 	static int FrustumsCount;
 	static bool CullingEnabled;
@@ -24,10 +27,29 @@ public:
 	static bool CameraHiZCullingEnabled;
 	static bool ShadowsHiZCullingEnabled;
 	static bool ClusterBackfaceCullingEnabled;
+	// reject whole objects by their prefab bounds before testing meshlets
+	static bool HierarchicalCullingEnabled;
+	// masked occlusion buffer of the current frame occluders, CPU side,
+	// the objects it occludes skip the camera in the GPU culling
+	static bool CPUOcclusionCullingEnabled;
+	static unsigned int CPUOccludersTrianglesBudget;
+	static const int CPUOcclusionWidth = 320;
+	static const int CPUOcclusionHeight = 180;
 	static bool SWREnabled;
 	static bool SWRWGEnabled;
+	// the culling routes the camera visible meshlets to the SW triangles, SW big triangles or HW passes
+	// of the SW frame, see CLUSTER_ROUTE_SOFTWARE_MICRO, the work graphs only draw the camera list
+	static bool ClusterRoutingEnabled;
+	static bool ClusterRouting()
+	{
+		return ClusterRoutingEnabled && CullingEnabled && SWREnabled && !SWRWGEnabled;
+	}
 	static bool ShowMeshlets;
 	static bool FreezeCulling;
+	// 0 means all hardware threads
+	static unsigned int LoadingThreadsCount;
+	// dedupe OBJ vertices while reading faces, instead of expanding every face corner first
+	static bool StreamingOBJIngestion;
 	static const float CameraNearZ;
 	static const float CameraFarZ;
 	static const float GUITransparency;
@@ -252,7 +252,7 @@ void Shadows::_createPSO()
 {
 	CD3DX12_ROOT_PARAMETER1 rootParameters[4] = {};
 	rootParameters[0].InitAsConstantBufferView(0);
-	rootParameters[1].InitAsConstants(1, 1);
+	rootParameters[1].InitAsConstants(DRAW_CALL_CONSTANTS, 1);
 	CD3DX12_DESCRIPTOR_RANGE1 ranges[2] = {};
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -314,7 +314,7 @@ void Shadows::_createPSO()
 		{
 			"POSITION",
 			0,
-			DXGI_FORMAT_R32G32B32_FLOAT,
+			VertexPositionFormat,
 			0,
 			0,
 			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
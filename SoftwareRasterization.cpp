@@ -1,7 +1,13 @@
 #include "SoftwareRasterization.h"
+#include "BigTriangleTuning.h"
 #include "DescriptorManager.h"
 #include "ForwardRenderer.h"
 #include "imgui.h"
+#include "Scene.h"
+
+#include <chrono>
+#include <cstring>
+#include <utility>
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -16,7 +22,9 @@ struct SWRDepthSceneCB
 	int useTopLeftRule;
 	int scanlineRasterization;
 	unsigned int totalTriangles;
-	int pad[39];
+	// big triangles buffer, for the statistics
+	unsigned int frustumIndex;
+	int pad[38];
 };
 static_assert(
 	(sizeof(SWRDepthSceneCB) % 256) == 0,
@@ -46,6 +54,26 @@ static_assert(
 	(sizeof(SWRSceneCB) % 256) == 0,
 	"Constant Buffer size must be 256-byte aligned");
 
+// TOP_LEFT_RULE and SCANLINE_RASTERIZATION of a permutation, see _getRasterizationPermutation(),
+// plus OPAQUE for the opaque passes, null terminated
+static void GetRasterizationDefines(int permutation, bool opaque, D3D_SHADER_MACRO defines[4])
+{
+	int count = 0;
+	if (opaque)
+	{
+		defines[count++] = { "OPAQUE", "1" };
+	}
+	if (permutation & 1)
+	{
+		defines[count++] = { "TOP_LEFT_RULE", "1" };
+	}
+	if (permutation & 2)
+	{
+		defines[count++] = { "SCANLINE_RASTERIZATION", "1" };
+	}
+	defines[count] = { nullptr, nullptr };
+}
+
 struct BigTriangleDepth
 {
 	float tileOffset;
@@ -86,6 +114,16 @@ struct BigTriangleOpaque
 	unsigned int packedUV2;
 };
 
+// COMPACT_BIG_TRIANGLES layout, the records are a separate region of the same buffer
+struct BigTriangleTile
+{
+	float tileOffset;
+	unsigned int record;
+};
+static_assert(
+	sizeof(BigTriangleTile) == BIG_TRIANGLE_TILE_FIELDS * sizeof(unsigned int),
+	"Big triangle tile entry must match BIG_TRIANGLE_TILE_FIELDS");
+
 void SoftwareRasterization::Resize(
 	ForwardRenderer* renderer,
 	int width,
@@ -100,19 +138,21 @@ void SoftwareRasterization::Resize(
 	_createBigTriangleDepthPSO();
 	_createTriangleOpaquePSO();
 	_createBigTriangleOpaquePSO();
+	_createRoutedClustersPSOs();
 	_createRenderTargetResources();
 	_createDepthBufferResources();
 
-	// depth CBV
-	_depthSceneCBFrameSize = sizeof(SWRDepthSceneCB) * MAX_FRUSTUMS_COUNT;
+	// depth CBV, a frustum each, then the SW big meshlets one, see SOFTWARE_BIG_CULLING_LIST
+	_depthSceneCBFrameSize = sizeof(SWRDepthSceneCB) * (MAX_FRUSTUMS_COUNT + 1);
 	Utils::CreateCBResources(
 		_depthSceneCBFrameSize * DX::FramesCount,
 		reinterpret_cast<void**>(&_depthSceneCBData),
 		_depthSceneCB);
 
-	//opaque CBV
+	//opaque CBV, then the SW big meshlets one
+	_sceneCBFrameSize = sizeof(SWRSceneCB) * 2;
 	Utils::CreateCBResources(
-		sizeof(SWRSceneCB) * DX::FramesCount,
+		_sceneCBFrameSize * DX::FramesCount,
 		reinterpret_cast<void**>(&_sceneCBData),
 		_sceneCB);
 
@@ -121,6 +161,12 @@ void SoftwareRasterization::Resize(
 	_createStatsResources();
 	_createResetBuffer();
 
+	if (!_smallTrianglesProfiler)
+	{
+		_smallTrianglesProfiler = std::make_unique<Profiler>();
+		_bigTrianglesProfiler = std::make_unique<Profiler>();
+	}
+
 #ifdef USE_WORK_GRAPHS
 	_createDepthWGResources();
 	_createOpaqueWGResources();
@@ -153,6 +199,24 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 	}
 	//int bigTrianglesPerFrame = Scene::MaxSceneFacesCount * sizeof(BigTriangle);
 
+	// COMPACT_BIG_TRIANGLES, the tile entries shrink to BigTriangleTile and the records get their own buffers,
+	// as many as the tile entries, since a triangle over the threshold can still cover a single tile,
+	// without it, the records buffers are unused, a record each, so their views are valid
+#ifdef COMPACT_BIG_TRIANGLES
+	const UINT depthTileSize = sizeof(BigTriangleTile);
+	const UINT opaqueTileSize = sizeof(BigTriangleTile);
+	const bool compact = true;
+#else
+	const UINT depthTileSize = sizeof(BigTriangleDepth);
+	const UINT opaqueTileSize = sizeof(BigTriangleOpaque);
+	const bool compact = false;
+#endif
+	int recordsPerFrame[MAX_FRUSTUMS_COUNT];
+	for (int frustum = 0; frustum < MAX_FRUSTUMS_COUNT; frustum++)
+	{
+		recordsPerFrame[frustum] = compact ? bigTrianglesPerFrame[frustum] : 1;
+	}
+
 	static D3D12_DISPATCH_ARGUMENTS dispatch;
 	dispatch.ThreadGroupCountX = 0;
 	dispatch.ThreadGroupCountY = 1;
@@ -175,7 +239,7 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 
 		CD3DX12_RESOURCE_DESC desc =
 			CD3DX12_RESOURCE_DESC::Buffer(
-				bigTrianglesPerFrame[depthBufferIdx] * sizeof(BigTriangleDepth),
+				bigTrianglesPerFrame[depthBufferIdx] * depthTileSize,
 				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
 		auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
@@ -193,7 +257,7 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 		UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 		UAVDesc.Buffer.FirstElement = 0;
 		UAVDesc.Buffer.NumElements = bigTrianglesPerFrame[depthBufferIdx];
-		UAVDesc.Buffer.StructureByteStride = sizeof(BigTriangleDepth);
+		UAVDesc.Buffer.StructureByteStride = depthTileSize;
 		UAVDesc.Buffer.CounterOffsetInBytes = 0;
 		UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 		DX::Device->CreateUnorderedAccessView(
@@ -207,7 +271,7 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 		SRVDesc.Format = DXGI_FORMAT_UNKNOWN;
 		SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
 		SRVDesc.Buffer.FirstElement = 0;
-		SRVDesc.Buffer.NumElements = bigTrianglesPerFrame[depthBufferIdx] * BIG_TRIANGLE_DEPTH_FIELDS;
+		SRVDesc.Buffer.NumElements = bigTrianglesPerFrame[depthBufferIdx] * depthTileSize / sizeof(unsigned int);
 		// uint view for parallel reads in the BigTriangle*CS.hlsl
 		SRVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
 		SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
@@ -215,6 +279,14 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 			_bigTrianglesDepth[depthBufferIdx].Get(),
 			&SRVDesc,
 			Descriptors::SV.GetCPUHandle(BigTrianglesDepthSRV + depthBufferIdx));
+
+		_createBigTriangleRecords(
+			_bigTriangleRecordsDepth[depthBufferIdx],
+			recordsPerFrame[depthBufferIdx],
+			BIG_TRIANGLE_DEPTH_RECORD_FIELDS,
+			BigTrianglesDepthRecordsSRV + depthBufferIdx,
+			BigTrianglesDepthRecordsUAV + depthBufferIdx);
+		NAME_D3D12_OBJECT_INDEXED(_bigTriangleRecordsDepth, depthBufferIdx);
 	}
 
 	// resources and views for the big triangles going to the opaque buffer
@@ -232,7 +304,7 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 
 	CD3DX12_RESOURCE_DESC desc =
 		CD3DX12_RESOURCE_DESC::Buffer(
-			bigTrianglesPerFrame[0] * sizeof(BigTriangleOpaque),
+			bigTrianglesPerFrame[0] * opaqueTileSize,
 			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
 	auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
@@ -250,7 +322,7 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 	UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 	UAVDesc.Buffer.FirstElement = 0;
 	UAVDesc.Buffer.NumElements = bigTrianglesPerFrame[0];
-	UAVDesc.Buffer.StructureByteStride = sizeof(BigTriangleOpaque);
+	UAVDesc.Buffer.StructureByteStride = opaqueTileSize;
 	UAVDesc.Buffer.CounterOffsetInBytes = 0;
 	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
 	DX::Device->CreateUnorderedAccessView(
@@ -264,7 +336,7 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 	SRVDesc.Format = DXGI_FORMAT_UNKNOWN;
 	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
 	SRVDesc.Buffer.FirstElement = 0;
-	SRVDesc.Buffer.NumElements = bigTrianglesPerFrame[0] * BIG_TRIANGLE_OPAQUE_FIELDS;
+	SRVDesc.Buffer.NumElements = bigTrianglesPerFrame[0] * opaqueTileSize / sizeof(unsigned int);
 	// uint view for parallel reads in the BigTriangle*CS.hlsl
 	SRVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
 	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
@@ -272,6 +344,65 @@ void SoftwareRasterization::_createBigTrianglesBuffers()
 		_bigTrianglesOpaque.Get(),
 		&SRVDesc,
 		Descriptors::SV.GetCPUHandle(BigTrianglesOpaqueSRV));
+
+	_createBigTriangleRecords(
+		_bigTriangleRecordsOpaque,
+		recordsPerFrame[0],
+		BIG_TRIANGLE_OPAQUE_RECORD_FIELDS,
+		BigTrianglesOpaqueRecordsSRV,
+		BigTrianglesOpaqueRecordsUAV);
+	NAME_D3D12_OBJECT(_bigTriangleRecordsOpaque);
+}
+
+void SoftwareRasterization::_createBigTriangleRecords(
+	ComPtr<ID3D12Resource>& records,
+	int recordsCount,
+	int recordFields,
+	int SRVIndex,
+	int UAVIndex)
+{
+	UINT fieldsCount = recordsCount * recordFields;
+
+	CD3DX12_RESOURCE_DESC desc =
+		CD3DX12_RESOURCE_DESC::Buffer(
+			fieldsCount * sizeof(unsigned int),
+			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+	auto prop = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	SUCCESS(DX::Device->CreateCommittedResource(
+		&prop,
+		D3D12_HEAP_FLAG_NONE,
+		&desc,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		nullptr,
+		IID_PPV_ARGS(&records)));
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
+	UAVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	UAVDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+	UAVDesc.Buffer.FirstElement = 0;
+	UAVDesc.Buffer.NumElements = fieldsCount;
+	UAVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
+	UAVDesc.Buffer.CounterOffsetInBytes = 0;
+	UAVDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+	DX::Device->CreateUnorderedAccessView(
+		records.Get(),
+		nullptr,
+		&UAVDesc,
+		Descriptors::SV.GetCPUHandle(UAVIndex));
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
+	SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	SRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	SRVDesc.Buffer.FirstElement = 0;
+	SRVDesc.Buffer.NumElements = fieldsCount;
+	SRVDesc.Buffer.StructureByteStride = sizeof(unsigned int);
+	SRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+	DX::Device->CreateShaderResourceView(
+		records.Get(),
+		&SRVDesc,
+		Descriptors::SV.GetCPUHandle(SRVIndex));
 }
 
 void SoftwareRasterization::_createStatsResources()
@@ -333,6 +464,23 @@ void SoftwareRasterization::_createMDIResources()
 		nullptr,
 		IID_PPV_ARGS(&_dispatchCS)));
 	NAME_D3D12_OBJECT(_dispatchCS);
+
+	D3D12_INDIRECT_ARGUMENT_DESC drawArgumentDescs[2] = {};
+	drawArgumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	drawArgumentDescs[0].Constant.RootParameterIndex = 1;
+	drawArgumentDescs[0].Constant.DestOffsetIn32BitValues = 0;
+	drawArgumentDescs[0].Constant.Num32BitValuesToSet = DRAW_CALL_CONSTANTS;
+	drawArgumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	commandSignatureDesc.pArgumentDescs = drawArgumentDescs;
+	commandSignatureDesc.NumArgumentDescs = _countof(drawArgumentDescs);
+	commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+
+	SUCCESS(DX::Device->CreateCommandSignature(
+		&commandSignatureDesc,
+		_routedClustersRS.Get(),
+		IID_PPV_ARGS(&_routedClustersCS)));
+	NAME_D3D12_OBJECT(_routedClustersCS);
 }
 
 #ifdef USE_WORK_GRAPHS
@@ -352,9 +500,9 @@ void SoftwareRasterization::_createDepthWGResources()
 	lib->SetDXILLibrary(&libraryCode);
 
 	{
-		CD3DX12_ROOT_PARAMETER1 computeRootParameters[9] = {};
+		CD3DX12_ROOT_PARAMETER1 computeRootParameters[10] = {};
 		computeRootParameters[0].InitAsConstantBufferView(0);
-		CD3DX12_DESCRIPTOR_RANGE1 ranges[8] = {};
+		CD3DX12_DESCRIPTOR_RANGE1 ranges[9] = {};
 
 		ranges[0].Init(
 			D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -404,6 +552,12 @@ void SoftwareRasterization::_createDepthWGResources()
 			2);
 		computeRootParameters[8].InitAsDescriptorTable(1, &ranges[7]);
 
+		ranges[8].Init(
+			D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+			1,
+			3);
+		computeRootParameters[9].InitAsDescriptorTable(1, &ranges[8]);
+
 		CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC computeRootSignatureDesc;
 		computeRootSignatureDesc.Init_1_1(
 			_countof(computeRootParameters),
@@ -476,9 +630,9 @@ void SoftwareRasterization::_createOpaqueWGResources()
 	lib->SetDXILLibrary(&libraryCode);
 
 	{
-		CD3DX12_ROOT_PARAMETER1 computeRootParameters[14] = {};
+		CD3DX12_ROOT_PARAMETER1 computeRootParameters[15] = {};
 		computeRootParameters[0].InitAsConstantBufferView(0);
-		CD3DX12_DESCRIPTOR_RANGE1 ranges[13] = {};
+		CD3DX12_DESCRIPTOR_RANGE1 ranges[14] = {};
 
 		ranges[0].Init(
 			D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -558,6 +712,12 @@ void SoftwareRasterization::_createOpaqueWGResources()
 			2);
 		computeRootParameters[13].InitAsDescriptorTable(1, &ranges[12]);
 
+		ranges[13].Init(
+			D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+			1,
+			3);
+		computeRootParameters[14].InitAsDescriptorTable(1, &ranges[13]);
+
 		D3D12_STATIC_SAMPLER_DESC pointClampSampler = {};
 		pointClampSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_POINT;
 		pointClampSampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_BORDER;
@@ -634,6 +794,11 @@ void SoftwareRasterization::Update()
 {
 	const Camera& camera = Scene::CurrentScene->camera;
 
+	if (_recordCameraPath && _cameraPath.size() < MaxCameraPathFrames)
+	{
+		_cameraPath.push_back(camera.GetVP());
+	}
+
 	SWRDepthSceneCB depthData = {};
 	depthData.VP = camera.GetVP();
 	depthData.outputRes =
@@ -651,11 +816,22 @@ void SoftwareRasterization::Update()
 	depthData.useTopLeftRule = _useTopLeftRule ? 1 : 0;
 	depthData.scanlineRasterization = _scanlineRasterization ? 1 : 0;
 	depthData.totalTriangles = static_cast<unsigned>(Scene::CurrentScene->indicesCPU.size() / 3);
+	depthData.frustumIndex = 0;
 	memcpy(
 		_depthSceneCBData + DX::FrameIndex * _depthSceneCBFrameSize,
 		&depthData,
 		sizeof(SWRDepthSceneCB));
 
+	// the SW big meshlets, every triangle of theirs goes to the big triangles pass of the camera
+	depthData.bigTriangleThreshold = 0.0f;
+	memcpy(
+		_depthSceneCBData +
+		DX::FrameIndex * _depthSceneCBFrameSize +
+		SOFTWARE_BIG_CULLING_LIST * sizeof(SWRDepthSceneCB),
+		&depthData,
+		sizeof(SWRDepthSceneCB));
+	depthData.bigTriangleThreshold = static_cast<float>(_bigTriangleThreshold);
+
 	for (int cascade = 0; cascade < Settings::CascadesCount; cascade++)
 	{
 		depthData.VP = Shadows::Sun.GetCascadeVP(cascade);
@@ -669,6 +845,7 @@ void SoftwareRasterization::Update()
 			1.0f / depthData.outputRes.x,
 			1.0f / depthData.outputRes.y
 		};
+		depthData.frustumIndex = 1 + cascade;
 		memcpy(
 			_depthSceneCBData +
 			DX::FrameIndex * _depthSceneCBFrameSize +
@@ -709,7 +886,14 @@ void SoftwareRasterization::Update()
 	}
 
 	memcpy(
-		_sceneCBData + DX::FrameIndex * sizeof(SWRSceneCB),
+		_sceneCBData + DX::FrameIndex * _sceneCBFrameSize,
+		&sceneData,
+		sizeof(SWRSceneCB));
+
+	// the SW big meshlets
+	sceneData.bigTriangleThreshold = 0.0f;
+	memcpy(
+		_sceneCBData + DX::FrameIndex * _sceneCBFrameSize + sizeof(SWRSceneCB),
 		&sceneData,
 		sizeof(SWRSceneCB));
 }
@@ -731,13 +915,38 @@ void SoftwareRasterization::Draw()
 	}
 	else
 	{
+		// the opaque pass uses the same threshold, so the depth passes stand for it
+		bool measure = _tuneBigTrianglesOnGPU;
+		_measuredBigTriangleThreshold[DX::FrameIndex] = measure ? _bigTriangleThreshold : 0;
+
 		_beginFrame();
+		if (measure)
+		{
+			_smallTrianglesProfiler->BeginMeasure(COMMAND_LIST.Get());
+		}
 		_drawDepth();
 		_drawShadows();
+		if (measure)
+		{
+			_smallTrianglesProfiler->FinishMeasure(COMMAND_LIST.Get());
+			_bigTrianglesProfiler->BeginMeasure(COMMAND_LIST.Get());
+		}
 		_drawDepthBigTriangles();
 		_drawShadowsBigTriangles();
+		if (measure)
+		{
+			_bigTrianglesProfiler->FinishMeasure(COMMAND_LIST.Get());
+		}
+		if (Settings::ClusterRouting())
+		{
+			_drawRoutedClusters(false);
+		}
 		_finishDepthsRendering();
 		_drawOpaque();
+		if (Settings::ClusterRouting())
+		{
+			_drawRoutedClusters(true);
+		}
 		_endFrame();
 	}
 }
@@ -745,7 +954,7 @@ void SoftwareRasterization::Draw()
 void SoftwareRasterization::_beginFrame()
 {
 	CD3DX12_RESOURCE_BARRIER* barriers =
-		(CD3DX12_RESOURCE_BARRIER*)alloca((5 + 2 * Settings::FrustumsCount) * sizeof(CD3DX12_RESOURCE_BARRIER));
+		(CD3DX12_RESOURCE_BARRIER*)alloca((6 + 3 * Settings::FrustumsCount) * sizeof(CD3DX12_RESOURCE_BARRIER));
 	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
 		_trianglesStats.Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
@@ -790,18 +999,26 @@ void SoftwareRasterization::_beginFrame()
 		_bigTrianglesOpaqueCounter.Get(),
 		D3D12_RESOURCE_STATE_COPY_DEST,
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	barriers[5] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_bigTriangleRecordsOpaque.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 	for (int frustum = 0; frustum < Settings::FrustumsCount; frustum++)
 	{
-		barriers[5 + 2 * frustum] = CD3DX12_RESOURCE_BARRIER::Transition(
+		barriers[6 + 3 * frustum] = CD3DX12_RESOURCE_BARRIER::Transition(
 			_bigTrianglesDepth[frustum].Get(),
 			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
 			D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		barriers[5 + 2 * frustum + 1] = CD3DX12_RESOURCE_BARRIER::Transition(
+		barriers[6 + 3 * frustum + 1] = CD3DX12_RESOURCE_BARRIER::Transition(
 			_bigTrianglesDepthCounters[frustum].Get(),
 			D3D12_RESOURCE_STATE_COPY_DEST,
 			D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		barriers[6 + 3 * frustum + 2] = CD3DX12_RESOURCE_BARRIER::Transition(
+			_bigTriangleRecordsDepth[frustum].Get(),
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 	}
-	COMMAND_LIST->ResourceBarrier(5 + 2 * Settings::FrustumsCount, barriers);
+	COMMAND_LIST->ResourceBarrier(6 + 3 * Settings::FrustumsCount, barriers);
 
 	unsigned int clearValue[] = { 0, 0, 0, 0 };
 	COMMAND_LIST->ClearUnorderedAccessViewUint(
@@ -837,12 +1054,15 @@ void SoftwareRasterization::_drawDepth()
 	PIXBeginEvent(COMMAND_LIST.Get(), 0, L"SWR Depth");
 
 	COMMAND_LIST->SetComputeRootSignature(_triangleDepthRS.Get());
-	COMMAND_LIST->SetPipelineState(_triangleDepthPSO.Get());
+	COMMAND_LIST->SetPipelineState(_triangleDepthPSO[_getRasterizationPermutation()].Get());
 	COMMAND_LIST->SetComputeRootConstantBufferView(
 		0, _depthSceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _depthSceneCBFrameSize);
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		1, Scene::CurrentScene->positionsGPU.GetSRV());
-#ifdef GPU_SOA_BUFFERS
+#if defined(MESHLET_INDICES)
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		2, Scene::CurrentScene->meshletIndicesGPU.GetSRV());
+#elif defined(GPU_SOA_BUFFERS)
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		2, Scene::CurrentScene->indicesSOAGPU.GetSRV());
 #else
@@ -857,40 +1077,52 @@ void SoftwareRasterization::_drawDepth()
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		4, Descriptors::SV.GetGPUHandle(PrevFrameDepthSRV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
-		5, Descriptors::SV.GetGPUHandle(CulledCommandsSRV + DX::FrameIndex * PerFrameDescriptorsCount));
+		5,
+		Settings::CullingEnabled
+		? Descriptors::SV.GetGPUHandle(CulledCommandsSRV + DX::FrameIndex * PerFrameDescriptorsCount)
+		: Scene::CurrentScene->SWRCommandsGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		6, Descriptors::SV.GetGPUHandle(SWRDepthUAV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		7, Descriptors::SV.GetGPUHandle(BigTrianglesDepthUAV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		8, Descriptors::SV.GetGPUHandle(SWRStatsUAV));
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		9, Descriptors::SV.GetGPUHandle(BigTrianglesDepthRecordsUAV));
 
 	if (Settings::CullingEnabled)
 	{
 		COMMAND_LIST->ExecuteIndirect(
 			_dispatchCS.Get(),
 			1,
-			_renderer->GetCulledCommandsCounter(DX::FrameIndex, 0),
-			0,
+			_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+			_renderer->GetCulledCommandsCounterOffset(0),
 			nullptr,
 			0);
 	}
 	else
 	{
-		for (const auto& prefab : Scene::CurrentScene->prefabs)
-		{
-			for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
-			{
-				const auto& currentMesh = Scene::CurrentScene->meshesMetaCPU[prefab.meshesOffset + mesh];
-
-				_drawIndexedInstanced(
-					currentMesh.indexCountPerInstance,
-					currentMesh.instanceCount,
-					currentMesh.startIndexLocation,
-					currentMesh.baseVertexLocation,
-					currentMesh.startInstanceLocation);
-			}
-		}
+		_drawIndexedInstanced();
+	}
+
+	if (Settings::ClusterRouting())
+	{
+		COMMAND_LIST->SetComputeRootConstantBufferView(
+			0,
+			_depthSceneCB->GetGPUVirtualAddress() +
+			DX::FrameIndex * _depthSceneCBFrameSize +
+			SOFTWARE_BIG_CULLING_LIST * sizeof(SWRDepthSceneCB));
+		COMMAND_LIST->SetComputeRootDescriptorTable(
+			5,
+			Descriptors::SV.GetGPUHandle(
+				CulledCommandsSRV + SOFTWARE_BIG_CULLING_LIST + DX::FrameIndex * PerFrameDescriptorsCount));
+		COMMAND_LIST->ExecuteIndirect(
+			_dispatchCS.Get(),
+			1,
+			_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+			_renderer->GetCulledCommandsCounterOffset(SOFTWARE_BIG_CULLING_LIST),
+			nullptr,
+			0);
 	}
 
 	//CD3DX12_RESOURCE_BARRIER barriers[2] = {};
@@ -916,7 +1148,7 @@ void SoftwareRasterization::_drawShadows()
 	PIXBeginEvent(COMMAND_LIST.Get(), 0, L"SWR Shadows");
 
 	COMMAND_LIST->SetComputeRootSignature(_triangleDepthRS.Get());
-	COMMAND_LIST->SetPipelineState(_triangleDepthPSO.Get());
+	COMMAND_LIST->SetPipelineState(_triangleDepthPSO[_getRasterizationPermutation()].Get());
 	CD3DX12_RESOURCE_BARRIER barriers[2] = {};
 	for (int cascade = 1; cascade <= Settings::CascadesCount; cascade++)
 	{
@@ -924,7 +1156,10 @@ void SoftwareRasterization::_drawShadows()
 			0, _depthSceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _depthSceneCBFrameSize + cascade * sizeof(SWRDepthSceneCB));
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			1, Scene::CurrentScene->positionsGPU.GetSRV());
-#ifdef GPU_SOA_BUFFERS
+#if defined(MESHLET_INDICES)
+		COMMAND_LIST->SetComputeRootDescriptorTable(
+			2, Scene::CurrentScene->meshletIndicesGPU.GetSRV());
+#elif defined(GPU_SOA_BUFFERS)
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			2, Scene::CurrentScene->indicesSOAGPU.GetSRV());
 #else
@@ -934,46 +1169,37 @@ void SoftwareRasterization::_drawShadows()
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			3,
 			Settings::CullingEnabled
-			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + cascade + DX::FrameIndex * PerFrameDescriptorsCount)
+			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + DX::FrameIndex * PerFrameDescriptorsCount)
 			: Scene::CurrentScene->instancesGPU.GetSRV());
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			4, Descriptors::SV.GetGPUHandle(PrevFrameShadowMapSRV + cascade - 1));
 		COMMAND_LIST->SetComputeRootDescriptorTable(
-			5, Descriptors::SV.GetGPUHandle(CulledCommandsSRV + cascade + DX::FrameIndex * PerFrameDescriptorsCount));
+			5,
+			Settings::CullingEnabled
+			? Descriptors::SV.GetGPUHandle(CulledCommandsSRV + cascade + DX::FrameIndex * PerFrameDescriptorsCount)
+			: Scene::CurrentScene->SWRCommandsGPU.GetSRV());
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			6, Descriptors::SV.GetGPUHandle(SWRShadowMapUAV + cascade - 1));
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			7, Descriptors::SV.GetGPUHandle(BigTrianglesDepthUAV + cascade));
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			8, Descriptors::SV.GetGPUHandle(SWRStatsUAV));
+		COMMAND_LIST->SetComputeRootDescriptorTable(
+			9, Descriptors::SV.GetGPUHandle(BigTrianglesDepthRecordsUAV + cascade));
 
 		if (Settings::CullingEnabled)
 		{
 			COMMAND_LIST->ExecuteIndirect(
 				_dispatchCS.Get(),
 				1,
-				_renderer->GetCulledCommandsCounter(DX::FrameIndex, cascade),
-				0,
+				_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+				_renderer->GetCulledCommandsCounterOffset(cascade),
 				nullptr,
 				0);
 		}
 		else
 		{
-			for (const auto& prefab : Scene::CurrentScene->prefabs)
-			{
-				for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
-				{
-					const auto& currentMesh =
-						Scene::CurrentScene->meshesMetaCPU[prefab.meshesOffset + mesh];
-
-					_drawIndexedInstanced(
-						currentMesh.indexCountPerInstance,
-						currentMesh.instanceCount,
-						currentMesh.startIndexLocation,
-						currentMesh.baseVertexLocation,
-						currentMesh.startInstanceLocation);
-				}
-			}
+			_drawIndexedInstanced();
 		}
 
 		//barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
@@ -998,7 +1224,7 @@ void SoftwareRasterization::_drawDepthBigTriangles()
 {
 	PIXBeginEvent(COMMAND_LIST.Get(), 0, L"SWR Depth Big Triangles");
 
-	CD3DX12_RESOURCE_BARRIER barriers[2] = {};
+	CD3DX12_RESOURCE_BARRIER barriers[3] = {};
 	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
 		_bigTrianglesDepth[0].Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
@@ -1011,10 +1237,14 @@ void SoftwareRasterization::_drawDepthBigTriangles()
 		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT/*,
 		D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
 		D3D12_RESOURCE_BARRIER_FLAG_END_ONLY*/);
+	barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_bigTriangleRecordsDepth[0].Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	COMMAND_LIST->ResourceBarrier(_countof(barriers), barriers);
 
 	COMMAND_LIST->SetComputeRootSignature(_bigTriangleDepthRS.Get());
-	COMMAND_LIST->SetPipelineState(_bigTriangleDepthPSO.Get());
+	COMMAND_LIST->SetPipelineState(_bigTriangleDepthPSO[_getRasterizationPermutation()].Get());
 	COMMAND_LIST->SetComputeRootConstantBufferView(
 		0, _depthSceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _depthSceneCBFrameSize);
 	COMMAND_LIST->SetComputeRootDescriptorTable(
@@ -1026,6 +1256,8 @@ void SoftwareRasterization::_drawDepthBigTriangles()
 		: Scene::CurrentScene->instancesGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		3, Descriptors::SV.GetGPUHandle(SWRDepthUAV));
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		4, Descriptors::SV.GetGPUHandle(BigTrianglesDepthRecordsSRV));
 
 	COMMAND_LIST->ExecuteIndirect(
 		_dispatchCS.Get(),
@@ -1051,8 +1283,8 @@ void SoftwareRasterization::_drawShadowsBigTriangles()
 	PIXBeginEvent(COMMAND_LIST.Get(), 0, L"SWR Shadows Big Triangles");
 
 	COMMAND_LIST->SetComputeRootSignature(_bigTriangleDepthRS.Get());
-	COMMAND_LIST->SetPipelineState(_bigTriangleDepthPSO.Get());
-	CD3DX12_RESOURCE_BARRIER barriers[2] = {};
+	COMMAND_LIST->SetPipelineState(_bigTriangleDepthPSO[_getRasterizationPermutation()].Get());
+	CD3DX12_RESOURCE_BARRIER barriers[3] = {};
 	for (int cascade = 1; cascade <= Settings::CascadesCount; cascade++)
 	{
 		barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
@@ -1067,6 +1299,10 @@ void SoftwareRasterization::_drawShadowsBigTriangles()
 			D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT/*,
 			D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
 			D3D12_RESOURCE_BARRIER_FLAG_END_ONLY*/);
+		barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(
+			_bigTriangleRecordsDepth[cascade].Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 		COMMAND_LIST->ResourceBarrier(_countof(barriers), barriers);
 
 		COMMAND_LIST->SetComputeRootConstantBufferView(
@@ -1076,10 +1312,12 @@ void SoftwareRasterization::_drawShadowsBigTriangles()
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			2,
 			Settings::CullingEnabled
-			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + cascade + DX::FrameIndex * PerFrameDescriptorsCount)
+			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + DX::FrameIndex * PerFrameDescriptorsCount)
 			: Scene::CurrentScene->instancesGPU.GetSRV());
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			3, Descriptors::SV.GetGPUHandle(SWRShadowMapUAV + cascade - 1));
+		COMMAND_LIST->SetComputeRootDescriptorTable(
+			4, Descriptors::SV.GetGPUHandle(BigTrianglesDepthRecordsSRV + cascade));
 
 		COMMAND_LIST->ExecuteIndirect(
 			_dispatchCS.Get(),
@@ -1117,9 +1355,9 @@ void SoftwareRasterization::_drawOpaque()
 	PIXBeginEvent(COMMAND_LIST.Get(), 0, L"SWR Opaque");
 
 	COMMAND_LIST->SetComputeRootSignature(_triangleOpaqueRS.Get());
-	COMMAND_LIST->SetPipelineState(_triangleOpaquePSO.Get());
+	COMMAND_LIST->SetPipelineState(_triangleOpaquePSO[_getRasterizationPermutation()].Get());
 	COMMAND_LIST->SetComputeRootConstantBufferView(
-		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * sizeof(SWRSceneCB));
+		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _sceneCBFrameSize);
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		1, Scene::CurrentScene->positionsGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
@@ -1128,7 +1366,10 @@ void SoftwareRasterization::_drawOpaque()
 		3, Scene::CurrentScene->colorsGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		4, Scene::CurrentScene->texcoordsGPU.GetSRV());
-#ifdef GPU_SOA_BUFFERS
+#if defined(MESHLET_INDICES)
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		5, Scene::CurrentScene->meshletIndicesGPU.GetSRV());
+#elif defined(GPU_SOA_BUFFERS)
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		5, Scene::CurrentScene->indicesSOAGPU.GetSRV());
 #else
@@ -1147,43 +1388,52 @@ void SoftwareRasterization::_drawOpaque()
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		8, Descriptors::SV.GetGPUHandle(SWRShadowMapSRV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
-		9, Descriptors::SV.GetGPUHandle(CulledCommandsSRV + DX::FrameIndex * PerFrameDescriptorsCount));
+		9,
+		Settings::CullingEnabled
+		? Descriptors::SV.GetGPUHandle(CulledCommandsSRV + DX::FrameIndex * PerFrameDescriptorsCount)
+		: Scene::CurrentScene->SWRCommandsGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		10, Descriptors::SV.GetGPUHandle(SWRRenderTargetUAV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		11, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueUAV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		12, Descriptors::SV.GetGPUHandle(SWRStatsUAV));
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		13, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueRecordsUAV));
 
 	if (Settings::CullingEnabled)
 	{
 		COMMAND_LIST->ExecuteIndirect(
 			_dispatchCS.Get(),
 			1,
-			_renderer->GetCulledCommandsCounter(DX::FrameIndex, 0),
-			0,
+			_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+			_renderer->GetCulledCommandsCounterOffset(0),
 			nullptr,
 			0);
 	}
 	else
 	{
-		for (const auto& prefab : Scene::CurrentScene->prefabs)
-		{
-			for (unsigned int mesh = 0; mesh < prefab.meshesCount; mesh++)
-			{
-				const auto& currentMesh = Scene::CurrentScene->meshesMetaCPU[prefab.meshesOffset + mesh];
-
-				_drawIndexedInstanced(
-					currentMesh.indexCountPerInstance,
-					currentMesh.instanceCount,
-					currentMesh.startIndexLocation,
-					currentMesh.baseVertexLocation,
-					currentMesh.startInstanceLocation);
-			}
-		}
+		_drawIndexedInstanced();
 	}
 
-	CD3DX12_RESOURCE_BARRIER barriers[2] = {};
+	if (Settings::ClusterRouting())
+	{
+		COMMAND_LIST->SetComputeRootConstantBufferView(
+			0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _sceneCBFrameSize + sizeof(SWRSceneCB));
+		COMMAND_LIST->SetComputeRootDescriptorTable(
+			9,
+			Descriptors::SV.GetGPUHandle(
+				CulledCommandsSRV + SOFTWARE_BIG_CULLING_LIST + DX::FrameIndex * PerFrameDescriptorsCount));
+		COMMAND_LIST->ExecuteIndirect(
+			_dispatchCS.Get(),
+			1,
+			_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+			_renderer->GetCulledCommandsCounterOffset(SOFTWARE_BIG_CULLING_LIST),
+			nullptr,
+			0);
+	}
+
+	CD3DX12_RESOURCE_BARRIER barriers[3] = {};
 	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
 		_bigTrianglesOpaque.Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
@@ -1192,12 +1442,16 @@ void SoftwareRasterization::_drawOpaque()
 		_bigTrianglesOpaqueCounter.Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
-	COMMAND_LIST->ResourceBarrier(2, barriers);
+	barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_bigTriangleRecordsOpaque.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	COMMAND_LIST->ResourceBarrier(_countof(barriers), barriers);
 
 	COMMAND_LIST->SetComputeRootSignature(_bigTriangleOpaqueRS.Get());
-	COMMAND_LIST->SetPipelineState(_bigTriangleOpaquePSO.Get());
+	COMMAND_LIST->SetPipelineState(_bigTriangleOpaquePSO[_getRasterizationPermutation()].Get());
 	COMMAND_LIST->SetComputeRootConstantBufferView(
-		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * sizeof(SWRSceneCB));
+		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _sceneCBFrameSize);
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		1, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueSRV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
@@ -1211,6 +1465,8 @@ void SoftwareRasterization::_drawOpaque()
 		4, Descriptors::SV.GetGPUHandle(SWRShadowMapSRV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		5, Descriptors::SV.GetGPUHandle(SWRRenderTargetUAV));
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		6, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueRecordsSRV));
 
 	COMMAND_LIST->ExecuteIndirect(
 		_dispatchCS.Get(),
@@ -1223,6 +1479,106 @@ void SoftwareRasterization::_drawOpaque()
 	PIXEndEvent(COMMAND_LIST.Get());
 }
 
+void SoftwareRasterization::_drawRoutedClusters(bool opaque)
+{
+	PIXBeginEvent(COMMAND_LIST.Get(), 0, opaque ? L"SWR Routed HW Opaque" : L"SWR Routed HW Depth");
+
+	// the scene buffers stay shader resources of the SW passes in the SW frame
+	ID3D12Resource* vertexBuffers[] =
+	{
+		Scene::CurrentScene->positionsGPU.Get(),
+		Scene::CurrentScene->normalsGPU.Get(),
+		Scene::CurrentScene->colorsGPU.Get(),
+		Scene::CurrentScene->texcoordsGPU.Get()
+	};
+	CD3DX12_RESOURCE_BARRIER barriers[7] = {};
+	for (size_t buffer = 0; buffer < _countof(vertexBuffers); buffer++)
+	{
+		barriers[buffer] = CD3DX12_RESOURCE_BARRIER::Transition(
+			vertexBuffers[buffer],
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+	}
+	barriers[4] = CD3DX12_RESOURCE_BARRIER::Transition(
+		Scene::CurrentScene->indicesGPU.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDEX_BUFFER);
+	// the depth is final by the opaque pass
+	barriers[5] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_depthBuffer.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	barriers[6] = CD3DX12_RESOURCE_BARRIER::Transition(
+		Shadows::Sun.GetShadowMapSWR(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	int barriersCount = opaque ? 7 : 5;
+	COMMAND_LIST->ResourceBarrier(barriersCount, barriers);
+
+	D3D12_VIEWPORT viewport = CD3DX12_VIEWPORT(
+		0.0f,
+		0.0f,
+		static_cast<float>(_width),
+		static_cast<float>(_height));
+	D3D12_RECT scissorRect = CD3DX12_RECT(
+		0,
+		0,
+		static_cast<LONG>(_width),
+		static_cast<LONG>(_height));
+
+	COMMAND_LIST->SetGraphicsRootSignature(_routedClustersRS.Get());
+	COMMAND_LIST->SetPipelineState(opaque ? _routedClustersOpaquePSO.Get() : _routedClustersDepthPSO.Get());
+	COMMAND_LIST->RSSetViewports(1, &viewport);
+	COMMAND_LIST->RSSetScissorRects(1, &scissorRect);
+	COMMAND_LIST->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	D3D12_VERTEX_BUFFER_VIEW VBVs[] =
+	{
+		Scene::CurrentScene->positionsGPU.GetVBView(),
+		Scene::CurrentScene->normalsGPU.GetVBView(),
+		Scene::CurrentScene->colorsGPU.GetVBView(),
+		Scene::CurrentScene->texcoordsGPU.GetVBView()
+	};
+	COMMAND_LIST->IASetVertexBuffers(0, _countof(VBVs), VBVs);
+	D3D12_INDEX_BUFFER_VIEW IBV = Scene::CurrentScene->indicesGPU.GetIBView();
+	COMMAND_LIST->IASetIndexBuffer(&IBV);
+	COMMAND_LIST->OMSetRenderTargets(0, nullptr, FALSE, nullptr);
+
+	COMMAND_LIST->SetGraphicsRootConstantBufferView(
+		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _sceneCBFrameSize);
+	COMMAND_LIST->SetGraphicsRootDescriptorTable(
+		2, Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + DX::FrameIndex * PerFrameDescriptorsCount));
+	if (opaque)
+	{
+		COMMAND_LIST->SetGraphicsRootDescriptorTable(
+			4, Descriptors::SV.GetGPUHandle(SWRRenderTargetUAV));
+		COMMAND_LIST->SetGraphicsRootDescriptorTable(
+			5, Descriptors::SV.GetGPUHandle(SWRDepthSRV));
+		COMMAND_LIST->SetGraphicsRootDescriptorTable(
+			6, Descriptors::SV.GetGPUHandle(SWRShadowMapSRV));
+	}
+	else
+	{
+		COMMAND_LIST->SetGraphicsRootDescriptorTable(
+			3, Descriptors::SV.GetGPUHandle(SWRDepthUAV));
+	}
+
+	COMMAND_LIST->ExecuteIndirect(
+		_routedClustersCS.Get(),
+		_renderer->GetMaxCulledCommandsCount(),
+		_renderer->GetCulledCommands(DX::FrameIndex),
+		_renderer->GetCulledCommandsOffset(HARDWARE_CULLING_LIST),
+		_renderer->GetCulledCommandsCounter(DX::FrameIndex),
+		_renderer->GetCulledCommandsCounterOffset(HARDWARE_CULLING_LIST));
+
+	for (int barrier = 0; barrier < barriersCount; barrier++)
+	{
+		std::swap(barriers[barrier].Transition.StateBefore, barriers[barrier].Transition.StateAfter);
+	}
+	COMMAND_LIST->ResourceBarrier(barriersCount, barriers);
+
+	PIXEndEvent(COMMAND_LIST.Get());
+}
+
 #ifdef USE_WORK_GRAPHS
 void SoftwareRasterization::_drawDepthWG()
 {
@@ -1240,7 +1596,10 @@ void SoftwareRasterization::_drawDepthWG()
 		2, Scene::CurrentScene->positionsGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		3, Descriptors::SV.GetGPUHandle(CulledCommandsSRV + frustumIndex + DX::FrameIndex * PerFrameDescriptorsCount));
-#ifdef GPU_SOA_BUFFERS
+#if defined(MESHLET_INDICES)
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		4, Scene::CurrentScene->meshletIndicesGPU.GetSRV());
+#elif defined(GPU_SOA_BUFFERS)
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		4, Scene::CurrentScene->indicesSOAGPU.GetSRV());
 #else
@@ -1250,7 +1609,7 @@ void SoftwareRasterization::_drawDepthWG()
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		5,
 		Settings::CullingEnabled
-		? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + frustumIndex + DX::FrameIndex * PerFrameDescriptorsCount)
+		? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + DX::FrameIndex * PerFrameDescriptorsCount)
 		: Scene::CurrentScene->instancesGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		6, Descriptors::SV.GetGPUHandle(SWRDepthUAV));
@@ -1258,6 +1617,8 @@ void SoftwareRasterization::_drawDepthWG()
 		7, Descriptors::SV.GetGPUHandle(BigTrianglesDepthUAV + frustumIndex));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		8, Descriptors::SV.GetGPUHandle(SWRStatsUAV));
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		9, Descriptors::SV.GetGPUHandle(BigTrianglesDepthRecordsUAV + frustumIndex));
 
 	ID3D12GraphicsCommandList10* commandList = (ID3D12GraphicsCommandList10*)COMMAND_LIST.Get();
 
@@ -1306,7 +1667,10 @@ void SoftwareRasterization::_drawShadowsWG()
 			2, Scene::CurrentScene->positionsGPU.GetSRV());
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			3, Descriptors::SV.GetGPUHandle(CulledCommandsSRV + cascade + DX::FrameIndex * PerFrameDescriptorsCount));
-#ifdef GPU_SOA_BUFFERS
+#if defined(MESHLET_INDICES)
+		COMMAND_LIST->SetComputeRootDescriptorTable(
+			4, Scene::CurrentScene->meshletIndicesGPU.GetSRV());
+#elif defined(GPU_SOA_BUFFERS)
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			4, Scene::CurrentScene->indicesSOAGPU.GetSRV());
 #else
@@ -1316,7 +1680,7 @@ void SoftwareRasterization::_drawShadowsWG()
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			5,
 			Settings::CullingEnabled
-			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + cascade + DX::FrameIndex * PerFrameDescriptorsCount)
+			? Descriptors::SV.GetGPUHandle(VisibleInstancesSRV + DX::FrameIndex * PerFrameDescriptorsCount)
 			: Scene::CurrentScene->instancesGPU.GetSRV());
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			6, Descriptors::SV.GetGPUHandle(SWRShadowMapUAV + cascade - 1));
@@ -1324,6 +1688,8 @@ void SoftwareRasterization::_drawShadowsWG()
 			7, Descriptors::SV.GetGPUHandle(BigTrianglesDepthUAV + cascade));
 		COMMAND_LIST->SetComputeRootDescriptorTable(
 			8, Descriptors::SV.GetGPUHandle(SWRStatsUAV));
+		COMMAND_LIST->SetComputeRootDescriptorTable(
+			9, Descriptors::SV.GetGPUHandle(BigTrianglesDepthRecordsUAV + cascade));
 
 		ID3D12GraphicsCommandList10* commandList = (ID3D12GraphicsCommandList10*)COMMAND_LIST.Get();
 
@@ -1362,7 +1728,7 @@ void SoftwareRasterization::_drawOpaqueWG()
 	COMMAND_LIST->SetComputeRootSignature(_opaqueWGRS.Get());
 
 	COMMAND_LIST->SetComputeRootConstantBufferView(
-		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * sizeof(SWRSceneCB));
+		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _sceneCBFrameSize);
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		1, Descriptors::SV.GetGPUHandle(CulledCommandsCountersSRV + DX::FrameIndex * PerFrameDescriptorsCount));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
@@ -1375,7 +1741,10 @@ void SoftwareRasterization::_drawOpaqueWG()
 		5, Scene::CurrentScene->texcoordsGPU.GetSRV());
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		6, Descriptors::SV.GetGPUHandle(CulledCommandsSRV + DX::FrameIndex * PerFrameDescriptorsCount));
-#ifdef GPU_SOA_BUFFERS
+#if defined(MESHLET_INDICES)
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		7, Scene::CurrentScene->meshletIndicesGPU.GetSRV());
+#elif defined(GPU_SOA_BUFFERS)
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		7, Scene::CurrentScene->indicesSOAGPU.GetSRV());
 #else
@@ -1399,6 +1768,8 @@ void SoftwareRasterization::_drawOpaqueWG()
 		12, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueUAV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		13, Descriptors::SV.GetGPUHandle(SWRStatsUAV));
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		14, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueRecordsUAV));
 
 	ID3D12GraphicsCommandList10* commandList = (ID3D12GraphicsCommandList10*)COMMAND_LIST.Get();
 
@@ -1412,7 +1783,7 @@ void SoftwareRasterization::_drawOpaqueWG()
 	dispatchDesc.NodeCPUInput.RecordStrideInBytes = 0;
 	commandList->DispatchGraph(&dispatchDesc);
 
-	CD3DX12_RESOURCE_BARRIER barriers[2] = {};
+	CD3DX12_RESOURCE_BARRIER barriers[3] = {};
 	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
 		_bigTrianglesOpaque.Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
@@ -1421,12 +1792,16 @@ void SoftwareRasterization::_drawOpaqueWG()
 		_bigTrianglesOpaqueCounter.Get(),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 		D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
-	COMMAND_LIST->ResourceBarrier(2, barriers);
+	barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(
+		_bigTriangleRecordsOpaque.Get(),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	COMMAND_LIST->ResourceBarrier(_countof(barriers), barriers);
 
 	COMMAND_LIST->SetComputeRootSignature(_bigTriangleOpaqueRS.Get());
-	COMMAND_LIST->SetPipelineState(_bigTriangleOpaquePSO.Get());
+	COMMAND_LIST->SetPipelineState(_bigTriangleOpaquePSO[_getRasterizationPermutation()].Get());
 	COMMAND_LIST->SetComputeRootConstantBufferView(
-		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * sizeof(SWRSceneCB));
+		0, _sceneCB->GetGPUVirtualAddress() + DX::FrameIndex * _sceneCBFrameSize);
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		1, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueSRV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
@@ -1440,6 +1815,8 @@ void SoftwareRasterization::_drawOpaqueWG()
 		4, Descriptors::SV.GetGPUHandle(SWRShadowMapSRV));
 	COMMAND_LIST->SetComputeRootDescriptorTable(
 		5, Descriptors::SV.GetGPUHandle(SWRRenderTargetUAV));
+	COMMAND_LIST->SetComputeRootDescriptorTable(
+		6, Descriptors::SV.GetGPUHandle(BigTrianglesOpaqueRecordsSRV));
 
 	COMMAND_LIST->ExecuteIndirect(
 		_dispatchCS.Get(),
@@ -1490,6 +1867,47 @@ void SoftwareRasterization::_endFrame()
 
 void SoftwareRasterization::GUINewFrame()
 {
+	// this frame index was waited for, so its timestamps are resolved,
+	// read every frame, as it also resets the profilers for the next measure
+	float smallTrianglesTime = _smallTrianglesProfiler->GetTimeMS(DX::CommandQueue.Get());
+	float bigTrianglesTime = _bigTrianglesProfiler->GetTimeMS(DX::CommandQueue.Get());
+	int measuredThreshold = _measuredBigTriangleThreshold[DX::FrameIndex];
+	_measuredBigTriangleThreshold[DX::FrameIndex] = 0;
+	// frames in flight before the last step were rendered with the previous threshold, they're skipped
+	if (_tuneBigTrianglesOnGPU && measuredThreshold == _bigTriangleThreshold)
+	{
+		float threshold = _bigTrianglesTuner.Update(
+			_smallTrianglesProfiler->GetLastTimeMS() / 1000.0,
+			_bigTrianglesProfiler->GetLastTimeMS() / 1000.0);
+		_bigTriangleThreshold = static_cast<int>(threshold);
+	}
+
+	if (_CPUSweep.valid() &&
+		_CPUSweep.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		std::vector<CPURasterizer::SweepResult> results = _CPUSweep.get();
+		const CPURasterizer::SweepResult* best = CPURasterizer::FindBestConfiguration(results);
+		for (const auto& result : results)
+		{
+			PrintToOutput(
+				"CPU SWR threshold %g, tile %g, job %u: mean %.2f ms, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, %.0f tiles%s\n",
+				result.configuration.bigTriangleThreshold,
+				result.configuration.bigTriangleTileSize,
+				result.configuration.trianglesPerJob,
+				result.mean,
+				result.p50,
+				result.p95,
+				result.p99,
+				result.bigTriangleTiles,
+				&result == best ? ", best" : "");
+		}
+		_CPUSweepDone = best != nullptr;
+		if (best)
+		{
+			_CPUSweepBest = *best;
+		}
+	}
+
 	int location = Settings::SWRGUILocation;
 	ImGuiWindowFlags window_flags =
 		ImGuiWindowFlags_NoDecoration |
@@ -1522,13 +1940,16 @@ void SoftwareRasterization::GUINewFrame()
 
 	if (ImGui::Begin("Software Rasterization", nullptr, window_flags))
 	{
-		ImGui::SliderInt(
+		if (ImGui::SliderInt(
 			"Big Triangle Threshold",
 			&_bigTriangleThreshold,
 			1,
 			8192,
 			"%i",
-			ImGuiSliderFlags_AlwaysClamp);
+			ImGuiSliderFlags_AlwaysClamp))
+		{
+			_bigTrianglesTuner.Reset(static_cast<float>(_bigTriangleThreshold));
+		}
 
 		ImGui::SliderInt(
 			"Big Triangle Tile Size",
@@ -1538,40 +1959,219 @@ void SoftwareRasterization::GUINewFrame()
 			"%i",
 			ImGuiSliderFlags_AlwaysClamp);
 
+		if (ImGui::Checkbox("Tune Big Triangles on GPU", &_tuneBigTrianglesOnGPU) && _tuneBigTrianglesOnGPU)
+		{
+			_bigTrianglesTuner.Reset(static_cast<float>(_bigTriangleThreshold));
+		}
+		if (_tuneBigTrianglesOnGPU)
+		{
+			ImGui::Text(
+				"Small Triangles: %.2f ms, Big Triangles: %.2f ms",
+				smallTrianglesTime,
+				bigTrianglesTime);
+		}
+
 		ImGui::Checkbox("Use top-left rasterization rule", &_useTopLeftRule);
 		ImGui::Checkbox("Scanline rasterization", &_scanlineRasterization);
+
+		// big triangles buffers traffic of the last frame, all frustums
+		unsigned long long records = 0;
+		unsigned long long tiles = 0;
+		unsigned long long outsideTiles = 0;
+		unsigned long long coveredTiles = 0;
+		unsigned long long droppedTriangles = 0;
+		unsigned long long compactBytes = 0;
+		unsigned long long perTileBytes = 0;
+		for (int buffer = 0; buffer < BIG_TRIANGLES_BUFFERS; buffer++)
+		{
+			bool opaque = buffer == OPAQUE_BIG_TRIANGLES_BUFFER;
+			unsigned long long bufferRecords = static_cast<unsigned int>(_statsResult[BigTriangleRecords + buffer]);
+			unsigned long long bufferTiles = static_cast<unsigned int>(_statsResult[BigTriangleTiles + buffer]);
+			records += bufferRecords;
+			tiles += bufferTiles;
+			outsideTiles += static_cast<unsigned int>(_statsResult[BigTriangleOutsideTiles + buffer]);
+			coveredTiles += static_cast<unsigned int>(_statsResult[BigTriangleCoveredTiles + buffer]);
+			droppedTriangles += static_cast<unsigned int>(_statsResult[BigTrianglesDropped + buffer]);
+			compactBytes +=
+				bufferRecords * (opaque ? BIG_TRIANGLE_OPAQUE_RECORD_FIELDS : BIG_TRIANGLE_DEPTH_RECORD_FIELDS) * sizeof(unsigned int) +
+				bufferTiles * sizeof(BigTriangleTile);
+			perTileBytes += bufferTiles * (opaque ? BIG_TRIANGLE_OPAQUE_FIELDS : BIG_TRIANGLE_DEPTH_FIELDS) * sizeof(unsigned int);
+		}
+#ifdef COMPACT_BIG_TRIANGLES
+		ImGui::Text("Big Triangles: %llu, Tiles: %llu", records, tiles);
+		if (droppedTriangles > 0)
+		{
+			ImGui::TextColored(
+				ImVec4(1.0f, 0.0f, 0.0f, 1.0f),
+				"Big Triangles Dropped, Records Full: %llu",
+				droppedTriangles);
+		}
+		ImGui::Text(
+			"Big Triangles Written: %.3f MB (per tile: %.3f MB)",
+			compactBytes / (1024.0 * 1024.0),
+			perTileBytes / (1024.0 * 1024.0));
+#else
+		ImGui::Text("Big Triangle Tiles: %llu", tiles);
+		ImGui::Text("Big Triangles Written: %.3f MB", perTileBytes / (1024.0 * 1024.0));
+#endif
+#ifdef COARSE_TILE_CLASSIFICATION
+		ImGui::Text(
+			"Tiles Outside: %llu, Partial: %llu, Covered: %llu",
+			outsideTiles,
+			tiles - coveredTiles,
+			coveredTiles);
+#endif
+
+		if (ImGui::Button("Compare CPU Atomics and Binning"))
+		{
+			RunCPUBinningComparison();
+		}
+
+		if (ImGui::Checkbox("Record Camera Path", &_recordCameraPath) && _recordCameraPath)
+		{
+			_cameraPath.clear();
+		}
+		ImGui::SameLine();
+		ImGui::Text("%zu frames", _cameraPath.size());
+
+		if (_CPUSweep.valid())
+		{
+			ImGui::Text("Sweeping Big Triangles on CPU...");
+		}
+		else if (ImGui::Button("Sweep Big Triangles on CPU"))
+		{
+			SweepBigTrianglesOnCPU();
+		}
+		if (_CPUSweepDone)
+		{
+			ImGui::Text(
+				"CPU best: threshold %g, tile %g, p95 %.2f ms",
+				_CPUSweepBest.configuration.bigTriangleThreshold,
+				_CPUSweepBest.configuration.bigTriangleTileSize,
+				_CPUSweepBest.p95);
+		}
 	}
 
 	ImGui::End();
 }
 
-void SoftwareRasterization::_drawIndexedInstanced(
-	unsigned int indexCountPerInstance,
-	unsigned int instanceCount,
-	unsigned int startIndexLocation,
-	int baseVertexLocation,
-	unsigned int startInstanceLocation)
+void SoftwareRasterization::RunCPUBinningComparison() const
 {
-	// TODO: restore it
-	//unsigned int commandData[] =
-	//{
-	//	indexCountPerInstance,
-	//	startIndexLocation,
-	//	baseVertexLocation,
-	//	startInstanceLocation
-	//};
-	//COMMAND_LIST->SetComputeRoot32BitConstants(
-	//	RootConstants,
-	//	_countof(commandData),
-	//	commandData,
-	//	0);
-	//
-	//assert(indexCountPerInstance % 3 == 0);
-	//unsigned int trianglesCount = indexCountPerInstance / 3;
-	//COMMAND_LIST->Dispatch(
-	//	Utils::DispatchSize(SWR_TRIANGLE_THREADS_X, trianglesCount),
-	//	instanceCount,
-	//	1);
+	CPURasterizer::Rasterizer rasterizer;
+
+	CPURasterizer::RasterizationSettings settings;
+	settings.bigTriangleThreshold = static_cast<float>(_bigTriangleThreshold);
+	settings.bigTriangleTileSize = static_cast<float>(_bigTriangleTileSize);
+	settings.useTopLeftRule = _useTopLeftRule;
+	settings.scanlineRasterization = _scanlineRasterization;
+
+	CPURasterizer::DepthTarget depth;
+	depth.Resize(Settings::BackBufferWidth, Settings::BackBufferHeight);
+
+	std::vector<CPURasterizer::IndirectCommand> commands;
+
+	const Scene* scenes[] = { &Scene::BuddhaScene, &Scene::PlantScene };
+	const char* names[] = { "Buddha", "Plant" };
+	for (size_t scene = 0; scene < _countof(scenes); scene++)
+	{
+		scenes[scene]->GetCPURasterizerCommands(commands);
+		CPURasterizer::SceneBuffers buffers = scenes[scene]->GetCPURasterizerBuffers();
+
+		CPURasterizer::Float4x4 VP;
+		memcpy(&VP, &scenes[scene]->camera.GetVP(), sizeof(VP));
+
+		for (int binning = 0; binning < 2; binning++)
+		{
+			settings.binning = binning != 0;
+			rasterizer.SetSettings(settings);
+
+			depth.Clear();
+			auto start = std::chrono::steady_clock::now();
+			CPURasterizer::Statistics stats = rasterizer.DrawDepth(
+				buffers,
+				commands.data(),
+				commands.size(),
+				VP,
+				depth);
+			std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+
+			PrintToOutput(
+				"CPU SWR %s, %s: %zu rendered triangles, %zu big triangle tiles, %zu binned, %.2f ms\n",
+				names[scene],
+				settings.binning ? "binning" : "atomics",
+				stats.renderedTriangles,
+				stats.bigTriangleTiles,
+				stats.binnedTriangles,
+				time.count());
+		}
+	}
+}
+
+void SoftwareRasterization::SweepBigTrianglesOnCPU()
+{
+	// every frame of the path is rendered per configuration, so it's subsampled
+	const size_t MaxSweepFrames = 32;
+
+	std::vector<CPURasterizer::Float4x4> cameraPath;
+	size_t stride = (_cameraPath.size() + MaxSweepFrames - 1) / MaxSweepFrames;
+	for (size_t frame = 0; frame < _cameraPath.size(); frame += stride)
+	{
+		CPURasterizer::Float4x4 VP;
+		memcpy(&VP, &_cameraPath[frame], sizeof(VP));
+		cameraPath.push_back(VP);
+	}
+	if (cameraPath.empty())
+	{
+		CPURasterizer::Float4x4 VP;
+		memcpy(&VP, &Scene::CurrentScene->camera.GetVP(), sizeof(VP));
+		cameraPath.push_back(VP);
+	}
+
+	CPURasterizer::RasterizationSettings settings;
+	settings.useTopLeftRule = _useTopLeftRule;
+	settings.scanlineRasterization = _scanlineRasterization;
+
+	std::vector<CPURasterizer::IndirectCommand> commands;
+	Scene::CurrentScene->GetCPURasterizerCommands(commands);
+
+	// the scenes' CPU data outlives the sweep, everything else is copied
+	CPURasterizer::SceneBuffers buffers = Scene::CurrentScene->GetCPURasterizerBuffers();
+	int width = Settings::BackBufferWidth;
+	int height = Settings::BackBufferHeight;
+
+	_CPUSweepDone = false;
+	_CPUSweep = std::async(
+		std::launch::async,
+		[settings, buffers, width, height, commands = std::move(commands), cameraPath = std::move(cameraPath)]()
+		{
+			CPURasterizer::Rasterizer rasterizer;
+
+			CPURasterizer::DepthTarget depth;
+			depth.Resize(width, height);
+
+			// both SWR_TRIANGLE_THREADS_X values of CPUGPUCommon.h, the GPU one is compile time, so it's reported only
+			return CPURasterizer::SweepBigTriangles(
+				rasterizer,
+				settings,
+				buffers,
+				commands.data(),
+				commands.size(),
+				cameraPath,
+				{ 512.0f, 1024.0f, 2048.0f, 4096.0f, 8192.0f },
+				{ 64.0f, 128.0f, 256.0f, 512.0f },
+				{ 64, 256 },
+				depth);
+		});
+}
+
+void SoftwareRasterization::_drawIndexedInstanced()
+{
+	// without culling, the scene's commands are bound instead of the culled ones,
+	// a thread group per command and meshlet chunk, as the culled commands counters dispatch them
+	COMMAND_LIST->Dispatch(
+		static_cast<unsigned int>(Scene::CurrentScene->SWRCommandsCPU.size()),
+		SWR_THREAD_GROUPS_Y,
+		1);
 }
 
 void SoftwareRasterization::_clearStatistics()
@@ -1740,9 +2340,9 @@ void SoftwareRasterization::_createResetBuffer()
 
 void SoftwareRasterization::_createTriangleDepthPSO()
 {
-	CD3DX12_ROOT_PARAMETER1 computeRootParameters[9] = {};
+	CD3DX12_ROOT_PARAMETER1 computeRootParameters[10] = {};
 	computeRootParameters[0].InitAsConstantBufferView(0);
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[8] = {};
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[9] = {};
 
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -1792,6 +2392,12 @@ void SoftwareRasterization::_createTriangleDepthPSO()
 		2);
 	computeRootParameters[8].InitAsDescriptorTable(1, &ranges[7]);
 
+	ranges[8].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		1,
+		3);
+	computeRootParameters[9].InitAsDescriptorTable(1, &ranges[8]);
+
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC computeRootSignatureDesc;
 	computeRootSignatureDesc.Init_1_1(
 		_countof(computeRootParameters),
@@ -1802,27 +2408,32 @@ void SoftwareRasterization::_createTriangleDepthPSO()
 	Utils::CreateRS(computeRootSignatureDesc, _triangleDepthRS);
 	NAME_D3D12_OBJECT(_triangleDepthRS);
 
-	ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
-		L"TriangleDepthCS.hlsl",
-		nullptr,
-		"main",
-		"cs_5_0");
-
 	D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
 	psoDesc.pRootSignature = _triangleDepthRS.Get();
-	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
 
-	SUCCESS(DX::Device->CreateComputePipelineState(
-		&psoDesc,
-		IID_PPV_ARGS(&_triangleDepthPSO)));
-	NAME_D3D12_OBJECT(_triangleDepthPSO);
+	for (int permutation = 0; permutation < RasterizationPermutations; permutation++)
+	{
+		D3D_SHADER_MACRO defines[4];
+		GetRasterizationDefines(permutation, false, defines);
+		ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
+			L"TriangleDepthCS.hlsl",
+			defines,
+			"main",
+			"cs_5_0");
+		psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+		SUCCESS(DX::Device->CreateComputePipelineState(
+			&psoDesc,
+			IID_PPV_ARGS(&_triangleDepthPSO[permutation])));
+		NAME_D3D12_OBJECT_INDEXED(_triangleDepthPSO, permutation);
+	}
 }
 
 void SoftwareRasterization::_createBigTriangleDepthPSO()
 {
-	CD3DX12_ROOT_PARAMETER1 computeRootParameters[4] = {};
+	CD3DX12_ROOT_PARAMETER1 computeRootParameters[5] = {};
 	computeRootParameters[0].InitAsConstantBufferView(0);
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[3] = {};
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[4] = {};
 
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -1842,33 +2453,44 @@ void SoftwareRasterization::_createBigTriangleDepthPSO()
 		0);
 	computeRootParameters[3].InitAsDescriptorTable(1, &ranges[2]);
 
+	ranges[3].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+		1,
+		2);
+	computeRootParameters[4].InitAsDescriptorTable(1, &ranges[3]);
+
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC computeRootSignatureDesc;
 	computeRootSignatureDesc.Init_1_1(_countof(computeRootParameters), computeRootParameters);
 
 	Utils::CreateRS(computeRootSignatureDesc, _bigTriangleDepthRS);
 	NAME_D3D12_OBJECT(_bigTriangleDepthRS);
 
-	ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
-		L"BigTriangleDepthCS.hlsl",
-		nullptr,
-		"main",
-		"cs_5_0");
-
 	D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
 	psoDesc.pRootSignature = _bigTriangleDepthRS.Get();
-	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
 
-	SUCCESS(DX::Device->CreateComputePipelineState(
-		&psoDesc,
-		IID_PPV_ARGS(&_bigTriangleDepthPSO)));
-	NAME_D3D12_OBJECT(_bigTriangleDepthPSO);
+	for (int permutation = 0; permutation < RasterizationPermutations; permutation++)
+	{
+		D3D_SHADER_MACRO defines[4];
+		GetRasterizationDefines(permutation, false, defines);
+		ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
+			L"BigTriangleDepthCS.hlsl",
+			defines,
+			"main",
+			"cs_5_0");
+		psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+		SUCCESS(DX::Device->CreateComputePipelineState(
+			&psoDesc,
+			IID_PPV_ARGS(&_bigTriangleDepthPSO[permutation])));
+		NAME_D3D12_OBJECT_INDEXED(_bigTriangleDepthPSO, permutation);
+	}
 }
 
 void SoftwareRasterization::_createTriangleOpaquePSO()
 {
-	CD3DX12_ROOT_PARAMETER1 computeRootParameters[13] = {};
+	CD3DX12_ROOT_PARAMETER1 computeRootParameters[14] = {};
 	computeRootParameters[0].InitAsConstantBufferView(0);
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[12] = {};
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[13] = {};
 
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -1942,6 +2564,12 @@ void SoftwareRasterization::_createTriangleOpaquePSO()
 		2);
 	computeRootParameters[12].InitAsDescriptorTable(1, &ranges[11]);
 
+	ranges[12].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+		1,
+		3);
+	computeRootParameters[13].InitAsDescriptorTable(1, &ranges[12]);
+
 	D3D12_STATIC_SAMPLER_DESC samplers[2] = {};
 	D3D12_STATIC_SAMPLER_DESC* pointClampSampler = &samplers[0];
 	pointClampSampler->Filter = D3D12_FILTER_MIN_MAG_MIP_POINT;
@@ -1977,26 +2605,32 @@ void SoftwareRasterization::_createTriangleOpaquePSO()
 	Utils::CreateRS(computeRootSignatureDesc, _triangleOpaqueRS);
 	NAME_D3D12_OBJECT(_triangleOpaqueRS);
 
-	const D3D_SHADER_MACRO defines[] = { { "OPAQUE", "1" }, { nullptr, nullptr } };
-	ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
-		L"TriangleOpaqueCS.hlsl",
-		defines,
-		"main",
-		"cs_5_0");
-
 	D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
 	psoDesc.pRootSignature = _triangleOpaqueRS.Get();
-	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
 
-	SUCCESS(DX::Device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&_triangleOpaquePSO)));
-	NAME_D3D12_OBJECT(_triangleOpaquePSO);
+	for (int permutation = 0; permutation < RasterizationPermutations; permutation++)
+	{
+		D3D_SHADER_MACRO defines[4];
+		GetRasterizationDefines(permutation, true, defines);
+		ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
+			L"TriangleOpaqueCS.hlsl",
+			defines,
+			"main",
+			"cs_5_0");
+		psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+		SUCCESS(DX::Device->CreateComputePipelineState(
+			&psoDesc,
+			IID_PPV_ARGS(&_triangleOpaquePSO[permutation])));
+		NAME_D3D12_OBJECT_INDEXED(_triangleOpaquePSO, permutation);
+	}
 }
 
 void SoftwareRasterization::_createBigTriangleOpaquePSO()
 {
-	CD3DX12_ROOT_PARAMETER1 computeRootParameters[6] = {};
+	CD3DX12_ROOT_PARAMETER1 computeRootParameters[7] = {};
 	computeRootParameters[0].InitAsConstantBufferView(0);
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[5] = {};
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[6] = {};
 
 	ranges[0].Init(
 		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
@@ -2028,6 +2662,12 @@ void SoftwareRasterization::_createBigTriangleOpaquePSO()
 		0);
 	computeRootParameters[5].InitAsDescriptorTable(1, &ranges[4]);
 
+	ranges[5].Init(
+		D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+		1,
+		4);
+	computeRootParameters[6].InitAsDescriptorTable(1, &ranges[5]);
+
 	D3D12_STATIC_SAMPLER_DESC pointClampSampler = {};
 	pointClampSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_POINT;
 	pointClampSampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_BORDER;
@@ -2053,19 +2693,159 @@ void SoftwareRasterization::_createBigTriangleOpaquePSO()
 	Utils::CreateRS(computeRootSignatureDesc, _bigTriangleOpaqueRS);
 	NAME_D3D12_OBJECT(_bigTriangleOpaqueRS);
 
+	D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
+	psoDesc.pRootSignature = _bigTriangleOpaqueRS.Get();
+
+	for (int permutation = 0; permutation < RasterizationPermutations; permutation++)
+	{
+		D3D_SHADER_MACRO defines[4];
+		GetRasterizationDefines(permutation, true, defines);
+		ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
+			L"BigTriangleOpaqueCS.hlsl",
+			defines,
+			"main",
+			"cs_5_0");
+		psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+
+		SUCCESS(DX::Device->CreateComputePipelineState(
+			&psoDesc,
+			IID_PPV_ARGS(&_bigTriangleOpaquePSO[permutation])));
+		NAME_D3D12_OBJECT_INDEXED(_bigTriangleOpaquePSO, permutation);
+	}
+}
+
+void SoftwareRasterization::_createRoutedClustersPSOs()
+{
+	CD3DX12_ROOT_PARAMETER1 rootParameters[7] = {};
+	rootParameters[0].InitAsConstantBufferView(0);
+	rootParameters[1].InitAsConstants(DRAW_CALL_CONSTANTS, 1);
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[5] = {};
+
+	ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+	rootParameters[2].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_VERTEX);
+
+	ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
+	rootParameters[3].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_PIXEL);
+
+	ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
+	rootParameters[4].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_PIXEL);
+
+	ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 10);
+	rootParameters[5].InitAsDescriptorTable(1, &ranges[3], D3D12_SHADER_VISIBILITY_PIXEL);
+
+	ranges[4].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 11);
+	rootParameters[6].InitAsDescriptorTable(1, &ranges[4], D3D12_SHADER_VISIBILITY_PIXEL);
+
+	D3D12_STATIC_SAMPLER_DESC pointClampSampler = {};
+	pointClampSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_POINT;
+	pointClampSampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_BORDER;
+	pointClampSampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_BORDER;
+	pointClampSampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_BORDER;
+	pointClampSampler.MipLODBias = 0;
+	pointClampSampler.MaxAnisotropy = 0;
+	pointClampSampler.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+	pointClampSampler.BorderColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK;
+	pointClampSampler.MinLOD = 0.0f;
+	pointClampSampler.MaxLOD = D3D12_FLOAT32_MAX;
+	pointClampSampler.ShaderRegister = 0;
+	pointClampSampler.RegisterSpace = 0;
+	pointClampSampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+	D3D12_ROOT_SIGNATURE_FLAGS rootSignatureFlags =
+		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
+		D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+		D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+		D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
+
+	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
+	rootSignatureDesc.Init_1_1(
+		_countof(rootParameters),
+		rootParameters,
+		1,
+		&pointClampSampler,
+		rootSignatureFlags);
+
+	Utils::CreateRS(rootSignatureDesc, _routedClustersRS);
+	NAME_D3D12_OBJECT(_routedClustersRS);
+
+	// both passes share the vertex shader, so the opaque one finds the depths the depth one wrote
 	const D3D_SHADER_MACRO defines[] = { { "OPAQUE", "1" }, { nullptr, nullptr } };
-	ComPtr<ID3DBlob> computeShader = Utils::CompileShader(
-		L"BigTriangleOpaqueCS.hlsl",
+	ComPtr<ID3DBlob> vertexShader = Utils::CompileShader(
+		L"DrawRoutedClusters.hlsl",
+		defines,
+		"vsMain",
+		"vs_5_0");
+	ComPtr<ID3DBlob> depthPixelShader = Utils::CompileShader(
+		L"DrawRoutedClusters.hlsl",
 		defines,
-		"main",
-		"cs_5_0");
+		"depthPS",
+		"ps_5_0");
+	ComPtr<ID3DBlob> opaquePixelShader = Utils::CompileShader(
+		L"DrawRoutedClusters.hlsl",
+		defines,
+		"opaquePS",
+		"ps_5_0");
 
-	D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
-	psoDesc.pRootSignature = _bigTriangleOpaqueRS.Get();
-	psoDesc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize() };
+	D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
+	{
+		{
+			"POSITION",
+			0,
+			VertexPositionFormat,
+			0,
+			0,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+			0
+		},
+		{
+			"NORMAL",
+			0,
+			DXGI_FORMAT_R32_UINT,
+			1,
+			0,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+			0
+		},
+		{
+			"COLOR",
+			0,
+			DXGI_FORMAT_R32G32_UINT,
+			2,
+			0,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+			0
+		},
+		{
+			"TEXCOORD",
+			0,
+			DXGI_FORMAT_R32_UINT,
+			3,
+			0,
+			D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA,
+			0
+		}
+	};
 
-	SUCCESS(DX::Device->CreateComputePipelineState(
-		&psoDesc,
-		IID_PPV_ARGS(&_bigTriangleOpaquePSO)));
-	NAME_D3D12_OBJECT(_bigTriangleOpaquePSO);
+	// the SW depth and render target are UAVs, no depth test, no render targets
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+	psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
+	psoDesc.pRootSignature = _routedClustersRS.Get();
+	psoDesc.VS = { vertexShader->GetBufferPointer(), vertexShader->GetBufferSize() };
+	psoDesc.PS = { depthPixelShader->GetBufferPointer(), depthPixelShader->GetBufferSize() };
+	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+	psoDesc.DepthStencilState.DepthEnable = FALSE;
+	psoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+	psoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+	psoDesc.SampleMask = UINT_MAX;
+	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	psoDesc.NumRenderTargets = 0;
+	psoDesc.SampleDesc.Count = 1;
+	SUCCESS(DX::Device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&_routedClustersDepthPSO)));
+	NAME_D3D12_OBJECT(_routedClustersDepthPSO);
+
+	psoDesc.PS = { opaquePixelShader->GetBufferPointer(), opaquePixelShader->GetBufferSize() };
+	SUCCESS(DX::Device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&_routedClustersOpaquePSO)));
+	NAME_D3D12_OBJECT(_routedClustersOpaquePSO);
 }
\ No newline at end of file
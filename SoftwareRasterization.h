@@ -3,6 +3,12 @@
 #include "DX.h"
 #include "Utils.h"
 #include "Shadows.h"
+#include "Profiler.h"
+#include "BigTriangleTuning.h"
+
+#include <future>
+#include <memory>
+#include <vector>
 
 class ForwardRenderer;
 
@@ -23,6 +29,13 @@ public:
 	void Update();
 	void Draw();
 
+	// CPU rasterizer depth pass of the Buddha and Plant scenes, depth atomics against binning
+	void RunCPUBinningComparison() const;
+	// CPU rasterizer sweep of the big triangles settings over the recorded camera path,
+	// or the current camera, on a background thread, the results are only reported,
+	// the GPU passes are tuned from their own timings
+	void SweepBigTrianglesOnCPU();
+
 	ID3D12Resource* GetRenderTarget() const { return _renderTarget.Get(); }
 
 	int GetPipelineTrianglesCount() const
@@ -58,6 +71,8 @@ private:
 	void _drawShadowsBigTriangles();
 	void _finishDepthsRendering();
 	void _drawOpaque();
+	// the camera meshlets CullingCS routes to the HW, against the SW depth and render target
+	void _drawRoutedClusters(bool opaque);
 	void _endFrame();
 #ifdef USE_WORK_GRAPHS
 	void _drawDepthWG();
@@ -65,38 +80,57 @@ private:
 	void _drawOpaqueWG();
 #endif
 
-	void _drawIndexedInstanced(
-		unsigned int indexCountPerInstance,
-		unsigned int instanceCount,
-		unsigned int startIndexLocation,
-		int baseVertexLocation,
-		unsigned int startInstanceLocation);
+	// the triangle passes with culling disabled, over Scene::SWRCommandsGPU
+	void _drawIndexedInstanced();
 
 	void _createTriangleDepthPSO();
 	void _createBigTriangleDepthPSO();
 	void _createTriangleOpaquePSO();
 	void _createBigTriangleOpaquePSO();
+	void _createRoutedClustersPSOs();
 	void _createBigTrianglesBuffers();
+	void _createBigTriangleRecords(
+		Microsoft::WRL::ComPtr<ID3D12Resource>& records,
+		int recordsCount,
+		int recordFields,
+		int SRVIndex,
+		int UAVIndex);
 
 	// need these two for UAV writes
 	Microsoft::WRL::ComPtr<ID3D12Resource> _renderTarget;
 	Microsoft::WRL::ComPtr<ID3D12Resource> _depthBuffer;
 
+	// top-left rule and scanline rasterization are compiled into the shaders,
+	// a PSO per combination, bit 0 for the top-left rule, bit 1 for scanline rasterization
+	static const int RasterizationPermutations = 4;
+	int _getRasterizationPermutation() const
+	{
+		return (_useTopLeftRule ? 1 : 0) | (_scanlineRasterization ? 2 : 0);
+	}
+
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> _triangleDepthRS;
-	Microsoft::WRL::ComPtr<ID3D12PipelineState> _triangleDepthPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _triangleDepthPSO[RasterizationPermutations];
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> _bigTriangleDepthRS;
-	Microsoft::WRL::ComPtr<ID3D12PipelineState> _bigTriangleDepthPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _bigTriangleDepthPSO[RasterizationPermutations];
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> _triangleOpaqueRS;
-	Microsoft::WRL::ComPtr<ID3D12PipelineState> _triangleOpaquePSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _triangleOpaquePSO[RasterizationPermutations];
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> _bigTriangleOpaqueRS;
-	Microsoft::WRL::ComPtr<ID3D12PipelineState> _bigTriangleOpaquePSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _bigTriangleOpaquePSO[RasterizationPermutations];
+	// Settings::ClusterRouting(), graphics pipelines without render targets, see DrawRoutedClusters.hlsl
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> _routedClustersRS;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _routedClustersDepthPSO;
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> _routedClustersOpaquePSO;
 	Microsoft::WRL::ComPtr<ID3D12Resource> _bigTrianglesDepth[MAX_FRUSTUMS_COUNT];
 	Microsoft::WRL::ComPtr<ID3D12Resource> _bigTrianglesOpaque;
+	// COMPACT_BIG_TRIANGLES, the tile entries above point at them
+	Microsoft::WRL::ComPtr<ID3D12Resource> _bigTriangleRecordsDepth[MAX_FRUSTUMS_COUNT];
+	Microsoft::WRL::ComPtr<ID3D12Resource> _bigTriangleRecordsOpaque;
 	Microsoft::WRL::ComPtr<ID3D12Resource> _depthSceneCB;
 	unsigned char* _depthSceneCBData;
 	int _depthSceneCBFrameSize = 0;
 	Microsoft::WRL::ComPtr<ID3D12Resource> _sceneCB;
 	unsigned char* _sceneCBData;
+	int _sceneCBFrameSize = 0;
 
 	int _width = 0;
 	int _height = 0;
@@ -104,6 +138,8 @@ private:
 
 	// MDI stuff
 	Microsoft::WRL::ComPtr<ID3D12CommandSignature> _dispatchCS;
+	// draw call constants + draw indexed, as the HW rasterizer's, for HARDWARE_CULLING_LIST
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> _routedClustersCS;
 	// first 4 bytes used as a counter
 	// all 12 bytes are used as a dispatch indirect command
 	// [0] - counter / group count X
@@ -134,9 +170,15 @@ private:
 	// statistics resources
 	enum StatsIndices
 	{
-		PipelineTriangles,
-		RenderedTriangles,
-		StatsCount
+		PipelineTriangles = PIPELINE_TRIANGLES_STAT,
+		RenderedTriangles = RENDERED_TRIANGLES_STAT,
+		// per big triangles buffer
+		BigTriangleRecords = BIG_TRIANGLE_RECORDS_STAT,
+		BigTriangleTiles = BIG_TRIANGLE_TILES_STAT,
+		BigTriangleOutsideTiles = BIG_TRIANGLE_OUTSIDE_TILES_STAT,
+		BigTriangleCoveredTiles = BIG_TRIANGLE_COVERED_TILES_STAT,
+		BigTrianglesDropped = BIG_TRIANGLE_DROPPED_STAT,
+		StatsCount = SWR_STATS_COUNT
 	};
 	Microsoft::WRL::ComPtr<ID3D12Resource> _trianglesStats;
 	Microsoft::WRL::ComPtr<ID3D12Resource> _trianglesStatsReadback[DX::FramesCount];
@@ -146,6 +188,22 @@ private:
 	int _bigTriangleThreshold = 4096;
 	int _bigTriangleTileSize = 128;
 
+	// camera VPs for SweepBigTrianglesOnCPU()
+	static const size_t MaxCameraPathFrames = 1024;
+	bool _recordCameraPath = false;
+	std::vector<DirectX::XMFLOAT4X4> _cameraPath;
+	std::future<std::vector<CPURasterizer::SweepResult>> _CPUSweep;
+	CPURasterizer::SweepResult _CPUSweepBest = {};
+	bool _CPUSweepDone = false;
+
+	// the threshold follows the timestamps of the small and big triangles depth and shadows passes,
+	// a frame's timestamps are read when its frame index comes back, with the threshold it was measured with, 0 if it wasn't
+	bool _tuneBigTrianglesOnGPU = false;
+	int _measuredBigTriangleThreshold[DX::FramesCount] = {};
+	std::unique_ptr<Profiler> _smallTrianglesProfiler;
+	std::unique_ptr<Profiler> _bigTrianglesProfiler;
+	CPURasterizer::BigTriangleTuner _bigTrianglesTuner;
+
 	bool _useTopLeftRule = true;
 	bool _scanlineRasterization = true;
 };
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "StreamCompaction.h"
+
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace CPURasterizer
+{
+
+static unsigned int LowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+// in place, returns the total, as the single thread group between the reduce and the scatter dispatches
+static uint32_t ExclusiveScan(std::vector<uint32_t>& values)
+{
+	uint32_t sum = 0;
+	for (uint32_t& value : values)
+	{
+		uint32_t count = value;
+		value = sum;
+		sum += count;
+	}
+
+	return sum;
+}
+
+void StreamCompaction::CompactWithAtomics(ThreadPool& pool, const CompactionInputs& inputs, CompactionOutputs& outputs)
+{
+	size_t objectsCount = inputs.objectsCount;
+	size_t meshesCount = inputs.meshesCount;
+	size_t frustumsCount = inputs.frustumsCount;
+	size_t rangesCount = frustumsCount * meshesCount;
+	size_t instancesPerFrustum = objectsCount * meshesCount;
+
+	size_t countersCount = rangesCount + frustumsCount;
+	if (_countersCount < countersCount)
+	{
+		_counters.reset(new std::atomic<uint32_t>[countersCount]);
+		_countersCount = countersCount;
+	}
+	for (size_t counter = 0; counter < countersCount; counter++)
+	{
+		_counters[counter].store(0, std::memory_order_relaxed);
+	}
+
+	outputs.visibleInstances.resize(frustumsCount * instancesPerFrustum);
+	outputs.commands.resize(rangesCount);
+	outputs.commandMeshes.resize(rangesCount);
+
+	// CullingCS
+	size_t pairsCount = objectsCount * meshesCount;
+	pool.ParallelFor((pairsCount + PairsPerJob - 1) / PairsPerJob, [&](size_t job)
+	{
+		size_t lastPair = std::min(pairsCount, (job + 1) * PairsPerJob);
+		for (size_t pair = job * PairsPerJob; pair < lastPair; pair++)
+		{
+			uint32_t mask = inputs.visibility[pair];
+			size_t object = pair / meshesCount;
+			size_t mesh = pair % meshesCount;
+			for (size_t frustum = 0; frustum < frustumsCount; frustum++)
+			{
+				if (!((mask >> frustum) & 1))
+				{
+					continue;
+				}
+
+				uint32_t writeOffset = _counters[frustum * meshesCount + mesh].fetch_add(1, std::memory_order_relaxed);
+				outputs.visibleInstances[frustum * instancesPerFrustum + mesh * objectsCount + writeOffset] =
+					static_cast<uint32_t>(object);
+			}
+		}
+	});
+
+	// GenerateCommandsCS, a thread per mesh
+	pool.ParallelFor((meshesCount + PairsPerJob - 1) / PairsPerJob, [&](size_t job)
+	{
+		size_t lastMesh = std::min(meshesCount, (job + 1) * PairsPerJob);
+		for (size_t mesh = job * PairsPerJob; mesh < lastMesh; mesh++)
+		{
+			for (size_t frustum = 0; frustum < frustumsCount; frustum++)
+			{
+				uint32_t count = _counters[frustum * meshesCount + mesh].load(std::memory_order_relaxed);
+				if (count == 0)
+				{
+					continue;
+				}
+
+				IndirectCommand command = inputs.meshCommands[mesh];
+				command.startInstanceLocation = static_cast<unsigned int>(frustum * instancesPerFrustum + mesh * objectsCount);
+				command.args.instanceCount = count;
+
+				uint32_t index = _counters[rangesCount + frustum].fetch_add(1, std::memory_order_relaxed);
+				outputs.commands[frustum * meshesCount + index] = command;
+				outputs.commandMeshes[frustum * meshesCount + index] = static_cast<uint32_t>(mesh);
+			}
+		}
+	});
+
+	outputs.frustumCommandsOffsets.resize(frustumsCount);
+	outputs.frustumCommandsCounts.resize(frustumsCount);
+	for (size_t frustum = 0; frustum < frustumsCount; frustum++)
+	{
+		outputs.frustumCommandsOffsets[frustum] = static_cast<uint32_t>(frustum * meshesCount);
+		outputs.frustumCommandsCounts[frustum] = _counters[rangesCount + frustum].load(std::memory_order_relaxed);
+	}
+}
+
+void StreamCompaction::CompactWithPrefixSum(ThreadPool& pool, const CompactionInputs& inputs, CompactionOutputs& outputs)
+{
+	size_t meshesCount = inputs.meshesCount;
+	size_t frustumsCount = inputs.frustumsCount;
+	size_t rangesCount = frustumsCount * meshesCount;
+
+	// blocks of whole objects, so every block reads its masks once, in the order CullingCS writes them,
+	// and counts the visible instances of every (frustum, mesh) range
+	size_t objectsPerBlock = std::max<size_t>(KeysPerBlock / std::max<size_t>(meshesCount, 1), MinObjectsPerBlock);
+	size_t blocksCount = (inputs.objectsCount + objectsPerBlock - 1) / objectsPerBlock;
+	uint32_t frustumsBits = frustumsCount < 32 ? (1u << frustumsCount) - 1 : ~0u;
+
+	// reduce, a count per range and block, range major, so the scan is in (frustum, mesh, object) order
+	_blockOffsets.assign(rangesCount * blocksCount, 0);
+	pool.ParallelFor(blocksCount, [&](size_t block)
+	{
+		size_t lastObject = std::min(inputs.objectsCount, (block + 1) * objectsPerBlock);
+		for (size_t object = block * objectsPerBlock; object < lastObject; object++)
+		{
+			for (size_t mesh = 0; mesh < meshesCount; mesh++)
+			{
+				uint32_t mask = inputs.visibility[object * meshesCount + mesh] & frustumsBits;
+				for (; mask != 0; mask &= mask - 1)
+				{
+					_blockOffsets[(LowestBit(mask) * meshesCount + mesh) * blocksCount + block]++;
+				}
+			}
+		}
+	});
+
+	uint32_t visibleCount = ExclusiveScan(_blockOffsets);
+	outputs.visibleInstances.resize(visibleCount);
+
+	// a range starts where its first block does, all of them are empty without objects
+	_rangeOffsets.assign(rangesCount + 1, 0);
+	for (size_t range = 0; range < rangesCount && blocksCount > 0; range++)
+	{
+		_rangeOffsets[range] = _blockOffsets[range * blocksCount];
+	}
+	_rangeOffsets[rangesCount] = visibleCount;
+
+	// scatter, every (range, block) offset has a single writer
+	pool.ParallelFor(blocksCount, [&](size_t block)
+	{
+		std::vector<uint32_t> writeIndices(rangesCount);
+		for (size_t range = 0; range < rangesCount; range++)
+		{
+			writeIndices[range] = _blockOffsets[range * blocksCount + block];
+		}
+
+		size_t lastObject = std::min(inputs.objectsCount, (block + 1) * objectsPerBlock);
+		for (size_t object = block * objectsPerBlock; object < lastObject; object++)
+		{
+			for (size_t mesh = 0; mesh < meshesCount; mesh++)
+			{
+				uint32_t mask = inputs.visibility[object * meshesCount + mesh] & frustumsBits;
+				for (; mask != 0; mask &= mask - 1)
+				{
+					outputs.visibleInstances[writeIndices[LowestBit(mask) * meshesCount + mesh]++] =
+						static_cast<uint32_t>(object);
+				}
+			}
+		}
+	});
+
+	// same again for the commands, a key per non-empty (frustum, mesh) range
+	size_t rangeBlocksCount = (rangesCount + KeysPerBlock - 1) / KeysPerBlock;
+	_blockOffsets.resize(rangeBlocksCount);
+	pool.ParallelFor(rangeBlocksCount, [&](size_t block)
+	{
+		size_t lastRange = std::min(rangesCount, (block + 1) * KeysPerBlock);
+		uint32_t count = 0;
+		for (size_t range = block * KeysPerBlock; range < lastRange; range++)
+		{
+			count += _rangeOffsets[range + 1] > _rangeOffsets[range] ? 1 : 0;
+		}
+		_blockOffsets[block] = count;
+	});
+
+	uint32_t commandsCount = ExclusiveScan(_blockOffsets);
+	outputs.commands.resize(commandsCount);
+	outputs.commandMeshes.resize(commandsCount);
+	outputs.frustumCommandsOffsets.resize(frustumsCount + 1);
+	outputs.frustumCommandsOffsets[frustumsCount] = commandsCount;
+	pool.ParallelFor(rangeBlocksCount, [&](size_t block)
+	{
+		size_t lastRange = std::min(rangesCount, (block + 1) * KeysPerBlock);
+		uint32_t writeIndex = _blockOffsets[block];
+		for (size_t range = block * KeysPerBlock; range < lastRange; range++)
+		{
+			size_t mesh = range % meshesCount;
+			if (mesh == 0)
+			{
+				outputs.frustumCommandsOffsets[range / meshesCount] = writeIndex;
+			}
+
+			uint32_t count = _rangeOffsets[range + 1] - _rangeOffsets[range];
+			if (count == 0)
+			{
+				continue;
+			}
+
+			IndirectCommand command = inputs.meshCommands[mesh];
+			command.startInstanceLocation = _rangeOffsets[range];
+			command.args.instanceCount = count;
+			outputs.commands[writeIndex] = command;
+			outputs.commandMeshes[writeIndex] = static_cast<uint32_t>(mesh);
+			writeIndex++;
+		}
+	});
+
+	outputs.frustumCommandsCounts.resize(frustumsCount);
+	for (size_t frustum = 0; frustum < frustumsCount; frustum++)
+	{
+		outputs.frustumCommandsCounts[frustum] =
+			outputs.frustumCommandsOffsets[frustum + 1] - outputs.frustumCommandsOffsets[frustum];
+	}
+	outputs.frustumCommandsOffsets.resize(frustumsCount);
+}
+
+size_t CompareCompactions(const CompactionInputs& inputs, const CompactionOutputs& a, const CompactionOutputs& b)
+{
+	size_t mismatches = 0;
+	std::vector<std::vector<uint32_t>> rangesA(inputs.meshesCount);
+	std::vector<std::vector<uint32_t>> rangesB(inputs.meshesCount);
+
+	auto gather = [&](const CompactionOutputs& outputs, size_t frustum, std::vector<std::vector<uint32_t>>& ranges)
+	{
+		for (std::vector<uint32_t>& range : ranges)
+		{
+			range.clear();
+		}
+
+		uint32_t firstCommand = outputs.frustumCommandsOffsets[frustum];
+		uint32_t lastCommand = firstCommand + outputs.frustumCommandsCounts[frustum];
+		for (uint32_t command = firstCommand; command < lastCommand; command++)
+		{
+			const IndirectCommand& drawn = outputs.commands[command];
+			std::vector<uint32_t>& range = ranges[outputs.commandMeshes[command]];
+			range.insert(
+				range.end(),
+				outputs.visibleInstances.begin() + drawn.startInstanceLocation,
+				outputs.visibleInstances.begin() + drawn.startInstanceLocation + drawn.args.instanceCount);
+			std::sort(range.begin(), range.end());
+		}
+	};
+
+	for (size_t frustum = 0; frustum < inputs.frustumsCount; frustum++)
+	{
+		gather(a, frustum, rangesA);
+		gather(b, frustum, rangesB);
+		for (size_t mesh = 0; mesh < inputs.meshesCount; mesh++)
+		{
+			mismatches += rangesA[mesh] != rangesB[mesh] ? 1 : 0;
+		}
+	}
+
+	return mismatches;
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "CPURasterizer.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// CPU reference of the culling results compaction, from a frustums mask per (object, mesh) pair
+// to the visible instances and the commands drawing them:
+// the atomic one is what CullingCS and GenerateCommandsCS used to do, an InterlockedAdd per visible instance
+// on its (frustum, mesh) counter, a fixed range of instances per frustum and mesh,
+// then a command buffer per frustum, appended to in whatever order the meshes come,
+// the prefix sum one is what CompactionCS and GenerateCommandsCS do now, it counts the visible instances
+// of every (frustum, mesh) range per block of objects, scans the counts in (frustum, mesh, object) order
+// and scatters them, so every frustum and mesh gets a contiguous range of one instances buffer, and a scan
+// of the non-empty (frustum, mesh) ranges does the same for the commands, without a single atomic
+namespace CPURasterizer
+{
+
+struct CompactionInputs
+{
+	// pair = object * meshesCount + mesh, as the CullingCS threads go,
+	// bit 0 is the camera, the cascades follow
+	const uint32_t* visibility = nullptr;
+	size_t objectsCount = 0;
+	size_t meshesCount = 0;
+	// at most 32
+	unsigned int frustumsCount = 0;
+	// per mesh, everything but the instances, as MeshMeta is for GenerateCommandsCS
+	const IndirectCommand* meshCommands = nullptr;
+};
+
+struct CompactionOutputs
+{
+	// object indices, the commands' startInstanceLocation point into it
+	std::vector<uint32_t> visibleInstances;
+	std::vector<IndirectCommand> commands;
+	// mesh of every command
+	std::vector<uint32_t> commandMeshes;
+	// per frustum, where its commands start in commands, and how many there are
+	std::vector<uint32_t> frustumCommandsOffsets;
+	std::vector<uint32_t> frustumCommandsCounts;
+};
+
+class StreamCompaction
+{
+public:
+
+	// instances at frustum * objectsCount * meshesCount + mesh * objectsCount, as CullingCS used to
+	// lay them out, commands at frustum * meshesCount, so visibleInstances
+	// and commands have holes, the order inside of a (frustum, mesh) range depends on the threads
+	void CompactWithAtomics(ThreadPool& pool, const CompactionInputs& inputs, CompactionOutputs& outputs);
+
+	// no holes, deterministic, ordered by frustum, mesh, then object
+	void CompactWithPrefixSum(ThreadPool& pool, const CompactionInputs& inputs, CompactionOutputs& outputs);
+
+	// pairs per job of the atomic version, as CULLING_THREADS_X per thread group,
+	// pairs per block of the instances scan, in whole objects, at least MinObjectsPerBlock of them,
+	// which keeps the counts below a 16th of the (frustum, mesh, object) keys, and ranges per block of the commands scan
+	static const size_t PairsPerJob = 1024;
+	static const size_t KeysPerBlock = 4096;
+	static const size_t MinObjectsPerBlock = 16;
+
+private:
+
+	// (frustum, mesh) counters, then a commands counter per frustum, reset every time, as ClearCS does
+	std::unique_ptr<std::atomic<uint32_t>[]> _counters;
+	size_t _countersCount = 0;
+
+	// per (frustum, mesh) range and scan block, then exclusive scanned, and the instances offset of every range
+	std::vector<uint32_t> _blockOffsets;
+	std::vector<uint32_t> _rangeOffsets;
+};
+
+// every (frustum, mesh) range has the same instances in both, whatever their order is,
+// returns the mismatching ranges
+size_t CompareCompactions(const CompactionInputs& inputs, const CompactionOutputs& a, const CompactionOutputs& b);
+
+}
@@ -0,0 +1,113 @@
+#include "ThreadPool.h"
+
+static thread_local unsigned int ThreadIndex = 0;
+
+ThreadPool::ThreadPool(unsigned int threadsCount)
+{
+	if (threadsCount == 0)
+	{
+		threadsCount = std::thread::hardware_concurrency();
+	}
+
+	// the calling thread takes part in every job
+	for (unsigned int thread = 1; thread < threadsCount; thread++)
+	{
+		_workers.emplace_back(&ThreadPool::_workerLoop, this, thread);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+
+	for (auto& worker : _workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// the caller may be a worker of another pool
+	unsigned int callerThreadIndex = ThreadIndex;
+	ThreadIndex = 0;
+
+	if (_workers.empty() || count == 1)
+	{
+		for (size_t index = 0; index < count; index++)
+		{
+			job(index);
+		}
+
+		ThreadIndex = callerThreadIndex;
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_job = &job;
+		_jobSize = count;
+		_nextIndex = 0;
+		_busyWorkers = static_cast<unsigned int>(_workers.size());
+		_generation++;
+	}
+	_wake.notify_all();
+
+	_runJob();
+
+	// every worker has to check in, so job is not referenced after return
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _busyWorkers == 0; });
+	_job = nullptr;
+
+	ThreadIndex = callerThreadIndex;
+}
+
+unsigned int ThreadPool::GetThreadIndex()
+{
+	return ThreadIndex;
+}
+
+void ThreadPool::_workerLoop(unsigned int threadIndex)
+{
+	ThreadIndex = threadIndex;
+
+	unsigned long long seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] { return _stop || _generation != seenGeneration; });
+			if (_stop)
+			{
+				return;
+			}
+			seenGeneration = _generation;
+		}
+
+		_runJob();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_busyWorkers == 0)
+		{
+			_done.notify_one();
+		}
+	}
+}
+
+void ThreadPool::_runJob()
+{
+	for (size_t index = _nextIndex++; index < _jobSize; index = _nextIndex++)
+	{
+		(*_job)(index);
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// minimal fork-join pool, portable and independent of D3D12/Win32
+class ThreadPool
+{
+public:
+
+	// 0 means one thread per hardware thread, calling thread included
+	explicit ThreadPool(unsigned int threadsCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// calls job(index) for every index in [0, count) and waits for completion,
+	// indices are handed out dynamically, so the order of execution is arbitrary
+	// not reentrant: jobs must not call ParallelFor on the same pool
+	void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+	unsigned int GetThreadsCount() const
+	{
+		return static_cast<unsigned int>(_workers.size()) + 1;
+	}
+
+	// index of the thread running the current job in [0, GetThreadsCount()),
+	// the calling thread of ParallelFor is 0, so per thread data can be indexed with it
+	static unsigned int GetThreadIndex();
+
+private:
+
+	void _workerLoop(unsigned int threadIndex);
+	void _runJob();
+
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+
+	const std::function<void(size_t)>* _job = nullptr;
+	size_t _jobSize = 0;
+	std::atomic<size_t> _nextIndex = 0;
+	unsigned int _busyWorkers = 0;
+	unsigned long long _generation = 0;
+	bool _stop = false;
+};
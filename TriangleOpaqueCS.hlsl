@@ -17,6 +17,7 @@ cbuffer SceneCB : register(b0)
 	float BigTriangleTileSize;
 	int ShowCascades;
 	int ShowMeshlets;
+	// the work graphs only, see USE_TOP_LEFT_RULE and USE_SCANLINE_RASTERIZATION
 	int UseTopLeftRule;
 	int CascadesCount;
 	int ScanlineRasterization;
@@ -39,8 +40,13 @@ Texture2DArray ShadowMap : register(t11);
 StructuredBuffer<IndirectCommand> Commands : register(t12);
 
 RWTexture2D<float4> RenderTarget : register(u0);
+#ifdef COMPACT_BIG_TRIANGLES
+AppendStructuredBuffer<BigTriangleTile> BigTriangles : register(u1);
+#else
 AppendStructuredBuffer<BigTriangleOpaque> BigTriangles : register(u1);
+#endif
 RWStructuredBuffer<uint> Statistics : register(u2);
+RWStructuredBuffer<uint> BigTriangleRecords : register(u3);
 
 groupshared IndirectCommand Command;
 groupshared uint2 StatisticsSM;
@@ -66,16 +72,30 @@ void main(
 	//[unroll(TRIANGLES_PER_THREAD)]
 	//for (uint meshletChunkIndex = 0; meshletChunkIndex < TRIANGLES_PER_THREAD; meshletChunkIndex++)
 	//{
+		uint triangleIndex = groupThreadID.x + groupID.y * SWR_TRIANGLE_THREADS_X;
+		bool validTriangle = triangleIndex * 3 < Command.args.indexCountPerInstance;
+#ifdef MESHLET_VERTEX_CACHE
+		// the whole group syncs on every instance, so threads without a triangle stay in the loop
+		{
+			uint l0 = 0, l1 = 0, l2 = 0;
+			[branch]
+			if (validTriangle)
+			{
+				GetMeshletTriangle(Command, triangleIndex, l0, l1, l2);
+			}
+			uint i0 = Indices[Command.startMeshletVertexLocation + l0];
+			uint i1 = Indices[Command.startMeshletVertexLocation + l1];
+			uint i2 = Indices[Command.startMeshletVertexLocation + l2];
+#else
 		[branch]
-		if ((groupThreadID.x + groupID.y * SWR_TRIANGLE_THREADS_X) * 3 < Command.args.indexCountPerInstance)
+		if (validTriangle)
 		{
 			uint i0, i1, i2;
-			GetTriangleIndices(
-				Command.args.startIndexLocation + (groupThreadID.x + groupID.y * SWR_TRIANGLE_THREADS_X) * 3,
-				i0, i1, i2);
+			GetTriangleIndices(Command, triangleIndex, i0, i1, i2);
 
 			float3 p0, p1, p2;
-			GetTriangleVertexPositions(i0, i1, i2, Command.args.baseVertexLocation, p0, p1, p2);
+			GetTriangleVertexPositions(i0, i1, i2, Command, p0, p1, p2);
+#endif
 
 			VertexNormal n0P, n1P, n2P;
 			GetPackedVertexNormals(i0, i1, i2, Command.args.baseVertexLocation, n0P, n1P, n2P);
@@ -84,13 +104,31 @@ void main(
 
 			for (uint instanceID = 0; instanceID < Command.args.instanceCount; instanceID++)
 			{
+				Instance instance = Instances[Command.startInstanceLocation + instanceID];
+
+#ifdef MESHLET_VERTEX_CACHE
+				// the previous instance's triangles are done with the cache
+				GroupMemoryBarrierWithGroupSync();
+				CacheMeshletVertices(Command, instance, groupIndex);
+				GroupMemoryBarrierWithGroupSync();
+
+				[branch]
+				if (!validTriangle)
+				{
+					continue;
+				}
+#endif
+
 				// one more triangle attempted to be rendered
 				InterlockedAdd(StatisticsSM[0], 1);
 
 				float3 p0WS, p1WS, p2WS;
 				float4 p0CS, p1CS, p2CS;
-				Instance instance = Instances[Command.startInstanceLocation + instanceID];
+#ifdef MESHLET_VERTEX_CACHE
+				GetCachedPositions(l0, l1, l2, p0WS, p1WS, p2WS, p0CS, p1CS, p2CS);
+#else
 				GetCSPositions(instance, p0, p1, p2, p0WS, p1WS, p2WS, p0CS, p1CS, p2CS);
+#endif
 
 				// crude "clipping" of polygons behind the camera
 				// w in CS is a view space z
@@ -110,6 +148,9 @@ void main(
 				GetSSPositions(p0CS.xy, p1CS.xy, p2CS.xy, invW0, invW1, invW2, p0SS, p1SS, p2SS);
 
 				float area = Area(p0SS.xy, p1SS.xy, p2SS.xy);
+#ifdef FIXED_POINT_EDGES
+				SnapVertices(p0SS, p1SS, p2SS, area);
+#endif
 
 				// backface if negative
 				[branch]
@@ -165,6 +206,41 @@ void main(
 				[branch]
 				if (dimensions.x * dimensions.y >= BigTriangleThreshold)
 				{
+					float2 tilesCount = ceil(dimensions / BigTriangleTileSize);
+					float totalTiles = tilesCount.x * tilesCount.y;
+					uint outsideTiles = 0;
+					uint coveredTiles = 0;
+
+#ifdef COMPACT_BIG_TRIANGLES
+					uint record;
+					[branch]
+					if (AllocateBigTriangleRecord(OPAQUE_BIG_TRIANGLES_BUFFER, record))
+					{
+						WriteBigTriangleSetup(
+							record,
+							p0SS, p1SS, p2SS,
+							float3(z0NDC, z1NDC, z2NDC),
+							area,
+							minP.xy,
+							maxP.xy,
+							tilesCount.x);
+						WriteBigTriangleAttributes(
+							record,
+							float3(invW0, invW1, invW2),
+							p0WS, p1WS, p2WS,
+							n0P, n1P, n2P,
+							c0P, c1P, c2P);
+						AppendBigTriangleTiles(
+							record,
+							p0SS, p1SS, p2SS,
+							minP.xy,
+							maxP.xy,
+							tilesCount.x,
+							totalTiles,
+							outsideTiles,
+							coveredTiles);
+					}
+#else
 					BigTriangleOpaque result;
 					result.p0WSX = p0WS.x;
 					result.p0WSY = p0WS.y;
@@ -189,17 +265,32 @@ void main(
 					result.packedUV1 = 0;
 					result.packedUV2 = 0;
 
-					float2 tilesCount = ceil(dimensions / BigTriangleTileSize);
-					float totalTiles = tilesCount.x * tilesCount.y;
 					for (float offset = 0.0; offset < totalTiles; offset += 1.0)
 					{
+#ifdef COARSE_TILE_CLASSIFICATION
+						if (!ClassifyBigTriangleTile(
+							p0SS, p1SS, p2SS,
+							minP.xy,
+							maxP.xy,
+							tilesCount.x,
+							offset,
+							outsideTiles,
+							coveredTiles,
+							result.tileOffset))
+						{
+							continue;
+						}
+#else
 						result.tileOffset = offset;
+#endif
 
 						// seemingly vastly inefficient way to write out that data,
 						// but the more reasonable/parallel approach isn't faster, and is in fact slower
 						// see the same code in the "experimental" branch
 						BigTriangles.Append(result);
 					}
+#endif
+					CountBigTriangleTiles(OPAQUE_BIG_TRIANGLES_BUFFER, totalTiles, outsideTiles, coveredTiles);
 
 					continue;
 				}
@@ -224,7 +315,19 @@ void main(
 				float area2;
 				EdgeFunction(p0SS.xy, p1SS.xy, minP.xy, area2, dxdy2);
 
-				if (ScanlineRasterization)
+#ifdef FIXED_POINT_EDGES
+				FixedPointEdges fixedEdges;
+				bool fixedPoint = SetupFixedPointEdges(p0SS.xy, p1SS.xy, p2SS.xy, minP.xy, USE_TOP_LEFT_RULE, fixedEdges);
+				if (fixedPoint)
+				{
+					invArea = fixedEdges.invArea;
+				}
+#else
+				bool fixedPoint = false;
+#endif
+
+				// the integer edge walk is exact, no need for scanlines
+				if (USE_SCANLINE_RASTERIZATION && !fixedPoint)
 				{
 					for (float y = minP.y; y <= maxP.y; y += 1.0)
 					{
@@ -258,7 +361,7 @@ void main(
 						xMin = ceil(xMin - 0.5) + 0.5;
 
 						// top-left rule
-						if (UseTopLeftRule)
+						if (USE_TOP_LEFT_RULE)
 						{
 							xMax += ((frac(xMax) == 0.5) ? -1.0 : 0.0);
 						}
@@ -288,7 +391,7 @@ void main(
 								float3 color = denom * (weight0 * c0.rgb * invW0 + weight1 * c1.rgb * invW1 + weight2 * c2.rgb * invW2);
 								if (ShowMeshlets)
 								{
-									color = instance.color;
+									color = MeshColor(Command.meshID);
 								}
 
 								float3 positionWS = denom * (weight0 * p0WS * invW0 + weight1 * p1WS * invW1 + weight2 * p2WS * invW2);
@@ -330,11 +433,14 @@ void main(
 						float area0tmp = area0;
 						float area1tmp = area1;
 						float area2tmp = area2;
+#ifdef FIXED_POINT_EDGES
+						FixedPoint3 fixedAreaTmp = fixedEdges.area;
+#endif
 						for (float x = minP.x; x <= maxP.x; x += 1.0)
 						{
 							// edge tests, "frustum culling" for 3 lines in 2D
 							bool insideTriangle = true;
-							if (UseTopLeftRule)
+							if (USE_TOP_LEFT_RULE)
 							{
 								insideTriangle = insideTriangle && (EdgeIsTopLeft(p1SS.xy, p2SS.xy) ? (area0tmp >= 0.0) : (area0tmp > 0.0));
 								insideTriangle = insideTriangle && (EdgeIsTopLeft(p2SS.xy, p0SS.xy) ? (area1tmp >= 0.0) : (area1tmp > 0.0));
@@ -344,6 +450,15 @@ void main(
 							{
 								insideTriangle = area0tmp >= 0.0 && area1tmp >= 0.0 && area2tmp >= 0.0;
 							}
+#ifdef FIXED_POINT_EDGES
+							if (fixedPoint)
+							{
+								insideTriangle = all(fixedAreaTmp >= 0);
+								// unbiased, for the barycentric weights
+								area0tmp = float(fixedAreaTmp.x - fixedEdges.bias.x);
+								area1tmp = float(fixedAreaTmp.y - fixedEdges.bias.y);
+							}
+#endif
 
 							[branch]
 							if (insideTriangle)
@@ -370,7 +485,7 @@ void main(
 									float3 color = denom * (weight0 * c0.rgb * invW0 + weight1 * c1.rgb * invW1 + weight2 * c2.rgb * invW2);
 									if (ShowMeshlets)
 									{
-										color = instance.color;
+										color = MeshColor(Command.meshID);
 									}
 
 									float3 positionWS = denom * (weight0 * p0WS * invW0 + weight1 * p1WS * invW1 + weight2 * p2WS * invW2);
@@ -395,11 +510,17 @@ void main(
 							area0tmp -= dxdy0.y;
 							area1tmp -= dxdy1.y;
 							area2tmp -= dxdy2.y;
+#ifdef FIXED_POINT_EDGES
+							fixedAreaTmp += fixedEdges.stepX;
+#endif
 						}
 
 						area0 += dxdy0.x;
 						area1 += dxdy1.x;
 						area2 += dxdy2.x;
+#ifdef FIXED_POINT_EDGES
+						fixedEdges.area += fixedEdges.stepY;
+#endif
 					}
 				}
 			}
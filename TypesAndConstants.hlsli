@@ -12,7 +12,13 @@ static const float FloatMin = 1.175494351e-38;
 
 struct VertexPosition
 {
+#ifdef QUANTIZED_POSITIONS
+	// .x : |16 bits - y | 16 bits - x |
+	// .y : |16 bits - unused | 16 bits - z |
+	uint2 packedPosition;
+#else
 	float3 position;
+#endif
 };
 
 struct VertexNormal
@@ -67,13 +73,23 @@ struct MeshMeta
 	float3 coneApex;
 	float3 coneAxis;
 	float coneCutoff;
+
+#ifdef QUANTIZED_POSITIONS
+	float3 positionsOrigin;
+	float3 positionsScale;
+#endif
+
+#ifdef MESHLET_INDICES
+	uint startMeshletVertexLocation;
+	uint startMeshletTriangleLocation;
+#endif
 };
 
 struct Instance
 {
 	float4x4 worldTransform;
-	uint meshID;
-	float3 color;
+	// prefab index for scene instances, mesh index for culled ones
+	uint ID;
 };
 
 struct DrawIndexedArguments
@@ -88,7 +104,16 @@ struct DrawIndexedArguments
 struct IndirectCommand
 {
 	uint startInstanceLocation;
+#ifdef QUANTIZED_POSITIONS
+	float3 positionsOrigin;
+	float3 positionsScale;
+#endif
+	uint meshID;
 	DrawIndexedArguments args;
+#ifdef MESHLET_INDICES
+	uint startMeshletVertexLocation;
+	uint startMeshletTriangleLocation;
+#endif
 };
 
 struct BigTriangleDepth
@@ -131,4 +156,38 @@ struct BigTriangleOpaque
 	uint packedUV2;
 };
 
+// COMPACT_BIG_TRIANGLES, the setup is in the record
+struct BigTriangleTile
+{
+	float tileOffset;
+	uint record;
+};
+
+#ifdef FIXED_POINT_EDGES
+
+#if defined(__SHADER_TARGET_MAJOR) && __SHADER_TARGET_MAJOR >= 6
+typedef int64_t FixedPoint;
+typedef int64_t2 FixedPoint2;
+typedef int64_t3 FixedPoint3;
+#else
+// SM 5.0 has no 64-bit integers, doubles hold the same integers exactly,
+// edge functions inside of the guard band stay well below 2^53
+typedef double FixedPoint;
+typedef double2 FixedPoint2;
+typedef double3 FixedPoint3;
+#endif
+
+// edge functions of the snapped vertices at the first pixel center, in sub-pixels squared,
+// biased, so the top-left rule is a plain >= 0 test
+struct FixedPointEdges
+{
+	FixedPoint3 area;
+	FixedPoint3 bias;
+	FixedPoint3 stepX;
+	FixedPoint3 stepY;
+	float invArea;
+};
+
+#endif // FIXED_POINT_EDGES
+
 #endif // TYPES_AND_CONSTANTS_HLSL
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "DescriptorManager.h"
 #include "DX.h"
 
+#include <psapi.h>
+
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
@@ -534,4 +536,11 @@ void GPUBuffer::Initialize(
 	_SRV = Descriptors::SV.GetGPUHandle(SRVIndex);
 }
 
+size_t GetPeakCommitSize()
+{
+	PROCESS_MEMORY_COUNTERS counters = {};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.PeakPagefileUsage;
+}
+
 }
\ No newline at end of file
@@ -149,6 +149,9 @@ void CreateRS(
 
 unsigned int MipsCount(unsigned int width, unsigned int height);
 
+// in bytes, the highest commit size of the process so far, kept by the OS, so no peak is missed
+size_t GetPeakCommitSize();
+
 void GenerateHiZ(
 	ID3D12GraphicsCommandList* commandList,
 	ID3D12Resource* resource,